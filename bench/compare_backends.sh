@@ -0,0 +1,74 @@
+#!/bin/bash
+# Run the same loadgen scenario against one ircserv binary with each I/O
+# backend and report throughput, CPU and I/O syscalls relative to the first.
+# Each backend is measured RUNS times and the median is kept.
+#
+# Usage: bench/compare_backends.sh [<backend> ...]   (default: poll epoll io_uring)
+# Environment:
+#   IRCSERV     server binary (default ./ircserv)
+#   PORT        port to listen on (default 6790)
+#   RUNS        runs per backend (default 3)
+#   BENCH_ARGS  loadgen options (default: fan-out heavy mixed scenario)
+#
+# "syscalls/delivery" counts event loop waits, accepts, reads and writes per
+# channel delivery: poll and epoll pay a read or write per ready socket,
+# io_uring one io_uring_enter() per loop iteration. As with compare_builds.sh,
+# "deliveries/cpu-s" is the throughput figure at a fixed offered rate.
+
+DIR="$(dirname "$0")"
+IRCSERV=${IRCSERV:-./ircserv}
+RUNS=${RUNS:-3}
+BENCH_ARGS=${BENCH_ARGS:---clients 1000 --channels 50 --joins 3 --dist zipf:1.0 --rate 4000 --duration 8 --churn 50 --reconnect 10}
+
+if [ $# -eq 0 ]; then
+    set -- poll epoll io_uring
+fi
+if [ ! -x "$IRCSERV" ]; then
+    echo "$IRCSERV: not found" >&2
+    exit 1
+fi
+
+# Value of key=... in a RESULT line
+field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+printf "%-10s %14s %14s %16s %18s %10s %10s\n" "backend" "deliveries/s" "server cpu %" "deliveries/cpu-s" \
+    "syscalls/delivery" "p99 ms" "vs first"
+BASELINE=""
+for BACKEND in "$@"; do
+    RATES=""
+    CPUS=""
+    EFFICIENCIES=""
+    SYSCALLS=""
+    P99S=""
+    for RUN in $(seq "$RUNS"); do
+        # shellcheck disable=SC2086
+        LINE=$(IRCSERV="$IRCSERV" IO_BACKEND="$BACKEND" "$DIR/run_bench.sh" $BENCH_ARGS | grep '^RESULT')
+        if [ -z "$LINE" ]; then
+            echo "$BACKEND: benchmark run failed" >&2
+            exit 1
+        fi
+        RATE=$(field "$LINE" deliveries_per_sec)
+        CPU=$(field "$LINE" server_cpu_pct)
+        RATES="$RATES $RATE"
+        CPUS="$CPUS $CPU"
+        EFFICIENCIES="$EFFICIENCIES $(awk -v r="$RATE" -v c="$CPU" 'BEGIN { printf "%.0f", (c > 0 ? r * 100 / c : 0) }')"
+        SYSCALLS="$SYSCALLS $(field "$LINE" syscalls_per_delivery)"
+        P99S="$P99S $(field "$LINE" p99_ms)"
+    done
+    RATE=$(echo $RATES | tr ' ' '\n' | median)
+    CPU=$(echo $CPUS | tr ' ' '\n' | median)
+    EFFICIENCY=$(echo $EFFICIENCIES | tr ' ' '\n' | median)
+    SYSCALL=$(echo $SYSCALLS | tr ' ' '\n' | median)
+    P99=$(echo $P99S | tr ' ' '\n' | median)
+    if [ -z "$BASELINE" ]; then
+        BASELINE=$EFFICIENCY
+    fi
+    DELTA=$(awk -v e="$EFFICIENCY" -v b="$BASELINE" 'BEGIN { printf "%+.1f%%", (b > 0 ? (e - b) * 100 / b : 0) }')
+    printf "%-10s %14s %14s %16s %18s %10s %10s\n" "$BACKEND" "$RATE" "$CPU" "$EFFICIENCY" "$SYSCALL" "$P99" "$DELTA"
+done
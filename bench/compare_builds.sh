@@ -0,0 +1,68 @@
+#!/bin/bash
+# Run the same loadgen scenario against several ircserv builds and report
+# throughput relative to the first one. Each build is measured RUNS times
+# and the median is kept.
+#
+# Usage: bench/compare_builds.sh <ircserv> [<ircserv> ...]
+# Environment:
+#   PORT        port to listen on (default 6790)
+#   RUNS        runs per build (default 3)
+#   BENCH_ARGS  loadgen options (default: fan-out heavy mixed scenario)
+#
+# "deliveries/cpu-s" (channel deliveries per second of server CPU) is the
+# figure to compare: at a fixed offered rate a faster build delivers the same
+# messages using less CPU, and only shows higher deliveries/s once saturated.
+
+DIR="$(dirname "$0")"
+RUNS=${RUNS:-3}
+BENCH_ARGS=${BENCH_ARGS:---clients 1000 --channels 50 --joins 3 --dist zipf:1.0 --rate 4000 --duration 8 --churn 50 --reconnect 10}
+
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 <ircserv> [<ircserv> ...]" >&2
+    exit 1
+fi
+
+# Value of key=... in a RESULT line
+field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+printf "%-24s %14s %14s %16s %10s %10s\n" "build" "deliveries/s" "server cpu %" "deliveries/cpu-s" "p99 ms" "vs first"
+BASELINE=""
+for BINARY in "$@"; do
+    if [ ! -x "$BINARY" ]; then
+        echo "$BINARY: not found" >&2
+        exit 1
+    fi
+    RATES=""
+    CPUS=""
+    EFFICIENCIES=""
+    P99S=""
+    for RUN in $(seq "$RUNS"); do
+        # shellcheck disable=SC2086
+        LINE=$(IRCSERV="$BINARY" "$DIR/run_bench.sh" $BENCH_ARGS | grep '^RESULT')
+        if [ -z "$LINE" ]; then
+            echo "$BINARY: benchmark run failed" >&2
+            exit 1
+        fi
+        RATE=$(field "$LINE" deliveries_per_sec)
+        CPU=$(field "$LINE" server_cpu_pct)
+        RATES="$RATES $RATE"
+        CPUS="$CPUS $CPU"
+        EFFICIENCIES="$EFFICIENCIES $(awk -v r="$RATE" -v c="$CPU" 'BEGIN { printf "%.0f", (c > 0 ? r * 100 / c : 0) }')"
+        P99S="$P99S $(field "$LINE" p99_ms)"
+    done
+    RATE=$(echo $RATES | tr ' ' '\n' | median)
+    CPU=$(echo $CPUS | tr ' ' '\n' | median)
+    EFFICIENCY=$(echo $EFFICIENCIES | tr ' ' '\n' | median)
+    P99=$(echo $P99S | tr ' ' '\n' | median)
+    if [ -z "$BASELINE" ]; then
+        BASELINE=$EFFICIENCY
+    fi
+    DELTA=$(awk -v e="$EFFICIENCY" -v b="$BASELINE" 'BEGIN { printf "%+.1f%%", (b > 0 ? (e - b) * 100 / b : 0) }')
+    printf "%-24s %14s %14s %16s %10s %10s\n" "$(basename "$BINARY")" "$RATE" "$CPU" "$EFFICIENCY" "$P99" "$DELTA"
+done
@@ -0,0 +1,62 @@
+#!/bin/bash
+# Run a latency-sensitive loadgen scenario against one ircserv binary with
+# and without the low-latency mode and compare the delivery latency
+# distribution and the CPU it costs. Each mode is measured RUNS times and
+# the median of every column is kept.
+#
+# Usage: bench/compare_latency.sh ["<latency options>" ...]
+#        (default: "spin=200" and "cpu=<last> busypoll=50 spin=200")
+# Environment:
+#   IRCSERV     server binary (default ./ircserv)
+#   PORT        port to listen on (default 6790)
+#   RUNS        runs per mode (default 3)
+#   BENCH_ARGS  loadgen options (default: light traffic, a few recipients each)
+#
+# The first row is always the server as configured by default, blocking in
+# the I/O backend between events. Spinning keeps a core busy while idle, so
+# "server cpu %" grows with spin= even at a fixed offered rate.
+
+DIR="$(dirname "$0")"
+IRCSERV=${IRCSERV:-./ircserv}
+RUNS=${RUNS:-3}
+BENCH_ARGS=${BENCH_ARGS:---clients 50 --channels 10 --joins 2 --dist uniform --rate 1000 --duration 8}
+
+if [ $# -eq 0 ]; then
+    set -- "spin=200" "cpu=$(($(nproc) - 1)) busypoll=50 spin=200"
+fi
+if [ ! -x "$IRCSERV" ]; then
+    echo "$IRCSERV: not found" >&2
+    exit 1
+fi
+
+# Value of key=... in a RESULT line
+field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+printf "%-32s %10s %10s %10s %14s\n" "latency" "p50 ms" "p99 ms" "p999 ms" "server cpu %"
+for MODE in "" "$@"; do
+    P50S=""
+    P99S=""
+    P999S=""
+    CPUS=""
+    for RUN in $(seq "$RUNS"); do
+        # shellcheck disable=SC2086
+        LINE=$(IRCSERV="$IRCSERV" LATENCY="$MODE" "$DIR/run_bench.sh" $BENCH_ARGS | grep '^RESULT')
+        if [ -z "$LINE" ]; then
+            echo "${MODE:-default}: benchmark run failed" >&2
+            exit 1
+        fi
+        P50S="$P50S $(field "$LINE" p50_ms)"
+        P99S="$P99S $(field "$LINE" p99_ms)"
+        P999S="$P999S $(field "$LINE" p999_ms)"
+        CPUS="$CPUS $(field "$LINE" server_cpu_pct)"
+    done
+    printf "%-32s %10s %10s %10s %14s\n" "${MODE:-default}" \
+        "$(echo $P50S | tr ' ' '\n' | median)" "$(echo $P99S | tr ' ' '\n' | median)" \
+        "$(echo $P999S | tr ' ' '\n' | median)" "$(echo $CPUS | tr ' ' '\n' | median)"
+done
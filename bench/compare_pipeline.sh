@@ -0,0 +1,79 @@
+#!/bin/bash
+# Run the same loadgen scenario against one ircserv binary with the
+# split-stage pipeline off and with each set of pipeline options, and report
+# throughput, CPU and I/O syscalls relative to the first row (off). Each
+# mode is measured RUNS times and the median is kept.
+#
+# Usage: bench/compare_pipeline.sh ["<pipeline options>" ...]
+#        (default: "threads=1" and "threads=<cores - 1>")
+# Environment:
+#   IRCSERV     server binary (default ./ircserv)
+#   PORT        port to listen on (default 6790)
+#   RUNS        runs per mode (default 3)
+#   BENCH_ARGS  loadgen options (default: fan-out heavy mixed scenario)
+#
+# "server cpu %" adds up every thread, so the pipeline pays for its rings
+# and wakeups there; it wins on "deliveries/s" and p99 once the event loop
+# alone cannot keep up, which needs spare cores for the I/O threads.
+
+DIR="$(dirname "$0")"
+IRCSERV=${IRCSERV:-./ircserv}
+RUNS=${RUNS:-3}
+BENCH_ARGS=${BENCH_ARGS:---clients 1000 --channels 50 --joins 3 --dist zipf:1.0 --rate 4000 --duration 8 --churn 50 --reconnect 10}
+
+if [ $# -eq 0 ]; then
+    THREADS=$(($(nproc) - 1))
+    if [ "$THREADS" -lt 2 ]; then
+        THREADS=2
+    fi
+    set -- "threads=1" "threads=$THREADS"
+fi
+if [ ! -x "$IRCSERV" ]; then
+    echo "$IRCSERV: not found" >&2
+    exit 1
+fi
+
+# Value of key=... in a RESULT line
+field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+printf "%-12s %14s %14s %16s %18s %10s %10s\n" "pipeline" "deliveries/s" "server cpu %" "deliveries/cpu-s" \
+    "syscalls/delivery" "p99 ms" "vs first"
+BASELINE=""
+for MODE in "" "$@"; do
+    RATES=""
+    CPUS=""
+    EFFICIENCIES=""
+    SYSCALLS=""
+    P99S=""
+    for RUN in $(seq "$RUNS"); do
+        # shellcheck disable=SC2086
+        LINE=$(IRCSERV="$IRCSERV" PIPELINE="$MODE" "$DIR/run_bench.sh" $BENCH_ARGS | grep '^RESULT')
+        if [ -z "$LINE" ]; then
+            echo "${MODE:-off}: benchmark run failed" >&2
+            exit 1
+        fi
+        RATE=$(field "$LINE" deliveries_per_sec)
+        CPU=$(field "$LINE" server_cpu_pct)
+        RATES="$RATES $RATE"
+        CPUS="$CPUS $CPU"
+        EFFICIENCIES="$EFFICIENCIES $(awk -v r="$RATE" -v c="$CPU" 'BEGIN { printf "%.0f", (c > 0 ? r * 100 / c : 0) }')"
+        SYSCALLS="$SYSCALLS $(field "$LINE" syscalls_per_delivery)"
+        P99S="$P99S $(field "$LINE" p99_ms)"
+    done
+    RATE=$(echo $RATES | tr ' ' '\n' | median)
+    CPU=$(echo $CPUS | tr ' ' '\n' | median)
+    EFFICIENCY=$(echo $EFFICIENCIES | tr ' ' '\n' | median)
+    SYSCALL=$(echo $SYSCALLS | tr ' ' '\n' | median)
+    P99=$(echo $P99S | tr ' ' '\n' | median)
+    if [ -z "$BASELINE" ]; then
+        BASELINE=$EFFICIENCY
+    fi
+    DELTA=$(awk -v e="$EFFICIENCY" -v b="$BASELINE" 'BEGIN { printf "%+.1f%%", (b > 0 ? (e - b) * 100 / b : 0) }')
+    printf "%-12s %14s %14s %16s %18s %10s %10s\n" "${MODE:-off}" "$RATE" "$CPU" "$EFFICIENCY" "$SYSCALL" "$P99" "$DELTA"
+done
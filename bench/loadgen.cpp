@@ -0,0 +1,1062 @@
+// Load generator for ircserv
+//
+// Opens many registered connections, joins them into channels following a
+// configurable size distribution, then drives channel PRIVMSG traffic on an
+// open-loop schedule together with JOIN/PART churn and reconnect storms.
+// Delivery latency is measured from the *intended* send time of each message,
+// so a stalled server or generator cannot hide queueing delay (coordinated
+// omission correction); the uncorrected figure is reported alongside.
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+// ---------------------------------------------------------------------------
+// Options
+
+struct Options
+{
+	std::string host;
+	int port;
+	std::string unixPath;
+	std::string password;
+	int clients;
+	int channels;
+	int joinsPerClient;
+	std::string distribution; // uniform | zipf
+	double zipfExponent;
+	double rate; // channel messages per second, whole run
+	double duration; // seconds of measured traffic
+	double churnRate; // PART+JOIN pairs per second
+	double reconnectRate; // disconnect+reconnect per second
+	double stormAt; // seconds into the run, <0 = no storm
+	int stormSize;
+	int connectBatch; // connection attempts per millisecond tick
+	int payloadSize; // bytes of padding per message
+	int serverPid;
+	int metricsPort; // protocol=metrics listener on host, 0 = none
+	unsigned int seed;
+
+	Options()
+		: host("127.0.0.1"), port(6667), password("bench"), clients(1000), channels(50),
+		  joinsPerClient(2), distribution("uniform"), zipfExponent(1.0), rate(2000), duration(10),
+		  churnRate(0), reconnectRate(0), stormAt(-1), stormSize(0), connectBatch(64),
+		  payloadSize(32), serverPid(0), metricsPort(0), seed(42)
+	{
+	}
+};
+
+static void usage(const char* prog)
+{
+	std::cerr << "Usage: " << prog << " [options]\n"
+		<< "  --host <addr>            server address (default 127.0.0.1)\n"
+		<< "  --port <n>               server port (default 6667)\n"
+		<< "  --unix <path>            connect to a Unix-domain listener instead\n"
+		<< "  --password <pw>          connection password (default bench)\n"
+		<< "  --clients <n>            connections to open (default 1000)\n"
+		<< "  --channels <n>           channels to spread them over (default 50)\n"
+		<< "  --joins <n>              channels joined per client (default 2)\n"
+		<< "  --dist uniform|zipf[:s]  channel size distribution (default uniform)\n"
+		<< "  --rate <msg/s>           channel PRIVMSG rate (default 2000)\n"
+		<< "  --duration <s>           measured run time (default 10)\n"
+		<< "  --churn <ops/s>          PART+JOIN churn rate (default 0)\n"
+		<< "  --reconnect <ops/s>      reconnect rate (default 0)\n"
+		<< "  --storm <at_s>:<n>       drop and reconnect n clients at once at at_s\n"
+		<< "  --payload <bytes>        padding per message (default 32)\n"
+		<< "  --server-pid <pid>       sample server CPU and RSS from /proc\n"
+		<< "  --metrics-port <n>       count server I/O syscalls via its metrics listener\n"
+		<< "  --seed <n>               random seed (default 42)\n";
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h")
+			return false;
+		if (i + 1 >= argc)
+		{
+			std::cerr << "Missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--host")
+			opt.host = value;
+		else if (arg == "--port")
+			opt.port = std::atoi(value.c_str());
+		else if (arg == "--unix")
+			opt.unixPath = value;
+		else if (arg == "--password")
+			opt.password = value;
+		else if (arg == "--clients")
+			opt.clients = std::atoi(value.c_str());
+		else if (arg == "--channels")
+			opt.channels = std::atoi(value.c_str());
+		else if (arg == "--joins")
+			opt.joinsPerClient = std::atoi(value.c_str());
+		else if (arg == "--dist")
+		{
+			std::string::size_type colon = value.find(':');
+			opt.distribution = value.substr(0, colon);
+			if (colon != std::string::npos)
+				opt.zipfExponent = std::atof(value.substr(colon + 1).c_str());
+			if (opt.distribution != "uniform" && opt.distribution != "zipf")
+			{
+				std::cerr << "Unknown distribution " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--rate")
+			opt.rate = std::atof(value.c_str());
+		else if (arg == "--duration")
+			opt.duration = std::atof(value.c_str());
+		else if (arg == "--churn")
+			opt.churnRate = std::atof(value.c_str());
+		else if (arg == "--reconnect")
+			opt.reconnectRate = std::atof(value.c_str());
+		else if (arg == "--storm")
+		{
+			std::string::size_type colon = value.find(':');
+			if (colon == std::string::npos)
+			{
+				std::cerr << "--storm expects <at_s>:<n>" << std::endl;
+				return false;
+			}
+			opt.stormAt = std::atof(value.substr(0, colon).c_str());
+			opt.stormSize = std::atoi(value.substr(colon + 1).c_str());
+		}
+		else if (arg == "--payload")
+			opt.payloadSize = std::atoi(value.c_str());
+		else if (arg == "--server-pid")
+			opt.serverPid = std::atoi(value.c_str());
+		else if (arg == "--metrics-port")
+			opt.metricsPort = std::atoi(value.c_str());
+		else if (arg == "--seed")
+			opt.seed = static_cast<unsigned int>(std::atoi(value.c_str()));
+		else
+		{
+			std::cerr << "Unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	if (opt.clients <= 0 || opt.channels <= 0 || opt.joinsPerClient < 0 || opt.rate < 0)
+	{
+		std::cerr << "Invalid option values" << std::endl;
+		return false;
+	}
+	if (opt.joinsPerClient > opt.channels)
+		opt.joinsPerClient = opt.channels;
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Time and randomness
+
+static unsigned long long nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// xorshift64*: fast, deterministic, good enough for workload shaping
+class Random
+{
+private:
+	unsigned long long _state;
+
+public:
+	explicit Random(unsigned long long seed) : _state(seed ? seed : 88172645463325252ULL) {}
+
+	unsigned long long next()
+	{
+		_state ^= _state >> 12;
+		_state ^= _state << 25;
+		_state ^= _state >> 27;
+		return _state * 2685821657736338717ULL;
+	}
+
+	int below(int n)
+	{
+		return static_cast<int>(next() % static_cast<unsigned long long>(n));
+	}
+
+	double unit()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Log-linear latency histogram (32 sub-buckets per power of two, ~3% error)
+
+class LatencyHistogram
+{
+private:
+	static const int SUB_BITS = 5;
+	static const int SIZE = 1024;
+	unsigned long long _counts[SIZE];
+	unsigned long long _total;
+	unsigned long long _max;
+
+	static int bitLength(unsigned long long v)
+	{
+		return v == 0 ? 0 : 64 - __builtin_clzll(v);
+	}
+
+	static int indexFor(unsigned long long v)
+	{
+		if (v < (1ULL << SUB_BITS))
+			return static_cast<int>(v);
+		int shift = bitLength(v) - SUB_BITS;
+		return shift * (1 << (SUB_BITS - 1)) + static_cast<int>(v >> shift);
+	}
+
+	static unsigned long long upperBoundFor(int index)
+	{
+		if (index < (1 << SUB_BITS))
+			return index;
+		int shift = index / (1 << (SUB_BITS - 1)) - 1;
+		unsigned long long sub = index - shift * (1 << (SUB_BITS - 1));
+		return ((sub + 1) << shift) - 1;
+	}
+
+public:
+	LatencyHistogram() : _total(0), _max(0)
+	{
+		std::memset(_counts, 0, sizeof(_counts));
+	}
+
+	void record(unsigned long long v)
+	{
+		_counts[indexFor(v)]++;
+		_total++;
+		if (v > _max)
+			_max = v;
+	}
+
+	unsigned long long count() const { return _total; }
+	unsigned long long max() const { return _max; }
+
+	unsigned long long percentile(double p) const
+	{
+		if (_total == 0)
+			return 0;
+		unsigned long long rank = static_cast<unsigned long long>(std::ceil(p * _total));
+		if (rank == 0)
+			rank = 1;
+		unsigned long long seen = 0;
+		for (int i = 0; i < SIZE; ++i)
+		{
+			seen += _counts[i];
+			if (seen >= rank)
+			{
+				unsigned long long bound = upperBoundFor(i);
+				return bound < _max ? bound : _max;
+			}
+		}
+		return _max;
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Server process sampling from /proc
+
+struct ProcSample
+{
+	bool valid;
+	double cpuSeconds;
+	long rssKb;
+	long peakRssKb;
+
+	ProcSample() : valid(false), cpuSeconds(0), rssKb(0), peakRssKb(0) {}
+};
+
+static ProcSample sampleProcess(int pid)
+{
+	ProcSample sample;
+	if (pid <= 0)
+		return sample;
+
+	std::ostringstream statPath;
+	statPath << "/proc/" << pid << "/stat";
+	std::ifstream stat(statPath.str().c_str());
+	std::string content;
+	if (!std::getline(stat, content))
+		return sample;
+
+	// Fields after the parenthesised command name; utime and stime are 14 and 15
+	std::string::size_type close = content.rfind(')');
+	if (close == std::string::npos)
+		return sample;
+	std::istringstream fields(content.substr(close + 2));
+	std::string field;
+	unsigned long utime = 0;
+	unsigned long stime = 0;
+	for (int i = 3; i <= 15 && (fields >> field); ++i)
+	{
+		if (i == 14)
+			utime = std::strtoul(field.c_str(), NULL, 10);
+		else if (i == 15)
+			stime = std::strtoul(field.c_str(), NULL, 10);
+	}
+	sample.cpuSeconds = static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+
+	std::ostringstream statusPath;
+	statusPath << "/proc/" << pid << "/status";
+	std::ifstream status(statusPath.str().c_str());
+	std::string line;
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmRSS:") == 0)
+			sample.rssKb = std::atol(line.c_str() + 6);
+		else if (line.compare(0, 6, "VmHWM:") == 0)
+			sample.peakRssKb = std::atol(line.c_str() + 6);
+	}
+	sample.valid = true;
+	return sample;
+}
+
+// ---------------------------------------------------------------------------
+// Server counters from its protocol=metrics listener
+
+// Value of one counter from GET /metrics, or -1 if it cannot be read
+static double scrapeCounter(const std::string& host, int port, const std::string& name)
+{
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(port));
+	if (port <= 0 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		return -1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	struct timeval timeout;
+	timeout.tv_sec = 2;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::string response;
+	const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0
+		&& send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(request) - 1))
+	{
+		char buffer[4096];
+		ssize_t n;
+		while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+			response.append(buffer, n);
+	}
+	close(fd);
+
+	std::string::size_type pos = response.find("\n" + name + " ");
+	if (pos == std::string::npos)
+		return -1;
+	return std::strtod(response.c_str() + pos + name.size() + 2, NULL);
+}
+
+// ---------------------------------------------------------------------------
+// Connections
+
+enum ConnState
+{
+	CONN_IDLE, // not connected (waiting to reconnect)
+	CONN_CONNECTING,
+	CONN_REGISTERING,
+	CONN_READY
+};
+
+struct Connection
+{
+	int fd;
+	ConnState state;
+	std::string nick;
+	std::string in;
+	std::string out;
+	std::vector<int> channels; // channels this client is (or is becoming) a member of
+	int pendingJoins;
+	unsigned long long connectStartNs;
+
+	Connection() : fd(-1), state(CONN_IDLE), pendingJoins(0), connectStartNs(0) {}
+};
+
+class LoadGenerator
+{
+private:
+	Options _opt;
+	Random _rng;
+	std::vector<Connection> _conns;
+	std::map<int, int> _fdToConn;
+	std::vector<double> _channelCdf; // cumulative popularity for channel selection
+	std::vector<int> _reconnectQueue;
+	unsigned long long _nickCounter;
+	std::string _padding;
+
+	// Results
+	LatencyHistogram _corrected;
+	LatencyHistogram _uncorrected;
+	LatencyHistogram _connectLatency;
+	unsigned long long _sent;
+	unsigned long long _delivered;
+	unsigned long long _sendErrors;
+	unsigned long long _churnOps;
+	unsigned long long _reconnects;
+	unsigned long long _maxScheduleLagNs;
+	unsigned long long _stormStartNs;
+	unsigned long long _stormRecoveredNs;
+	int _stormPending;
+	bool _measuring;
+	double _ioSyscalls; // server I/O syscalls while measuring, -1 = unknown
+
+	LoadGenerator(const LoadGenerator&);
+	LoadGenerator& operator=(const LoadGenerator&);
+
+public:
+	explicit LoadGenerator(const Options& opt)
+		: _opt(opt), _rng(opt.seed), _conns(opt.clients), _nickCounter(0), _padding(opt.payloadSize, 'x'),
+		  _sent(0), _delivered(0), _sendErrors(0), _churnOps(0), _reconnects(0), _maxScheduleLagNs(0),
+		  _stormStartNs(0), _stormRecoveredNs(0), _stormPending(0), _measuring(false),
+		  _ioSyscalls(-1)
+	{
+		buildChannelDistribution();
+	}
+
+	int run();
+
+private:
+	void buildChannelDistribution();
+	int pickChannel();
+	std::string channelName(int index) const;
+	std::string nextNick();
+
+	bool startConnect(int id);
+	void closeConnection(int id);
+	void onWritable(int id);
+	void onReadable(int id);
+	void handleLine(int id, const std::string& line);
+	void queue(int id, const std::string& data);
+	void assignChannels(int id);
+
+	void pump(int timeoutMs);
+	int countReady() const;
+	int countSettled() const;
+
+	void sendChannelMessage(unsigned long long intendedNs);
+	void churnOnce();
+	void reconnectOnce(int id);
+	void report(double elapsed, const ProcSample& before, const ProcSample& after, const ProcSample& peak) const;
+};
+
+void LoadGenerator::buildChannelDistribution()
+{
+	_channelCdf.resize(_opt.channels);
+	double total = 0;
+	for (int i = 0; i < _opt.channels; ++i)
+	{
+		double weight = 1.0;
+		if (_opt.distribution == "zipf")
+			weight = 1.0 / std::pow(static_cast<double>(i + 1), _opt.zipfExponent);
+		total += weight;
+		_channelCdf[i] = total;
+	}
+	for (int i = 0; i < _opt.channels; ++i)
+		_channelCdf[i] /= total;
+}
+
+int LoadGenerator::pickChannel()
+{
+	double u = _rng.unit();
+	int lo = 0;
+	int hi = _opt.channels - 1;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (_channelCdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+std::string LoadGenerator::channelName(int index) const
+{
+	std::ostringstream oss;
+	oss << "#lg" << index;
+	return oss.str();
+}
+
+// Unique per connection attempt so a reconnect never races its own old nick
+std::string LoadGenerator::nextNick()
+{
+	static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	unsigned long long n = _nickCounter++;
+	std::string nick;
+	do
+	{
+		nick = digits[n % 36] + nick;
+		n /= 36;
+	} while (n > 0);
+	return "lg" + nick;
+}
+
+void LoadGenerator::assignChannels(int id)
+{
+	Connection& conn = _conns[id];
+	conn.channels.clear();
+	for (int attempts = 0; static_cast<int>(conn.channels.size()) < _opt.joinsPerClient && attempts < 1000; ++attempts)
+	{
+		int channel = pickChannel();
+		bool duplicate = false;
+		for (size_t i = 0; i < conn.channels.size(); ++i)
+		{
+			if (conn.channels[i] == channel)
+				duplicate = true;
+		}
+		if (!duplicate)
+			conn.channels.push_back(channel);
+	}
+}
+
+bool LoadGenerator::startConnect(int id)
+{
+	Connection& conn = _conns[id];
+	int fd;
+	int result;
+
+	if (!_opt.unixPath.empty())
+	{
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1)
+			return false;
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		struct sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, _opt.unixPath.c_str(), sizeof(addr.sun_path) - 1);
+		result = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
+	else
+	{
+		bool v6 = _opt.host.find(':') != std::string::npos;
+		fd = socket(v6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+		if (fd == -1)
+			return false;
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		if (v6)
+		{
+			struct sockaddr_in6 addr;
+			std::memset(&addr, 0, sizeof(addr));
+			addr.sin6_family = AF_INET6;
+			addr.sin6_port = htons(_opt.port);
+			inet_pton(AF_INET6, _opt.host.c_str(), &addr.sin6_addr);
+			result = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+		}
+		else
+		{
+			struct sockaddr_in addr;
+			std::memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons(_opt.port);
+			inet_pton(AF_INET, _opt.host.c_str(), &addr.sin_addr);
+			result = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+		}
+	}
+
+	if (result == -1 && errno != EINPROGRESS && errno != EAGAIN)
+	{
+		close(fd);
+		return false;
+	}
+
+	conn.fd = fd;
+	conn.state = CONN_CONNECTING;
+	conn.in.clear();
+	conn.out.clear();
+	conn.nick = nextNick();
+	conn.pendingJoins = 0;
+	conn.connectStartNs = nowNs();
+	_fdToConn[fd] = id;
+
+	std::ostringstream reg;
+	reg << "PASS " << _opt.password << "\r\nNICK " << conn.nick << "\r\nUSER " << conn.nick << " 0 * :loadgen\r\n";
+	conn.out = reg.str();
+	return true;
+}
+
+void LoadGenerator::closeConnection(int id)
+{
+	Connection& conn = _conns[id];
+	if (conn.fd != -1)
+	{
+		_fdToConn.erase(conn.fd);
+		close(conn.fd);
+	}
+	conn.fd = -1;
+	conn.state = CONN_IDLE;
+	conn.in.clear();
+	conn.out.clear();
+}
+
+void LoadGenerator::queue(int id, const std::string& data)
+{
+	_conns[id].out += data;
+}
+
+void LoadGenerator::onWritable(int id)
+{
+	Connection& conn = _conns[id];
+	if (conn.state == CONN_CONNECTING)
+	{
+		int err = 0;
+		socklen_t len = sizeof(err);
+		getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+		if (err != 0)
+		{
+			closeConnection(id);
+			_reconnectQueue.push_back(id);
+			return;
+		}
+		conn.state = CONN_REGISTERING;
+	}
+	if (conn.out.empty())
+		return;
+
+	ssize_t n = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+	if (n > 0)
+		conn.out.erase(0, n);
+	else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+	{
+		_sendErrors++;
+		closeConnection(id);
+		_reconnectQueue.push_back(id);
+	}
+}
+
+void LoadGenerator::onReadable(int id)
+{
+	Connection& conn = _conns[id];
+	char buffer[65536];
+	while (conn.fd != -1)
+	{
+		ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+		if (n > 0)
+		{
+			conn.in.append(buffer, n);
+			continue;
+		}
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		// Server closed the connection or error
+		closeConnection(id);
+		_reconnectQueue.push_back(id);
+		return;
+	}
+
+	std::string::size_type start = 0;
+	std::string::size_type pos;
+	while ((pos = conn.in.find("\r\n", start)) != std::string::npos)
+	{
+		handleLine(id, conn.in.substr(start, pos - start));
+		if (_conns[id].fd == -1)
+			return;
+		start = pos + 2;
+	}
+	conn.in.erase(0, start);
+}
+
+void LoadGenerator::handleLine(int id, const std::string& line)
+{
+	Connection& conn = _conns[id];
+	unsigned long long now = nowNs();
+
+	// Fast path: measured channel traffic ":nick!u@h PRIVMSG #lgN :LG <intended> <actual> pad"
+	std::string::size_type marker = line.find(" :LG ");
+	if (marker != std::string::npos && line.find(" PRIVMSG ") != std::string::npos)
+	{
+		const char* p = line.c_str() + marker + 5;
+		char* end;
+		unsigned long long intended = std::strtoull(p, &end, 10);
+		unsigned long long actual = std::strtoull(end, NULL, 10);
+		_delivered++;
+		if (_measuring)
+		{
+			_corrected.record(now > intended ? now - intended : 0);
+			_uncorrected.record(now > actual ? now - actual : 0);
+		}
+		return;
+	}
+
+	std::istringstream iss(line);
+	std::string prefix;
+	std::string command;
+	iss >> prefix >> command;
+
+	if (command == "001" && conn.state != CONN_READY)
+	{
+		conn.state = CONN_READY;
+		_connectLatency.record(now - conn.connectStartNs);
+		if (conn.channels.empty())
+			assignChannels(id);
+		std::string joins;
+		for (size_t i = 0; i < conn.channels.size(); ++i)
+			joins += "JOIN " + channelName(conn.channels[i]) + "\r\n";
+		conn.pendingJoins = static_cast<int>(conn.channels.size());
+		queue(id, joins);
+		if (conn.pendingJoins == 0 && _stormPending > 0 && --_stormPending == 0)
+			_stormRecoveredNs = now;
+	}
+	else if (command == "366")
+	{
+		// End of NAMES: one of our joins completed
+		if (conn.pendingJoins > 0)
+		{
+			conn.pendingJoins--;
+			if (conn.pendingJoins == 0 && _stormPending > 0 && --_stormPending == 0)
+				_stormRecoveredNs = now;
+		}
+	}
+	else if (command == "433")
+	{
+		// Nick collision: pick the next unique one
+		conn.nick = nextNick();
+		queue(id, "NICK " + conn.nick + "\r\n");
+	}
+	else if (prefix == "ERROR")
+	{
+		closeConnection(id);
+		_reconnectQueue.push_back(id);
+	}
+}
+
+int LoadGenerator::countReady() const
+{
+	int ready = 0;
+	for (size_t i = 0; i < _conns.size(); ++i)
+	{
+		if (_conns[i].state == CONN_READY)
+			ready++;
+	}
+	return ready;
+}
+
+// Ready clients whose joins have all been acknowledged
+int LoadGenerator::countSettled() const
+{
+	int settled = 0;
+	for (size_t i = 0; i < _conns.size(); ++i)
+	{
+		if (_conns[i].state == CONN_READY && _conns[i].pendingJoins == 0)
+			settled++;
+	}
+	return settled;
+}
+
+void LoadGenerator::pump(int timeoutMs)
+{
+	std::vector<struct pollfd> pfds;
+	std::vector<int> ids;
+	pfds.reserve(_fdToConn.size());
+	ids.reserve(_fdToConn.size());
+	for (std::map<int, int>::iterator it = _fdToConn.begin(); it != _fdToConn.end(); ++it)
+	{
+		const Connection& conn = _conns[it->second];
+		struct pollfd pfd;
+		pfd.fd = it->first;
+		pfd.events = POLLIN;
+		if (conn.state == CONN_CONNECTING || !conn.out.empty())
+			pfd.events |= POLLOUT;
+		pfd.revents = 0;
+		pfds.push_back(pfd);
+		ids.push_back(it->second);
+	}
+
+	int ready = poll(pfds.empty() ? NULL : &pfds[0], pfds.size(), timeoutMs);
+	if (ready <= 0)
+		return;
+
+	for (size_t i = 0; i < pfds.size(); ++i)
+	{
+		if (pfds[i].revents == 0 || _conns[ids[i]].fd != pfds[i].fd)
+			continue;
+		if (pfds[i].revents & POLLOUT)
+			onWritable(ids[i]);
+		if (_conns[ids[i]].fd != pfds[i].fd)
+			continue;
+		if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			onReadable(ids[i]);
+	}
+
+	// Flush whatever handlers queued (JOINs after 001, NICK retries)
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		Connection& conn = _conns[ids[i]];
+		if (conn.fd != -1 && conn.state != CONN_CONNECTING && !conn.out.empty())
+			onWritable(ids[i]);
+	}
+}
+
+void LoadGenerator::sendChannelMessage(unsigned long long intendedNs)
+{
+	// Pick a ready sender that is in at least one channel
+	for (int attempts = 0; attempts < 16; ++attempts)
+	{
+		int id = _rng.below(static_cast<int>(_conns.size()));
+		Connection& conn = _conns[id];
+		if (conn.state != CONN_READY || conn.pendingJoins != 0 || conn.channels.empty())
+			continue;
+
+		int channel = conn.channels[_rng.below(static_cast<int>(conn.channels.size()))];
+		std::ostringstream oss;
+		oss << "PRIVMSG " << channelName(channel) << " :LG " << intendedNs << " " << nowNs() << " " << _padding << "\r\n";
+		queue(id, oss.str());
+		onWritable(id);
+		_sent++;
+		return;
+	}
+	_sendErrors++;
+}
+
+void LoadGenerator::churnOnce()
+{
+	for (int attempts = 0; attempts < 16; ++attempts)
+	{
+		int id = _rng.below(static_cast<int>(_conns.size()));
+		Connection& conn = _conns[id];
+		if (conn.state != CONN_READY || conn.channels.empty())
+			continue;
+
+		size_t slot = _rng.below(static_cast<int>(conn.channels.size()));
+		int newChannel = pickChannel();
+		for (size_t i = 0; i < conn.channels.size(); ++i)
+		{
+			if (conn.channels[i] == newChannel)
+				return;
+		}
+		queue(id, "PART " + channelName(conn.channels[slot]) + " :churn\r\nJOIN " + channelName(newChannel) + "\r\n");
+		conn.channels[slot] = newChannel;
+		conn.pendingJoins++;
+		onWritable(id);
+		_churnOps++;
+		return;
+	}
+}
+
+void LoadGenerator::reconnectOnce(int id)
+{
+	Connection& conn = _conns[id];
+	if (conn.fd != -1)
+	{
+		queue(id, "QUIT :reconnect\r\n");
+		onWritable(id);
+		closeConnection(id);
+	}
+	_reconnects++;
+	if (!startConnect(id))
+		_reconnectQueue.push_back(id);
+}
+
+void LoadGenerator::report(double elapsed, const ProcSample& before, const ProcSample& after, const ProcSample& peak) const
+{
+	std::printf("\n== ircserv load test ==\n");
+	std::printf("clients          %d (%d ready at end)\n", _opt.clients, countReady());
+	std::printf("channels         %d, %d joins/client, %s", _opt.channels, _opt.joinsPerClient, _opt.distribution.c_str());
+	if (_opt.distribution == "zipf")
+		std::printf(" s=%.2f", _opt.zipfExponent);
+	std::printf("\n");
+	std::printf("duration         %.2f s\n", elapsed);
+	std::printf("messages sent    %llu (%.0f msg/s, target %.0f)\n", _sent, _sent / elapsed, _opt.rate);
+	std::printf("deliveries       %llu (%.0f msg/s, fan-out %.1f)\n", _delivered, _delivered / elapsed,
+		_sent ? static_cast<double>(_delivered) / _sent : 0.0);
+	std::printf("churn ops        %llu, reconnects %llu, send errors %llu\n", _churnOps, _reconnects, _sendErrors);
+	std::printf("schedule lag max %.3f ms\n", _maxScheduleLagNs / 1e6);
+	std::printf("connect+register p50 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+		_connectLatency.percentile(0.50) / 1e6, _connectLatency.percentile(0.99) / 1e6, _connectLatency.max() / 1e6);
+	std::printf("delivery latency (corrected)   p50 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms\n",
+		_corrected.percentile(0.50) / 1e6, _corrected.percentile(0.99) / 1e6,
+		_corrected.percentile(0.999) / 1e6, _corrected.max() / 1e6);
+	std::printf("delivery latency (uncorrected) p50 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms\n",
+		_uncorrected.percentile(0.50) / 1e6, _uncorrected.percentile(0.99) / 1e6,
+		_uncorrected.percentile(0.999) / 1e6, _uncorrected.max() / 1e6);
+	if (_opt.stormSize > 0)
+	{
+		if (_stormRecoveredNs > _stormStartNs)
+			std::printf("storm            %d clients recovered in %.3f ms\n", _opt.stormSize, (_stormRecoveredNs - _stormStartNs) / 1e6);
+		else
+			std::printf("storm            %d clients, %d not recovered\n", _opt.stormSize, _stormPending);
+	}
+	if (before.valid && after.valid)
+	{
+		std::printf("server cpu       %.1f%% of one core\n", 100.0 * (after.cpuSeconds - before.cpuSeconds) / elapsed);
+		std::printf("server rss       %ld KiB (peak sampled %ld KiB, VmHWM %ld KiB)\n", after.rssKb, peak.rssKb, after.peakRssKb);
+	}
+	if (_ioSyscalls >= 0)
+	{
+		std::printf("server syscalls  %.0f I/O (%.2f per message sent, %.3f per delivery)\n", _ioSyscalls,
+			_sent ? _ioSyscalls / _sent : 0.0, _delivered ? _ioSyscalls / _delivered : 0.0);
+	}
+	// One machine-readable line for scripts comparing builds
+	std::printf("RESULT sent_per_sec=%.0f deliveries_per_sec=%.0f p50_ms=%.3f p99_ms=%.3f p999_ms=%.3f",
+		_sent / elapsed, _delivered / elapsed, _corrected.percentile(0.50) / 1e6,
+		_corrected.percentile(0.99) / 1e6, _corrected.percentile(0.999) / 1e6);
+	if (before.valid && after.valid)
+		std::printf(" server_cpu_pct=%.1f", 100.0 * (after.cpuSeconds - before.cpuSeconds) / elapsed);
+	if (_ioSyscalls >= 0)
+	{
+		std::printf(" syscalls_per_msg=%.3f syscalls_per_delivery=%.4f", _sent ? _ioSyscalls / _sent : 0.0,
+			_delivered ? _ioSyscalls / _delivered : 0.0);
+	}
+	std::printf("\n");
+}
+
+int LoadGenerator::run()
+{
+	// Phase 1: connect and register everyone, in batches to spare the accept backlog
+	unsigned long long setupStart = nowNs();
+	int next = 0;
+	while (countSettled() < _opt.clients)
+	{
+		for (int i = 0; i < _opt.connectBatch && next < _opt.clients; ++i, ++next)
+		{
+			if (!startConnect(next))
+				_reconnectQueue.push_back(next);
+		}
+		while (!_reconnectQueue.empty())
+		{
+			int id = _reconnectQueue.back();
+			_reconnectQueue.pop_back();
+			startConnect(id);
+		}
+		pump(1);
+		if (nowNs() - setupStart > 60ULL * 1000000000ULL)
+		{
+			std::fprintf(stderr, "setup timed out: %d/%d clients settled\n", countSettled(), _opt.clients);
+			return 1;
+		}
+	}
+	std::printf("setup: %d clients registered and joined in %.2f s\n", _opt.clients, (nowNs() - setupStart) / 1e9);
+
+	// Phase 2: open-loop traffic
+	ProcSample before = sampleProcess(_opt.serverPid);
+	ProcSample peak = before;
+	double syscallsBefore = scrapeCounter(_opt.host, _opt.metricsPort, "ircserv_io_syscalls_total");
+	_measuring = true;
+	unsigned long long start = nowNs();
+	unsigned long long end = start + static_cast<unsigned long long>(_opt.duration * 1e9);
+	double messageInterval = _opt.rate > 0 ? 1e9 / _opt.rate : 0;
+	double churnInterval = _opt.churnRate > 0 ? 1e9 / _opt.churnRate : 0;
+	double reconnectInterval = _opt.reconnectRate > 0 ? 1e9 / _opt.reconnectRate : 0;
+	unsigned long long messageIndex = 0;
+	unsigned long long churnIndex = 0;
+	unsigned long long reconnectIndex = 0;
+	unsigned long long nextSample = start;
+	bool stormDone = _opt.stormAt < 0 || _opt.stormSize <= 0;
+
+	unsigned long long now = start;
+	while (now < end)
+	{
+		// Send every message whose intended time has passed
+		while (messageInterval > 0)
+		{
+			unsigned long long intended = start + static_cast<unsigned long long>(messageIndex * messageInterval);
+			if (intended > now || intended >= end)
+				break;
+			if (now - intended > _maxScheduleLagNs)
+				_maxScheduleLagNs = now - intended;
+			sendChannelMessage(intended);
+			messageIndex++;
+		}
+		while (churnInterval > 0 && start + static_cast<unsigned long long>(churnIndex * churnInterval) <= now)
+		{
+			churnOnce();
+			churnIndex++;
+		}
+		while (reconnectInterval > 0 && start + static_cast<unsigned long long>(reconnectIndex * reconnectInterval) <= now)
+		{
+			reconnectOnce(_rng.below(_opt.clients));
+			reconnectIndex++;
+		}
+		if (!stormDone && now >= start + static_cast<unsigned long long>(_opt.stormAt * 1e9))
+		{
+			stormDone = true;
+			_stormStartNs = now;
+			_stormPending = _opt.stormSize < _opt.clients ? _opt.stormSize : _opt.clients;
+			for (int i = 0; i < _stormPending; ++i)
+				reconnectOnce(i);
+		}
+		while (!_reconnectQueue.empty())
+		{
+			int id = _reconnectQueue.back();
+			_reconnectQueue.pop_back();
+			reconnectOnce(id);
+		}
+
+		if (now >= nextSample)
+		{
+			ProcSample sample = sampleProcess(_opt.serverPid);
+			if (sample.rssKb > peak.rssKb)
+				peak = sample;
+			nextSample = now + 250000000ULL;
+		}
+
+		pump(messageInterval > 0 && messageInterval < 1e6 ? 0 : 1);
+		now = nowNs();
+	}
+	double elapsed = (nowNs() - start) / 1e9;
+	ProcSample after = sampleProcess(_opt.serverPid);
+	double syscallsAfter = scrapeCounter(_opt.host, _opt.metricsPort, "ircserv_io_syscalls_total");
+	if (syscallsBefore >= 0 && syscallsAfter >= syscallsBefore)
+		_ioSyscalls = syscallsAfter - syscallsBefore;
+
+	// Phase 3: drain in-flight deliveries for up to a second (not counted in throughput time)
+	unsigned long long drainEnd = nowNs() + 1000000000ULL;
+	while (nowNs() < drainEnd)
+		pump(10);
+
+	report(elapsed, before, after, peak);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseOptions(argc, argv, opt))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Thousands of sockets need a raised descriptor limit
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	LoadGenerator generator(opt);
+	return generator.run();
+}
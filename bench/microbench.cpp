@@ -0,0 +1,582 @@
+// Microbenchmarks for ircserv hot paths
+//
+// Links against the server objects (everything but main.o) and measures
+// ns/op and heap allocations/op for parsing, framing, channel fan-out,
+// NAMES rendering, nickname lookup, spam filter scans and reply formatting.
+// Results can be saved and compared so optimizations are checked against a
+// baseline:
+//
+//   bench/microbench --save before.txt
+//   ... change code, make microbench ...
+//   bench/microbench --compare before.txt
+
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Message.hpp"
+#include "SpamFilter.hpp"
+#include "FanoutPool.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Allocation counting via global operator new replacement; the counters
+// are atomic because fan-out threads allocate too
+
+static bool g_countAllocations = false;
+static unsigned long long g_allocations = 0;
+static unsigned long long g_allocatedBytes = 0;
+
+void* operator new(std::size_t size) throw(std::bad_alloc)
+{
+	if (g_countAllocations)
+	{
+		__atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_allocatedBytes, size, __ATOMIC_RELAXED);
+	}
+	void* p = std::malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size) throw(std::bad_alloc)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	std::free(p);
+}
+
+// ---------------------------------------------------------------------------
+// Timing
+
+static unsigned long long nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Accumulates time and allocations only while running, so benchmarks can
+// exclude per-iteration setup and cleanup.
+class Timer
+{
+private:
+	unsigned long long _elapsedNs;
+	unsigned long long _startNs;
+	unsigned long long _allocations;
+	unsigned long long _bytes;
+	unsigned long long _startAllocations;
+	unsigned long long _startBytes;
+
+public:
+	Timer() : _elapsedNs(0), _startNs(0), _allocations(0), _bytes(0), _startAllocations(0), _startBytes(0) {}
+
+	void resume()
+	{
+		_startAllocations = __atomic_load_n(&g_allocations, __ATOMIC_RELAXED);
+		_startBytes = __atomic_load_n(&g_allocatedBytes, __ATOMIC_RELAXED);
+		g_countAllocations = true;
+		_startNs = nowNs();
+	}
+
+	void pause()
+	{
+		unsigned long long end = nowNs();
+		g_countAllocations = false;
+		_elapsedNs += end - _startNs;
+		_allocations += __atomic_load_n(&g_allocations, __ATOMIC_RELAXED) - _startAllocations;
+		_bytes += __atomic_load_n(&g_allocatedBytes, __ATOMIC_RELAXED) - _startBytes;
+	}
+
+	unsigned long long elapsedNs() const { return _elapsedNs; }
+	unsigned long long allocations() const { return _allocations; }
+	unsigned long long bytes() const { return _bytes; }
+};
+
+// Keep results observable so the optimizer cannot drop the measured work
+static volatile size_t g_sink = 0;
+
+// ---------------------------------------------------------------------------
+// Benchmarks
+
+class Benchmark
+{
+private:
+	std::string _name;
+
+	Benchmark(const Benchmark&);
+	Benchmark& operator=(const Benchmark&);
+
+public:
+	explicit Benchmark(const std::string& name) : _name(name) {}
+	virtual ~Benchmark() {}
+
+	const std::string& name() const { return _name; }
+	virtual void setup() {}
+	virtual void teardown() {}
+	// Run iterations operations; the timer starts paused
+	virtual void run(size_t iterations, Timer& timer) = 0;
+};
+
+class MessageParseBenchmark : public Benchmark
+{
+private:
+	std::string _line;
+
+public:
+	MessageParseBenchmark(const std::string& name, const std::string& line) : Benchmark(name), _line(line) {}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			Message msg(_line);
+			g_sink += msg.getParamCount();
+		}
+		timer.pause();
+	}
+};
+
+// Feed a recv()-sized chunk holding several lines and extract them all
+class ExtractMessageBenchmark : public Benchmark
+{
+private:
+	std::string _chunk;
+	size_t _lines;
+
+public:
+	ExtractMessageBenchmark(const std::string& name, size_t lines) : Benchmark(name), _lines(lines)
+	{
+		for (size_t i = 0; i < lines; ++i)
+			_chunk += "PRIVMSG #bench :the quick brown fox jumps over the lazy dog\r\n";
+	}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		Client client(-1);
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			client.appendToRecvBuffer(_chunk);
+			for (size_t j = 0; j < _lines; ++j)
+				g_sink += client.extractMessage().length();
+		}
+		timer.pause();
+	}
+};
+
+// Channel with N members whose nicknames are set; fds are fake and never used
+class ChannelFixture
+{
+protected:
+	std::vector<Client*> _clients;
+	Channel* _channel;
+
+	void build(size_t members)
+	{
+		for (size_t i = 0; i < members; ++i)
+		{
+			Client* client = new Client(static_cast<int>(1000000 + i));
+			std::ostringstream nick;
+			nick << "user" << i;
+			client->setNickname(nick.str());
+			client->setUsername("bench");
+			_clients.push_back(client);
+		}
+		_channel = new Channel("#bench", _clients[0]);
+		for (size_t i = 1; i < members; ++i)
+			_channel->addMember(_clients[i]);
+	}
+
+	void destroy()
+	{
+		delete _channel;
+		_channel = NULL;
+		for (size_t i = 0; i < _clients.size(); ++i)
+			delete _clients[i];
+		_clients.clear();
+	}
+
+public:
+	ChannelFixture() : _channel(NULL) {}
+	virtual ~ChannelFixture() {}
+};
+
+// With threads, the broadcast is shared out by FanoutPool
+class BroadcastBenchmark : public Benchmark, protected ChannelFixture
+{
+private:
+	size_t _members;
+	size_t _threads;
+	std::string _line;
+
+public:
+	BroadcastBenchmark(const std::string& name, size_t members, size_t threads = 0)
+		: Benchmark(name), _members(members), _threads(threads),
+		  _line(":nick!user@host PRIVMSG #bench :the quick brown fox jumps over the lazy dog\r\n")
+	{
+	}
+
+	virtual void setup()
+	{
+		build(_members);
+		std::string error;
+		if (!FanoutPool::instance().start(_threads, 1, error))
+			std::cerr << "fan-out threads: " << error << std::endl;
+	}
+
+	virtual void teardown()
+	{
+		FanoutPool::instance().stop();
+		destroy();
+	}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			timer.resume();
+			_channel->broadcast(_line, _clients[0]->getFd());
+			timer.pause();
+			// Drain queues outside the timed region, as the send sweep would
+			for (size_t j = 0; j < _clients.size(); ++j)
+				_clients[j]->clearSendBuffer();
+		}
+	}
+};
+
+class MembersStringBenchmark : public Benchmark, protected ChannelFixture
+{
+private:
+	size_t _members;
+
+public:
+	MembersStringBenchmark(const std::string& name, size_t members) : Benchmark(name), _members(members) {}
+
+	virtual void setup() { build(_members); }
+	virtual void teardown() { destroy(); }
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+			g_sink += _channel->getMembersString().length();
+		timer.pause();
+	}
+};
+
+class NicknameLookupBenchmark : public Benchmark
+{
+private:
+	size_t _clients;
+	Server* _server;
+	std::vector<std::string> _nicks;
+
+public:
+	NicknameLookupBenchmark(const std::string& name, size_t clients) : Benchmark(name), _clients(clients), _server(NULL) {}
+
+	virtual void setup()
+	{
+		_server = new Server(6667, "bench");
+		for (size_t i = 0; i < _clients; ++i)
+		{
+			// Descriptors far above anything open, so the destructor's close() is a no-op
+			Client* client = new Client(static_cast<int>(1000000 + i));
+			std::ostringstream nick;
+			nick << "User" << i;
+			client->setNickname(nick.str());
+			_server->addClient(client);
+			_nicks.push_back(nick.str());
+		}
+	}
+
+	virtual void teardown()
+	{
+		delete _server;
+		_server = NULL;
+		_nicks.clear();
+	}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			// Lower-case query against mixed-case nicks, spread over the table
+			std::string query = _nicks[(i * 7919) % _nicks.size()];
+			query[0] = 'u';
+			g_sink += _server->getClientByNickname(query) != NULL;
+		}
+		timer.pause();
+	}
+};
+
+// The reply idiom used by every command handler
+class ReplyFormatBenchmark : public Benchmark
+{
+public:
+	explicit ReplyFormatBenchmark(const std::string& name) : Benchmark(name) {}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		std::string nick = "someone";
+		std::string target = "#channel";
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			std::ostringstream oss;
+			oss << ":irc.server 404 " << nick << " " << target << " :Cannot send to channel\r\n";
+			g_sink += oss.str().length();
+		}
+		timer.pause();
+	}
+};
+
+class PrivmsgFormatBenchmark : public Benchmark
+{
+public:
+	explicit PrivmsgFormatBenchmark(const std::string& name) : Benchmark(name) {}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		std::string nick = "someone";
+		std::string user = "user";
+		std::string host = "127.0.0.1";
+		std::string target = "#channel";
+		std::string message = "the quick brown fox jumps over the lazy dog";
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			std::ostringstream oss;
+			oss << ":" << nick << "!" << user << "@" << host << " PRIVMSG " << target << " :" << message << "\r\n";
+			g_sink += oss.str().length();
+		}
+		timer.pause();
+	}
+};
+
+// Scan a clean message body against n filter phrases, compiled into one
+// automaton or (naive) tried one find() at a time
+class FilterScanBenchmark : public Benchmark
+{
+private:
+	size_t _phrases;
+	bool _naive;
+	std::vector<FilterRule> _rules;
+	FilterAutomaton* _automaton;
+	std::string _text;
+
+public:
+	FilterScanBenchmark(const std::string& name, size_t phrases, bool naive)
+		: Benchmark(name), _phrases(phrases), _naive(naive), _automaton(NULL)
+	{
+	}
+
+	virtual void setup()
+	{
+		for (size_t i = 0; i < _phrases; ++i)
+		{
+			std::ostringstream phrase;
+			phrase << "buy cheap item" << i << " now";
+			FilterRule rule;
+			rule.pattern = phrase.str();
+			rule.foldCase = i % 2 == 0;
+			_rules.push_back(rule);
+		}
+		_automaton = new FilterAutomaton(_rules);
+		_text = "the quick brown fox jumps over the lazy dog, then buys a cheap item at the shop and goes home now";
+	}
+
+	virtual void teardown()
+	{
+		delete _automaton;
+		_automaton = NULL;
+		_rules.clear();
+	}
+
+	virtual void run(size_t iterations, Timer& timer)
+	{
+		timer.resume();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			if (!_naive)
+			{
+				g_sink += _automaton->scan(_text) != NULL;
+				continue;
+			}
+			for (size_t r = 0; r < _rules.size(); ++r)
+				g_sink += _text.find(_rules[r].pattern) != std::string::npos;
+		}
+		timer.pause();
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Runner
+
+struct Result
+{
+	std::string name;
+	size_t iterations;
+	double nsPerOp;
+	double allocsPerOp;
+	double bytesPerOp;
+};
+
+static Result measure(Benchmark& bench, double minSeconds)
+{
+	bench.setup();
+
+	// Grow the iteration count until a run takes long enough to trust
+	size_t iterations = 1;
+	Timer timer;
+	while (true)
+	{
+		timer = Timer();
+		bench.run(iterations, timer);
+		if (timer.elapsedNs() >= minSeconds * 1e9 || iterations >= (1UL << 30))
+			break;
+		double perOp = timer.elapsedNs() > 0 ? static_cast<double>(timer.elapsedNs()) / iterations : 1;
+		size_t predicted = static_cast<size_t>(minSeconds * 1e9 * 1.2 / perOp);
+		size_t next = iterations * 10;
+		if (predicted < next)
+			next = predicted;
+		iterations = next > iterations ? next : iterations + 1;
+	}
+
+	bench.teardown();
+
+	Result result;
+	result.name = bench.name();
+	result.iterations = iterations;
+	result.nsPerOp = static_cast<double>(timer.elapsedNs()) / iterations;
+	result.allocsPerOp = static_cast<double>(timer.allocations()) / iterations;
+	result.bytesPerOp = static_cast<double>(timer.bytes()) / iterations;
+	return result;
+}
+
+static std::map<std::string, Result> loadBaseline(const std::string& path)
+{
+	std::map<std::string, Result> baseline;
+	std::ifstream file(path.c_str());
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream iss(line);
+		Result result;
+		if (iss >> result.name >> result.nsPerOp >> result.allocsPerOp >> result.bytesPerOp)
+			baseline[result.name] = result;
+	}
+	return baseline;
+}
+
+static void usage(const char* prog)
+{
+	std::cerr << "Usage: " << prog << " [--filter <substr>] [--min-time <s>] [--save <file>] [--compare <file>]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	std::string savePath;
+	std::string comparePath;
+	double minSeconds = 0.3;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		if (arg == "--filter")
+			filter = argv[++i];
+		else if (arg == "--save")
+			savePath = argv[++i];
+		else if (arg == "--compare")
+			comparePath = argv[++i];
+		else if (arg == "--min-time")
+			minSeconds = std::atof(argv[++i]);
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<Benchmark*> benchmarks;
+	benchmarks.push_back(new MessageParseBenchmark("Message::parse/privmsg", "PRIVMSG #channel :the quick brown fox jumps over the lazy dog"));
+	benchmarks.push_back(new MessageParseBenchmark("Message::parse/prefixed", ":nick!user@host PRIVMSG #channel :the quick brown fox"));
+	benchmarks.push_back(new MessageParseBenchmark("Message::parse/mode", "MODE #channel +kl-i secret 50"));
+	benchmarks.push_back(new ExtractMessageBenchmark("Client::extractMessage/1line", 1));
+	benchmarks.push_back(new ExtractMessageBenchmark("Client::extractMessage/8lines", 8));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/10", 10));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/1k", 1000));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/10k", 10000));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/100k", 100000));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/10k/fanout4", 10000, 4));
+	benchmarks.push_back(new BroadcastBenchmark("Channel::broadcast/100k/fanout4", 100000, 4));
+	benchmarks.push_back(new MembersStringBenchmark("Channel::getMembersString/10", 10));
+	benchmarks.push_back(new MembersStringBenchmark("Channel::getMembersString/1k", 1000));
+	benchmarks.push_back(new NicknameLookupBenchmark("Server::getClientByNickname/100", 100));
+	benchmarks.push_back(new NicknameLookupBenchmark("Server::getClientByNickname/10k", 10000));
+	benchmarks.push_back(new FilterScanBenchmark("FilterAutomaton::scan/500", 500, false));
+	benchmarks.push_back(new FilterScanBenchmark("FilterScan/naive/500", 500, true));
+	benchmarks.push_back(new ReplyFormatBenchmark("ostringstream/numeric_reply"));
+	benchmarks.push_back(new PrivmsgFormatBenchmark("ostringstream/privmsg_line"));
+
+	std::map<std::string, Result> baseline;
+	if (!comparePath.empty())
+		baseline = loadBaseline(comparePath);
+
+	std::ofstream save;
+	if (!savePath.empty())
+		save.open(savePath.c_str());
+
+	std::printf("%-36s %12s %12s %10s %10s", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+	if (!baseline.empty())
+		std::printf(" %10s %10s", "d ns/op", "d allocs");
+	std::printf("\n");
+
+	for (size_t i = 0; i < benchmarks.size(); ++i)
+	{
+		if (filter.empty() || benchmarks[i]->name().find(filter) != std::string::npos)
+		{
+			Result r = measure(*benchmarks[i], minSeconds);
+			std::printf("%-36s %12lu %12.1f %10.2f %10.1f", r.name.c_str(), static_cast<unsigned long>(r.iterations),
+				r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+			std::map<std::string, Result>::iterator base = baseline.find(r.name);
+			if (base != baseline.end() && base->second.nsPerOp > 0)
+			{
+				std::printf(" %+9.1f%% %+10.2f", 100.0 * (r.nsPerOp - base->second.nsPerOp) / base->second.nsPerOp,
+					r.allocsPerOp - base->second.allocsPerOp);
+			}
+			std::printf("\n");
+			std::fflush(stdout);
+			if (save.is_open())
+				save << r.name << " " << r.nsPerOp << " " << r.allocsPerOp << " " << r.bytesPerOp << "\n";
+		}
+		delete benchmarks[i];
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Training workload for the profile-guided build: drives an instrumented
+# ircserv through registration, JOIN/PART churn, reconnects, a reconnect
+# storm and channel PRIVMSG fan-out, then stops it with SIGTERM so the
+# profile is written on a normal exit.
+#
+# Usage: bench/pgo_train.sh <instrumented ircserv>
+# Environment:
+#   PORT  port to listen on (default 6791)
+
+IRCSERV=$1
+PORT=${PORT:-6791}
+PASS="bench"
+DIR="$(dirname "$0")"
+
+if [ -z "$IRCSERV" ]; then
+    echo "Usage: $0 <instrumented ircserv>" >&2
+    exit 1
+fi
+
+ulimit -n "$(ulimit -Hn)" 2>/dev/null
+
+"$IRCSERV" "$PORT" "$PASS" > /dev/null 2>&1 &
+SERVER_PID=$!
+sleep 0.5
+if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+    echo "ircserv failed to start on port $PORT" >&2
+    exit 1
+fi
+
+# A few shapes so neither tiny nor huge channels dominate the profile.
+# The first failed run stops the training: a partial profile is no use.
+STATUS=0
+"$DIR/loadgen" --port "$PORT" --password "$PASS" --clients 1000 --channels 50 --joins 3 \
+    --dist zipf:1.0 --rate 4000 --duration 6 --churn 100 --reconnect 20 --storm 3:100 > /dev/null \
+    || STATUS=1
+if [ $STATUS -eq 0 ]; then
+    "$DIR/loadgen" --port "$PORT" --password "$PASS" --clients 300 --channels 300 --joins 2 \
+        --dist uniform --rate 3000 --duration 3 --churn 50 --payload 200 > /dev/null \
+        || STATUS=1
+fi
+if [ $STATUS -ne 0 ]; then
+    echo "Training run failed" >&2
+fi
+
+kill -TERM "$SERVER_PID"
+wait "$SERVER_PID"
+exit $STATUS
@@ -0,0 +1,268 @@
+// Deterministic replay of traffic captured with `capture file=<path>`
+//
+// Links against the server objects (everything but main.o) and feeds the
+// recorded connect, data and disconnect events straight into a Server
+// instance, either on the original schedule or as fast as possible:
+//
+//   bench/replay --password secret capture.bin           # original timing
+//   bench/replay --password secret --max capture.bin     # maximum speed
+//   bench/replay --password secret --speed 4 capture.bin # 4x faster
+//
+// Each connection gets a socketpair: the server writes its replies into one
+// end exactly as it would into a TCP socket, and the tool drains the other.
+// Input bypasses the sockets and is handed to Server::processInput in the
+// recorded chunks, so parsing and command order match the original run.
+
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Capture.hpp"
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+// Drain replies from the peer ends every this many events
+static const size_t DRAIN_INTERVAL = 256;
+
+struct ReplayConnection
+{
+	int serverFd; // -1 once the server closed it
+	int peerFd;
+};
+
+static void usage(const char* program)
+{
+	std::fprintf(stderr,
+		"Usage: %s --password <pw> [options] <capture>\n"
+		"  --password <pw>  server password used when the capture was taken\n"
+		"  --config <file>  server config to apply (listeners are ignored)\n"
+		"  --speed <x>      replay x times faster than recorded (default 1)\n"
+		"  --max            replay as fast as possible\n"
+		"  --verbose        print server log output\n",
+		program);
+}
+
+static void sleepUntil(unsigned long long targetNs)
+{
+	unsigned long long now = Metrics::nowNs();
+	if (targetNs <= now)
+		return;
+	unsigned long long wait = targetNs - now;
+	struct timespec pause;
+	pause.tv_sec = static_cast<time_t>(wait / 1000000000ULL);
+	pause.tv_nsec = static_cast<long>(wait % 1000000000ULL);
+	nanosleep(&pause, NULL);
+}
+
+static bool setNonBlocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+// Read and discard everything the server has written so far
+static unsigned long long drainPeers(const std::map<unsigned long long, ReplayConnection>& connections)
+{
+	std::vector<struct pollfd> fds;
+	for (std::map<unsigned long long, ReplayConnection>::const_iterator it = connections.begin();
+		 it != connections.end(); ++it)
+	{
+		struct pollfd pfd;
+		pfd.fd = it->second.peerFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		fds.push_back(pfd);
+	}
+	if (fds.empty() || poll(&fds[0], fds.size(), 0) <= 0)
+		return 0;
+
+	unsigned long long total = 0;
+	char buffer[65536];
+	for (size_t i = 0; i < fds.size(); ++i)
+	{
+		if ((fds[i].revents & POLLIN) == 0)
+			continue;
+		ssize_t n;
+		while ((n = recv(fds[i].fd, buffer, sizeof(buffer), 0)) > 0)
+			total += n;
+	}
+	return total;
+}
+
+// A new fd number means the server closed whoever held it before
+static void forgetReusedFd(std::map<unsigned long long, ReplayConnection>& connections, int fd)
+{
+	for (std::map<unsigned long long, ReplayConnection>::iterator it = connections.begin();
+		 it != connections.end(); ++it)
+	{
+		if (it->second.serverFd == fd)
+			it->second.serverFd = -1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string password;
+	std::string configPath;
+	std::string capturePath;
+	double speed = 1.0;
+	bool verbose = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--max")
+			speed = 0;
+		else if (arg == "--verbose")
+			verbose = true;
+		else if (arg == "--password" && i + 1 < argc)
+			password = argv[++i];
+		else if (arg == "--config" && i + 1 < argc)
+			configPath = argv[++i];
+		else if (arg == "--speed" && i + 1 < argc)
+			speed = std::atof(argv[++i]);
+		else if (arg[0] != '-' && capturePath.empty())
+			capturePath = arg;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (capturePath.empty() || password.empty() || speed < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::string error;
+	CaptureReader reader;
+	if (!reader.open(capturePath, error))
+	{
+		std::fprintf(stderr, "%s: %s\n", capturePath.c_str(), error.c_str());
+		return 1;
+	}
+
+	Config config;
+	try
+	{
+		if (!configPath.empty())
+			config.loadFile(configPath);
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+
+	Server server(6667, password, config);
+	if (verbose)
+		Logger::instance().start();
+	else
+		Logger::instance().setCategoryMask(0);
+
+	std::map<unsigned long long, ReplayConnection> connections;
+	Histogram eventNs;
+	unsigned long long events = 0;
+	unsigned long long bytesIn = 0;
+	unsigned long long bytesOut = 0;
+	unsigned long long recordedNs = 0;
+	unsigned long long startNs = Metrics::nowNs();
+
+	CaptureEvent event;
+	while (reader.next(event, error))
+	{
+		recordedNs = event.timestampNs;
+		if (speed > 0)
+			sleepUntil(startNs + static_cast<unsigned long long>(event.timestampNs / speed));
+
+		unsigned long long eventStart = Metrics::nowNs();
+		if (event.type == CAPTURE_CONNECT)
+		{
+			int pair[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1 || !setNonBlocking(pair[0]) || !setNonBlocking(pair[1]))
+			{
+				std::fprintf(stderr, "socketpair: %s\n", std::strerror(errno));
+				return 1;
+			}
+			forgetReusedFd(connections, pair[0]);
+			forgetReusedFd(connections, pair[1]);
+
+			Client* client = new Client(pair[0]);
+			client->setHostname(event.data);
+			server.addClient(client);
+
+			ReplayConnection connection;
+			connection.serverFd = pair[0];
+			connection.peerFd = pair[1];
+			connections[event.connection] = connection;
+		}
+		else
+		{
+			std::map<unsigned long long, ReplayConnection>::iterator it = connections.find(event.connection);
+			if (it == connections.end())
+				continue;
+
+			if (event.type == CAPTURE_DATA)
+			{
+				Client* client = it->second.serverFd == -1 ? NULL : server.getClient(it->second.serverFd);
+				if (client != NULL)
+				{
+					server.processInput(*client, event.data.data(), event.data.length());
+					// Hashed passwords: wait for the check, as the loop would
+					while (server.hasPendingAuth())
+						server.handleAuthCompletions(true);
+					bytesIn += event.data.length();
+				}
+			}
+			else
+			{
+				if (it->second.serverFd != -1)
+					server.removeClient(it->second.serverFd);
+				bytesOut += drainPeers(connections);
+				close(it->second.peerFd);
+				connections.erase(it);
+			}
+		}
+		server.flushClients();
+		eventNs.record(Metrics::nowNs() - eventStart);
+
+		if (++events % DRAIN_INTERVAL == 0)
+			bytesOut += drainPeers(connections);
+	}
+	if (!error.empty())
+		std::fprintf(stderr, "%s: %s, stopping after %llu events\n", capturePath.c_str(), error.c_str(), events);
+	bytesOut += drainPeers(connections);
+
+	double elapsed = (Metrics::nowNs() - startNs) / 1e9;
+	std::printf("events=%llu connections_open=%lu bytes_in=%llu bytes_out=%llu\n",
+		events, static_cast<unsigned long>(connections.size()), bytesIn, bytesOut);
+	std::printf("recorded=%.3fs replayed=%.3fs events_per_sec=%.0f\n",
+		recordedNs / 1e9, elapsed, elapsed > 0 ? events / elapsed : 0.0);
+	std::printf("event_ns p50<=%llu p99<=%llu max=%llu\n",
+		eventNs.percentile(0.50), eventNs.percentile(0.99), eventNs.getMax());
+
+	std::vector<std::string> lines;
+	Metrics::instance().renderSummary(server.collectGauges(), lines);
+	for (size_t i = 0; i < lines.size(); ++i)
+		std::printf("%s\n", lines[i].c_str());
+
+	for (std::map<unsigned long long, ReplayConnection>::iterator it = connections.begin();
+		 it != connections.end(); ++it)
+	{
+		close(it->second.peerFd);
+	}
+	if (verbose)
+		Logger::instance().stop();
+	return 0;
+}
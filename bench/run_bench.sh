@@ -0,0 +1,53 @@
+#!/bin/bash
+# End-to-end fan-out benchmark: starts ./ircserv, drives it with bench/loadgen
+# and prints throughput, delivery latency percentiles and server CPU/RSS.
+#
+# Usage: bench/run_bench.sh [loadgen options]
+# Without options a default mixed scenario is run. Environment:
+#   IRCSERV       server binary (default ./ircserv)
+#   PORT          port to listen on (default 6790)
+#   METRICS_PORT  metrics listener for the syscall count (default PORT+1)
+#   IO_BACKEND    io backend= for the server (default: its own choice)
+#   LATENCY       latency options for the server, e.g. "cpu=2 busypoll=50 spin=200"
+#   PIPELINE      pipeline options for the server, e.g. "threads=2"
+
+IRCSERV=${IRCSERV:-./ircserv}
+PORT=${PORT:-6790}
+METRICS_PORT=${METRICS_PORT:-$((PORT + 1))}
+PASS="bench"
+
+if [ $# -eq 0 ]; then
+    set -- --clients 2000 --channels 100 --joins 3 --dist zipf:1.0 \
+           --rate 5000 --duration 10 --churn 50 --reconnect 10 --storm 5:200
+fi
+
+# Thousands of connections need more descriptors on both sides
+ulimit -n "$(ulimit -Hn)" 2>/dev/null
+
+CONFIG=$(mktemp)
+{
+    echo "listen tcp4 127.0.0.1 $PORT"
+    echo "listen tcp4 127.0.0.1 $METRICS_PORT protocol=metrics"
+    if [ -n "$IO_BACKEND" ]; then
+        echo "io backend=$IO_BACKEND"
+    fi
+    if [ -n "$LATENCY" ]; then
+        echo "latency $LATENCY"
+    fi
+    if [ -n "$PIPELINE" ]; then
+        echo "pipeline $PIPELINE"
+    fi
+} > "$CONFIG"
+
+"$IRCSERV" "$PORT" "$PASS" "$CONFIG" > /dev/null 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null; rm -f "$CONFIG"' EXIT
+sleep 0.5
+
+if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+    echo "ircserv failed to start on port $PORT" >&2
+    exit 1
+fi
+
+"$(dirname "$0")/loadgen" --port "$PORT" --password "$PASS" --server-pid "$SERVER_PID" \
+    --metrics-port "$METRICS_PORT" "$@"
@@ -0,0 +1,76 @@
+#ifndef AUTHPOOL_HPP
+# define AUTHPOOL_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <cstddef>
+# include <pthread.h>
+
+// Password checks against crypt(3) hashes ("$6$...", "$y$...", "$2b$..."),
+// run on a few worker threads: the hashes are made to be slow, tens of
+// milliseconds each, which the event loop cannot afford once per login.
+// Finished jobs are collected by the loop when the eventfd is readable.
+
+// Input a client may pile up while its password is being checked
+static const size_t AUTH_PARKED_INPUT = 16 * 1024;
+
+enum AuthKind
+{
+	AUTH_PASS, // connection password
+	AUTH_OPER // operator block password
+};
+
+struct AuthJob
+{
+	unsigned long long id;
+	int fd; // client waiting for the result
+	AuthKind kind;
+	std::string name; // operator name for AUTH_OPER
+	std::string password; // as the client sent it
+	std::string hash;
+	bool matched; // set by the worker
+
+	AuthJob();
+};
+
+class AuthPool
+{
+private:
+	std::vector<pthread_t> _threads;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup; // a job was queued, or stop()
+	pthread_cond_t _idle; // the last job in flight finished
+	std::deque<AuthJob> _queue;
+	std::vector<AuthJob> _done;
+	size_t _busy; // jobs taken by a worker and not done yet
+	bool _running;
+	int _eventFd;
+	unsigned long long _nextId;
+
+	// Orthodox Canonical Form
+	AuthPool(const AuthPool& other);
+	AuthPool& operator=(const AuthPool& other);
+
+	static void* workerThread(void* arg);
+	void workerLoop();
+
+public:
+	AuthPool();
+	~AuthPool();
+
+	bool start(size_t threads, std::string& error);
+	void stop(); // jobs still queued are dropped
+	int getEventFd() const;
+	bool isIdle();
+
+	unsigned long long submit(int fd, AuthKind kind, const std::string& name, const std::string& password,
+		const std::string& hash);
+	// Finished jobs, in completion order; with wait, blocks until none is left
+	void collect(std::vector<AuthJob>& done, bool wait);
+
+	static bool isHash(const std::string& secret);
+	static bool matches(const std::string& password, const std::string& secret); // constant time
+};
+
+#endif
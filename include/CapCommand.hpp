@@ -0,0 +1,14 @@
+#ifndef CAPCOMMAND_HPP
+# define CAPCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class CapCommand : public CommandHandler
+{
+public:
+	CapCommand();
+	virtual ~CapCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
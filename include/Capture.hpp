@@ -0,0 +1,84 @@
+#ifndef CAPTURE_HPP
+# define CAPTURE_HPP
+
+# include <string>
+# include <map>
+# include <cstdio>
+
+// Traffic capture file format, shared by the server and bench/replay.
+//
+//   header: "IRCCAP" version(1 byte) flags(1 byte) varint(start unix time)
+//   record: type(1 byte) varint(ns since previous record) varint(connection)
+//           [varint(length) bytes] for CAPTURE_CONNECT (hostname) and
+//           CAPTURE_DATA (raw bytes as received)
+//
+// Connection ids are assigned in connect order, so reused fds do not alias.
+enum CaptureEventType
+{
+	CAPTURE_CONNECT = 1,
+	CAPTURE_DATA = 2,
+	CAPTURE_DISCONNECT = 3
+};
+
+struct CaptureEvent
+{
+	CaptureEventType type;
+	unsigned long long timestampNs; // since the first record
+	unsigned long long connection;
+	std::string data;
+
+	CaptureEvent();
+};
+
+class CaptureWriter
+{
+private:
+	FILE* _file;
+	unsigned long long _lastNs;
+	unsigned long long _nextConnection;
+	std::map<int, unsigned long long> _connections; // fd -> connection id
+
+	// Orthodox Canonical Form
+	CaptureWriter(const CaptureWriter& other);
+	CaptureWriter& operator=(const CaptureWriter& other);
+
+	void writeVarint(unsigned long long value);
+	void writeRecord(CaptureEventType type, unsigned long long connection, const char* data, size_t length);
+
+public:
+	CaptureWriter();
+	~CaptureWriter();
+
+	bool open(const std::string& path, std::string& error);
+	void close();
+	bool isOpen() const;
+
+	void recordConnect(int fd, const std::string& hostname);
+	void recordData(int fd, const char* data, size_t length);
+	void recordDisconnect(int fd);
+};
+
+class CaptureReader
+{
+private:
+	FILE* _file;
+	unsigned long long _timestampNs;
+	long long _startTime;
+
+	// Orthodox Canonical Form
+	CaptureReader(const CaptureReader& other);
+	CaptureReader& operator=(const CaptureReader& other);
+
+	bool readVarint(unsigned long long& value);
+
+public:
+	CaptureReader();
+	~CaptureReader();
+
+	bool open(const std::string& path, std::string& error);
+	// Returns false at end of file; error is set when the file is truncated or corrupt
+	bool next(CaptureEvent& event, std::string& error);
+	long long getStartTime() const;
+};
+
+#endif
@@ -4,8 +4,26 @@
 # include <string>
 # include <vector>
 # include <map>
+# include <ctime>
+# include "Metrics.hpp"
+# include "SharedBuffer.hpp"
+# include "History.hpp"
+# include "MaskMatcher.hpp"
 
 class Client;
+class OutboundMessage;
+
+// Entries each of +b, +e and +I may hold
+static const size_t CHANNEL_MAX_MASKS = 4096;
+
+// Ban check results kept per member, until the lists change or the
+// client's nick!user@host does
+struct BanCacheEntry
+{
+	unsigned long stamp; // Client::getMaskStamp() when checked
+	unsigned long version; // list version when checked
+	bool banned;
+};
 
 class Channel
 {
@@ -21,6 +39,19 @@ private:
 	bool _hasKey;
 	bool _hasUserLimit;
 	int _userLimit;
+	time_t _createdAt; // channel TS: the oldest creation wins when links merge
+	bool _snapshotDirty; // persistent state changed since the last snapshot
+	ChannelHistory _history; // recent messages for CHATHISTORY
+	MaskMatcher _bans; // +b
+	MaskMatcher _exceptions; // +e
+	MaskMatcher _inviteExceptions; // +I
+	unsigned long _listVersion; // bumped on every b/e/I change
+	std::map<int, BanCacheEntry> _banCache; // fd -> last check
+	std::vector<Client*> _memberList; // _members as a vector, for splitting a fan-out
+	bool _memberListDirty;
+
+	MaskMatcher* getMaskList(char mode);
+	void broadcastSplit(const SharedBuffer* lines, bool tagged, int excludeFd);
 
 	// Orthodox Canonical Form
 	Channel();
@@ -40,9 +71,13 @@ public:
 	bool hasKey() const;
 	bool hasUserLimit() const;
 	int getUserLimit() const;
+	time_t getCreatedAt() const;
 	bool isMember(int clientFd) const;
 	bool isOperator(int clientFd) const;
 	bool isInvited(int clientFd) const;
+	std::vector<int> getInvited() const;
+	bool isSnapshotDirty() const;
+	void clearSnapshotDirty();
 	std::vector<Client*> getMembers() const;
 	std::string getMembersString() const; // For NAMES list with @ prefix
 	std::string getModeString() const; // For MODE query
@@ -55,6 +90,7 @@ public:
 	void setHasKey(bool hasKey);
 	void setHasUserLimit(bool hasLimit);
 	void setUserLimit(int limit);
+	void setCreatedAt(time_t createdAt);
 
 	// Member management
 	void addMember(Client* client);
@@ -64,10 +100,25 @@ public:
 	void removeOperator(int clientFd);
 	void addToInviteList(int clientFd);
 	void removeFromInviteList(int clientFd);
+
+	// Ban, exception and invite exception lists ('b', 'e', 'I')
+	bool addMask(char mode, const std::string& mask, const std::string& setBy, time_t setAt);
+	bool removeMask(char mode, const std::string& mask);
+	void clearMasks();
+	const std::vector<MaskEntry>& getMasks(char mode) const;
+	bool isMaskListFull(char mode) const;
+	bool isBanned(const Client& client); // banned and not excepted
+	bool isInviteExempt(const Client& client) const;
+
 	size_t getMemberCount() const;
+	MemoryUsage getMemoryUsage() const;
+	ChannelHistory& getHistory();
+	const ChannelHistory& getHistory() const;
 
-	// Broadcasting
+	// Broadcasting (local members only; links get messages via Server::propagate)
 	void broadcast(const std::string& message, int excludeFd = -1);
+	void broadcast(const SharedBuffer& message, int excludeFd = -1);
+	void broadcast(OutboundMessage& message, int excludeFd = -1);
 };
 
 #endif
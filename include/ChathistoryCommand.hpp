@@ -0,0 +1,17 @@
+#ifndef CHATHISTORYCOMMAND_HPP
+# define CHATHISTORYCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class ChathistoryCommand : public CommandHandler
+{
+private:
+	unsigned long _nextBatch; // BATCH reference tags
+
+public:
+	ChathistoryCommand();
+	virtual ~ChathistoryCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
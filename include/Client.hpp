@@ -2,6 +2,33 @@
 # define CLIENT_HPP
 
 # include <string>
+# include <vector>
+# include <cstddef>
+# include <ctime>
+# include <sys/uio.h>
+# include "Config.hpp"
+# include "Metrics.hpp"
+# include "SharedBuffer.hpp"
+
+// Server-to-server state of a connection; LINK_NONE for ordinary clients
+enum LinkState
+{
+	LINK_NONE,
+	LINK_CONNECTING, // outgoing CONNECT, TCP handshake in progress
+	LINK_HANDSHAKE, // we sent SERVER, waiting for the peer's
+	LINK_ESTABLISHED
+};
+
+class TlsSession;
+class WebSocketSession;
+
+// IRCv3 capabilities a client can turn on with CAP REQ
+enum Capability
+{
+	CAP_MESSAGE_TAGS = 1 << 0,
+	CAP_SERVER_TIME = 1 << 1,
+	CAP_BATCH = 1 << 2
+};
 
 class Client
 {
@@ -12,15 +39,38 @@ private:
 	std::string _realname;
 	std::string _hostname;
 	bool _authenticated;
+	unsigned long long _pendingAuth; // password check in flight (AuthPool job), 0 if none
 	bool _registered;
+	bool _isServerOperator;
+	bool _closeAfterFlush;
+	unsigned int _capabilities; // Capability bits
+	bool _negotiatingCaps; // registration waits for CAP END
+	ListenerProtocol _protocol;
+	TlsSession* _tls; // owned; NULL for plain connections
+	WebSocketSession* _webSocket; // owned; NULL unless accepted on a websocket listener
 	std::string _recvBuffer;
-	std::string _sendBuffer;
+	std::vector<SharedBuffer> _sendQueue; // shared with other recipients and channel history
+	size_t _sendHead; // first unsent buffer
+	size_t _sendOffset; // bytes of it already sent
+	size_t _sendQueued; // bytes still to send
+	size_t _recvBufferPeak;
+	size_t _sendBufferPeak;
+	ConnectionClass* _connClass;
+	LinkState _linkState;
+	std::string _linkName; // peer server name for link connections
+	Client* _link; // link the user is reachable through, NULL for local users
+	std::string _serverName; // server a remote user is connected to
+	time_t _nickTs; // when the nickname was taken, for collisions
+	unsigned long _maskStamp; // changes with nick, user or host; keys cached ban checks
 
 	// Orthodox Canonical Form
 	Client();
 	Client(const Client& other);
 	Client& operator=(const Client& other);
 
+	void queue(const std::string& data);
+	void queue(const SharedBuffer& data);
+
 public:
 	Client(int fd);
 	~Client();
@@ -32,23 +82,71 @@ public:
 	const std::string& getRealname() const;
 	const std::string& getHostname() const;
 	bool isAuthenticated() const;
+	unsigned long long getPendingAuth() const;
 	bool isRegistered() const;
+	bool isServerOperator() const;
+	bool shouldCloseAfterFlush() const;
+	unsigned int getCapabilities() const;
+	bool hasCapability(Capability capability) const;
+	bool isNegotiatingCaps() const;
+	ListenerProtocol getProtocol() const;
+	TlsSession* getTls() const;
+	WebSocketSession* getWebSocket() const;
 	const std::string& getRecvBuffer() const;
+	ConnectionClass* getConnectionClass() const;
+	MemoryUsage getMemoryUsage() const;
+	size_t getRecvBufferPeak() const;
+	size_t getSendBufferPeak() const;
+
+	// Server linking
+	bool isRemote() const;
+	bool isServerLink() const;
+	LinkState getLinkState() const;
+	const std::string& getLinkName() const;
+	Client* getLink() const;
+	const std::string& getServerName() const;
+	time_t getNickTs() const;
+	unsigned long getMaskStamp() const;
+	void setLinkState(LinkState state);
+	void setLinkName(const std::string& name);
+	void setRemote(Client* link, const std::string& serverName);
+	void setNickTs(time_t ts);
 
 	// Setters
 	void setNickname(const std::string& nickname);
 	void setUsername(const std::string& username);
 	void setRealname(const std::string& realname);
+	void setHostname(const std::string& hostname);
+	void setConnectionClass(ConnectionClass* connClass);
 	void setAuthenticated(bool authenticated);
+	void setPendingAuth(unsigned long long job);
 	void setRegistered(bool registered);
+	void setServerOperator(bool isOperator);
+	void setCloseAfterFlush(bool close);
+	void setCapabilities(unsigned int capabilities);
+	void setNegotiatingCaps(bool negotiating);
+	void setProtocol(ListenerProtocol protocol);
+	void setTls(TlsSession* tls);
+	void setWebSocket(WebSocketSession* webSocket);
 
 	// Buffer management
 	void appendToRecvBuffer(const std::string& data);
 	std::string extractMessage();
 	void appendToSendBuffer(const std::string& message);
+	void appendToSendBuffer(const SharedBuffer& message);
+	void appendRawToSendBuffer(const std::string& data); // bypasses WebSocket framing
 	bool hasMessageToSend() const;
 	std::string getSendBuffer() const;
+	size_t getSendBufferSize() const;
+	size_t getSendIovec(struct iovec* iov, size_t maxCount) const;
+	size_t getSendIovec(struct iovec* iov, size_t maxCount, std::vector<SharedBuffer>& hold) const; // keeps them alive
+	void consumeSendBuffer(size_t bytes);
 	void clearSendBuffer();
+
+	// Handing a connection between threads (see Pipeline.hpp)
+	std::string takeRecvBuffer();
+	void takeSendQueue(std::vector<SharedBuffer>& out); // unsent output, emptied here
+	void prependToSendBuffer(const std::vector<SharedBuffer>& output);
 };
 
 #endif
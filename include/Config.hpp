@@ -0,0 +1,161 @@
+#ifndef CONFIG_HPP
+# define CONFIG_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <cstddef>
+# include "Logger.hpp"
+
+enum ListenerType
+{
+	LISTEN_TCP4,
+	LISTEN_TCP6,
+	LISTEN_UNIX
+};
+
+// What is spoken on connections accepted by a listener
+enum ListenerProtocol
+{
+	PROTO_IRC,
+	PROTO_WEBSOCKET, // IRC lines in WebSocket messages, for browsers
+	PROTO_METRICS // one-shot HTTP GET returning Prometheus text
+};
+
+// Limits shared by every connection accepted through listeners of the class
+struct ConnectionClass
+{
+	std::string name;
+	size_t sendq; // max queued output bytes before the client is dropped
+	size_t maxClients; // 0 = unlimited
+	size_t clientCount;
+
+	ConnectionClass();
+};
+
+struct ListenerConfig
+{
+	ListenerType type;
+	ListenerProtocol protocol;
+	std::string address; // IP address, or filesystem path for unix sockets
+	int port;
+	std::string className;
+	int backlog;
+	bool v6only;
+	bool noDelay;
+	bool keepAlive;
+	bool tls; // TLS with the certificate from the tls directive
+	int sendBufferSize; // 0 = kernel default
+	int recvBufferSize; // 0 = kernel default
+	int mode; // unix socket permissions, -1 = umask default
+
+	ListenerConfig();
+	std::string describe() const;
+};
+
+// A peer server we accept links from and can CONNECT to
+struct LinkConfig
+{
+	std::string name;
+	std::string address; // IPv4 or IPv6 literal
+	int port;
+	std::string password; // shared secret, sent in both directions
+
+	LinkConfig();
+};
+
+class Config
+{
+private:
+	std::vector<ListenerConfig> _listeners;
+	std::vector<ConnectionClass> _classes;
+	std::map<std::string, std::string> _operators; // name -> password
+	std::string _serverName;
+	std::map<std::string, LinkConfig> _links; // name -> link block
+	LogLevel _logLevel;
+	unsigned int _logCategories; // bit per LogCategory
+	bool _traceEnabled;
+	std::string _traceFile;
+	std::string _captureFile; // empty = capture off
+	std::string _snapshotFile; // empty = channel snapshots off
+	size_t _snapshotSlots;
+	unsigned int _snapshotInterval; // seconds between msyncs
+	size_t _historyLines; // per channel, 0 = CHATHISTORY off
+	size_t _historyBytes; // per channel
+	size_t _historyTotal; // across all channels
+	std::string _tlsCertFile; // PEM chain, leaf first
+	std::string _tlsKeyFile;
+	bool _ktls; // hand records to the kernel when it can take them
+	std::string _ioBackend; // auto, poll, epoll or io_uring
+	size_t _ioBuffers; // io_uring receive buffers, a power of two
+	size_t _ioZeroCopy; // queued bytes from which sends are zero-copy, 0 = off
+	int _latencyCpu; // CPU the event loop is pinned to, -1 = not pinned
+	int _busyPoll; // SO_BUSY_POLL microseconds for client sockets, 0 = off
+	unsigned int _spinUsec; // longest spin before the loop blocks, 0 = off
+	size_t _authThreads; // workers checking password hashes
+	size_t _pipelineThreads; // I/O threads for plain IRC clients, 0 = off
+	size_t _pipelineRing; // entries per ring, a power of two
+	size_t _fanoutThreads; // threads sharing out big broadcasts, 0 = off
+	size_t _fanoutThreshold; // members from which a broadcast is shared out
+
+	void parseLine(const std::string& line, int lineNumber);
+	void parseClass(const std::vector<std::string>& tokens, int lineNumber);
+	void parseListen(const std::vector<std::string>& tokens, int lineNumber);
+	void parseOper(const std::vector<std::string>& tokens, int lineNumber);
+	void parseServer(const std::vector<std::string>& tokens, int lineNumber);
+	void parseLink(const std::vector<std::string>& tokens, int lineNumber);
+	void parseLog(const std::vector<std::string>& tokens, int lineNumber);
+	void parseTrace(const std::vector<std::string>& tokens, int lineNumber);
+	void parseCapture(const std::vector<std::string>& tokens, int lineNumber);
+	void parseSnapshot(const std::vector<std::string>& tokens, int lineNumber);
+	void parseHistory(const std::vector<std::string>& tokens, int lineNumber);
+	void parseTls(const std::vector<std::string>& tokens, int lineNumber);
+	void parseIo(const std::vector<std::string>& tokens, int lineNumber);
+	void parseLatency(const std::vector<std::string>& tokens, int lineNumber);
+	void parseAuth(const std::vector<std::string>& tokens, int lineNumber);
+	void parsePipeline(const std::vector<std::string>& tokens, int lineNumber);
+	void parseFanout(const std::vector<std::string>& tokens, int lineNumber);
+
+public:
+	Config();
+	Config(const Config& other);
+	Config& operator=(const Config& other);
+	~Config();
+
+	void loadFile(const std::string& path);
+	void applyDefaults(int port);
+
+	const std::vector<ListenerConfig>& getListeners() const;
+	const std::vector<ConnectionClass>& getClasses() const;
+	const std::map<std::string, std::string>& getOperators() const;
+	const std::string& getServerName() const;
+	const std::map<std::string, LinkConfig>& getLinks() const;
+	LogLevel getLogLevel() const;
+	unsigned int getLogCategories() const;
+	bool isTraceEnabled() const;
+	const std::string& getTraceFile() const;
+	const std::string& getCaptureFile() const;
+	const std::string& getSnapshotFile() const;
+	size_t getSnapshotSlots() const;
+	unsigned int getSnapshotInterval() const;
+	size_t getHistoryLines() const;
+	size_t getHistoryBytes() const;
+	size_t getHistoryTotal() const;
+	const std::string& getTlsCertFile() const;
+	const std::string& getTlsKeyFile() const;
+	bool isKtlsEnabled() const;
+	bool hasTlsListener() const;
+	const std::string& getIoBackend() const;
+	size_t getIoBuffers() const;
+	size_t getIoZeroCopy() const;
+	int getLatencyCpu() const;
+	int getBusyPoll() const;
+	unsigned int getSpinUsec() const;
+	size_t getAuthThreads() const;
+	size_t getPipelineThreads() const;
+	size_t getPipelineRing() const;
+	size_t getFanoutThreads() const;
+	size_t getFanoutThreshold() const;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef CONNECTCOMMAND_HPP
+# define CONNECTCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class ConnectCommand : public CommandHandler
+{
+public:
+	ConnectCommand();
+	virtual ~ConnectCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef FANOUTPOOL_HPP
+# define FANOUTPOOL_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+# include <pthread.h>
+
+// Threads that share out a broadcast to a very large channel ("fanout
+// threads=<n> threshold=<members>"). The event loop splits the member list
+// into one part per thread plus one for itself, runs its own part and waits
+// for the rest; every member is in exactly one part, so each send queue is
+// only ever appended to by one thread. Below the threshold, or with no
+// threads, broadcasts stay on the loop.
+
+// Runs part (0 .. parts - 1) of a job; part 0 is the caller's
+typedef void (*FanoutTask)(void* context, size_t part, size_t parts);
+
+class FanoutPool
+{
+private:
+	std::vector<pthread_t> _threads;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup; // a job was posted, or stop()
+	pthread_cond_t _finished; // the last worker part is done
+	FanoutTask _task;
+	void* _context;
+	unsigned long _generation; // bumped per job
+	unsigned long _startGeneration; // when the workers were started
+	size_t _pending; // worker parts not done yet
+	size_t _nextPart; // handed to workers as they start
+	size_t _threshold;
+	bool _running;
+
+	FanoutPool();
+	~FanoutPool();
+	// Orthodox Canonical Form
+	FanoutPool(const FanoutPool& other);
+	FanoutPool& operator=(const FanoutPool& other);
+
+	static void* workerThread(void* arg);
+	void workerLoop();
+
+public:
+	static FanoutPool& instance();
+
+	bool start(size_t threads, size_t threshold, std::string& error);
+	void stop();
+	bool shouldSplit(size_t members) const;
+	size_t getParts() const;
+
+	// Run every part of a job and return once all of them are done
+	void run(FanoutTask task, void* context);
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FILTERCOMMAND_HPP
+# define FILTERCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class FilterCommand : public CommandHandler
+{
+public:
+	FilterCommand();
+	virtual ~FilterCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef HISTORY_HPP
+# define HISTORY_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+# include "SharedBuffer.hpp"
+
+// Most messages one CHATHISTORY request returns (advertised in 005)
+static const size_t CHATHISTORY_MAX_LIMIT = 100;
+
+// One channel message kept for CHATHISTORY. The line is the very buffer
+// that was broadcast, tags are added only when it is replayed.
+struct HistoryEntry
+{
+	SharedBuffer line; // ":nick!user@host PRIVMSG #chan :text\r\n" (or NOTICE)
+	std::string msgid;
+	long long timeMs; // server time, ms since the epoch
+	unsigned long long seq; // server-wide order, oldest first
+
+	HistoryEntry();
+};
+
+// Fixed-capacity ring of a channel's most recent messages, bounded by line
+// count and by payload bytes; the oldest entries go first. Indexes passed
+// to at() run from 0 (oldest) to size() - 1 (newest).
+class ChannelHistory
+{
+private:
+	std::vector<HistoryEntry> _ring; // allocated on the first message
+	size_t _capacity;
+	size_t _head; // oldest entry
+	size_t _count;
+	size_t _bytes;
+	size_t _maxBytes;
+
+	// Orthodox Canonical Form
+	ChannelHistory(const ChannelHistory& other);
+	ChannelHistory& operator=(const ChannelHistory& other);
+
+public:
+	ChannelHistory();
+	~ChannelHistory();
+
+	void configure(size_t maxLines, size_t maxBytes); // 0 lines disables history
+	bool isEnabled() const;
+	void push(const HistoryEntry& entry);
+	void popOldest();
+	void clear();
+
+	size_t size() const;
+	bool empty() const;
+	size_t getBytes() const; // payload bytes held
+	const HistoryEntry& at(size_t index) const;
+	const HistoryEntry& oldest() const;
+	const HistoryEntry& newest() const;
+
+	// Positions for pagination: first entry at or after timeMs, first entry
+	// after timeMs, and the entry with msgid (size() when absent)
+	size_t lowerBound(long long timeMs) const;
+	size_t upperBound(long long timeMs) const;
+	size_t find(const std::string& msgid) const;
+};
+
+// Wall clock in ms, and its IRCv3 server-time form "2024-01-31T12:00:00.000Z"
+long long historyNowMs();
+std::string formatHistoryTime(long long timeMs);
+bool parseHistoryTime(const std::string& text, long long& timeMs);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef IOBACKEND_HPP
+# define IOBACKEND_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <cstddef>
+# include <poll.h>
+# include <sys/epoll.h>
+# include <sys/uio.h>
+# include "SharedBuffer.hpp"
+
+// How the event loop waits for its sockets. Readiness backends (poll,
+// epoll) report what a descriptor is ready for and leave the syscalls to
+// the server. Completion backends (io_uring, see IoUring.hpp) may accept,
+// read and send themselves and report the results, so the server asks
+// which it got through the flags and canSend().
+
+// How a descriptor is watched
+enum IoWatchFlags
+{
+	IO_LISTENER = 1 << 0, // may be accepted from by the backend (IO_ACCEPTED)
+	IO_RECEIVE = 1 << 1 // may be read by the backend (IO_RECEIVED)
+};
+
+enum IoEventType
+{
+	IO_READY, // revents: POLLIN, POLLOUT, POLLHUP, POLLERR
+	IO_ACCEPTED, // result: the accepted socket, or -errno
+	IO_RECEIVED, // data/length: bytes read, length 0 at end of stream; result: -errno on error
+	IO_SENT, // result: bytes sent, or -errno
+	IO_DISCARDED // its descriptor was removed while the batch was being handled
+};
+
+// One event from wait(). Received data stays valid until the next wait().
+struct IoEvent
+{
+	int fd;
+	IoEventType type;
+	short revents;
+	int result;
+	const char* data;
+	size_t length;
+
+	IoEvent();
+};
+
+class IoBackend
+{
+private:
+	std::map<int, short> _watched; // descriptor -> poll events wanted
+	std::vector<IoEvent>* _batch; // events returned by the last wait()
+
+	// Orthodox Canonical Form
+	IoBackend(const IoBackend& other);
+	IoBackend& operator=(const IoBackend& other);
+
+protected:
+	void startBatch(std::vector<IoEvent>& events);
+
+public:
+	IoBackend();
+	virtual ~IoBackend();
+
+	virtual const char* getName() const = 0;
+
+	// Interest in POLLIN/POLLOUT; flags are IoWatchFlags
+	virtual void add(int fd, short events, unsigned int flags);
+	virtual void modify(int fd, short events);
+	virtual void remove(int fd); // before the descriptor is closed
+
+	// Wait up to timeoutMs; returns the number of events, or -1 with errno
+	virtual int wait(int timeoutMs, std::vector<IoEvent>& events) = 0;
+
+	// Completion sends: queued by send(), submitted with the next wait().
+	// The backend keeps hold alive until the IO_SENT event.
+	virtual bool canSend() const;
+	virtual bool isSending(int fd) const;
+	virtual void send(int fd, const struct iovec* iov, size_t count, const std::vector<SharedBuffer>& hold);
+
+	// Upgrade handover: stop reading and finish sends, returning the last
+	// events; resume() if the handover fails
+	virtual void suspend(std::vector<IoEvent>& events);
+	virtual void resume();
+
+	bool isWatched(int fd) const;
+	short getEvents(int fd) const;
+	const std::map<int, short>& getWatched() const;
+};
+
+// poll(2) over a pollfd array
+class PollBackend : public IoBackend
+{
+private:
+	std::vector<struct pollfd> _pollfds;
+
+public:
+	PollBackend();
+	virtual ~PollBackend();
+
+	virtual const char* getName() const;
+	virtual void add(int fd, short events, unsigned int flags);
+	virtual void modify(int fd, short events);
+	virtual void remove(int fd);
+	virtual int wait(int timeoutMs, std::vector<IoEvent>& events);
+};
+
+// Level-triggered epoll(7)
+class EpollBackend : public IoBackend
+{
+private:
+	int _epollFd;
+	std::vector<struct epoll_event> _ready;
+
+public:
+	EpollBackend();
+	virtual ~EpollBackend();
+
+	bool init(std::string& error);
+	virtual const char* getName() const;
+	virtual void add(int fd, short events, unsigned int flags);
+	virtual void modify(int fd, short events);
+	virtual void remove(int fd);
+	virtual int wait(int timeoutMs, std::vector<IoEvent>& events);
+};
+
+// By name: poll, epoll, io_uring, or auto for the first of io_uring, epoll
+// and poll that works here. NULL with error set if the one asked for does
+// not work.
+IoBackend* createIoBackend(const std::string& name, size_t receiveBuffers, std::string& error);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef IOURING_HPP
+# define IOURING_HPP
+
+# include <map>
+# include <vector>
+# include <ctime>
+# include <sys/socket.h>
+# include <linux/io_uring.h>
+# include "IoBackend.hpp"
+
+// io_uring(7) completion backend, driven through the raw syscalls:
+// - listeners get one multishot accept each,
+// - IO_RECEIVE sockets one multishot recv picking buffers from a provided
+//   buffer ring, handed back to the ring at the next wait(),
+// - whatever else is wanted (POLLOUT, readiness-only sockets such as TLS)
+//   a oneshot poll, re-armed at the next wait(),
+// - sends are queued by send() and submitted together with the wait, so a
+//   loop iteration costs one io_uring_enter() however busy it was.
+// Needs Linux 6.0 for multishot recv; init() fails on older kernels.
+
+// Size of each provided receive buffer
+static const size_t URING_BUFFER_SIZE = 4096;
+// Submission queue entries; the completion queue gets URING_CQ_FACTOR times that
+static const unsigned int URING_SQ_ENTRIES = 256;
+static const unsigned int URING_CQ_FACTOR = 16;
+// A send still in flight when its socket is removed gets this long to finish
+static const time_t URING_ORPHAN_SECONDS = 5;
+
+class UringBackend : public IoBackend
+{
+private:
+	// One sendmsg() in flight; the kernel reads msg, iov and the held
+	// buffers until its completion
+	struct Send
+	{
+		int fd;
+		struct msghdr msg;
+		std::vector<struct iovec> iov;
+		std::vector<SharedBuffer> hold;
+		time_t deadline; // set once its socket is removed
+	};
+
+	// Operations in flight on one descriptor, by user_data (0 if none)
+	struct Watch
+	{
+		unsigned int flags;
+		unsigned long long readData; // multishot accept or recv
+		unsigned long long pollData;
+		unsigned long long sendData;
+		short pollEvents; // what the armed poll waits for
+
+		Watch();
+	};
+
+	size_t _bufferCount;
+	int _ringFd;
+	void* _ring;
+	size_t _ringSize;
+	struct io_uring_sqe* _sqes;
+	size_t _sqesSize;
+	unsigned int* _sqHead;
+	unsigned int* _sqTail;
+	unsigned int* _sqArray;
+	unsigned int _sqMask;
+	unsigned int _sqEntries;
+	unsigned int _sqLocalTail; // published to *_sqTail on submit
+	unsigned int* _cqHead;
+	unsigned int* _cqTail;
+	unsigned int _cqMask;
+	struct io_uring_cqe* _cqes;
+	struct io_uring_buf* _bufRing;
+	size_t _bufRingSize;
+	char* _buffers;
+	unsigned short _bufTail;
+	std::vector<unsigned short> _recycle; // handed out by the last wait()
+	std::map<int, Watch> _fds;
+	std::map<unsigned long long, Send*> _sends;
+	size_t _orphans; // sends whose socket is gone
+	std::vector<int> _rearm; // descriptors whose operations ended
+	unsigned long long _seq;
+	bool _suspended;
+
+	// Orthodox Canonical Form
+	UringBackend(const UringBackend& other);
+	UringBackend& operator=(const UringBackend& other);
+
+	bool setupRing(std::string& error);
+	bool setupBuffers(std::string& error);
+	struct io_uring_sqe* getSqe();
+	unsigned long long nextData(int fd, unsigned int op);
+	int enter(bool getEvents, int timeoutMs);
+	void provideBuffer(unsigned short id);
+	void recycleBuffers();
+	void arm(int fd);
+	void cancel(unsigned long long data);
+	void cancelOverdue();
+	void reap(std::vector<IoEvent>& events);
+	void complete(const struct io_uring_cqe& cqe, std::vector<IoEvent>& events);
+	bool isQuiet() const;
+
+public:
+	explicit UringBackend(size_t bufferCount);
+	virtual ~UringBackend();
+
+	bool init(std::string& error);
+	virtual const char* getName() const;
+	virtual void add(int fd, short events, unsigned int flags);
+	virtual void modify(int fd, short events);
+	virtual void remove(int fd);
+	virtual int wait(int timeoutMs, std::vector<IoEvent>& events);
+
+	virtual bool canSend() const;
+	virtual bool isSending(int fd) const;
+	virtual void send(int fd, const struct iovec* iov, size_t count, const std::vector<SharedBuffer>& hold);
+
+	virtual void suspend(std::vector<IoEvent>& events);
+	virtual void resume();
+};
+
+#endif
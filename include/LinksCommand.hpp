@@ -0,0 +1,14 @@
+#ifndef LINKSCOMMAND_HPP
+# define LINKSCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class LinksCommand : public CommandHandler
+{
+public:
+	LinksCommand();
+	virtual ~LinksCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef LOGGER_HPP
+# define LOGGER_HPP
+
+# include <string>
+# include <sstream>
+# include <cstddef>
+# include <pthread.h>
+
+enum LogLevel
+{
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARN,
+	LOG_ERROR
+};
+
+enum LogCategory
+{
+	LOG_SERVER,
+	LOG_NET,
+	LOG_CMD,
+	LOG_CHAN,
+	LOG_CATEGORY_COUNT
+};
+
+// Asynchronous logger. Producers copy each record into a bounded lock-free
+// ring (Vyukov MPMC sequence scheme, used here with a single consumer) and
+// never block: when the ring is full the record is dropped and counted.
+// A background thread drains the ring and does the actual writes.
+class Logger
+{
+public:
+	static const size_t CAPACITY = 4096; // power of two
+	static const size_t MAX_TEXT = 224;
+
+private:
+	struct Record
+	{
+		size_t sequence;
+		LogLevel level;
+		LogCategory category;
+		long long timestampUs; // wall clock
+		size_t length;
+		char text[MAX_TEXT];
+	};
+
+	Record* _ring;
+	size_t _enqueuePos; // shared by producers
+	size_t _dequeuePos; // owned by the drain thread
+	unsigned long long _dropped;
+	LogLevel _level;
+	unsigned int _categoryMask;
+	bool _running;
+	bool _threadStarted;
+	pthread_t _thread;
+
+	// Orthodox Canonical Form
+	Logger();
+	Logger(const Logger& other);
+	Logger& operator=(const Logger& other);
+
+	static void* drainThread(void* arg);
+	bool drainBatch();
+
+public:
+	~Logger();
+
+	static Logger& instance();
+	static bool parseLevel(const std::string& name, LogLevel& level);
+	static bool parseCategory(const std::string& name, LogCategory& category);
+	static const char* levelName(LogLevel level);
+	static const char* categoryName(LogCategory category);
+
+	void start();
+	void stop(); // drains remaining records and joins the thread
+
+	void setLevel(LogLevel level);
+	void setCategoryMask(unsigned int mask);
+	bool isEnabled(LogLevel level, LogCategory category) const;
+	void log(LogLevel level, LogCategory category, const std::string& text);
+	unsigned long long getDropped() const;
+};
+
+// Stream-style logging that formats nothing when the record is filtered out:
+//   LOG(LOG_INFO, LOG_NET, "New client connected: fd " << fd);
+# define LOG(level, category, expr) \
+	do \
+	{ \
+		if (Logger::instance().isEnabled(level, category)) \
+		{ \
+			std::ostringstream logStream_; \
+			logStream_ << expr; \
+			Logger::instance().log(level, category, logStream_.str()); \
+		} \
+	} while (0)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef LOOPTRACECOMMAND_HPP
+# define LOOPTRACECOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class LooptraceCommand : public CommandHandler
+{
+public:
+	LooptraceCommand();
+	virtual ~LooptraceCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
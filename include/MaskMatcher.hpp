@@ -0,0 +1,63 @@
+#ifndef MASKMATCHER_HPP
+# define MASKMATCHER_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <ctime>
+# include <cstddef>
+
+// A channel's ban (+b), exception (+e) or invite exception (+I) list.
+// Masks are nick!user@host globs with '*' and '?'. Instead of trying every
+// mask on every check, each one is filed under the literal text it must
+// end with (the last few characters of a host, usually) or else the text it
+// must start with; a subject only tries the masks filed under its own last
+// and first characters, plus the few that have neither.
+
+struct MaskEntry
+{
+	std::string mask;
+	std::string setBy;
+	time_t setAt;
+
+	MaskEntry();
+};
+
+class MaskMatcher
+{
+private:
+	static const size_t KEY_LENGTH = 3; // literal characters a bucket is keyed on
+
+	std::vector<MaskEntry> _entries;
+	std::vector<std::string> _patterns; // lowercased masks, same order
+	std::map<std::string, std::vector<size_t> > _bySuffix;
+	std::map<std::string, std::vector<size_t> > _byPrefix;
+	std::vector<size_t> _unindexed;
+
+	void index(size_t entry);
+	void rebuild();
+	bool tryBucket(const std::map<std::string, std::vector<size_t> >& buckets, const std::string& key,
+		const std::string& subject) const;
+
+public:
+	MaskMatcher();
+	MaskMatcher(const MaskMatcher& other);
+	MaskMatcher& operator=(const MaskMatcher& other);
+	~MaskMatcher();
+
+	// "nick" -> "nick!*@*", "host.name" -> "*!*@host.name" and so on
+	static std::string normalize(const std::string& mask);
+	static std::string toLower(const std::string& str);
+	static bool glob(const std::string& pattern, const std::string& subject);
+
+	bool add(const std::string& mask, const std::string& setBy, time_t setAt); // false if already listed
+	bool remove(const std::string& mask); // false if not listed
+	void clear();
+	bool matches(const std::string& subject) const; // lowercased nick!user@host
+	const std::vector<MaskEntry>& getEntries() const;
+	size_t size() const;
+	bool empty() const;
+	size_t getBytes() const;
+};
+
+#endif
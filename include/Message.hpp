@@ -3,10 +3,29 @@
 
 # include <string>
 # include <vector>
+# include <cstddef>
+
+// Longest line without tags, CRLF included, and longest tag section
+// ("@" through the space before the rest of the line)
+static const size_t MAX_LINE_LENGTH = 512;
+static const size_t MAX_TAGS_LENGTH = 8191;
+// Client-only tags a client may have relayed, leaving room for ours
+static const size_t MAX_CLIENT_TAGS_LENGTH = 4094;
+
+// One IRCv3 message tag, as offsets into the raw line
+struct TagSpan
+{
+	size_t keyStart;
+	size_t keyLength;
+	size_t valueStart;
+	size_t valueLength;
+};
 
 class Message
 {
 private:
+	std::vector<TagSpan> _tags; // values still escaped
+	size_t _tagsLength;
 	std::string _prefix;
 	std::string _command;
 	std::vector<std::string> _params;
@@ -17,8 +36,10 @@ private:
 	Message(const Message& other);
 	Message& operator=(const Message& other);
 
-	// Private parsing method
+	// Private parsing methods
 	void parse();
+	size_t parseTags();
+	const TagSpan* findTag(const std::string& key) const;
 
 public:
 	Message(const std::string& raw);
@@ -30,6 +51,14 @@ public:
 	std::string getPrefix() const;
 	std::string getParam(size_t index) const;
 	size_t getParamCount() const;
+	const std::string& getRaw() const; // the line as received
+
+	// Message tags
+	size_t getTagCount() const;
+	bool hasTag(const std::string& key) const;
+	std::string getTagValue(const std::string& key) const; // unescaped
+	std::string getClientTags() const; // "+key=value;..." as received
+	bool hasTooLongTags() const;
 };
 
 #endif
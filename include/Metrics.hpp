@@ -0,0 +1,144 @@
+#ifndef METRICS_HPP
+# define METRICS_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <sstream>
+
+// Power-of-two bucketed histogram: bucket i counts values below 2^i.
+// Recording is a handful of integer ops, cheap enough for the event loop.
+class Histogram
+{
+public:
+	static const int BUCKETS = 64;
+
+private:
+	unsigned long long _buckets[BUCKETS];
+	unsigned long long _count;
+	unsigned long long _sum;
+	unsigned long long _max;
+
+public:
+	Histogram();
+
+	void record(unsigned long long value);
+	void reset();
+
+	unsigned long long getCount() const;
+	unsigned long long getSum() const;
+	unsigned long long getMax() const;
+	unsigned long long getBucket(int index) const;
+	unsigned long long percentile(double fraction) const; // upper bound of the bucket
+
+	static int bucketFor(unsigned long long value);
+	static unsigned long long bucketUpperBound(int index);
+};
+
+struct CommandStats
+{
+	unsigned long long count;
+	Histogram latencyNs;
+
+	CommandStats();
+};
+
+// Approximate heap bytes held by clients and channels, by category.
+// Containers are costed by element count, strings by their heap capacity.
+struct MemoryUsage
+{
+	// Red-black tree node header (color + parent/left/right) on top of the value
+	static const size_t MAP_NODE_OVERHEAD = 4 * sizeof(void*);
+
+	size_t recvBuffers;
+	size_t sendBuffers;
+	size_t clientIdentity; // Client objects and their nick/user/real/host strings
+	size_t channelMembers; // member and operator tables
+	size_t channelInvites; // invite tables and b/e/I lists
+	size_t channelStrings; // Channel objects and their name/topic/key
+	size_t channelHistory; // CHATHISTORY entries and their payloads
+
+	MemoryUsage();
+	void add(const MemoryUsage& other);
+	void raiseTo(const MemoryUsage& other); // per-field maximum, for high-water marks
+	size_t clientTotal() const;
+	size_t channelTotal() const;
+
+	static size_t stringBytes(const std::string& str); // heap part only
+};
+
+// Gauges owned by the Server, passed in when metrics are rendered
+struct MetricsGauges
+{
+	size_t clients;
+	size_t registeredClients;
+	size_t channels;
+	unsigned long long uptimeSeconds;
+	MemoryUsage memory;
+	MemoryUsage memoryPeak;
+
+	MetricsGauges();
+};
+
+class Metrics
+{
+private:
+	std::map<std::string, CommandStats> _commands;
+	unsigned long long _bytesIn;
+	unsigned long long _bytesOut;
+	unsigned long long _messagesFannedOut;
+	unsigned long long _connectionsAccepted;
+	unsigned long long _connectionsClosed;
+	unsigned long long _ioSyscalls;
+	unsigned long long _spinHits; // spins that found work before blocking
+	unsigned long long _spinMisses;
+	unsigned long long _sentZeroCopy; // sendmsg bytes the kernel sent from our buffers
+	unsigned long long _sentCopied; // sendmsg bytes the kernel copied
+	Histogram _sendqDepth;
+	Histogram _pollIterationNs;
+
+	// Orthodox Canonical Form
+	Metrics();
+	Metrics(const Metrics& other);
+	Metrics& operator=(const Metrics& other);
+
+public:
+	~Metrics();
+
+	static Metrics& instance();
+	static unsigned long long nowNs(); // monotonic clock
+
+	// Recording
+	void recordCommand(const std::string& command, unsigned long long latencyNs);
+	void addBytesIn(size_t bytes); // also from pipeline I/O threads, like addBytesOut and addIoSyscall
+	void addBytesOut(size_t bytes);
+	void addFanOut(size_t recipients);
+	void addConnectionAccepted();
+	void addConnectionClosed();
+	void addIoSyscall(); // event loop waits, accepts, reads and writes
+	void recordLoopSpin(bool hit);
+	void addSentBytes(size_t bytes, bool zeroCopy); // event loop sendmsg; zero-copy ones once completed
+	void recordSendqDepth(size_t bytes);
+	void recordPollIteration(unsigned long long ns);
+
+	// Getters
+	const std::map<std::string, CommandStats>& getCommands() const;
+	unsigned long long getBytesIn() const;
+	unsigned long long getBytesOut() const;
+	unsigned long long getMessagesFannedOut() const;
+	unsigned long long getConnectionsAccepted() const;
+	unsigned long long getConnectionsClosed() const;
+	unsigned long long getIoSyscalls() const;
+	unsigned long long getSpinHits() const;
+	unsigned long long getSpinMisses() const;
+	unsigned long long getSentZeroCopy() const;
+	unsigned long long getSentCopied() const;
+	const Histogram& getSendqDepth() const;
+	const Histogram& getPollIterationNs() const;
+
+	// Rendering
+	void renderSummary(const MetricsGauges& gauges, std::vector<std::string>& lines) const;
+	void renderPrometheus(const MetricsGauges& gauges, std::ostringstream& out) const;
+};
+
+#endif
@@ -5,10 +5,12 @@
 # include <string>
 # include <vector>
 
+class Channel;
+
 struct ModeChange
 {
 	char sign; // '+' or '-'
-	char mode; // 'i', 't', 'k', 'o', 'l'
+	char mode; // 'i', 't', 'k', 'o', 'l', 'b', 'e', 'I'
 	std::string param; // empty if no param needed
 };
 
@@ -16,6 +18,8 @@ class ModeCommand : public CommandHandler
 {
 private:
 	std::vector<ModeChange> parseModeString(const std::string& modeStr, const std::vector<std::string>& params);
+	static bool isListMode(char mode);
+	void sendMaskList(Server& server, Client& client, const Channel& channel, char mode);
 
 public:
 	ModeCommand();
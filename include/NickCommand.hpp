@@ -0,0 +1,14 @@
+#ifndef NICKCOMMAND_HPP
+# define NICKCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class NickCommand : public CommandHandler
+{
+public:
+	NickCommand();
+	virtual ~NickCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
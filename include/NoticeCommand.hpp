@@ -0,0 +1,14 @@
+#ifndef NOTICECOMMAND_HPP
+# define NOTICECOMMAND_HPP
+
+# include "PrivmsgCommand.hpp"
+
+// PRIVMSG delivery without error replies
+class NoticeCommand : public PrivmsgCommand
+{
+public:
+	NoticeCommand();
+	virtual ~NoticeCommand();
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef OPERCOMMAND_HPP
+# define OPERCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class OperCommand : public CommandHandler
+{
+public:
+	OperCommand();
+	virtual ~OperCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+	static void finish(Server& server, Client& client, const std::string& name, bool matched);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef OUTBOUNDMESSAGE_HPP
+# define OUTBOUNDMESSAGE_HPP
+
+# include <string>
+# include <cstddef>
+# include "SharedBuffer.hpp"
+# include "Client.hpp"
+
+// Capability bits that change how a message is tagged; each combination is
+// one variant
+static const unsigned int OUTBOUND_TAG_CAPS = CAP_MESSAGE_TAGS | CAP_SERVER_TIME;
+static const size_t OUTBOUND_VARIANTS = OUTBOUND_TAG_CAPS + 1;
+
+// A PRIVMSG/NOTICE as each recipient gets it. The untagged line is rendered
+// by the sender; a tagged variant ("@time=...;msgid=... " + line) is built
+// the first time a recipient with that combination of capabilities needs
+// it, then shared by every other such recipient.
+class OutboundMessage
+{
+private:
+	SharedBuffer _line;
+	std::string _clientTags; // "+key=value;..." from the sender
+	std::string _msgid;
+	long long _timeMs;
+	unsigned long long _seq;
+	SharedBuffer _variants[OUTBOUND_VARIANTS];
+
+	// Orthodox Canonical Form
+	OutboundMessage();
+	OutboundMessage(const OutboundMessage& other);
+	OutboundMessage& operator=(const OutboundMessage& other);
+
+public:
+	OutboundMessage(const SharedBuffer& line, const std::string& clientTags);
+	~OutboundMessage();
+
+	void stamp(const std::string& msgid, long long timeMs, unsigned long long seq);
+	const SharedBuffer& getLine() const;
+	const std::string& getMsgid() const;
+	long long getTimeMs() const;
+	unsigned long long getSeq() const;
+
+	// The line for a recipient with these Capability bits
+	const SharedBuffer& render(unsigned int capabilities);
+};
+
+#endif
@@ -9,6 +9,7 @@ public:
 	PassCommand();
 	virtual ~PassCommand();
 	virtual void execute(Server& server, Client& client, const Message& msg);
+	static void finish(Server& server, Client& client, bool matched);
 };
 
 #endif
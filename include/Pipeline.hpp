@@ -0,0 +1,179 @@
+#ifndef PIPELINE_HPP
+# define PIPELINE_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <map>
+# include <cstddef>
+# include <pthread.h>
+# include "SharedBuffer.hpp"
+# include "SpscRing.hpp"
+# include "IoBackend.hpp"
+
+class Client;
+class Message;
+
+// Split-stage mode ("pipeline threads=<n>"): I/O threads own plain IRC
+// sockets, read them, frame and parse the lines, and write the output.
+// The event loop thread keeps all channel and nick state and only runs
+// the commands. Each I/O thread talks to it over a pair of SPSC rings:
+// parsed messages one way, output and close requests the other. A side
+// that is about to block says so, and only then does the other wake it
+// through an eventfd, so a busy pipeline makes no wakeup syscalls.
+
+// I/O thread -> event loop: a parsed line, or (message NULL) a hangup
+struct PipeInput
+{
+	int fd;
+	unsigned long long id; // connection, tells a reused descriptor apart
+	Message* message; // owned by whoever pops it
+
+	PipeInput();
+};
+
+enum PipeOutputType
+{
+	PIPE_ADOPT, // take the socket over; data holds input read so far
+	PIPE_SEND,
+	PIPE_CLOSE, // write what is queued if it can, then close
+	PIPE_STOP
+};
+
+// Event loop -> I/O thread
+struct PipeOutput
+{
+	PipeOutputType type;
+	int fd;
+	unsigned long long id;
+	SharedBuffer data;
+	size_t sendq; // PIPE_ADOPT: queued bytes allowed before a hangup
+
+	PipeOutput();
+};
+
+// A connection handed back by stop()
+struct PipeReclaim
+{
+	int fd;
+	unsigned long long id;
+	std::string input; // an unfinished line
+	std::vector<SharedBuffer> output; // not written yet
+
+	PipeReclaim();
+};
+
+class PipelineWorker
+{
+private:
+	// The I/O side of a connection is a bare Client: its receive buffer
+	// frames the lines and its send queue holds the output
+	struct Connection
+	{
+		unsigned long long id;
+		Client* io;
+		size_t sendq;
+		bool hungUp; // reported, waiting for PIPE_CLOSE
+	};
+
+	SpscRing<PipeInput> _input;
+	SpscRing<PipeOutput> _output;
+	std::deque<PipeInput> _inputBacklog; // did not fit in the ring
+	int _wakeFd; // written by the event loop while we sleep
+	int _sleeping;
+	int _spaceWanted; // the event loop has output waiting for ring space
+	int _loopWakeFd;
+	int* _loopSleeping;
+	IoBackend* _io;
+	std::vector<IoEvent> _ioEvents; // outlives the thread: the backend points at it
+	std::map<int, Connection> _connections;
+	pthread_t _thread;
+	bool _started;
+
+	// Orthodox Canonical Form
+	PipelineWorker(const PipelineWorker& other);
+	PipelineWorker& operator=(const PipelineWorker& other);
+
+	static void* workerThread(void* arg);
+	void run();
+	bool applyOutput(std::vector<int>& touched);
+	void readConnection(int fd, Connection& connection);
+	void frame(int fd, Connection& connection);
+	void writeConnection(int fd, Connection& connection);
+	void hangUp(int fd, Connection& connection);
+	void pushInput(const PipeInput& input);
+	bool flushInput();
+
+public:
+	PipelineWorker(size_t ringSize, int loopWakeFd, int* loopSleeping);
+	~PipelineWorker();
+
+	bool start(std::string& error);
+	void join();
+
+	// Event loop side
+	bool post(const PipeOutput& output);
+	bool receive(PipeInput& input);
+	bool hasInput() const;
+	void wake();
+	void wantSpace(); // wake the event loop once the output ring is drained
+
+	// Once joined
+	void collect(std::vector<PipeInput>& inputs);
+	void reclaim(std::vector<PipeReclaim>& connections);
+};
+
+class Pipeline
+{
+private:
+	struct Route
+	{
+		size_t worker;
+		unsigned long long id;
+	};
+
+	std::vector<PipelineWorker*> _workers;
+	std::vector<std::deque<PipeOutput> > _backlogs; // output waiting for ring space
+	std::vector<bool> _posted; // since the last flush()
+	std::vector<size_t> _load; // connections per worker
+	std::map<int, Route> _routes;
+	unsigned long long _nextId;
+	int _wakeFd;
+	int _sleeping;
+	bool _stopped;
+
+	// Orthodox Canonical Form
+	Pipeline(const Pipeline& other);
+	Pipeline& operator=(const Pipeline& other);
+
+	void post(size_t worker, const PipeOutput& output);
+
+public:
+	Pipeline();
+	~Pipeline();
+
+	bool start(size_t threads, size_t ringSize, std::string& error);
+	int getWakeFd() const;
+	void clearWakeup();
+
+	bool owns(int fd) const;
+	void adopt(int fd, size_t sendq, const std::string& input);
+	void send(Client& client); // moves its queued output
+	void close(int fd);
+	void flush(); // hand posted output over and wake whoever needs it
+
+	// Parsed lines and hangups from every connection still ours
+	void receive(std::vector<PipeInput>& inputs);
+	bool hasInput() const;
+	bool hasBacklog() const; // output still waiting for ring space
+	bool sleep(); // false if input is already waiting
+	void awake();
+
+	// Finish the output posted so far and join the threads. Lines still in
+	// flight come back through inputs, to be run first; the connections
+	// through reclaim(), once no longer owned.
+	void stop(std::vector<PipeInput>& inputs);
+	void reclaim(std::vector<PipeReclaim>& connections);
+};
+
+#endif
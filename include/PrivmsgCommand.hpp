@@ -2,9 +2,21 @@
 # define PRIVMSGCOMMAND_HPP
 
 # include "CommandHandler.hpp"
+# include <string>
+# include <cstddef>
+
+// Most targets one local PRIVMSG/NOTICE may name (advertised as TARGMAX)
+static const size_t MAX_MESSAGE_TARGETS = 4;
 
 class PrivmsgCommand : public CommandHandler
 {
+private:
+	std::string _command; // "PRIVMSG" or "NOTICE"
+	bool _replies; // NOTICE never triggers error replies
+
+protected:
+	PrivmsgCommand(const std::string& command, bool replies);
+
 public:
 	PrivmsgCommand();
 	virtual ~PrivmsgCommand();
@@ -12,4 +24,3 @@ public:
 };
 
 #endif
-
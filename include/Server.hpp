@@ -5,24 +5,85 @@
 # include <poll.h>
 # include <vector>
 # include <map>
+# include <set>
 # include <string>
+# include <ctime>
+# include "Config.hpp"
+# include "Metrics.hpp"
+# include "Capture.hpp"
+# include "Snapshot.hpp"
+# include "SharedBuffer.hpp"
+# include "Tls.hpp"
+# include "IoBackend.hpp"
+# include "AuthPool.hpp"
+# include "SpamFilter.hpp"
+# include "Pipeline.hpp"
+# include "ZeroCopy.hpp"
 
 class Client;
 class CommandHandler;
 class Message;
 class Channel;
+class OutboundMessage;
+class UpgradeWriter;
+class UpgradeReader;
+
+struct Listener
+{
+	int fd;
+	ListenerConfig config;
+	ConnectionClass* connClass;
+};
+
+// Another server on the network, reached through one of our direct links
+struct RemoteServer
+{
+	std::string name;
+	std::string uplink; // server that introduced it
+	int hops;
+	Client* link;
+};
 
 class Server
 {
 private:
 	int _port;
 	std::string _password;
-	int _serverSocket;
-	std::vector<struct pollfd> _pollfds;
+	Config _config;
+	std::map<int, Listener> _listeners; // listening fd -> listener
+	std::map<std::string, ConnectionClass> _classes;
+	IoBackend* _io; // how the event loop waits (see IoBackend.hpp)
+	std::vector<IoEvent> _ioEvents;
+	int _busyPoll; // SO_BUSY_POLL for accepted sockets, cleared if refused
+	ZeroCopy _zeroCopy; // MSG_ZEROCOPY sends waiting for their completions
+	unsigned long long _spinNs; // current spin budget, adapted to traffic
 	std::map<int, Client*> _clients;
+	std::map<std::string, Client*> _nicknames; // lowercased nick -> client, local and remote
 	std::map<std::string, CommandHandler*> _commandHandlers;
 	std::map<std::string, Channel*> _channels;
 	bool _isRunning;
+	time_t _startTime;
+	CaptureWriter _capture;
+	ChannelSnapshot _snapshot; // channel state kept across restarts
+	TlsContext _tls; // set up when a listener uses TLS
+	AuthPool _auth; // checks password hashes off the event loop
+	SpamFilter _filter; // FILTER phrases, compiled off the event loop
+	Pipeline* _pipeline; // I/O threads in split-stage mode, NULL otherwise
+	MemoryUsage _memoryPeak;
+	time_t _lastMemorySample;
+	std::string _serverName;
+	std::map<std::string, Client*> _links; // established direct links by server name
+	std::map<std::string, RemoteServer> _servers; // every other server on the network
+	int _nextRemoteFd; // remote users get negative pseudo fds
+	std::string _execPath; // binary to exec on UPGRADE
+	std::vector<std::string> _execArgs;
+	bool _upgradeRequested;
+	std::string _upgradeRequester; // nick to notify of the outcome
+	bool _handedOver; // state now belongs to the upgraded process
+	int _resumeSocket; // handover socket, acknowledged once we serve
+	std::set<std::pair<unsigned long long, Channel*> > _historyOldest; // each channel's oldest entry
+	size_t _historyBytes; // across all channels, capped by history total=
+	unsigned long long _messageSeq; // msgids and history order
 
 	// Orthodox Canonical Form
 	Server();
@@ -30,36 +91,149 @@ private:
 	Server& operator=(const Server& other);
 
 	// Private helper methods
-	void setupSocket();
-	void handleNewConnection();
+	void setupListeners();
+	int openListener(const ListenerConfig& config);
+	void closeListeners();
+	void pinEventLoop();
+	int waitForEvents();
+	int blockForEvents();
+	void handleIoEvent(const IoEvent& event);
+	void handleNewConnection(Listener& listener);
+	void acceptConnection(Listener& listener, int clientFd, const struct sockaddr_storage& peerAddr);
 	void handleClientMessage(int clientFd);
+	void handleMetricsRequest(Client& client);
 	void registerCommands();
 	void sendToClient(Client& client);
+	void sampleMemory();
+	void saveSnapshot();
+	void applySnapshot(Channel& channel, const SavedChannel& saved);
+	void dropClient(int clientFd, const std::string& reason, bool propagateQuit);
+	bool runMessages(Client& client);
+	bool runMessage(Client& client, const Message& msg);
+	void finishAuth(Client& client, AuthKind kind, const std::string& name, bool matched);
+	void setPollEvents(int fd, short events);
+
+	// Server linking (ServerLink.cpp)
+	void handleLinkConnect(int fd);
+	void handleLinkMessage(Client& link, const Message& msg);
+	void handleLinkLoss(Client& link, const std::string& reason);
+	void introduceServer(Client& link, const Message& msg);
+	void introduceRemoteUser(Client& link, const Message& msg);
+	void changeRemoteNick(Client& link, Client& user, const Message& msg);
+	void applySjoin(Client& link, const Message& msg);
+	void applyServerTopic(Client& link, const Message& msg);
+	void applyBmask(Client& link, const Message& msg);
+	void applyKill(Client& link, const Message& msg);
+	void applySquit(Client& link, const Message& msg);
+	void splitServers(const std::set<std::string>& names, const std::string& reason);
+	void killClient(Client& client, const std::string& reason, Client* skipLink);
+	void sendBurst(Client& link);
+	std::string userIntroduction(const Client& client) const;
+	std::vector<std::string> channelBurst(const Channel& channel, const Client* skipLink) const;
+	std::vector<std::string> maskBurst(const Channel& channel) const;
+
+	// Hot upgrade (ServerUpgrade.cpp)
+	bool performUpgrade(std::string& error);
+	void saveState(UpgradeWriter& writer) const;
+	bool restoreState(UpgradeReader& reader, std::string& error);
+	void finishResume();
+
+	// TLS listeners (ServerTls.cpp)
+	void setupTls();
+	void startTls(Client& client);
+	bool advanceTlsHandshake(Client& client);
+	void handleTlsInput(Client& client);
+	void sendTls(Client& client);
+	void closeTlsClients(const std::string& reason);
+
+	// WebSocket listeners (ServerWebSocket.cpp)
+	bool receiveWebSocket(Client& client, const char* data, size_t length);
+	void closeWebSocket(Client& client);
+
+	// Split-stage pipeline (ServerPipeline.cpp)
+	bool startPipeline(std::string& error);
+	void stopPipeline();
+	bool canPipeline(const Client& client) const;
+	void pipelineClient(Client& client);
+	void runPipeline();
+	void runPipeInputs(std::vector<PipeInput>& inputs);
+
+	// Channel history (ServerHistory.cpp)
+	void unlinkHistory(Channel& channel);
+	void linkHistory(Channel& channel);
 
 public:
-	Server(int port, const std::string& password);
+	Server(int port, const std::string& password, const Config& config = Config());
 	~Server();
 
 	void start();
 	void stop();
+
+	// Hot upgrade
+	void setCommandLine(int argc, char** argv);
+	void requestUpgrade(const std::string& requester);
+	void adoptHandover();
 	
 	// Command handling
 	void registerCommand(const std::string& cmd, CommandHandler* handler);
 	void executeCommand(Client& client, const Message& msg);
+	void processInput(Client& client, const char* data, size_t length);
+	void flushClients();
 	void sendReply(Client& client, const std::string& reply);
+	void sendReply(Client& client, const SharedBuffer& reply);
 	
 	// Client management
-	void removeClient(int clientFd);
+	void addClient(Client* client, bool receive = true);
+	void removeClient(int clientFd, const std::string& reason = "Connection closed");
+	Client* getClient(int clientFd);
+	void completeRegistration(Client& client);
 	
 	// Getters
 	const std::string& getPassword() const;
+
+	// Password checks (PASS, OPER); see AuthPool.hpp
+	void verifyPassword(Client& client, AuthKind kind, const std::string& name, const std::string& password);
+	void handleAuthCompletions(bool wait);
+	bool hasPendingAuth();
+
+	// Server-wide spam filter (FILTER); see SpamFilter.hpp
+	SpamFilter& getSpamFilter();
+	bool filterMessage(Client& client, const std::string& text); // true if the message must be dropped
+
+	MetricsGauges collectGauges() const;
+	MemoryUsage collectMemory() const;
+	void renderMemoryReport(size_t topN, std::vector<std::string>& lines) const;
+	bool dumpTrace(std::string& error);
+	const std::string& getTraceFile() const;
 	Client* getClientByNickname(const std::string& nickname);
+	void setNickname(Client& client, const std::string& nickname); // keeps the nick index current
 	
+	// Server linking
+	const std::string& getServerName() const;
+	const LinkConfig* findLinkConfig(const std::string& name) const;
+	bool isKnownServer(const std::string& name) const;
+	bool connectToServer(const std::string& name, std::string& error);
+	bool closeLink(const std::string& name, const std::string& reason);
+	void sendLinkHandshake(Client& link, const LinkConfig& config);
+	void establishLink(Client& link, const std::string& name);
+	void introduceUser(Client& client);
+	void propagate(Client& origin, const std::string& line);
+	void propagateToChannel(Client& origin, const Channel& channel, const SharedBuffer& line);
+	void propagateChannelCreation(Client& origin, const Channel& channel);
+	void deliver(Client& target, const std::string& line);
+	void deliver(Client& target, OutboundMessage& message);
+	void listServers(std::vector<std::string>& lines) const;
+
 	// Channel management
 	Channel* getChannel(const std::string& channelName);
 	Channel* createChannel(const std::string& channelName, Client* creator);
 	void removeChannel(const std::string& channelName);
 	std::vector<Channel*> getChannelsForClient(int clientFd);
+
+	// Message ids and channel history
+	void stampMessage(OutboundMessage& message, const Channel* channel);
+	bool isHistoryEnabled() const;
+	void recordHistory(Channel& channel, const OutboundMessage& message);
 	
 	// Helper methods
 	bool isValidChannelName(const std::string& name) const;
@@ -0,0 +1,14 @@
+#ifndef SERVERCOMMAND_HPP
+# define SERVERCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class ServerCommand : public CommandHandler
+{
+public:
+	ServerCommand();
+	virtual ~ServerCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
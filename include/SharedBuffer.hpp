@@ -0,0 +1,56 @@
+#ifndef SHAREDBUFFER_HPP
+# define SHAREDBUFFER_HPP
+
+# include <string>
+# include <cstddef>
+
+// Derived forms a buffer can cache (see getDerived)
+static const size_t SHARED_BUFFER_DERIVED = 2;
+
+// Reference-counted, immutable once shared: a channel message is rendered
+// into one SharedBuffer that every recipient's send queue and the channel
+// history point at, instead of each holding its own copy. A buffer nobody
+// else references may still be appended to, which lets small replies
+// coalesce in a send queue. The count is atomic so pipeline I/O threads
+// (see Pipeline.hpp) can drop their references; everything else, appending
+// and the derived slots included, is for the event loop only.
+//
+// A buffer can also cache derived forms of its data, such as the same
+// lines framed for WebSocket recipients, so they are built once however
+// many recipients need them. Appending drops them.
+class SharedBuffer
+{
+private:
+	struct Block
+	{
+		size_t refs;
+		std::string data;
+		Block* derived[SHARED_BUFFER_DERIVED];
+	};
+	Block* _block;
+
+	static Block* newBlock();
+	static void releaseBlock(Block* block);
+	void release();
+
+public:
+	SharedBuffer();
+	explicit SharedBuffer(const std::string& data);
+	SharedBuffer(const SharedBuffer& other);
+	SharedBuffer& operator=(const SharedBuffer& other);
+	~SharedBuffer();
+
+	const char* data() const;
+	size_t size() const;
+	bool empty() const;
+	const std::string& str() const;
+	size_t getRefCount() const;
+	bool isShared() const;
+	void append(const std::string& data); // only while not shared
+
+	// Cached derived form in slot, empty until set
+	SharedBuffer getDerived(size_t slot) const;
+	void setDerived(size_t slot, const SharedBuffer& derived) const;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SNAPSHOT_HPP
+# define SNAPSHOT_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <ctime>
+# include <stdint.h>
+# include <pthread.h>
+
+// Channel state snapshot: a memory-mapped file of fixed-size slots, one per
+// channel, holding what should survive a restart (topic, modes, key, limit,
+// TS and invited nicks). The event loop writes changed channels straight
+// into their slots; a background thread msyncs the mapping every few
+// seconds, so the loop never waits for the disk. On startup the slots are
+// read in place, there is nothing to parse.
+//
+// Layout, version 1, host byte order:
+//   SnapshotHeader, then slotCount x SnapshotSlot
+// Each slot carries a checksum, so a slot torn by a crash mid-update is
+// dropped rather than restored half-written.
+
+static const size_t SNAPSHOT_NAME_SIZE = 64;
+static const size_t SNAPSHOT_KEY_SIZE = 64;
+static const size_t SNAPSHOT_TOPIC_SIZE = 512;
+static const size_t SNAPSHOT_MAX_INVITES = 32;
+static const size_t SNAPSHOT_NICK_SIZE = 16;
+
+enum SnapshotModes
+{
+	SNAPSHOT_MODE_INVITE = 1,
+	SNAPSHOT_MODE_TOPIC = 2,
+	SNAPSHOT_MODE_KEY = 4,
+	SNAPSHOT_MODE_LIMIT = 8
+};
+
+struct SnapshotHeader
+{
+	char magic[8]; // "IRCSNAP"
+	uint32_t version;
+	uint32_t slotSize;
+	uint32_t slotCount;
+	uint32_t reserved;
+};
+
+struct SnapshotSlot
+{
+	uint32_t checksum; // FNV-1a of the rest of the slot
+	uint32_t used;
+	int64_t createdAt;
+	uint32_t modes; // SnapshotModes bits
+	int32_t userLimit;
+	uint32_t inviteCount;
+	uint32_t reserved;
+	char name[SNAPSHOT_NAME_SIZE];
+	char key[SNAPSHOT_KEY_SIZE];
+	char topic[SNAPSHOT_TOPIC_SIZE];
+	char invites[SNAPSHOT_MAX_INVITES][SNAPSHOT_NICK_SIZE];
+};
+
+// A channel's persistent state, as stored in or loaded from a slot
+struct SavedChannel
+{
+	std::string name;
+	std::string topic;
+	std::string key;
+	unsigned int modes;
+	int userLimit;
+	time_t createdAt;
+	std::vector<std::string> invites; // nicknames
+
+	SavedChannel();
+};
+
+class ChannelSnapshot
+{
+private:
+	int _fd;
+	char* _map;
+	size_t _length;
+	size_t _slotCount;
+	std::map<std::string, size_t> _slots; // lowercased channel name -> slot
+	std::vector<size_t> _free;
+	size_t _restored;
+	unsigned int _interval;
+	bool _running;
+	pthread_t _thread;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup;
+
+	// Orthodox Canonical Form
+	ChannelSnapshot(const ChannelSnapshot& other);
+	ChannelSnapshot& operator=(const ChannelSnapshot& other);
+
+	SnapshotSlot* slot(size_t index) const;
+	static void* syncThread(void* arg);
+	void syncLoop();
+
+public:
+	ChannelSnapshot();
+	~ChannelSnapshot();
+
+	// Maps the file, creating or growing it to slotCount slots
+	bool open(const std::string& path, size_t slotCount, unsigned int interval, std::string& error);
+	void close(); // final msync, then unmap
+	bool isOpen() const;
+	size_t getRestoredCount() const;
+	size_t getSlotCount() const;
+	size_t getUsedCount() const;
+
+	bool load(const std::string& key, SavedChannel& channel) const;
+	bool store(const std::string& key, const SavedChannel& channel); // false when every slot is taken
+	void erase(const std::string& key);
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef SPAMFILTER_HPP
+# define SPAMFILTER_HPP
+
+# include <string>
+# include <vector>
+# include <ctime>
+# include <cstddef>
+# include <stdint.h>
+# include <pthread.h>
+
+// Server-wide spam filter (FILTER): phrases looked for in every PRIVMSG and
+// NOTICE body. All phrases are compiled into one Aho-Corasick automaton, a
+// DFA over byte classes, so a body is scanned once whatever the number of
+// phrases. Compiling hundreds of them takes a while, so it happens on a
+// builder thread; the event loop keeps scanning with the old automaton and
+// swaps in the new one when the eventfd says it is ready.
+
+static const size_t FILTER_MAX_RULES = 1024;
+static const size_t FILTER_MAX_PATTERN = 128;
+
+// By severity: when several phrases match, the worst action is taken
+enum FilterAction
+{
+	FILTER_NOTICE, // dropped, and the sender is told
+	FILTER_DROP, // dropped silently
+	FILTER_KILL // dropped, and the sender disconnected
+};
+
+struct FilterRule
+{
+	std::string pattern;
+	FilterAction action;
+	bool foldCase; // ASCII letters match either case
+	std::string setBy;
+	time_t setAt;
+
+	FilterRule();
+};
+
+// Built once, then only read
+class FilterAutomaton
+{
+private:
+	std::vector<FilterRule> _rules;
+	unsigned char _classes[256]; // byte -> class, both cases of a letter share one
+	size_t _classCount;
+	std::vector<int32_t> _next; // state * _classCount + class -> state
+	std::vector<int32_t> _firstRule; // rule ending in this state, -1 if none
+	std::vector<int32_t> _nextRule; // next rule ending in the same state
+	std::vector<int32_t> _outputLink; // nearest suffix state with rules, -1 if none
+
+	// Orthodox Canonical Form
+	FilterAutomaton(const FilterAutomaton& other);
+	FilterAutomaton& operator=(const FilterAutomaton& other);
+
+	void build();
+	bool ruleMatches(size_t rule, const std::string& text, size_t end) const;
+
+public:
+	explicit FilterAutomaton(const std::vector<FilterRule>& rules);
+	~FilterAutomaton();
+
+	// Worst rule found in text, NULL if none
+	const FilterRule* scan(const std::string& text) const;
+	size_t getStateCount() const;
+};
+
+class SpamFilter
+{
+private:
+	std::vector<FilterRule> _rules; // the list as FILTER edits it
+	FilterAutomaton* _active; // event loop only
+	pthread_t _thread;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup;
+	std::vector<FilterRule> _pending; // rules to compile next
+	bool _requested;
+	FilterAutomaton* _built; // compiled, not installed yet
+	bool _running;
+	bool _started;
+	int _eventFd;
+
+	// Orthodox Canonical Form
+	SpamFilter(const SpamFilter& other);
+	SpamFilter& operator=(const SpamFilter& other);
+
+	static void* builderThread(void* arg);
+	void builderLoop();
+	void rebuild();
+
+public:
+	SpamFilter();
+	~SpamFilter();
+
+	bool start(std::string& error);
+	void stop();
+	int getEventFd() const;
+	void install(); // eventfd readable: swap in the newest automaton
+
+	bool add(const FilterRule& rule); // false if the list is full; replaces the same pattern
+	bool remove(const std::string& pattern);
+	void clear();
+	const std::vector<FilterRule>& getRules() const;
+
+	const FilterRule* check(const std::string& text) const;
+
+	static bool parseAction(const std::string& name, FilterAction& action);
+	static const char* actionName(FilterAction action);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SPSCRING_HPP
+# define SPSCRING_HPP
+
+# include <vector>
+# include <cstddef>
+
+// Bounded single-producer single-consumer queue. Each index is written by
+// one side only and published with release/acquire, so a push or pop costs
+// no lock and no syscall. Full and empty are reported, never waited out.
+template <typename T>
+class SpscRing
+{
+private:
+	static const size_t CACHE_LINE = 64;
+
+	std::vector<T> _slots;
+	size_t _mask;
+	char _padHead[CACHE_LINE];
+	size_t _head; // next slot to pop, written by the consumer
+	char _padTail[CACHE_LINE];
+	size_t _tail; // next slot to push, written by the producer
+	char _padEnd[CACHE_LINE];
+
+	// Orthodox Canonical Form
+	SpscRing(const SpscRing& other);
+	SpscRing& operator=(const SpscRing& other);
+
+public:
+	explicit SpscRing(size_t capacity) // a power of two
+		: _slots(capacity), _mask(capacity - 1), _head(0), _tail(0)
+	{
+	}
+
+	~SpscRing()
+	{
+	}
+
+	// Producer side
+	bool push(const T& item)
+	{
+		size_t tail = _tail;
+		if (tail - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) == _slots.size())
+			return false;
+		_slots[tail & _mask] = item;
+		__atomic_store_n(&_tail, tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	// Consumer side; the slot is reset so it holds no references
+	bool pop(T& item)
+	{
+		size_t head = _head;
+		if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE))
+			return false;
+		item = _slots[head & _mask];
+		_slots[head & _mask] = T();
+		__atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	// Either side; a snapshot
+	bool empty() const
+	{
+		return __atomic_load_n(&_head, __ATOMIC_ACQUIRE) == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+	}
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SQUITCOMMAND_HPP
+# define SQUITCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class SquitCommand : public CommandHandler
+{
+public:
+	SquitCommand();
+	virtual ~SquitCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
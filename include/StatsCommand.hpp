@@ -0,0 +1,14 @@
+#ifndef STATSCOMMAND_HPP
+# define STATSCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class StatsCommand : public CommandHandler
+{
+public:
+	StatsCommand();
+	virtual ~StatsCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
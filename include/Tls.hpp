@@ -0,0 +1,80 @@
+#ifndef TLS_HPP
+# define TLS_HPP
+
+# include <string>
+# include <cstddef>
+# include <openssl/ssl.h>
+
+// TLS for client listeners, on OpenSSL over the non-blocking sockets. Once
+// the handshake is done and the kernel accepts the session keys (kTLS), the
+// kernel builds the records: the socket is then written like plain TCP, so
+// the shared send buffers go out with sendmsg() and no userspace encryption
+// copy. Without kTLS, records are built by SSL_write.
+
+// Outcome of one non-blocking TLS operation
+enum TlsStatus
+{
+	TLS_OK,
+	TLS_WANT_READ,
+	TLS_WANT_WRITE,
+	TLS_CLOSED, // close_notify from the peer
+	TLS_ERROR
+};
+
+// Largest plaintext in one TLS record
+static const size_t TLS_RECORD_SIZE = 16384;
+
+// One server certificate and its settings, shared by every TLS listener.
+// Sessions can be resumed from the server-side cache or from tickets.
+class TlsContext
+{
+private:
+	SSL_CTX* _ctx;
+
+	// Orthodox Canonical Form
+	TlsContext(const TlsContext& other);
+	TlsContext& operator=(const TlsContext& other);
+
+public:
+	TlsContext();
+	~TlsContext();
+
+	bool init(const std::string& certFile, const std::string& keyFile, bool ktls, std::string& error);
+	bool isReady() const;
+	SSL* createSession(int fd) const;
+};
+
+// The TLS state of one accepted connection
+class TlsSession
+{
+private:
+	SSL* _ssl;
+	bool _established;
+	bool _kernelSend; // kTLS builds outgoing records
+	bool _failed; // no close_notify after a fatal error
+
+	// Orthodox Canonical Form
+	TlsSession();
+	TlsSession(const TlsSession& other);
+	TlsSession& operator=(const TlsSession& other);
+
+	TlsStatus status(int result);
+
+public:
+	explicit TlsSession(SSL* ssl);
+	~TlsSession();
+
+	TlsStatus handshake();
+	TlsStatus read(char* buffer, size_t size, size_t& received);
+	TlsStatus write(const char* data, size_t size, size_t& sent);
+	void shutdown(); // best-effort close_notify
+
+	bool isEstablished() const;
+	bool isKernelSend() const;
+	std::string describe() const; // "TLSv1.3 TLS_AES_128_GCM_SHA256, resumed, kTLS send"
+};
+
+// The most recent OpenSSL error for this thread, as text
+std::string tlsError();
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef TRACER_HPP
+# define TRACER_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+# include <pthread.h>
+# if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+# endif
+
+// Opt-in span tracer. Each thread records completed spans into its own
+// ring buffer (oldest spans are overwritten), timestamps come from the TSC,
+// and dump() writes everything as Chrome trace / Perfetto JSON.
+// While disabled a TRACE_SCOPE costs one load and a predictable branch.
+class Tracer
+{
+public:
+	static const size_t SPANS_PER_THREAD = 65536; // power of two
+	static const size_t DETAIL_LENGTH = 16;
+
+	struct Span
+	{
+		const char* name; // string literal
+		unsigned long long startTicks;
+		unsigned long long endTicks;
+		char detail[DETAIL_LENGTH]; // e.g. command name, may be empty
+	};
+
+	struct ThreadBuffer
+	{
+		int tid;
+		pthread_t thread;
+		size_t head; // total spans ever written
+		Span spans[SPANS_PER_THREAD];
+	};
+
+private:
+	static bool _enabled;
+	std::vector<ThreadBuffer*> _buffers;
+	pthread_mutex_t _buffersMutex;
+	int _nextTid;
+	pthread_t _loopThread;
+	bool _hasLoopThread; // setLoopThread() was called
+	unsigned long long _calibrationTicks;
+	unsigned long long _calibrationNs;
+
+	// Orthodox Canonical Form
+	Tracer();
+	Tracer(const Tracer& other);
+	Tracer& operator=(const Tracer& other);
+
+	ThreadBuffer* registerThread();
+	double ticksPerMicrosecond() const;
+
+public:
+	~Tracer();
+
+	static Tracer& instance();
+
+	static bool isEnabled()
+	{
+		return _enabled;
+	}
+
+	static unsigned long long ticks()
+	{
+# if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+# else
+		return monotonicNs();
+# endif
+	}
+
+	static unsigned long long monotonicNs();
+
+	void enable();
+	void disable();
+	void setLoopThread(); // the calling thread is labelled "event-loop"
+	void record(const char* name, const char* detail, unsigned long long startTicks, unsigned long long endTicks);
+	bool dump(const std::string& path, std::string& error);
+};
+
+class TraceScope
+{
+private:
+	const char* _name;
+	const char* _detail;
+	unsigned long long _start;
+
+	TraceScope(const TraceScope& other);
+	TraceScope& operator=(const TraceScope& other);
+
+public:
+	explicit TraceScope(const char* name, const char* detail = NULL)
+		: _name(name), _detail(detail), _start(Tracer::isEnabled() ? Tracer::ticks() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if (_start != 0 && Tracer::isEnabled())
+		{
+			Tracer::instance().record(_name, _detail, _start, Tracer::ticks());
+		}
+	}
+};
+
+# define TRACE_CONCAT_(a, b) a##b
+# define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+# define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+# define TRACE_SCOPE_DETAIL(name, detail) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, detail)
+
+#endif
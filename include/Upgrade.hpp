@@ -0,0 +1,69 @@
+#ifndef UPGRADE_HPP
+# define UPGRADE_HPP
+
+# include <string>
+# include <vector>
+
+// Hot upgrade handover, from the running server to a freshly exec'd binary
+// over a Unix socketpair:
+//
+//   header: "IRCUPG" version(1 byte) pad(1 byte) u64(state length) u64(fd count)
+//   state:  varints and length-prefixed strings written by Server::saveState
+//   fds:    SCM_RIGHTS messages of up to UPGRADE_FDS_PER_MESSAGE descriptors,
+//           in putFd() order
+//   ack:    one byte from the new process, '+' once it is ready to serve
+//
+// Fds are referenced in the state by their index in the fd list, so the new
+// process does not depend on getting the same numbers back.
+class UpgradeWriter
+{
+private:
+	std::string _data;
+	std::vector<int> _fds;
+
+	// Orthodox Canonical Form
+	UpgradeWriter(const UpgradeWriter& other);
+	UpgradeWriter& operator=(const UpgradeWriter& other);
+
+public:
+	UpgradeWriter();
+	~UpgradeWriter();
+
+	void putNumber(unsigned long long value);
+	void putSigned(long long value);
+	void putString(const std::string& value);
+	void putFd(int fd);
+
+	size_t getFdCount() const;
+	bool send(int socket, std::string& error) const;
+};
+
+class UpgradeReader
+{
+private:
+	std::string _data;
+	size_t _pos;
+	std::vector<int> _fds;
+	std::vector<bool> _taken; // fds handed out by getFd()
+	bool _failed;
+
+	// Orthodox Canonical Form
+	UpgradeReader(const UpgradeReader& other);
+	UpgradeReader& operator=(const UpgradeReader& other);
+
+public:
+	UpgradeReader();
+	~UpgradeReader(); // closes received fds nobody took
+
+	bool receive(int socket, std::string& error);
+
+	// Reads past the end or bad fd indexes set failed() and return 0 / "" / -1
+	unsigned long long getNumber();
+	long long getSigned();
+	std::string getString();
+	int getFd();
+	bool failed() const;
+	bool atEnd() const;
+};
+
+#endif
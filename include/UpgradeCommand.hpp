@@ -0,0 +1,14 @@
+#ifndef UPGRADECOMMAND_HPP
+# define UPGRADECOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class UpgradeCommand : public CommandHandler
+{
+public:
+	UpgradeCommand();
+	virtual ~UpgradeCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
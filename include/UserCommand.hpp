@@ -0,0 +1,14 @@
+#ifndef USERCOMMAND_HPP
+# define USERCOMMAND_HPP
+
+# include "CommandHandler.hpp"
+
+class UserCommand : public CommandHandler
+{
+public:
+	UserCommand();
+	virtual ~UserCommand();
+	virtual void execute(Server& server, Client& client, const Message& msg);
+};
+
+#endif
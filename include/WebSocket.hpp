@@ -0,0 +1,91 @@
+#ifndef WEBSOCKET_HPP
+# define WEBSOCKET_HPP
+
+# include <string>
+# include <cstddef>
+# include "SharedBuffer.hpp"
+# include "Message.hpp"
+
+// IRC over WebSocket (RFC 6455), as in the IRCv3 WebSocket spec: after the
+// HTTP Upgrade handshake every message in either direction carries one IRC
+// line without its CRLF. Received messages are turned back into CRLF lines
+// for the usual Client/Message pipeline. Outgoing lines are framed when they
+// are queued; a broadcast buffer is framed once and the framing is cached
+// on the buffer, so every WebSocket recipient queues the same frames.
+
+// Outcome of feeding received bytes to a session
+enum WebSocketStatus
+{
+	WS_OK,
+	WS_CLOSE // close handshake or protocol error; send closeFrame() and hang up
+};
+
+// Frame opcodes
+enum WebSocketOpcode
+{
+	WS_CONTINUATION = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE_FRAME = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xA
+};
+
+// Largest message accepted: one IRC line with the most tags it may carry
+static const size_t WEBSOCKET_MAX_MESSAGE = MAX_LINE_LENGTH + MAX_TAGS_LENGTH;
+// Request headers buffered before the handshake is refused
+static const size_t WEBSOCKET_MAX_REQUEST = 8192;
+// SharedBuffer derived slots holding the text and binary framings
+static const size_t WEBSOCKET_TEXT_SLOT = 0;
+static const size_t WEBSOCKET_BINARY_SLOT = 1;
+
+// The WebSocket state of one accepted connection
+class WebSocketSession
+{
+private:
+	bool _open; // handshake done
+	bool _binary; // binary.ircv3.net negotiated, else text frames
+	std::string _input; // received bytes not decoded yet
+	WebSocketOpcode _messageOpcode; // of the fragmented message, WS_CONTINUATION if none
+	std::string _message; // its payload so far
+	std::string _pending; // queued output not ending a line yet
+	unsigned short _closeCode; // status for closeFrame()
+
+	// Orthodox Canonical Form
+	WebSocketSession(const WebSocketSession& other);
+	WebSocketSession& operator=(const WebSocketSession& other);
+
+	WebSocketStatus handshake(std::string& replies);
+	WebSocketStatus fail(unsigned short code);
+	bool deliver(WebSocketOpcode opcode, const std::string& payload, std::string& lines);
+	std::string frameLines(const char* data, size_t size) const;
+
+public:
+	WebSocketSession();
+	~WebSocketSession();
+
+	// Decode received bytes: IRC lines (CRLF-terminated) go to lines, the
+	// handshake answer and pongs to replies
+	WebSocketStatus receive(const char* data, size_t length, std::string& lines, std::string& replies);
+	std::string closeFrame() const;
+
+	// Frame IRC output; a line split across calls is held until it ends
+	std::string frame(const std::string& data);
+	SharedBuffer frame(const SharedBuffer& data);
+
+	bool isOpen() const;
+	bool isBinary() const;
+
+	// Upgrade handover
+	const std::string& getInput() const;
+	WebSocketOpcode getMessageOpcode() const;
+	const std::string& getMessage() const;
+	const std::string& getPending() const;
+	void restore(bool open, bool binary, const std::string& input, WebSocketOpcode messageOpcode,
+		const std::string& message, const std::string& pending);
+};
+
+// One unmasked server frame
+std::string webSocketFrame(WebSocketOpcode opcode, const char* payload, size_t size);
+
+#endif
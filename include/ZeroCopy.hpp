@@ -0,0 +1,80 @@
+#ifndef ZEROCOPY_HPP
+# define ZEROCOPY_HPP
+
+# include <vector>
+# include <deque>
+# include <map>
+# include <ctime>
+# include <cstddef>
+# include <stdint.h>
+# include <sys/uio.h>
+# include "SharedBuffer.hpp"
+
+// Zero-copy sends for large flushes ("io zerocopy=<bytes>"). Once a plain
+// TCP client has that much queued, sendToClient passes MSG_ZEROCOPY and the
+// kernel sends straight from the queued SharedBuffers instead of copying
+// them. They must stay untouched until the kernel is done with them, so
+// each send keeps its buffers here until its completion shows up on the
+// socket's error queue, which raises POLLERR; reap() reads those.
+//
+// Every iovec pins at least a page and is charged as one, so a queue of
+// short broadcast lines is cheaper to copy; only queues of big coalesced
+// replies (NAMES, LIST, history replay) are sent zero-copy.
+//
+// The kernel numbers the zero-copy sends on a socket from 0 and reports
+// completed ranges, and whether it ended up copying anyway (loopback
+// always does).
+
+// Average iovec size from which pinning pays
+static const size_t ZEROCOPY_MIN_SEGMENT = 2048;
+
+// How long buffers of a closed socket are kept: TCP may still be sending them
+static const time_t ZEROCOPY_RETIRE_SECONDS = 120;
+
+struct ZeroCopySend
+{
+	uint32_t id;
+	size_t bytes;
+	std::vector<SharedBuffer> hold;
+};
+
+struct ZeroCopySocket
+{
+	uint32_t nextId;
+	std::deque<ZeroCopySend> inFlight;
+
+	ZeroCopySocket();
+};
+
+class ZeroCopy
+{
+private:
+	size_t _threshold; // queued bytes from which to send zero-copy, 0 = off
+	std::map<int, ZeroCopySocket> _sockets; // SO_ZEROCOPY set by us
+	std::deque<std::pair<time_t, std::vector<SharedBuffer> > > _retired; // closed sockets, by close time
+
+	// Orthodox Canonical Form
+	ZeroCopy(const ZeroCopy& other);
+	ZeroCopy& operator=(const ZeroCopy& other);
+
+	void complete(ZeroCopySocket& socket, uint32_t last, bool copied);
+
+public:
+	ZeroCopy();
+	~ZeroCopy();
+
+	void setThreshold(size_t threshold);
+	size_t getThreshold() const;
+
+	bool enable(int fd); // false if the kernel refuses SO_ZEROCOPY
+	bool shouldUse(int fd, size_t queued) const;
+	static bool isWorthPinning(const struct iovec* iov, size_t count);
+	void sent(int fd, size_t bytes, const std::vector<SharedBuffer>& hold);
+
+	// POLLERR: drain the completions; false if the socket has a real error
+	bool reap(int fd);
+	void forget(int fd, time_t now); // before the socket is closed
+	void expire(time_t now);
+};
+
+#endif
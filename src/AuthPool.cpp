@@ -0,0 +1,200 @@
+#include "AuthPool.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <crypt.h>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+
+AuthJob::AuthJob()
+	: id(0), fd(-1), kind(AUTH_PASS), matched(false)
+{
+}
+
+AuthPool::AuthPool()
+	: _busy(0), _running(false), _eventFd(-1), _nextId(1)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeup, NULL);
+	pthread_cond_init(&_idle, NULL);
+}
+
+AuthPool::~AuthPool()
+{
+	stop();
+	pthread_cond_destroy(&_idle);
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+}
+
+bool AuthPool::start(size_t threads, std::string& error)
+{
+	_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_eventFd == -1)
+	{
+		error = std::string("eventfd: ") + std::strerror(errno);
+		return false;
+	}
+	_running = true;
+	for (size_t i = 0; i < threads; ++i)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, workerThread, this) != 0)
+		{
+			error = "failed to start an auth worker thread";
+			stop();
+			return false;
+		}
+		_threads.push_back(thread);
+	}
+	return true;
+}
+
+void AuthPool::stop()
+{
+	pthread_mutex_lock(&_mutex);
+	_running = false;
+	pthread_cond_broadcast(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	for (size_t i = 0; i < _threads.size(); ++i)
+	{
+		pthread_join(_threads[i], NULL);
+	}
+	_threads.clear();
+	_queue.clear();
+	_done.clear();
+	if (_eventFd != -1)
+	{
+		close(_eventFd);
+		_eventFd = -1;
+	}
+}
+
+int AuthPool::getEventFd() const
+{
+	return _eventFd;
+}
+
+bool AuthPool::isIdle()
+{
+	pthread_mutex_lock(&_mutex);
+	bool idle = _queue.empty() && _busy == 0 && _done.empty();
+	pthread_mutex_unlock(&_mutex);
+	return idle;
+}
+
+unsigned long long AuthPool::submit(int fd, AuthKind kind, const std::string& name, const std::string& password,
+	const std::string& hash)
+{
+	AuthJob job;
+	job.id = _nextId++;
+	job.fd = fd;
+	job.kind = kind;
+	job.name = name;
+	job.password = password;
+	job.hash = hash;
+
+	pthread_mutex_lock(&_mutex);
+	_queue.push_back(job);
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	return job.id;
+}
+
+void AuthPool::collect(std::vector<AuthJob>& done, bool wait)
+{
+	uint64_t count;
+	while (read(_eventFd, &count, sizeof(count)) == -1 && errno == EINTR)
+	{
+	}
+
+	pthread_mutex_lock(&_mutex);
+	while (wait && _running && (!_queue.empty() || _busy != 0))
+	{
+		pthread_cond_wait(&_idle, &_mutex);
+	}
+	done.swap(_done);
+	_done.clear();
+	pthread_mutex_unlock(&_mutex);
+}
+
+void* AuthPool::workerThread(void* arg)
+{
+	static_cast<AuthPool*>(arg)->workerLoop();
+	return NULL;
+}
+
+void AuthPool::workerLoop()
+{
+	// Too big for the stack: libxcrypt keeps its scratch space in here
+	struct crypt_data* data = new struct crypt_data;
+	std::memset(data, 0, sizeof(*data));
+
+	pthread_mutex_lock(&_mutex);
+	while (true)
+	{
+		while (_running && _queue.empty())
+		{
+			pthread_cond_wait(&_wakeup, &_mutex);
+		}
+		if (!_running)
+		{
+			break;
+		}
+		AuthJob job = _queue.front();
+		_queue.pop_front();
+		_busy++;
+		pthread_mutex_unlock(&_mutex);
+
+		// Invalid settings give NULL or a "*0"-style string, never the hash
+		const char* result = crypt_r(job.password.c_str(), job.hash.c_str(), data);
+		job.matched = result != NULL && matches(result, job.hash);
+		job.password.clear();
+
+		pthread_mutex_lock(&_mutex);
+		_busy--;
+		_done.push_back(job);
+		if (_busy == 0 && _queue.empty())
+		{
+			pthread_cond_broadcast(&_idle);
+		}
+		uint64_t one = 1;
+		ssize_t written = write(_eventFd, &one, sizeof(one));
+		(void)written; // only fails when the counter is already huge
+	}
+	pthread_mutex_unlock(&_mutex);
+	delete data;
+}
+
+// "$<id>$...", the prefix every crypt(3) method in use shares
+bool AuthPool::isHash(const std::string& secret)
+{
+	if (secret.size() < 4 || secret[0] != '$')
+	{
+		return false;
+	}
+	std::string::size_type end = secret.find('$', 1);
+	if (end == std::string::npos || end == 1)
+	{
+		return false;
+	}
+	for (std::string::size_type i = 1; i < end; ++i)
+	{
+		if (!std::isalnum(static_cast<unsigned char>(secret[i])))
+			return false;
+	}
+	return true;
+}
+
+// Constant time in the content, so a mismatch position does not leak
+bool AuthPool::matches(const std::string& password, const std::string& secret)
+{
+	unsigned char diff = password.size() == secret.size() ? 0 : 1;
+	size_t length = password.size() < secret.size() ? password.size() : secret.size();
+	for (size_t i = 0; i < length; ++i)
+	{
+		diff |= static_cast<unsigned char>(password[i] ^ secret[i]);
+	}
+	return diff == 0;
+}
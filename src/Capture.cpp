@@ -0,0 +1,227 @@
+#include "Capture.hpp"
+#include "Metrics.hpp"
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char CAPTURE_MAGIC[6] = { 'I', 'R', 'C', 'C', 'A', 'P' };
+static const unsigned char CAPTURE_VERSION = 1;
+static const size_t CAPTURE_BUFFER_SIZE = 1 << 20;
+static const unsigned long long CAPTURE_MAX_RECORD = 1 << 24;
+
+CaptureEvent::CaptureEvent()
+	: type(CAPTURE_DATA), timestampNs(0), connection(0)
+{
+}
+
+CaptureWriter::CaptureWriter()
+	: _file(NULL), _lastNs(0), _nextConnection(1)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	close();
+}
+
+bool CaptureWriter::open(const std::string& path, std::string& error)
+{
+	close();
+	// Owner only: the capture holds passwords and decrypted TLS input
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1)
+	{
+		error = std::strerror(errno);
+		return false;
+	}
+	_file = fdopen(fd, "wb");
+	if (_file == NULL)
+	{
+		error = std::strerror(errno);
+		::close(fd);
+		return false;
+	}
+	// Large stdio buffer: recording costs a memcpy, not a write(2) per event
+	std::setvbuf(_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+	std::fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), _file);
+	std::fputc(CAPTURE_VERSION, _file);
+	std::fputc(0, _file);
+	writeVarint(static_cast<unsigned long long>(time(NULL)));
+	_lastNs = 0;
+	return true;
+}
+
+void CaptureWriter::close()
+{
+	if (_file != NULL)
+	{
+		std::fclose(_file);
+		_file = NULL;
+	}
+	_connections.clear();
+}
+
+bool CaptureWriter::isOpen() const
+{
+	return _file != NULL;
+}
+
+void CaptureWriter::writeVarint(unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		std::fputc(static_cast<int>((value & 0x7F) | 0x80), _file);
+		value >>= 7;
+	}
+	std::fputc(static_cast<int>(value), _file);
+}
+
+void CaptureWriter::writeRecord(CaptureEventType type, unsigned long long connection, const char* data, size_t length)
+{
+	unsigned long long now = Metrics::nowNs();
+	// The first record starts the clock
+	unsigned long long delta = _lastNs == 0 ? 0 : now - _lastNs;
+	_lastNs = now;
+
+	std::fputc(type, _file);
+	writeVarint(delta);
+	writeVarint(connection);
+	if (type != CAPTURE_DISCONNECT)
+	{
+		writeVarint(length);
+		std::fwrite(data, 1, length, _file);
+	}
+}
+
+void CaptureWriter::recordConnect(int fd, const std::string& hostname)
+{
+	if (_file == NULL)
+		return;
+	unsigned long long connection = _nextConnection++;
+	_connections[fd] = connection;
+	writeRecord(CAPTURE_CONNECT, connection, hostname.data(), hostname.length());
+}
+
+void CaptureWriter::recordData(int fd, const char* data, size_t length)
+{
+	if (_file == NULL)
+		return;
+	std::map<int, unsigned long long>::iterator it = _connections.find(fd);
+	if (it == _connections.end())
+		return;
+	writeRecord(CAPTURE_DATA, it->second, data, length);
+}
+
+void CaptureWriter::recordDisconnect(int fd)
+{
+	if (_file == NULL)
+		return;
+	std::map<int, unsigned long long>::iterator it = _connections.find(fd);
+	if (it == _connections.end())
+		return;
+	writeRecord(CAPTURE_DISCONNECT, it->second, NULL, 0);
+	_connections.erase(it);
+}
+
+CaptureReader::CaptureReader()
+	: _file(NULL), _timestampNs(0), _startTime(0)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+	if (_file != NULL)
+		std::fclose(_file);
+}
+
+bool CaptureReader::open(const std::string& path, std::string& error)
+{
+	_file = std::fopen(path.c_str(), "rb");
+	if (_file == NULL)
+	{
+		error = std::strerror(errno);
+		return false;
+	}
+	std::setvbuf(_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+	char magic[sizeof(CAPTURE_MAGIC)];
+	if (std::fread(magic, 1, sizeof(magic), _file) != sizeof(magic) ||
+		std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0)
+	{
+		error = "not a capture file";
+		return false;
+	}
+	int version = std::fgetc(_file);
+	int flags = std::fgetc(_file);
+	unsigned long long startTime;
+	if (version != CAPTURE_VERSION || flags == EOF || !readVarint(startTime))
+	{
+		error = "unsupported capture version";
+		return false;
+	}
+	_startTime = static_cast<long long>(startTime);
+	return true;
+}
+
+bool CaptureReader::readVarint(unsigned long long& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int c = std::fgetc(_file);
+		if (c == EOF)
+			return false;
+		value |= static_cast<unsigned long long>(c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool CaptureReader::next(CaptureEvent& event, std::string& error)
+{
+	int type = std::fgetc(_file);
+	if (type == EOF)
+		return false;
+	if (type != CAPTURE_CONNECT && type != CAPTURE_DATA && type != CAPTURE_DISCONNECT)
+	{
+		error = "corrupt record";
+		return false;
+	}
+
+	unsigned long long delta;
+	if (!readVarint(delta) || !readVarint(event.connection))
+	{
+		error = "truncated record";
+		return false;
+	}
+	_timestampNs += delta;
+	event.type = static_cast<CaptureEventType>(type);
+	event.timestampNs = _timestampNs;
+	event.data.clear();
+
+	if (event.type != CAPTURE_DISCONNECT)
+	{
+		unsigned long long length;
+		if (!readVarint(length) || length > CAPTURE_MAX_RECORD)
+		{
+			error = "truncated record";
+			return false;
+		}
+		event.data.resize(length);
+		if (length > 0 && std::fread(&event.data[0], 1, length, _file) != length)
+		{
+			error = "truncated record";
+			return false;
+		}
+	}
+	return true;
+}
+
+long long CaptureReader::getStartTime() const
+{
+	return _startTime;
+}
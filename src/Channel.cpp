@@ -1,10 +1,15 @@
 #include "Channel.hpp"
 #include "Client.hpp"
+#include "Metrics.hpp"
+#include "OutboundMessage.hpp"
+#include "FanoutPool.hpp"
 #include <algorithm>
 #include <sstream>
 
 Channel::Channel(const std::string& name, Client* creator)
-	: _name(name), _inviteOnly(false), _topicRestricted(false), _hasKey(false), _hasUserLimit(false), _userLimit(0)
+	: _name(name), _inviteOnly(false), _topicRestricted(false), _hasKey(false), _hasUserLimit(false), _userLimit(0),
+	  _createdAt(time(NULL)), _snapshotDirty(true), _listVersion(0),
+	  _memberListDirty(true)
 {
 	if (creator != NULL)
 	{
@@ -42,6 +47,11 @@ int Channel::getUserLimit() const
 	return _userLimit;
 }
 
+time_t Channel::getCreatedAt() const
+{
+	return _createdAt;
+}
+
 bool Channel::isMember(int clientFd) const
 {
 	return _members.find(clientFd) != _members.end();
@@ -91,21 +101,31 @@ std::string Channel::getMembersString() const
 void Channel::setTopic(const std::string& topic)
 {
 	_topic = topic;
+	_snapshotDirty = true;
 }
 
 void Channel::setKey(const std::string& key)
 {
 	_key = key;
+	_snapshotDirty = true;
 }
 
 void Channel::setInviteOnly(bool inviteOnly)
 {
 	_inviteOnly = inviteOnly;
+	_snapshotDirty = true;
 }
 
 void Channel::setUserLimit(int limit)
 {
 	_userLimit = limit;
+	_snapshotDirty = true;
+}
+
+void Channel::setCreatedAt(time_t createdAt)
+{
+	_createdAt = createdAt;
+	_snapshotDirty = true;
 }
 
 bool Channel::isTopicRestricted() const
@@ -126,16 +146,19 @@ bool Channel::hasUserLimit() const
 void Channel::setTopicRestricted(bool restricted)
 {
 	_topicRestricted = restricted;
+	_snapshotDirty = true;
 }
 
 void Channel::setHasKey(bool hasKey)
 {
 	_hasKey = hasKey;
+	_snapshotDirty = true;
 }
 
 void Channel::setHasUserLimit(bool hasLimit)
 {
 	_hasUserLimit = hasLimit;
+	_snapshotDirty = true;
 }
 
 bool Channel::isInvited(int clientFd) const
@@ -143,14 +166,126 @@ bool Channel::isInvited(int clientFd) const
 	return _inviteList.find(clientFd) != _inviteList.end();
 }
 
+bool Channel::isSnapshotDirty() const
+{
+	return _snapshotDirty;
+}
+
+void Channel::clearSnapshotDirty()
+{
+	_snapshotDirty = false;
+}
+
+std::vector<int> Channel::getInvited() const
+{
+	std::vector<int> invited;
+	for (std::map<int, bool>::const_iterator it = _inviteList.begin(); it != _inviteList.end(); ++it)
+	{
+		invited.push_back(it->first);
+	}
+	return invited;
+}
+
 void Channel::addToInviteList(int clientFd)
 {
 	_inviteList[clientFd] = true;
+	_snapshotDirty = true;
 }
 
 void Channel::removeFromInviteList(int clientFd)
 {
 	_inviteList.erase(clientFd);
+	_snapshotDirty = true;
+}
+
+// Ban cache entries for clients that are not members (refused joins)
+static const size_t BAN_CACHE_SLACK = 256;
+
+static std::string maskSubject(const Client& client)
+{
+	std::string host = client.getHostname().empty() ? "localhost" : client.getHostname();
+	return MaskMatcher::toLower(client.getNickname() + "!" + client.getUsername() + "@" + host);
+}
+
+MaskMatcher* Channel::getMaskList(char mode)
+{
+	if (mode == 'b')
+		return &_bans;
+	if (mode == 'e')
+		return &_exceptions;
+	if (mode == 'I')
+		return &_inviteExceptions;
+	return NULL;
+}
+
+bool Channel::addMask(char mode, const std::string& mask, const std::string& setBy, time_t setAt)
+{
+	MaskMatcher* list = getMaskList(mode);
+	if (list == NULL || list->size() >= CHANNEL_MAX_MASKS || !list->add(mask, setBy, setAt))
+		return false;
+	_listVersion++;
+	return true;
+}
+
+bool Channel::removeMask(char mode, const std::string& mask)
+{
+	MaskMatcher* list = getMaskList(mode);
+	if (list == NULL || !list->remove(mask))
+		return false;
+	_listVersion++;
+	return true;
+}
+
+void Channel::clearMasks()
+{
+	_bans.clear();
+	_exceptions.clear();
+	_inviteExceptions.clear();
+	_listVersion++;
+	_banCache.clear();
+}
+
+const std::vector<MaskEntry>& Channel::getMasks(char mode) const
+{
+	if (mode == 'e')
+		return _exceptions.getEntries();
+	if (mode == 'I')
+		return _inviteExceptions.getEntries();
+	return _bans.getEntries();
+}
+
+bool Channel::isMaskListFull(char mode) const
+{
+	return getMasks(mode).size() >= CHANNEL_MAX_MASKS;
+}
+
+// Checked on every message a member sends, so the answer is kept until the
+// lists or the client's nick!user@host change
+bool Channel::isBanned(const Client& client)
+{
+	if (_bans.empty())
+		return false;
+	std::map<int, BanCacheEntry>::iterator cached = _banCache.find(client.getFd());
+	if (cached != _banCache.end() && cached->second.stamp == client.getMaskStamp() &&
+		cached->second.version == _listVersion)
+	{
+		return cached->second.banned;
+	}
+
+	std::string subject = maskSubject(client);
+	bool banned = _bans.matches(subject) && !_exceptions.matches(subject);
+	if (cached == _banCache.end() && _banCache.size() >= _members.size() + BAN_CACHE_SLACK)
+		_banCache.clear();
+	BanCacheEntry& entry = _banCache[client.getFd()];
+	entry.stamp = client.getMaskStamp();
+	entry.version = _listVersion;
+	entry.banned = banned;
+	return banned;
+}
+
+bool Channel::isInviteExempt(const Client& client) const
+{
+	return !_inviteExceptions.empty() && _inviteExceptions.matches(maskSubject(client));
 }
 
 void Channel::addOperator(int clientFd)
@@ -188,14 +323,18 @@ void Channel::addMember(Client* client)
 	{
 		_members[client->getFd()] = client;
 		_operators[client->getFd()] = false;
+		_memberListDirty = true;
 	}
 }
 
 void Channel::removeMember(int clientFd)
 {
-	_members.erase(clientFd);
+	if (_members.erase(clientFd) > 0)
+		_memberListDirty = true;
 	_operators.erase(clientFd);
-	_inviteList.erase(clientFd);
+	_banCache.erase(clientFd);
+	if (_inviteList.erase(clientFd) > 0)
+		_snapshotDirty = true;
 }
 
 void Channel::setOperator(int clientFd, bool isOp)
@@ -210,12 +349,162 @@ size_t Channel::getMemberCount() const
 
 void Channel::broadcast(const std::string& message, int excludeFd)
 {
+	broadcast(SharedBuffer(message), excludeFd);
+}
+
+// Every recipient queues the same buffer
+void Channel::broadcast(const SharedBuffer& message, int excludeFd)
+{
+	if (FanoutPool::instance().shouldSplit(_members.size()))
+	{
+		broadcastSplit(&message, false, excludeFd);
+		return;
+	}
+	size_t recipients = 0;
 	for (std::map<int, Client*>::iterator it = _members.begin(); it != _members.end(); ++it)
 	{
-		if (it->first != excludeFd)
+		if (it->first != excludeFd && !it->second->isRemote())
 		{
 			it->second->appendToSendBuffer(message);
+			recipients++;
+		}
+	}
+	Metrics::instance().addFanOut(recipients);
+}
+
+// Recipients with the same tag capabilities share one rendering
+void Channel::broadcast(OutboundMessage& message, int excludeFd)
+{
+	if (FanoutPool::instance().shouldSplit(_members.size()))
+	{
+		// Rendered up front: the threads only read them
+		SharedBuffer lines[OUTBOUND_VARIANTS];
+		for (unsigned int variant = 0; variant < OUTBOUND_VARIANTS; ++variant)
+		{
+			if ((variant & OUTBOUND_TAG_CAPS) == variant)
+				lines[variant] = message.render(variant);
+		}
+		broadcastSplit(lines, true, excludeFd);
+		return;
+	}
+	size_t recipients = 0;
+	for (std::map<int, Client*>::iterator it = _members.begin(); it != _members.end(); ++it)
+	{
+		if (it->first != excludeFd && !it->second->isRemote())
+		{
+			it->second->appendToSendBuffer(message.render(it->second->getCapabilities()));
+			recipients++;
+		}
+	}
+	Metrics::instance().addFanOut(recipients);
+}
+
+// A broadcast shared out by FanoutPool. Each part gets its own copy of the
+// lines, so the threads do not contend on one reference count. Members
+// with a WebSocket session are left to the loop: their framing is cached
+// in the shared buffer.
+struct FanoutJob
+{
+	Client* const* members;
+	size_t count;
+	int excludeFd;
+	size_t variants; // lines per part: one per tag variant, or just one
+	std::vector<SharedBuffer> lines;
+	std::vector<size_t> recipients; // per part
+	std::vector<std::vector<Client*> > deferred; // per part, for the loop
+};
+
+static void fanOutPart(void* context, size_t part, size_t parts)
+{
+	FanoutJob& job = *static_cast<FanoutJob*>(context);
+	const SharedBuffer* lines = &job.lines[part * job.variants];
+	size_t end = job.count * (part + 1) / parts;
+	size_t recipients = 0;
+	for (size_t i = job.count * part / parts; i < end; ++i)
+	{
+		Client* member = job.members[i];
+		if (member->getFd() == job.excludeFd || member->isRemote())
+			continue;
+		if (member->getWebSocket() != NULL)
+		{
+			job.deferred[part].push_back(member);
+			continue;
+		}
+		member->appendToSendBuffer(lines[job.variants > 1 ? member->getCapabilities() & OUTBOUND_TAG_CAPS : 0]);
+		recipients++;
+	}
+	job.recipients[part] = recipients;
+}
+
+void Channel::broadcastSplit(const SharedBuffer* lines, bool tagged, int excludeFd)
+{
+	if (_memberListDirty)
+	{
+		_memberList.clear();
+		for (std::map<int, Client*>::iterator it = _members.begin(); it != _members.end(); ++it)
+		{
+			_memberList.push_back(it->second);
+		}
+		_memberListDirty = false;
+	}
+
+	FanoutPool& pool = FanoutPool::instance();
+	size_t parts = pool.getParts();
+	FanoutJob job;
+	job.members = &_memberList[0];
+	job.count = _memberList.size();
+	job.excludeFd = excludeFd;
+	job.variants = tagged ? OUTBOUND_VARIANTS : 1;
+	job.lines.resize(parts * job.variants);
+	for (size_t part = 0; part < parts; ++part)
+	{
+		for (size_t variant = 0; variant < job.variants; ++variant)
+		{
+			if (!lines[variant].empty())
+				job.lines[part * job.variants + variant] = part == 0 ? lines[variant] : SharedBuffer(lines[variant].str());
+		}
+	}
+	job.recipients.assign(parts, 0);
+	job.deferred.resize(parts);
+
+	pool.run(fanOutPart, &job);
+
+	size_t recipients = 0;
+	for (size_t part = 0; part < parts; ++part)
+	{
+		recipients += job.recipients[part];
+		for (size_t i = 0; i < job.deferred[part].size(); ++i)
+		{
+			Client* member = job.deferred[part][i];
+			member->appendToSendBuffer(lines[tagged ? member->getCapabilities() & OUTBOUND_TAG_CAPS : 0]);
+			recipients++;
 		}
 	}
+	Metrics::instance().addFanOut(recipients);
+}
+
+// Memory accounting
+MemoryUsage Channel::getMemoryUsage() const
+{
+	MemoryUsage usage;
+	usage.channelMembers = _members.size() * (MemoryUsage::MAP_NODE_OVERHEAD + sizeof(std::pair<const int, Client*>))
+		+ _operators.size() * (MemoryUsage::MAP_NODE_OVERHEAD + sizeof(std::pair<const int, bool>))
+		+ _memberList.capacity() * sizeof(Client*);
+	usage.channelInvites = _inviteList.size() * (MemoryUsage::MAP_NODE_OVERHEAD + sizeof(std::pair<const int, bool>))
+		+ _bans.getBytes() + _exceptions.getBytes() + _inviteExceptions.getBytes()
+		+ _banCache.size() * (MemoryUsage::MAP_NODE_OVERHEAD + sizeof(std::pair<const int, BanCacheEntry>));
+	usage.channelStrings = sizeof(Channel) + MemoryUsage::stringBytes(_name) + MemoryUsage::stringBytes(_topic)
+		+ MemoryUsage::stringBytes(_key);
+	usage.channelHistory = _history.getBytes() + _history.size() * sizeof(HistoryEntry);
+	return usage;
+}
+
+ChannelHistory& Channel::getHistory()
+{
+	return _history;
 }
 
+const ChannelHistory& Channel::getHistory() const
+{
+	return _history;
+}
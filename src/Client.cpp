@@ -1,13 +1,30 @@
 #include "Client.hpp"
+#include "Message.hpp"
+#include "Tls.hpp"
+#include "WebSocket.hpp"
 #include <cctype>
 
+// Shared by every Client, including the bare ones of pipeline I/O threads
+static unsigned long nextMaskStamp()
+{
+	static unsigned long stamp = 0;
+	return __atomic_add_fetch(&stamp, 1, __ATOMIC_RELAXED);
+}
+
 Client::Client(int fd)
-	: _fd(fd), _authenticated(false), _registered(false)
+	: _fd(fd), _authenticated(false), _pendingAuth(0), _registered(false), _isServerOperator(false),
+	  _closeAfterFlush(false), _capabilities(0), _negotiatingCaps(false), _protocol(PROTO_IRC), _tls(NULL), _webSocket(NULL),
+	  _sendHead(0), _sendOffset(0), _sendQueued(0), _recvBufferPeak(0),
+	  _sendBufferPeak(0), _connClass(NULL),
+	  _linkState(LINK_NONE), _link(NULL), _nickTs(0),
+	  _maskStamp(nextMaskStamp())
 {
 }
 
 Client::~Client()
 {
+	delete _tls;
+	delete _webSocket;
 }
 
 // Getters
@@ -41,25 +58,77 @@ bool Client::isAuthenticated() const
 	return _authenticated;
 }
 
+unsigned long long Client::getPendingAuth() const
+{
+	return _pendingAuth;
+}
+
 bool Client::isRegistered() const
 {
 	return _registered;
 }
 
+bool Client::isServerOperator() const
+{
+	return _isServerOperator;
+}
+
+unsigned int Client::getCapabilities() const
+{
+	return _capabilities;
+}
+
+bool Client::hasCapability(Capability capability) const
+{
+	return (_capabilities & capability) != 0;
+}
+
+bool Client::isNegotiatingCaps() const
+{
+	return _negotiatingCaps;
+}
+
+bool Client::shouldCloseAfterFlush() const
+{
+	return _closeAfterFlush;
+}
+
+ListenerProtocol Client::getProtocol() const
+{
+	return _protocol;
+}
+
+TlsSession* Client::getTls() const
+{
+	return _tls;
+}
+
+WebSocketSession* Client::getWebSocket() const
+{
+	return _webSocket;
+}
+
 const std::string& Client::getRecvBuffer() const
 {
 	return _recvBuffer;
 }
 
+ConnectionClass* Client::getConnectionClass() const
+{
+	return _connClass;
+}
+
 // Setters
 void Client::setNickname(const std::string& nickname)
 {
 	_nickname = nickname;
+	_maskStamp = nextMaskStamp();
 }
 
 void Client::setUsername(const std::string& username)
 {
 	_username = username;
+	_maskStamp = nextMaskStamp();
 }
 
 void Client::setRealname(const std::string& realname)
@@ -67,32 +136,93 @@ void Client::setRealname(const std::string& realname)
 	_realname = realname;
 }
 
+void Client::setHostname(const std::string& hostname)
+{
+	_hostname = hostname;
+	_maskStamp = nextMaskStamp();
+}
+
+void Client::setConnectionClass(ConnectionClass* connClass)
+{
+	_connClass = connClass;
+}
+
 void Client::setAuthenticated(bool authenticated)
 {
 	_authenticated = authenticated;
 }
 
+void Client::setPendingAuth(unsigned long long job)
+{
+	_pendingAuth = job;
+}
+
 void Client::setRegistered(bool registered)
 {
 	_registered = registered;
 }
 
+void Client::setServerOperator(bool isOperator)
+{
+	_isServerOperator = isOperator;
+}
+
+void Client::setCloseAfterFlush(bool close)
+{
+	_closeAfterFlush = close;
+}
+
+void Client::setCapabilities(unsigned int capabilities)
+{
+	_capabilities = capabilities;
+}
+
+void Client::setNegotiatingCaps(bool negotiating)
+{
+	_negotiatingCaps = negotiating;
+}
+
+void Client::setProtocol(ListenerProtocol protocol)
+{
+	_protocol = protocol;
+}
+
+void Client::setTls(TlsSession* tls)
+{
+	delete _tls;
+	_tls = tls;
+}
+
+void Client::setWebSocket(WebSocketSession* webSocket)
+{
+	delete _webSocket;
+	_webSocket = webSocket;
+}
+
 // Buffer management
 void Client::appendToRecvBuffer(const std::string& data)
 {
 	_recvBuffer += data;
+	if (_recvBuffer.size() > _recvBufferPeak)
+		_recvBufferPeak = _recvBuffer.size();
 }
 
 std::string Client::extractMessage()
 {
-	// Check if buffer exceeds 512 chars without \r\n
-	if (_recvBuffer.length() > 512)
+	// Check if buffer exceeds the line limit without \r\n; a tagged line
+	// may carry up to MAX_TAGS_LENGTH more
+	std::string::size_type limit = MAX_LINE_LENGTH;
+	if (!_recvBuffer.empty() && _recvBuffer[0] == '@')
+	{
+		limit += MAX_TAGS_LENGTH;
+	}
+	if (_recvBuffer.length() > limit)
 	{
 		std::string::size_type pos = _recvBuffer.find("\r\n");
 		if (pos == std::string::npos)
 		{
-			// Truncate to 512 chars
-			_recvBuffer = _recvBuffer.substr(0, 512);
+			// Truncate to the limit
+			_recvBuffer = _recvBuffer.substr(0, limit);
 			// Try to find \r\n again after truncation
 			pos = _recvBuffer.find("\r\n");
 			if (pos == std::string::npos)
@@ -144,23 +274,252 @@ std::string Client::extractMessage()
 	return message;
 }
 
+// Small replies coalesce into the last buffer while nobody shares it
+static const size_t SEND_COALESCE_LIMIT = 4096;
+
+void Client::queue(const std::string& data)
+{
+	if (data.empty())
+		return;
+	if (!_sendQueue.empty() && !_sendQueue.back().isShared() && _sendQueue.back().size() < SEND_COALESCE_LIMIT)
+		_sendQueue.back().append(data);
+	else
+		_sendQueue.push_back(SharedBuffer(data));
+	_sendQueued += data.size();
+	if (_sendQueued > _sendBufferPeak)
+		_sendBufferPeak = _sendQueued;
+}
+
+void Client::queue(const SharedBuffer& data)
+{
+	if (data.empty())
+		return;
+	_sendQueue.push_back(data);
+	_sendQueued += data.size();
+	if (_sendQueued > _sendBufferPeak)
+		_sendBufferPeak = _sendQueued;
+}
+
+// IRC output; WebSocket clients get it framed
 void Client::appendToSendBuffer(const std::string& message)
 {
-	_sendBuffer += message;
+	if (_webSocket != NULL && _webSocket->isOpen())
+		queue(_webSocket->frame(message));
+	else
+		queue(message);
+}
+
+void Client::appendToSendBuffer(const SharedBuffer& message)
+{
+	if (_webSocket != NULL && _webSocket->isOpen())
+		queue(_webSocket->frame(message));
+	else
+		queue(message);
+}
+
+void Client::appendRawToSendBuffer(const std::string& data)
+{
+	queue(data);
 }
 
 bool Client::hasMessageToSend() const
 {
-	return !_sendBuffer.empty();
+	return _sendQueued != 0;
 }
 
 std::string Client::getSendBuffer() const
 {
-	return _sendBuffer;
+	std::string pending;
+	pending.reserve(_sendQueued);
+	for (size_t i = _sendHead; i < _sendQueue.size(); ++i)
+	{
+		size_t skip = i == _sendHead ? _sendOffset : 0;
+		pending.append(_sendQueue[i].data() + skip, _sendQueue[i].size() - skip);
+	}
+	return pending;
+}
+
+size_t Client::getSendBufferSize() const
+{
+	return _sendQueued;
+}
+
+// Point iov at the unsent output, at most maxCount buffers; returns the count
+size_t Client::getSendIovec(struct iovec* iov, size_t maxCount) const
+{
+	size_t count = 0;
+	for (; _sendHead + count < _sendQueue.size() && count < maxCount; ++count)
+	{
+		const SharedBuffer& buffer = _sendQueue[_sendHead + count];
+		size_t skip = count == 0 ? _sendOffset : 0;
+		iov[count].iov_base = const_cast<char*>(buffer.data() + skip);
+		iov[count].iov_len = buffer.size() - skip;
+	}
+	return count;
+}
+
+// For sends that complete later: hold references the buffers, which also
+// keeps new output from being coalesced into them meanwhile
+size_t Client::getSendIovec(struct iovec* iov, size_t maxCount, std::vector<SharedBuffer>& hold) const
+{
+	size_t count = getSendIovec(iov, maxCount);
+	hold.assign(_sendQueue.begin() + _sendHead, _sendQueue.begin() + _sendHead + count);
+	return count;
+}
+
+// Sent buffers drop their reference right away; the vector keeps its
+// capacity and is only compacted once the sent prefix dominates it
+void Client::consumeSendBuffer(size_t bytes)
+{
+	_sendQueued -= bytes;
+	while (bytes > 0)
+	{
+		size_t available = _sendQueue[_sendHead].size() - _sendOffset;
+		if (bytes < available)
+		{
+			_sendOffset += bytes;
+			return;
+		}
+		bytes -= available;
+		_sendQueue[_sendHead++] = SharedBuffer();
+		_sendOffset = 0;
+	}
+	if (_sendHead == _sendQueue.size())
+	{
+		_sendQueue.clear();
+		_sendHead = 0;
+	}
+	else if (_sendHead >= 64 && _sendHead * 2 >= _sendQueue.size())
+	{
+		_sendQueue.erase(_sendQueue.begin(), _sendQueue.begin() + _sendHead);
+		_sendHead = 0;
+	}
 }
 
 void Client::clearSendBuffer()
 {
-	_sendBuffer.clear();
+	_sendQueue.clear();
+	_sendHead = 0;
+	_sendOffset = 0;
+	_sendQueued = 0;
+}
+
+std::string Client::takeRecvBuffer()
+{
+	std::string data;
+	data.swap(_recvBuffer);
+	return data;
+}
+
+// A partly sent first buffer is cut down to its unsent part
+void Client::takeSendQueue(std::vector<SharedBuffer>& out)
+{
+	for (size_t i = _sendHead; i < _sendQueue.size(); ++i)
+	{
+		if (i == _sendHead && _sendOffset != 0)
+			out.push_back(SharedBuffer(_sendQueue[i].str().substr(_sendOffset)));
+		else
+			out.push_back(_sendQueue[i]);
+	}
+	clearSendBuffer();
+}
+
+// Output that was queued elsewhere before ours; it goes out first
+void Client::prependToSendBuffer(const std::vector<SharedBuffer>& output)
+{
+	std::vector<SharedBuffer> pending;
+	takeSendQueue(pending);
+	for (size_t i = 0; i < output.size(); ++i)
+		queue(output[i]);
+	for (size_t i = 0; i < pending.size(); ++i)
+		queue(pending[i]);
+}
+
+
+// Memory accounting
+MemoryUsage Client::getMemoryUsage() const
+{
+	MemoryUsage usage;
+	usage.recvBuffers = MemoryUsage::stringBytes(_recvBuffer);
+	// A shared payload is split between everyone holding it
+	usage.sendBuffers = _sendQueue.capacity() * sizeof(SharedBuffer);
+	for (size_t i = _sendHead; i < _sendQueue.size(); ++i)
+	{
+		usage.sendBuffers += _sendQueue[i].str().capacity() / _sendQueue[i].getRefCount();
+	}
+	usage.clientIdentity = sizeof(Client) + MemoryUsage::stringBytes(_nickname) + MemoryUsage::stringBytes(_username)
+		+ MemoryUsage::stringBytes(_realname) + MemoryUsage::stringBytes(_hostname);
+	return usage;
 }
 
+size_t Client::getRecvBufferPeak() const
+{
+	return _recvBufferPeak;
+}
+
+size_t Client::getSendBufferPeak() const
+{
+	return _sendBufferPeak;
+}
+
+// Server linking
+bool Client::isRemote() const
+{
+	return _link != NULL;
+}
+
+bool Client::isServerLink() const
+{
+	return _linkState == LINK_ESTABLISHED;
+}
+
+LinkState Client::getLinkState() const
+{
+	return _linkState;
+}
+
+const std::string& Client::getLinkName() const
+{
+	return _linkName;
+}
+
+Client* Client::getLink() const
+{
+	return _link;
+}
+
+const std::string& Client::getServerName() const
+{
+	return _serverName;
+}
+
+time_t Client::getNickTs() const
+{
+	return _nickTs;
+}
+
+unsigned long Client::getMaskStamp() const
+{
+	return _maskStamp;
+}
+
+void Client::setLinkState(LinkState state)
+{
+	_linkState = state;
+}
+
+void Client::setLinkName(const std::string& name)
+{
+	_linkName = name;
+}
+
+void Client::setRemote(Client* link, const std::string& serverName)
+{
+	_link = link;
+	_serverName = serverName;
+}
+
+void Client::setNickTs(time_t ts)
+{
+	_nickTs = ts;
+}
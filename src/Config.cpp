@@ -0,0 +1,907 @@
+#include "Config.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <sched.h>
+
+ConnectionClass::ConnectionClass()
+	: name("default"), sendq(1048576), maxClients(0), clientCount(0)
+{
+}
+
+ListenerConfig::ListenerConfig()
+	: type(LISTEN_TCP4), protocol(PROTO_IRC), port(0), className("default"), backlog(128), v6only(false),
+	  noDelay(false), keepAlive(false), tls(false), sendBufferSize(0), recvBufferSize(0), mode(-1)
+{
+}
+
+std::string ListenerConfig::describe() const
+{
+	std::ostringstream oss;
+	switch (type)
+	{
+		case LISTEN_TCP4:
+			oss << "tcp4 " << address << ":" << port;
+			break;
+		case LISTEN_TCP6:
+			oss << "tcp6 [" << address << "]:" << port;
+			break;
+		case LISTEN_UNIX:
+			oss << "unix " << address;
+			break;
+	}
+	if (protocol == PROTO_METRICS)
+		oss << " (metrics";
+	else
+		oss << " (class " << className;
+	if (protocol == PROTO_WEBSOCKET)
+		oss << ", websocket";
+	oss << (tls ? ", tls)" : ")");
+	return oss.str();
+}
+
+LinkConfig::LinkConfig()
+	: port(0)
+{
+}
+
+Config::Config()
+	: _serverName("irc.server"), _logLevel(LOG_INFO), _logCategories(~0U), _traceEnabled(false), _traceFile("ircserv-trace.json"),
+	  _snapshotSlots(4096), _snapshotInterval(5), _historyLines(200), _historyBytes(64 * 1024),
+	  _historyTotal(64 * 1024 * 1024), _ktls(true), _ioBackend("auto"), _ioBuffers(256), _ioZeroCopy(0),
+	  _latencyCpu(-1), _busyPoll(0), _spinUsec(0), _authThreads(2),
+	  _pipelineThreads(0), _pipelineRing(4096), _fanoutThreads(0), _fanoutThreshold(10000)
+{
+}
+
+Config::Config(const Config& other)
+	: _listeners(other._listeners), _classes(other._classes), _operators(other._operators),
+	  _serverName(other._serverName), _links(other._links),
+	  _logLevel(other._logLevel), _logCategories(other._logCategories),
+	  _traceEnabled(other._traceEnabled), _traceFile(other._traceFile), _captureFile(other._captureFile),
+	  _snapshotFile(other._snapshotFile), _snapshotSlots(other._snapshotSlots), _snapshotInterval(other._snapshotInterval),
+	  _historyLines(other._historyLines), _historyBytes(other._historyBytes), _historyTotal(other._historyTotal),
+	  _tlsCertFile(other._tlsCertFile), _tlsKeyFile(other._tlsKeyFile), _ktls(other._ktls),
+	  _ioBackend(other._ioBackend), _ioBuffers(other._ioBuffers), _ioZeroCopy(other._ioZeroCopy),
+	  _latencyCpu(other._latencyCpu), _busyPoll(other._busyPoll), _spinUsec(other._spinUsec),
+	  _authThreads(other._authThreads), _pipelineThreads(other._pipelineThreads), _pipelineRing(other._pipelineRing),
+	  _fanoutThreads(other._fanoutThreads), _fanoutThreshold(other._fanoutThreshold)
+{
+}
+
+Config& Config::operator=(const Config& other)
+{
+	if (this != &other)
+	{
+		_listeners = other._listeners;
+		_classes = other._classes;
+		_operators = other._operators;
+		_serverName = other._serverName;
+		_links = other._links;
+		_logLevel = other._logLevel;
+		_logCategories = other._logCategories;
+		_traceEnabled = other._traceEnabled;
+		_traceFile = other._traceFile;
+		_captureFile = other._captureFile;
+		_snapshotFile = other._snapshotFile;
+		_snapshotSlots = other._snapshotSlots;
+		_snapshotInterval = other._snapshotInterval;
+		_historyLines = other._historyLines;
+		_historyBytes = other._historyBytes;
+		_historyTotal = other._historyTotal;
+		_tlsCertFile = other._tlsCertFile;
+		_tlsKeyFile = other._tlsKeyFile;
+		_ktls = other._ktls;
+		_ioBackend = other._ioBackend;
+		_ioBuffers = other._ioBuffers;
+		_ioZeroCopy = other._ioZeroCopy;
+		_latencyCpu = other._latencyCpu;
+		_busyPoll = other._busyPoll;
+		_spinUsec = other._spinUsec;
+		_authThreads = other._authThreads;
+		_pipelineThreads = other._pipelineThreads;
+		_pipelineRing = other._pipelineRing;
+		_fanoutThreads = other._fanoutThreads;
+		_fanoutThreshold = other._fanoutThreshold;
+	}
+	return *this;
+}
+
+Config::~Config()
+{
+}
+
+static std::runtime_error configError(int lineNumber, const std::string& message)
+{
+	std::ostringstream oss;
+	oss << "config line " << lineNumber << ": " << message;
+	return std::runtime_error(oss.str());
+}
+
+// Parse a non-negative decimal number, rejecting trailing garbage
+static long parseNumber(const std::string& value, int lineNumber, int base = 10)
+{
+	if (value.empty())
+	{
+		throw configError(lineNumber, "missing numeric value");
+	}
+	char* end = NULL;
+	long result = std::strtol(value.c_str(), &end, base);
+	if (*end != '\0' || result < 0)
+	{
+		throw configError(lineNumber, "invalid number '" + value + "'");
+	}
+	return result;
+}
+
+static bool parseBool(const std::string& value, int lineNumber)
+{
+	if (value == "1" || value == "yes" || value == "on" || value == "true")
+		return true;
+	if (value == "0" || value == "no" || value == "off" || value == "false")
+		return false;
+	throw configError(lineNumber, "invalid boolean '" + value + "'");
+}
+
+static void splitOption(const std::string& token, std::string& key, std::string& value)
+{
+	std::string::size_type eq = token.find('=');
+	if (eq == std::string::npos)
+	{
+		key = token;
+		value = "1";
+	}
+	else
+	{
+		key = token.substr(0, eq);
+		value = token.substr(eq + 1);
+	}
+}
+
+void Config::loadFile(const std::string& path)
+{
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		throw std::runtime_error("Failed to open config file: " + path);
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		parseLine(line, lineNumber);
+	}
+}
+
+void Config::parseLine(const std::string& line, int lineNumber)
+{
+	// A comment starts at a token beginning with '#'; a '#' inside a token
+	// (a password, a channel name) is kept
+	std::vector<std::string> tokens;
+	std::istringstream iss(line);
+	std::string token;
+	while (iss >> token && token[0] != '#')
+	{
+		tokens.push_back(token);
+	}
+
+	if (tokens.empty())
+	{
+		return;
+	}
+
+	if (tokens[0] == "class")
+	{
+		parseClass(tokens, lineNumber);
+	}
+	else if (tokens[0] == "listen")
+	{
+		parseListen(tokens, lineNumber);
+	}
+	else if (tokens[0] == "oper")
+	{
+		parseOper(tokens, lineNumber);
+	}
+	else if (tokens[0] == "server")
+	{
+		parseServer(tokens, lineNumber);
+	}
+	else if (tokens[0] == "link")
+	{
+		parseLink(tokens, lineNumber);
+	}
+	else if (tokens[0] == "log")
+	{
+		parseLog(tokens, lineNumber);
+	}
+	else if (tokens[0] == "trace")
+	{
+		parseTrace(tokens, lineNumber);
+	}
+	else if (tokens[0] == "capture")
+	{
+		parseCapture(tokens, lineNumber);
+	}
+	else if (tokens[0] == "snapshot")
+	{
+		parseSnapshot(tokens, lineNumber);
+	}
+	else if (tokens[0] == "history")
+	{
+		parseHistory(tokens, lineNumber);
+	}
+	else if (tokens[0] == "tls")
+	{
+		parseTls(tokens, lineNumber);
+	}
+	else if (tokens[0] == "io")
+	{
+		parseIo(tokens, lineNumber);
+	}
+	else if (tokens[0] == "latency")
+	{
+		parseLatency(tokens, lineNumber);
+	}
+	else if (tokens[0] == "auth")
+	{
+		parseAuth(tokens, lineNumber);
+	}
+	else if (tokens[0] == "pipeline")
+	{
+		parsePipeline(tokens, lineNumber);
+	}
+	else if (tokens[0] == "fanout")
+	{
+		parseFanout(tokens, lineNumber);
+	}
+	else
+	{
+		throw configError(lineNumber, "unknown directive '" + tokens[0] + "'");
+	}
+}
+
+// class <name> [sendq=<bytes>] [maxclients=<n>]
+void Config::parseClass(const std::vector<std::string>& tokens, int lineNumber)
+{
+	if (tokens.size() < 2)
+	{
+		throw configError(lineNumber, "class requires a name");
+	}
+
+	ConnectionClass connClass;
+	connClass.name = tokens[1];
+
+	for (size_t i = 2; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "sendq")
+			connClass.sendq = parseNumber(value, lineNumber);
+		else if (key == "maxclients")
+			connClass.maxClients = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown class option '" + key + "'");
+	}
+
+	// Later definitions override earlier ones with the same name
+	for (size_t i = 0; i < _classes.size(); ++i)
+	{
+		if (_classes[i].name == connClass.name)
+		{
+			_classes[i] = connClass;
+			return;
+		}
+	}
+	_classes.push_back(connClass);
+}
+
+// listen tcp4 <address> [port] [options...]
+// listen tcp6 <address> [port] [options...]
+// listen unix <path> [options...]
+void Config::parseListen(const std::vector<std::string>& tokens, int lineNumber)
+{
+	if (tokens.size() < 3)
+	{
+		throw configError(lineNumber, "listen requires a type and an address");
+	}
+
+	ListenerConfig listener;
+	if (tokens[1] == "tcp4")
+		listener.type = LISTEN_TCP4;
+	else if (tokens[1] == "tcp6")
+		listener.type = LISTEN_TCP6;
+	else if (tokens[1] == "unix")
+		listener.type = LISTEN_UNIX;
+	else
+		throw configError(lineNumber, "unknown listener type '" + tokens[1] + "'");
+
+	listener.address = tokens[2];
+
+	size_t i = 3;
+	if (listener.type != LISTEN_UNIX && i < tokens.size() && tokens[i].find('=') == std::string::npos)
+	{
+		long port = parseNumber(tokens[i], lineNumber);
+		if (port < 1 || port > 65535)
+		{
+			throw configError(lineNumber, "port out of range");
+		}
+		listener.port = static_cast<int>(port);
+		++i;
+	}
+
+	for (; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "class")
+			listener.className = value;
+		else if (key == "protocol")
+		{
+			if (value == "irc")
+				listener.protocol = PROTO_IRC;
+			else if (value == "websocket")
+				listener.protocol = PROTO_WEBSOCKET;
+			else if (value == "metrics")
+				listener.protocol = PROTO_METRICS;
+			else
+				throw configError(lineNumber, "unknown protocol '" + value + "'");
+		}
+		else if (key == "backlog")
+			listener.backlog = static_cast<int>(parseNumber(value, lineNumber));
+		else if (key == "v6only")
+			listener.v6only = parseBool(value, lineNumber);
+		else if (key == "nodelay")
+			listener.noDelay = parseBool(value, lineNumber);
+		else if (key == "keepalive")
+			listener.keepAlive = parseBool(value, lineNumber);
+		else if (key == "tls")
+			listener.tls = parseBool(value, lineNumber);
+		else if (key == "sndbuf")
+			listener.sendBufferSize = static_cast<int>(parseNumber(value, lineNumber));
+		else if (key == "rcvbuf")
+			listener.recvBufferSize = static_cast<int>(parseNumber(value, lineNumber));
+		else if (key == "mode")
+			listener.mode = static_cast<int>(parseNumber(value, lineNumber, 8));
+		else
+			throw configError(lineNumber, "unknown listener option '" + key + "'");
+	}
+
+	_listeners.push_back(listener);
+}
+
+// oper <name> <password or crypt(3) hash>
+void Config::parseOper(const std::vector<std::string>& tokens, int lineNumber)
+{
+	if (tokens.size() != 3)
+	{
+		throw configError(lineNumber, "oper requires a name and a password");
+	}
+	_operators[tokens[1]] = tokens[2];
+}
+
+// server <name>
+void Config::parseServer(const std::vector<std::string>& tokens, int lineNumber)
+{
+	if (tokens.size() != 2)
+	{
+		throw configError(lineNumber, "server requires a name");
+	}
+	if (tokens[1].find('.') == std::string::npos)
+	{
+		throw configError(lineNumber, "server name must contain a '.'");
+	}
+	_serverName = tokens[1];
+}
+
+// link <name> <address> <port> password=<secret>
+void Config::parseLink(const std::vector<std::string>& tokens, int lineNumber)
+{
+	if (tokens.size() < 4)
+	{
+		throw configError(lineNumber, "link requires a name, an address and a port");
+	}
+
+	LinkConfig link;
+	link.name = tokens[1];
+	link.address = tokens[2];
+	link.port = static_cast<int>(parseNumber(tokens[3], lineNumber));
+	if (link.name.find('.') == std::string::npos)
+	{
+		throw configError(lineNumber, "link name must be a server name containing a '.'");
+	}
+	if (link.port < 1 || link.port > 65535)
+	{
+		throw configError(lineNumber, "link port out of range");
+	}
+
+	for (size_t i = 4; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "password")
+			link.password = value;
+		else
+			throw configError(lineNumber, "unknown link option '" + key + "'");
+	}
+	if (link.password.empty())
+	{
+		throw configError(lineNumber, "link needs password=<secret>");
+	}
+	_links[link.name] = link;
+}
+
+// log [level=<debug|info|warn|error>] [categories=<server,net,cmd,chan>]
+void Config::parseLog(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "level")
+		{
+			if (!Logger::parseLevel(value, _logLevel))
+				throw configError(lineNumber, "unknown log level '" + value + "'");
+		}
+		else if (key == "categories")
+		{
+			_logCategories = 0;
+			std::istringstream names(value);
+			std::string name;
+			while (std::getline(names, name, ','))
+			{
+				LogCategory category;
+				if (!Logger::parseCategory(name, category))
+					throw configError(lineNumber, "unknown log category '" + name + "'");
+				_logCategories |= 1U << category;
+			}
+		}
+		else
+			throw configError(lineNumber, "unknown log option '" + key + "'");
+	}
+}
+
+// trace [enabled=<0|1>] [file=<path>]
+void Config::parseTrace(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "enabled")
+			_traceEnabled = parseBool(value, lineNumber);
+		else if (key == "file")
+			_traceFile = value;
+		else
+			throw configError(lineNumber, "unknown trace option '" + key + "'");
+	}
+}
+
+// capture file=<path>
+void Config::parseCapture(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "file")
+			_captureFile = value;
+		else
+			throw configError(lineNumber, "unknown capture option '" + key + "'");
+	}
+	if (_captureFile.empty())
+		throw configError(lineNumber, "capture needs file=<path>");
+}
+
+// snapshot file=<path> [slots=<n>] [interval=<seconds>]
+void Config::parseSnapshot(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "file")
+			_snapshotFile = value;
+		else if (key == "slots")
+			_snapshotSlots = parseNumber(value, lineNumber);
+		else if (key == "interval")
+			_snapshotInterval = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown snapshot option '" + key + "'");
+	}
+	if (_snapshotFile.empty())
+		throw configError(lineNumber, "snapshot needs file=<path>");
+	if (_snapshotSlots == 0 || _snapshotInterval == 0)
+		throw configError(lineNumber, "snapshot slots and interval must be positive");
+}
+
+// history [lines=<n>] [bytes=<n>] [total=<bytes>]
+void Config::parseHistory(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "lines")
+			_historyLines = parseNumber(value, lineNumber);
+		else if (key == "bytes")
+			_historyBytes = parseNumber(value, lineNumber);
+		else if (key == "total")
+			_historyTotal = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown history option '" + key + "'");
+	}
+}
+
+// tls cert=<path> key=<path> [ktls=yes|no]
+void Config::parseTls(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "cert")
+			_tlsCertFile = value;
+		else if (key == "key")
+			_tlsKeyFile = value;
+		else if (key == "ktls")
+			_ktls = parseBool(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown tls option '" + key + "'");
+	}
+	if (_tlsCertFile.empty() || _tlsKeyFile.empty())
+		throw configError(lineNumber, "tls needs cert=<path> and key=<path>");
+}
+
+// io [backend=auto|poll|epoll|io_uring] [buffers=<n>] [zerocopy=<bytes>]
+void Config::parseIo(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "backend")
+		{
+			if (value != "auto" && value != "poll" && value != "epoll" && value != "io_uring")
+				throw configError(lineNumber, "io backend must be auto, poll, epoll or io_uring");
+			_ioBackend = value;
+		}
+		else if (key == "buffers")
+			_ioBuffers = parseNumber(value, lineNumber);
+		else if (key == "zerocopy")
+			_ioZeroCopy = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown io option '" + key + "'");
+	}
+	if (_ioBuffers == 0 || _ioBuffers > 32768 || (_ioBuffers & (_ioBuffers - 1)) != 0)
+		throw configError(lineNumber, "io buffers must be a power of two up to 32768");
+	// Pinning pages costs more than copying a few of them
+	if (_ioZeroCopy != 0 && _ioZeroCopy < 4096)
+		throw configError(lineNumber, "io zerocopy must be 0 or at least 4096 bytes");
+}
+
+// latency [cpu=<n>] [busypoll=<usec>] [spin=<usec>]
+void Config::parseLatency(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "cpu")
+		{
+			long cpu = parseNumber(value, lineNumber);
+			if (cpu >= CPU_SETSIZE)
+				throw configError(lineNumber, "latency cpu out of range");
+			_latencyCpu = static_cast<int>(cpu);
+		}
+		else if (key == "busypoll")
+		{
+			long usec = parseNumber(value, lineNumber);
+			if (usec > 1000000)
+				throw configError(lineNumber, "latency busypoll must be at most 1000000 microseconds");
+			_busyPoll = static_cast<int>(usec);
+		}
+		else if (key == "spin")
+		{
+			long usec = parseNumber(value, lineNumber);
+			if (usec > 100000)
+				throw configError(lineNumber, "latency spin must be at most 100000 microseconds");
+			_spinUsec = static_cast<unsigned int>(usec);
+		}
+		else
+			throw configError(lineNumber, "unknown latency option '" + key + "'");
+	}
+}
+
+// auth [threads=<n>]
+void Config::parseAuth(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "threads")
+			_authThreads = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown auth option '" + key + "'");
+	}
+	if (_authThreads == 0 || _authThreads > 64)
+		throw configError(lineNumber, "auth threads must be between 1 and 64");
+}
+
+// pipeline [threads=<n>] [ring=<entries>]
+void Config::parsePipeline(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "threads")
+			_pipelineThreads = parseNumber(value, lineNumber);
+		else if (key == "ring")
+			_pipelineRing = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown pipeline option '" + key + "'");
+	}
+	if (_pipelineThreads > 64)
+		throw configError(lineNumber, "pipeline threads must be at most 64");
+	if (_pipelineRing < 16 || _pipelineRing > 1048576 || (_pipelineRing & (_pipelineRing - 1)) != 0)
+		throw configError(lineNumber, "pipeline ring must be a power of two from 16 to 1048576");
+}
+
+// fanout [threads=<n>] [threshold=<members>]
+void Config::parseFanout(const std::vector<std::string>& tokens, int lineNumber)
+{
+	for (size_t i = 1; i < tokens.size(); ++i)
+	{
+		std::string key;
+		std::string value;
+		splitOption(tokens[i], key, value);
+
+		if (key == "threads")
+			_fanoutThreads = parseNumber(value, lineNumber);
+		else if (key == "threshold")
+			_fanoutThreshold = parseNumber(value, lineNumber);
+		else
+			throw configError(lineNumber, "unknown fanout option '" + key + "'");
+	}
+	if (_fanoutThreads > 64)
+		throw configError(lineNumber, "fanout threads must be at most 64");
+	if (_fanoutThreshold == 0)
+		throw configError(lineNumber, "fanout threshold must be at least 1");
+}
+
+// Fill in everything the config file left out: the default class, a plain
+// IPv4 listener when none was configured, and the command line port for
+// TCP listeners that did not name one.
+void Config::applyDefaults(int port)
+{
+	bool hasDefaultClass = false;
+	for (size_t i = 0; i < _classes.size(); ++i)
+	{
+		if (_classes[i].name == "default")
+			hasDefaultClass = true;
+	}
+	if (!hasDefaultClass)
+	{
+		_classes.push_back(ConnectionClass());
+	}
+
+	if (_listeners.empty())
+	{
+		ListenerConfig listener;
+		listener.address = "0.0.0.0";
+		_listeners.push_back(listener);
+	}
+
+	for (size_t i = 0; i < _listeners.size(); ++i)
+	{
+		if (_listeners[i].type != LISTEN_UNIX && _listeners[i].port == 0)
+		{
+			_listeners[i].port = port;
+		}
+
+		bool classFound = false;
+		for (size_t j = 0; j < _classes.size(); ++j)
+		{
+			if (_classes[j].name == _listeners[i].className)
+				classFound = true;
+		}
+		if (!classFound)
+		{
+			throw std::runtime_error("Listener " + _listeners[i].describe() + " uses undefined class");
+		}
+		if (_listeners[i].tls && _tlsCertFile.empty())
+		{
+			throw std::runtime_error("Listener " + _listeners[i].describe() + " uses tls without a tls directive");
+		}
+	}
+}
+
+const std::vector<ListenerConfig>& Config::getListeners() const
+{
+	return _listeners;
+}
+
+const std::vector<ConnectionClass>& Config::getClasses() const
+{
+	return _classes;
+}
+
+const std::map<std::string, std::string>& Config::getOperators() const
+{
+	return _operators;
+}
+
+const std::string& Config::getServerName() const
+{
+	return _serverName;
+}
+
+const std::map<std::string, LinkConfig>& Config::getLinks() const
+{
+	return _links;
+}
+
+LogLevel Config::getLogLevel() const
+{
+	return _logLevel;
+}
+
+unsigned int Config::getLogCategories() const
+{
+	return _logCategories;
+}
+
+bool Config::isTraceEnabled() const
+{
+	return _traceEnabled;
+}
+
+const std::string& Config::getTraceFile() const
+{
+	return _traceFile;
+}
+
+const std::string& Config::getCaptureFile() const
+{
+	return _captureFile;
+}
+
+const std::string& Config::getSnapshotFile() const
+{
+	return _snapshotFile;
+}
+
+size_t Config::getSnapshotSlots() const
+{
+	return _snapshotSlots;
+}
+
+unsigned int Config::getSnapshotInterval() const
+{
+	return _snapshotInterval;
+}
+
+size_t Config::getHistoryLines() const
+{
+	return _historyLines;
+}
+
+size_t Config::getHistoryBytes() const
+{
+	return _historyBytes;
+}
+
+size_t Config::getHistoryTotal() const
+{
+	return _historyTotal;
+}
+
+const std::string& Config::getTlsCertFile() const
+{
+	return _tlsCertFile;
+}
+
+const std::string& Config::getTlsKeyFile() const
+{
+	return _tlsKeyFile;
+}
+
+bool Config::isKtlsEnabled() const
+{
+	return _ktls;
+}
+
+bool Config::hasTlsListener() const
+{
+	for (size_t i = 0; i < _listeners.size(); ++i)
+	{
+		if (_listeners[i].tls)
+			return true;
+	}
+	return false;
+}
+
+const std::string& Config::getIoBackend() const
+{
+	return _ioBackend;
+}
+
+size_t Config::getIoBuffers() const
+{
+	return _ioBuffers;
+}
+
+size_t Config::getIoZeroCopy() const
+{
+	return _ioZeroCopy;
+}
+
+int Config::getLatencyCpu() const
+{
+	return _latencyCpu;
+}
+
+int Config::getBusyPoll() const
+{
+	return _busyPoll;
+}
+
+unsigned int Config::getSpinUsec() const
+{
+	return _spinUsec;
+}
+
+size_t Config::getAuthThreads() const
+{
+	return _authThreads;
+}
+
+size_t Config::getPipelineThreads() const
+{
+	return _pipelineThreads;
+}
+
+size_t Config::getPipelineRing() const
+{
+	return _pipelineRing;
+}
+
+size_t Config::getFanoutThreads() const
+{
+	return _fanoutThreads;
+}
+
+size_t Config::getFanoutThreshold() const
+{
+	return _fanoutThreshold;
+}
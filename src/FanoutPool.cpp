@@ -0,0 +1,120 @@
+#include "FanoutPool.hpp"
+
+FanoutPool::FanoutPool()
+	: _task(NULL), _context(NULL), _generation(0), _startGeneration(0), _pending(0), _nextPart(1), _threshold(0),
+	  _running(false)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeup, NULL);
+	pthread_cond_init(&_finished, NULL);
+}
+
+FanoutPool::~FanoutPool()
+{
+	stop();
+	pthread_cond_destroy(&_finished);
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+}
+
+FanoutPool& FanoutPool::instance()
+{
+	static FanoutPool pool;
+	return pool;
+}
+
+bool FanoutPool::start(size_t threads, size_t threshold, std::string& error)
+{
+	stop();
+	_threshold = threshold;
+	_nextPart = 1;
+	_startGeneration = _generation;
+	_running = true;
+	for (size_t i = 0; i < threads; ++i)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, workerThread, this) != 0)
+		{
+			error = "failed to start a fan-out thread";
+			stop();
+			return false;
+		}
+		_threads.push_back(thread);
+	}
+	return true;
+}
+
+void FanoutPool::stop()
+{
+	pthread_mutex_lock(&_mutex);
+	_running = false;
+	pthread_cond_broadcast(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	for (size_t i = 0; i < _threads.size(); ++i)
+	{
+		pthread_join(_threads[i], NULL);
+	}
+	_threads.clear();
+}
+
+bool FanoutPool::shouldSplit(size_t members) const
+{
+	return !_threads.empty() && members >= _threshold;
+}
+
+size_t FanoutPool::getParts() const
+{
+	return _threads.size() + 1;
+}
+
+void* FanoutPool::workerThread(void* arg)
+{
+	static_cast<FanoutPool*>(arg)->workerLoop();
+	return NULL;
+}
+
+void FanoutPool::workerLoop()
+{
+	pthread_mutex_lock(&_mutex);
+	size_t part = _nextPart++;
+	// A job may have been posted before this thread got here
+	unsigned long seen = _startGeneration;
+	while (true)
+	{
+		while (_running && _generation == seen)
+			pthread_cond_wait(&_wakeup, &_mutex);
+		if (!_running)
+			break;
+		seen = _generation;
+		FanoutTask task = _task;
+		void* context = _context;
+		size_t parts = _threads.size() + 1;
+		pthread_mutex_unlock(&_mutex);
+
+		task(context, part, parts);
+
+		pthread_mutex_lock(&_mutex);
+		if (--_pending == 0)
+			pthread_cond_signal(&_finished);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void FanoutPool::run(FanoutTask task, void* context)
+{
+	size_t parts = getParts();
+	pthread_mutex_lock(&_mutex);
+	_task = task;
+	_context = context;
+	_pending = parts - 1;
+	_generation++;
+	pthread_cond_broadcast(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+
+	task(context, 0, parts);
+
+	pthread_mutex_lock(&_mutex);
+	while (_pending != 0)
+		pthread_cond_wait(&_finished, &_mutex);
+	pthread_mutex_unlock(&_mutex);
+}
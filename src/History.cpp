@@ -0,0 +1,189 @@
+#include "History.hpp"
+#include <sys/time.h>
+#include <cstdio>
+#include <ctime>
+#include <cstring>
+
+HistoryEntry::HistoryEntry()
+	: timeMs(0), seq(0)
+{
+}
+
+ChannelHistory::ChannelHistory()
+	: _capacity(0), _head(0), _count(0), _bytes(0), _maxBytes(0)
+{
+}
+
+ChannelHistory::~ChannelHistory()
+{
+}
+
+void ChannelHistory::configure(size_t maxLines, size_t maxBytes)
+{
+	clear();
+	_ring.clear();
+	_capacity = maxLines;
+	_maxBytes = maxBytes;
+}
+
+bool ChannelHistory::isEnabled() const
+{
+	return _capacity != 0;
+}
+
+void ChannelHistory::push(const HistoryEntry& entry)
+{
+	if (_capacity == 0)
+		return;
+	if (_ring.empty())
+		_ring.resize(_capacity);
+	if (_count == _ring.size())
+		popOldest();
+	while (_count > 0 && _bytes + entry.line.size() > _maxBytes)
+		popOldest();
+
+	_ring[(_head + _count) % _ring.size()] = entry;
+	_count++;
+	_bytes += entry.line.size();
+}
+
+// Drop the slot's reference too, so the payload is freed once every send
+// queue is done with it
+void ChannelHistory::popOldest()
+{
+	if (_count == 0)
+		return;
+	_bytes -= _ring[_head].line.size();
+	_ring[_head] = HistoryEntry();
+	_head = (_head + 1) % _ring.size();
+	_count--;
+}
+
+void ChannelHistory::clear()
+{
+	while (_count > 0)
+		popOldest();
+	_head = 0;
+}
+
+size_t ChannelHistory::size() const
+{
+	return _count;
+}
+
+bool ChannelHistory::empty() const
+{
+	return _count == 0;
+}
+
+size_t ChannelHistory::getBytes() const
+{
+	return _bytes;
+}
+
+const HistoryEntry& ChannelHistory::at(size_t index) const
+{
+	return _ring[(_head + index) % _ring.size()];
+}
+
+const HistoryEntry& ChannelHistory::oldest() const
+{
+	return at(0);
+}
+
+const HistoryEntry& ChannelHistory::newest() const
+{
+	return at(_count - 1);
+}
+
+// Entries are in time order, so both bounds are binary searches
+size_t ChannelHistory::lowerBound(long long timeMs) const
+{
+	size_t low = 0;
+	size_t high = _count;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (at(middle).timeMs < timeMs)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t ChannelHistory::upperBound(long long timeMs) const
+{
+	size_t low = 0;
+	size_t high = _count;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (at(middle).timeMs <= timeMs)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t ChannelHistory::find(const std::string& msgid) const
+{
+	for (size_t i = 0; i < _count; ++i)
+	{
+		if (at(i).msgid == msgid)
+			return i;
+	}
+	return _count;
+}
+
+long long historyNowMs()
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return static_cast<long long>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+std::string formatHistoryTime(long long timeMs)
+{
+	time_t seconds = static_cast<time_t>(timeMs / 1000);
+	struct tm utc;
+	gmtime_r(&seconds, &utc);
+	char text[32];
+	std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", utc.tm_year + 1900, utc.tm_mon + 1,
+		utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(timeMs % 1000));
+	return text;
+}
+
+// Milliseconds are optional; anything but UTC ("Z") is rejected
+bool parseHistoryTime(const std::string& text, long long& timeMs)
+{
+	struct tm utc;
+	std::memset(&utc, 0, sizeof(utc));
+	int millis = 0;
+	int consumed = 0;
+	if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n", &utc.tm_year, &utc.tm_mon, &utc.tm_mday,
+			&utc.tm_hour, &utc.tm_min, &utc.tm_sec, &consumed) != 6)
+		return false;
+	std::string rest = text.substr(consumed);
+	if (rest.size() == 5 && rest[0] == '.')
+	{
+		for (size_t i = 1; i < 4; ++i)
+		{
+			if (rest[i] < '0' || rest[i] > '9')
+				return false;
+			millis = millis * 10 + (rest[i] - '0');
+		}
+		rest.erase(0, 4);
+	}
+	if (rest != "Z")
+		return false;
+
+	utc.tm_year -= 1900;
+	utc.tm_mon -= 1;
+	time_t seconds = timegm(&utc);
+	if (seconds == static_cast<time_t>(-1))
+		return false;
+	timeMs = static_cast<long long>(seconds) * 1000 + millis;
+	return true;
+}
@@ -0,0 +1,273 @@
+#include "IoBackend.hpp"
+#include "IoUring.hpp"
+#include "Metrics.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Starting epoll_wait() batch; doubled whenever a wait fills it
+static const size_t EPOLL_BATCH = 256;
+
+IoEvent::IoEvent()
+	: fd(-1), type(IO_READY), revents(0), result(0), data(NULL), length(0)
+{
+}
+
+IoBackend::IoBackend()
+	: _batch(NULL)
+{
+}
+
+IoBackend::~IoBackend()
+{
+}
+
+void IoBackend::startBatch(std::vector<IoEvent>& events)
+{
+	events.clear();
+	_batch = &events;
+}
+
+void IoBackend::add(int fd, short events, unsigned int flags)
+{
+	(void)flags;
+	_watched[fd] = events;
+}
+
+void IoBackend::modify(int fd, short events)
+{
+	std::map<int, short>::iterator it = _watched.find(fd);
+	if (it != _watched.end())
+		it->second = events;
+}
+
+// The descriptor number may be reused right away, by a connection accepted
+// later in the same batch, so its pending events must not reach that one
+void IoBackend::remove(int fd)
+{
+	_watched.erase(fd);
+	if (_batch == NULL)
+		return;
+	for (size_t i = 0; i < _batch->size(); ++i)
+	{
+		if ((*_batch)[i].fd == fd)
+			(*_batch)[i].type = IO_DISCARDED;
+	}
+}
+
+bool IoBackend::canSend() const
+{
+	return false;
+}
+
+bool IoBackend::isSending(int fd) const
+{
+	(void)fd;
+	return false;
+}
+
+void IoBackend::send(int fd, const struct iovec* iov, size_t count, const std::vector<SharedBuffer>& hold)
+{
+	(void)fd;
+	(void)iov;
+	(void)count;
+	(void)hold;
+}
+
+void IoBackend::suspend(std::vector<IoEvent>& events)
+{
+	startBatch(events);
+}
+
+void IoBackend::resume()
+{
+}
+
+bool IoBackend::isWatched(int fd) const
+{
+	return _watched.count(fd) != 0;
+}
+
+short IoBackend::getEvents(int fd) const
+{
+	std::map<int, short>::const_iterator it = _watched.find(fd);
+	return it == _watched.end() ? 0 : it->second;
+}
+
+const std::map<int, short>& IoBackend::getWatched() const
+{
+	return _watched;
+}
+
+// poll
+PollBackend::PollBackend()
+{
+}
+
+PollBackend::~PollBackend()
+{
+}
+
+const char* PollBackend::getName() const
+{
+	return "poll";
+}
+
+void PollBackend::add(int fd, short events, unsigned int flags)
+{
+	IoBackend::add(fd, events, flags);
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	_pollfds.push_back(pfd);
+}
+
+void PollBackend::modify(int fd, short events)
+{
+	IoBackend::modify(fd, events);
+	for (std::vector<struct pollfd>::iterator it = _pollfds.begin(); it != _pollfds.end(); ++it)
+	{
+		if (it->fd == fd)
+		{
+			it->events = events;
+			return;
+		}
+	}
+}
+
+void PollBackend::remove(int fd)
+{
+	IoBackend::remove(fd);
+	for (std::vector<struct pollfd>::iterator it = _pollfds.begin(); it != _pollfds.end(); ++it)
+	{
+		if (it->fd == fd)
+		{
+			_pollfds.erase(it);
+			return;
+		}
+	}
+}
+
+int PollBackend::wait(int timeoutMs, std::vector<IoEvent>& events)
+{
+	startBatch(events);
+	Metrics::instance().addIoSyscall();
+	int ready = poll(_pollfds.empty() ? NULL : &_pollfds[0], _pollfds.size(), timeoutMs);
+	if (ready <= 0)
+		return ready;
+	for (size_t i = 0; i < _pollfds.size(); ++i)
+	{
+		if (_pollfds[i].revents == 0)
+			continue;
+		IoEvent event;
+		event.fd = _pollfds[i].fd;
+		event.revents = _pollfds[i].revents;
+		events.push_back(event);
+	}
+	return events.size();
+}
+
+// epoll
+EpollBackend::EpollBackend()
+	: _epollFd(-1), _ready(EPOLL_BATCH)
+{
+}
+
+EpollBackend::~EpollBackend()
+{
+	if (_epollFd != -1)
+		close(_epollFd);
+}
+
+bool EpollBackend::init(std::string& error)
+{
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd == -1)
+	{
+		error = std::string("epoll_create1: ") + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+const char* EpollBackend::getName() const
+{
+	return "epoll";
+}
+
+// POLLIN/POLLOUT and EPOLLIN/EPOLLOUT share their values on Linux
+void EpollBackend::add(int fd, short events, unsigned int flags)
+{
+	IoBackend::add(fd, events, flags);
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = static_cast<unsigned short>(events);
+	event.data.fd = fd;
+	Metrics::instance().addIoSyscall();
+	epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void EpollBackend::modify(int fd, short events)
+{
+	if (getEvents(fd) == events)
+		return;
+	IoBackend::modify(fd, events);
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = static_cast<unsigned short>(events);
+	event.data.fd = fd;
+	Metrics::instance().addIoSyscall();
+	epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EpollBackend::remove(int fd)
+{
+	IoBackend::remove(fd);
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	Metrics::instance().addIoSyscall();
+	epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, &event);
+}
+
+int EpollBackend::wait(int timeoutMs, std::vector<IoEvent>& events)
+{
+	startBatch(events);
+	Metrics::instance().addIoSyscall();
+	int ready = epoll_wait(_epollFd, &_ready[0], _ready.size(), timeoutMs);
+	if (ready <= 0)
+		return ready;
+	for (int i = 0; i < ready; ++i)
+	{
+		IoEvent event;
+		event.fd = _ready[i].data.fd;
+		event.revents = static_cast<short>(_ready[i].events);
+		events.push_back(event);
+	}
+	if (static_cast<size_t>(ready) == _ready.size())
+		_ready.resize(_ready.size() * 2);
+	return ready;
+}
+
+IoBackend* createIoBackend(const std::string& name, size_t receiveBuffers, std::string& error)
+{
+	if (name == "io_uring" || name == "auto")
+	{
+		UringBackend* uring = new UringBackend(receiveBuffers);
+		if (uring->init(error))
+			return uring;
+		delete uring;
+		if (name == "io_uring")
+			return NULL;
+	}
+	if (name == "epoll" || name == "auto")
+	{
+		EpollBackend* epoll = new EpollBackend();
+		if (epoll->init(error))
+			return epoll;
+		delete epoll;
+		if (name == "epoll")
+			return NULL;
+	}
+	return new PollBackend();
+}
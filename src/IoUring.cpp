@@ -0,0 +1,588 @@
+#include "IoUring.hpp"
+#include "Metrics.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+// user_data: descriptor in the low 32 bits, then the operation, then a
+// sequence number so a completion for a closed and reused descriptor is
+// recognised as stale
+enum UringOp
+{
+	URING_ACCEPT = 1,
+	URING_RECV = 2,
+	URING_POLL = 3,
+	URING_SEND = 4,
+	URING_CANCEL = 5
+};
+
+static int uringFd(unsigned long long data)
+{
+	return static_cast<int>(data & 0xffffffffULL);
+}
+
+static unsigned int uringOp(unsigned long long data)
+{
+	return static_cast<unsigned int>((data >> 32) & 0xf);
+}
+
+UringBackend::Watch::Watch()
+	: flags(0), readData(0), pollData(0), sendData(0), pollEvents(0)
+{
+}
+
+UringBackend::UringBackend(size_t bufferCount)
+	: _bufferCount(bufferCount), _ringFd(-1), _ring(MAP_FAILED), _ringSize(0), _sqes(NULL), _sqesSize(0),
+	  _sqHead(NULL), _sqTail(NULL), _sqArray(NULL), _sqMask(0), _sqEntries(0), _sqLocalTail(0), _cqHead(NULL),
+	  _cqTail(NULL), _cqMask(0), _cqes(NULL), _bufRing(NULL), _bufRingSize(0), _buffers(NULL), _bufTail(0),
+	  _orphans(0), _seq(0), _suspended(false)
+{
+}
+
+UringBackend::~UringBackend()
+{
+	// Closing the ring cancels whatever is still in flight
+	if (_ringFd != -1)
+		close(_ringFd);
+	for (std::map<unsigned long long, Send*>::iterator it = _sends.begin(); it != _sends.end(); ++it)
+		delete it->second;
+	if (_sqes != NULL)
+		munmap(_sqes, _sqesSize);
+	if (_ring != MAP_FAILED)
+		munmap(_ring, _ringSize);
+	if (_bufRing != NULL)
+		munmap(_bufRing, _bufRingSize);
+	delete[] _buffers;
+}
+
+// Multishot recv and provided buffer rings arrived in 6.0
+static bool kernelSupported()
+{
+	struct utsname name;
+	if (uname(&name) == -1)
+		return false;
+	return std::strtol(name.release, NULL, 10) >= 6;
+}
+
+bool UringBackend::init(std::string& error)
+{
+	if (!kernelSupported())
+	{
+		error = "io_uring needs Linux 6.0 or later";
+		return false;
+	}
+	return setupRing(error) && setupBuffers(error);
+}
+
+bool UringBackend::setupRing(std::string& error)
+{
+	struct io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN
+		| IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = URING_SQ_ENTRIES * URING_CQ_FACTOR;
+	_ringFd = syscall(SYS_io_uring_setup, URING_SQ_ENTRIES, &params);
+	if (_ringFd == -1 && errno == EINVAL)
+	{
+		// Task run tuning is 6.1; the ring works without it
+		std::memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL;
+		params.cq_entries = URING_SQ_ENTRIES * URING_CQ_FACTOR;
+		_ringFd = syscall(SYS_io_uring_setup, URING_SQ_ENTRIES, &params);
+	}
+	if (_ringFd == -1)
+	{
+		error = std::string("io_uring_setup: ") + strerror(errno);
+		return false;
+	}
+	unsigned int needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+	if ((params.features & needed) != needed)
+	{
+		error = "io_uring lacks single mmap, no-drop or extended wait arguments";
+		return false;
+	}
+
+	// Submission and completion rings share one mapping
+	size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	_ringSize = sqSize > cqSize ? sqSize : cqSize;
+	_ring = mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+	if (_ring == MAP_FAILED)
+	{
+		error = std::string("io_uring ring mmap: ") + strerror(errno);
+		return false;
+	}
+	_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	void* sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		error = std::string("io_uring sqe mmap: ") + strerror(errno);
+		return false;
+	}
+	_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+	char* base = static_cast<char*>(_ring);
+	_sqHead = reinterpret_cast<unsigned int*>(base + params.sq_off.head);
+	_sqTail = reinterpret_cast<unsigned int*>(base + params.sq_off.tail);
+	_sqArray = reinterpret_cast<unsigned int*>(base + params.sq_off.array);
+	_sqMask = *reinterpret_cast<unsigned int*>(base + params.sq_off.ring_mask);
+	_sqEntries = params.sq_entries;
+	_cqHead = reinterpret_cast<unsigned int*>(base + params.cq_off.head);
+	_cqTail = reinterpret_cast<unsigned int*>(base + params.cq_off.tail);
+	_cqMask = *reinterpret_cast<unsigned int*>(base + params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+	// Entries are used in ring order, so the index array never changes
+	for (unsigned int i = 0; i < _sqEntries; ++i)
+		_sqArray[i] = i;
+	_sqLocalTail = *_sqTail;
+	return true;
+}
+
+bool UringBackend::setupBuffers(std::string& error)
+{
+	if (_bufferCount == 0 || _bufferCount > 32768 || (_bufferCount & (_bufferCount - 1)) != 0)
+	{
+		error = "io_uring buffer count must be a power of two up to 32768";
+		return false;
+	}
+	_bufRingSize = _bufferCount * sizeof(struct io_uring_buf);
+	void* ring = mmap(NULL, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+	{
+		error = std::string("io_uring buffer ring mmap: ") + strerror(errno);
+		return false;
+	}
+	_bufRing = static_cast<struct io_uring_buf*>(ring);
+
+	struct io_uring_buf_reg reg;
+	std::memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<unsigned long>(_bufRing);
+	reg.ring_entries = _bufferCount;
+	reg.bgid = 0;
+	if (syscall(SYS_io_uring_register, _ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+	{
+		error = std::string("io_uring buffer ring registration: ") + strerror(errno);
+		return false;
+	}
+
+	_buffers = new char[_bufferCount * URING_BUFFER_SIZE];
+	for (size_t i = 0; i < _bufferCount; ++i)
+		provideBuffer(i);
+	__atomic_store_n(&_bufRing[0].resv, _bufTail, __ATOMIC_RELEASE);
+	return true;
+}
+
+const char* UringBackend::getName() const
+{
+	return "io_uring";
+}
+
+// Hand a receive buffer back to the kernel; published by the caller. The
+// ring's tail overlays the first entry's reserved field.
+void UringBackend::provideBuffer(unsigned short id)
+{
+	struct io_uring_buf& entry = _bufRing[_bufTail & (_bufferCount - 1)];
+	entry.addr = reinterpret_cast<unsigned long>(_buffers + id * URING_BUFFER_SIZE);
+	entry.len = URING_BUFFER_SIZE;
+	entry.bid = id;
+	++_bufTail;
+}
+
+// The data they held was handled when the previous wait() returned
+void UringBackend::recycleBuffers()
+{
+	if (_recycle.empty())
+		return;
+	for (size_t i = 0; i < _recycle.size(); ++i)
+		provideBuffer(_recycle[i]);
+	__atomic_store_n(&_bufRing[0].resv, _bufTail, __ATOMIC_RELEASE);
+	_recycle.clear();
+}
+
+// Next free submission entry, submitting what is queued if the ring is full
+struct io_uring_sqe* UringBackend::getSqe()
+{
+	if (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+		enter(false, 0);
+	struct io_uring_sqe* sqe = &_sqes[_sqLocalTail & _sqMask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	++_sqLocalTail;
+	return sqe;
+}
+
+unsigned long long UringBackend::nextData(int fd, unsigned int op)
+{
+	return static_cast<unsigned long long>(static_cast<unsigned int>(fd))
+		| (static_cast<unsigned long long>(op) << 32) | (++_seq << 36);
+}
+
+// Submit everything queued; with getEvents also run completions, waiting up
+// to timeoutMs for one unless some are already there
+int UringBackend::enter(bool getEvents, int timeoutMs)
+{
+	__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+	unsigned int toSubmit = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+	if (!getEvents && toSubmit == 0)
+		return 0;
+
+	unsigned int flags = 0;
+	unsigned int minComplete = 0;
+	struct __kernel_timespec timeout;
+	struct io_uring_getevents_arg arg;
+	std::memset(&arg, 0, sizeof(arg));
+	if (getEvents)
+	{
+		flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+		arg.ts = reinterpret_cast<unsigned long>(&timeout);
+		bool pending = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE) != *_cqHead;
+		minComplete = pending || timeoutMs == 0 ? 0 : 1;
+	}
+	Metrics::instance().addIoSyscall();
+	long result = syscall(SYS_io_uring_enter, _ringFd, toSubmit, minComplete, flags, getEvents ? &arg : NULL,
+		getEvents ? sizeof(arg) : 0);
+	// Timed out, or completions are backed up: reap what is there
+	if (result == -1 && (errno == ETIME || errno == EBUSY || errno == EAGAIN))
+		return 0;
+	return static_cast<int>(result);
+}
+
+// Start whatever a descriptor should have in flight and does not
+void UringBackend::arm(int fd)
+{
+	std::map<int, Watch>::iterator it = _fds.find(fd);
+	if (it == _fds.end() || _suspended)
+		return;
+	Watch& watch = it->second;
+
+	if ((watch.flags & IO_LISTENER) && watch.readData == 0)
+	{
+		struct io_uring_sqe* sqe = getSqe();
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = fd;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK;
+		watch.readData = nextData(fd, URING_ACCEPT);
+		sqe->user_data = watch.readData;
+	}
+	else if ((watch.flags & IO_RECEIVE) && watch.readData == 0)
+	{
+		struct io_uring_sqe* sqe = getSqe();
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = fd;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		watch.readData = nextData(fd, URING_RECV);
+		sqe->user_data = watch.readData;
+	}
+
+	// Accept and recv cover POLLIN
+	short events = getEvents(fd);
+	if (watch.flags & (IO_LISTENER | IO_RECEIVE))
+		events &= ~POLLIN;
+	if (events != 0 && watch.pollData == 0)
+	{
+		struct io_uring_sqe* sqe = getSqe();
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = fd;
+		sqe->poll32_events = static_cast<unsigned short>(events);
+		watch.pollData = nextData(fd, URING_POLL);
+		watch.pollEvents = events;
+		sqe->user_data = watch.pollData;
+	}
+}
+
+void UringBackend::cancel(unsigned long long data)
+{
+	struct io_uring_sqe* sqe = getSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = data;
+	sqe->user_data = nextData(uringFd(data), URING_CANCEL);
+}
+
+// Sends left behind by removed sockets whose peer stopped reading
+void UringBackend::cancelOverdue()
+{
+	if (_orphans == 0)
+		return;
+	time_t now = time(NULL);
+	for (std::map<unsigned long long, Send*>::iterator it = _sends.begin(); it != _sends.end(); ++it)
+	{
+		if (it->second->deadline != 0 && it->second->deadline <= now)
+		{
+			cancel(it->first);
+			it->second->deadline = now + URING_ORPHAN_SECONDS;
+		}
+	}
+}
+
+void UringBackend::add(int fd, short events, unsigned int flags)
+{
+	IoBackend::add(fd, events, flags);
+	Watch watch;
+	watch.flags = flags;
+	_fds[fd] = watch;
+	arm(fd);
+}
+
+void UringBackend::modify(int fd, short events)
+{
+	IoBackend::modify(fd, events);
+	std::map<int, Watch>::iterator it = _fds.find(fd);
+	if (it == _fds.end())
+		return;
+	short wanted = events;
+	if (it->second.flags & (IO_LISTENER | IO_RECEIVE))
+		wanted &= ~POLLIN;
+	if (it->second.pollData != 0 && it->second.pollEvents != wanted)
+	{
+		cancel(it->second.pollData);
+		it->second.pollData = 0;
+	}
+	arm(fd);
+}
+
+// Everything queued for the descriptor is submitted now, while the number
+// still names this socket. A send in flight is left to finish, so last
+// words such as ERROR reach the peer; the kernel holds the socket open
+// until then.
+void UringBackend::remove(int fd)
+{
+	IoBackend::remove(fd);
+	std::map<int, Watch>::iterator it = _fds.find(fd);
+	if (it == _fds.end())
+		return;
+	Watch watch = it->second;
+	_fds.erase(it);
+	if (watch.readData != 0)
+		cancel(watch.readData);
+	if (watch.pollData != 0)
+		cancel(watch.pollData);
+	if (watch.sendData != 0)
+	{
+		_sends[watch.sendData]->deadline = time(NULL) + URING_ORPHAN_SECONDS;
+		++_orphans;
+	}
+	enter(false, 0);
+}
+
+int UringBackend::wait(int timeoutMs, std::vector<IoEvent>& events)
+{
+	startBatch(events);
+	recycleBuffers();
+	cancelOverdue();
+	std::vector<int> rearm;
+	rearm.swap(_rearm);
+	for (size_t i = 0; i < rearm.size(); ++i)
+		arm(rearm[i]);
+
+	if (enter(true, timeoutMs) == -1)
+		return -1;
+	reap(events);
+	return events.size();
+}
+
+void UringBackend::reap(std::vector<IoEvent>& events)
+{
+	unsigned int head = *_cqHead;
+	unsigned int tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		for (; head != tail; ++head)
+			complete(_cqes[head & _cqMask], events);
+		tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	}
+	__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+}
+
+// Turn one completion into an event. Operations that end (no F_MORE) are
+// re-armed by the next wait(), after the buffers are back in the ring.
+void UringBackend::complete(const struct io_uring_cqe& cqe, std::vector<IoEvent>& events)
+{
+	unsigned long long data = cqe.user_data;
+	int fd = uringFd(data);
+	unsigned int op = uringOp(data);
+	int result = cqe.res;
+	bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+	std::map<int, Watch>::iterator it = _fds.find(fd);
+	Watch* watch = it == _fds.end() ? NULL : &it->second;
+
+	IoEvent event;
+	event.fd = fd;
+	event.result = result;
+	if (op == URING_SEND)
+	{
+		std::map<unsigned long long, Send*>::iterator send = _sends.find(data);
+		if (send != _sends.end())
+		{
+			if (send->second->deadline != 0)
+				--_orphans;
+			delete send->second;
+			_sends.erase(send);
+		}
+		if (watch == NULL || watch->sendData != data)
+			return;
+		watch->sendData = 0;
+		event.type = IO_SENT;
+		events.push_back(event);
+	}
+	else if (op == URING_RECV)
+	{
+		bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+		unsigned short id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		if (hasBuffer)
+			_recycle.push_back(id);
+		if (watch == NULL || watch->readData != data)
+			return;
+		if (!more)
+		{
+			watch->readData = 0;
+			if ((result > 0 || result == -ENOBUFS) && !_suspended)
+				_rearm.push_back(fd);
+		}
+		if (result == -ENOBUFS || result == -ECANCELED)
+			return;
+		event.type = IO_RECEIVED;
+		if (result > 0 && hasBuffer)
+		{
+			event.data = _buffers + id * URING_BUFFER_SIZE;
+			event.length = result;
+			event.result = 0;
+		}
+		events.push_back(event);
+	}
+	else if (op == URING_ACCEPT)
+	{
+		if (watch == NULL || watch->readData != data)
+		{
+			if (result >= 0)
+				close(result);
+			return;
+		}
+		if (!more)
+		{
+			watch->readData = 0;
+			if (result != -ECANCELED && !_suspended)
+				_rearm.push_back(fd);
+		}
+		if (result == -ECANCELED)
+			return;
+		event.type = IO_ACCEPTED;
+		events.push_back(event);
+	}
+	else if (op == URING_POLL)
+	{
+		if (watch == NULL || watch->pollData != data)
+			return;
+		watch->pollData = 0;
+		if (!_suspended)
+			_rearm.push_back(fd);
+		if (result == -ECANCELED)
+			return;
+		event.type = IO_READY;
+		event.revents = result < 0 ? POLLERR : static_cast<short>(result);
+		events.push_back(event);
+	}
+}
+
+bool UringBackend::canSend() const
+{
+	return true;
+}
+
+bool UringBackend::isSending(int fd) const
+{
+	std::map<int, Watch>::const_iterator it = _fds.find(fd);
+	return it != _fds.end() && it->second.sendData != 0;
+}
+
+void UringBackend::send(int fd, const struct iovec* iov, size_t count, const std::vector<SharedBuffer>& hold)
+{
+	// Output queued while suspended is handed over instead
+	std::map<int, Watch>::iterator it = _fds.find(fd);
+	if (it == _fds.end() || count == 0 || _suspended)
+		return;
+	Send* send = new Send();
+	send->fd = fd;
+	send->iov.assign(iov, iov + count);
+	send->hold = hold;
+	send->deadline = 0;
+	std::memset(&send->msg, 0, sizeof(send->msg));
+	send->msg.msg_iov = &send->iov[0];
+	send->msg.msg_iovlen = count;
+
+	unsigned long long data = nextData(fd, URING_SEND);
+	_sends[data] = send;
+	it->second.sendData = data;
+
+	struct io_uring_sqe* sqe = getSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<unsigned long>(&send->msg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = data;
+}
+
+bool UringBackend::isQuiet() const
+{
+	for (std::map<int, Watch>::const_iterator it = _fds.begin(); it != _fds.end(); ++it)
+	{
+		if (it->second.readData != 0 || it->second.pollData != 0 || it->second.sendData != 0)
+			return false;
+	}
+	return true;
+}
+
+// Cancel every accept, recv and poll and collect their last completions,
+// so nothing is read from a socket after its state is saved. Sends get a
+// second to finish, then are cancelled too.
+void UringBackend::suspend(std::vector<IoEvent>& events)
+{
+	startBatch(events);
+	recycleBuffers();
+	_suspended = true;
+	_rearm.clear();
+	for (std::map<int, Watch>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+	{
+		if (it->second.readData != 0)
+			cancel(it->second.readData);
+		if (it->second.pollData != 0)
+			cancel(it->second.pollData);
+	}
+
+	unsigned long long deadline = Metrics::nowNs() + 1000000000ULL;
+	bool sendsCancelled = false;
+	while (!isQuiet())
+	{
+		if (enter(true, 10) == -1 && errno != EINTR)
+			break;
+		reap(events);
+		if (Metrics::nowNs() < deadline)
+			continue;
+		if (sendsCancelled)
+			break;
+		for (std::map<int, Watch>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+		{
+			if (it->second.sendData != 0)
+				cancel(it->second.sendData);
+		}
+		sendsCancelled = true;
+		deadline = Metrics::nowNs() + 1000000000ULL;
+	}
+}
+
+void UringBackend::resume()
+{
+	_suspended = false;
+	for (std::map<int, Watch>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+		arm(it->first);
+}
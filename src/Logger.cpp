@@ -0,0 +1,234 @@
+#include "Logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sys/time.h>
+
+Logger::Logger()
+	: _ring(new Record[CAPACITY]), _enqueuePos(0), _dequeuePos(0), _dropped(0), _level(LOG_INFO),
+	  _categoryMask(~0U), _running(false), _threadStarted(false)
+{
+	for (size_t i = 0; i < CAPACITY; ++i)
+	{
+		_ring[i].sequence = i;
+	}
+}
+
+Logger::~Logger()
+{
+	stop();
+	delete[] _ring;
+}
+
+Logger& Logger::instance()
+{
+	static Logger logger;
+	return logger;
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level)
+{
+	if (name == "debug")
+		level = LOG_DEBUG;
+	else if (name == "info")
+		level = LOG_INFO;
+	else if (name == "warn")
+		level = LOG_WARN;
+	else if (name == "error")
+		level = LOG_ERROR;
+	else
+		return false;
+	return true;
+}
+
+bool Logger::parseCategory(const std::string& name, LogCategory& category)
+{
+	for (int i = 0; i < LOG_CATEGORY_COUNT; ++i)
+	{
+		if (name == categoryName(static_cast<LogCategory>(i)))
+		{
+			category = static_cast<LogCategory>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* Logger::levelName(LogLevel level)
+{
+	switch (level)
+	{
+		case LOG_DEBUG:
+			return "DEBUG";
+		case LOG_INFO:
+			return "INFO";
+		case LOG_WARN:
+			return "WARN";
+		case LOG_ERROR:
+			return "ERROR";
+	}
+	return "?";
+}
+
+const char* Logger::categoryName(LogCategory category)
+{
+	switch (category)
+	{
+		case LOG_SERVER:
+			return "server";
+		case LOG_NET:
+			return "net";
+		case LOG_CMD:
+			return "cmd";
+		case LOG_CHAN:
+			return "chan";
+		case LOG_CATEGORY_COUNT:
+			break;
+	}
+	return "?";
+}
+
+void Logger::start()
+{
+	if (_threadStarted)
+	{
+		return;
+	}
+	_running = true;
+	if (pthread_create(&_thread, NULL, &Logger::drainThread, this) != 0)
+	{
+		_running = false;
+		return;
+	}
+	_threadStarted = true;
+}
+
+void Logger::stop()
+{
+	if (!_threadStarted)
+	{
+		return;
+	}
+	__atomic_store_n(&_running, false, __ATOMIC_RELEASE);
+	pthread_join(_thread, NULL);
+	_threadStarted = false;
+}
+
+void Logger::setLevel(LogLevel level)
+{
+	_level = level;
+}
+
+void Logger::setCategoryMask(unsigned int mask)
+{
+	_categoryMask = mask;
+}
+
+bool Logger::isEnabled(LogLevel level, LogCategory category) const
+{
+	return level >= _level && (_categoryMask & (1U << category)) != 0;
+}
+
+unsigned long long Logger::getDropped() const
+{
+	return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+void Logger::log(LogLevel level, LogCategory category, const std::string& text)
+{
+	// Claim a slot; a slot is free when its sequence equals the claim position
+	size_t pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+	Record* record;
+	while (true)
+	{
+		record = &_ring[pos & (CAPACITY - 1)];
+		size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&_enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// Ring full: never block the caller
+			__atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	record->level = level;
+	record->category = category;
+	record->timestampUs = static_cast<long long>(tv.tv_sec) * 1000000LL + tv.tv_usec;
+	record->length = text.length() < MAX_TEXT ? text.length() : MAX_TEXT;
+	std::memcpy(record->text, text.data(), record->length);
+
+	// Publish to the consumer
+	__atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+// Write out every published record; returns false when the ring was empty
+bool Logger::drainBatch()
+{
+	bool wroteAny = false;
+	bool wroteError = false;
+	while (true)
+	{
+		Record* record = &_ring[_dequeuePos & (CAPACITY - 1)];
+		size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		if (sequence != _dequeuePos + 1)
+		{
+			break;
+		}
+
+		time_t seconds = static_cast<time_t>(record->timestampUs / 1000000LL);
+		struct tm utc;
+		gmtime_r(&seconds, &utc);
+		char stamp[32];
+		std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+		FILE* out = record->level >= LOG_WARN ? stderr : stdout;
+		std::fprintf(out, "%s.%06dZ %-5s %-6s %.*s\n", stamp, static_cast<int>(record->timestampUs % 1000000LL),
+			levelName(record->level), categoryName(record->category),
+			static_cast<int>(record->length), record->text);
+		wroteError = wroteError || out == stderr;
+		wroteAny = true;
+
+		// Hand the slot back to producers for the next lap
+		__atomic_store_n(&record->sequence, _dequeuePos + CAPACITY, __ATOMIC_RELEASE);
+		_dequeuePos++;
+	}
+
+	if (wroteAny)
+	{
+		std::fflush(stdout);
+		if (wroteError)
+			std::fflush(stderr);
+	}
+	return wroteAny;
+}
+
+void* Logger::drainThread(void* arg)
+{
+	Logger* logger = static_cast<Logger*>(arg);
+	while (__atomic_load_n(&logger->_running, __ATOMIC_ACQUIRE))
+	{
+		if (!logger->drainBatch())
+		{
+			// Idle: poll the ring again shortly instead of making producers signal
+			struct timespec pause;
+			pause.tv_sec = 0;
+			pause.tv_nsec = 2000000;
+			nanosleep(&pause, NULL);
+		}
+	}
+	// Flush whatever was logged before stop()
+	logger->drainBatch();
+	return NULL;
+}
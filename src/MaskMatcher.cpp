@@ -0,0 +1,249 @@
+#include "MaskMatcher.hpp"
+#include "Metrics.hpp"
+#include <cctype>
+
+MaskEntry::MaskEntry()
+	: setAt(0)
+{
+}
+
+MaskMatcher::MaskMatcher()
+{
+}
+
+MaskMatcher::MaskMatcher(const MaskMatcher& other)
+	: _entries(other._entries), _patterns(other._patterns), _bySuffix(other._bySuffix), _byPrefix(other._byPrefix),
+	  _unindexed(other._unindexed)
+{
+}
+
+MaskMatcher& MaskMatcher::operator=(const MaskMatcher& other)
+{
+	if (this != &other)
+	{
+		_entries = other._entries;
+		_patterns = other._patterns;
+		_bySuffix = other._bySuffix;
+		_byPrefix = other._byPrefix;
+		_unindexed = other._unindexed;
+	}
+	return *this;
+}
+
+MaskMatcher::~MaskMatcher()
+{
+}
+
+// Complete a short mask the way other servers do; empty if unusable
+std::string MaskMatcher::normalize(const std::string& mask)
+{
+	if (mask.empty() || mask[0] == ':' || mask.find_first_of(" ,\r\n") != std::string::npos)
+		return "";
+
+	std::string nick;
+	std::string user;
+	std::string host;
+	std::string::size_type bang = mask.find('!');
+	std::string::size_type at = mask.find('@', bang == std::string::npos ? 0 : bang);
+	if (bang != std::string::npos)
+	{
+		nick = mask.substr(0, bang);
+		user = mask.substr(bang + 1, at == std::string::npos ? std::string::npos : at - bang - 1);
+		if (at != std::string::npos)
+			host = mask.substr(at + 1);
+	}
+	else if (at != std::string::npos)
+	{
+		user = mask.substr(0, at);
+		host = mask.substr(at + 1);
+	}
+	else if (mask.find_first_of(".:") != std::string::npos)
+	{
+		host = mask;
+	}
+	else
+	{
+		nick = mask;
+	}
+	return (nick.empty() ? "*" : nick) + "!" + (user.empty() ? "*" : user) + "@" + (host.empty() ? "*" : host);
+}
+
+std::string MaskMatcher::toLower(const std::string& str)
+{
+	std::string result = str;
+	for (std::string::size_type i = 0; i < result.length(); ++i)
+	{
+		result[i] = std::tolower(static_cast<unsigned char>(result[i]));
+	}
+	return result;
+}
+
+// '*' matches any run, '?' any one character; backtracks to the last '*' only
+bool MaskMatcher::glob(const std::string& pattern, const std::string& subject)
+{
+	size_t p = 0;
+	size_t s = 0;
+	size_t star = std::string::npos;
+	size_t resume = 0;
+	while (s < subject.length())
+	{
+		if (p < pattern.length() && (pattern[p] == '?' || pattern[p] == subject[s]))
+		{
+			p++;
+			s++;
+		}
+		else if (p < pattern.length() && pattern[p] == '*')
+		{
+			star = p++;
+			resume = s;
+		}
+		else if (star != std::string::npos)
+		{
+			p = star + 1;
+			s = ++resume;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (p < pattern.length() && pattern[p] == '*')
+		p++;
+	return p == pattern.length();
+}
+
+// File a mask under the literal text it ends with, else the text it
+// starts with; a subject can only match if it ends or starts the same
+void MaskMatcher::index(size_t entry)
+{
+	const std::string& pattern = _patterns[entry];
+	std::string::size_type last = pattern.find_last_of("*?");
+	size_t suffix = last == std::string::npos ? pattern.length() : pattern.length() - last - 1;
+	if (suffix >= KEY_LENGTH)
+	{
+		_bySuffix[pattern.substr(pattern.length() - KEY_LENGTH)].push_back(entry);
+		return;
+	}
+	std::string::size_type first = pattern.find_first_of("*?");
+	size_t prefix = first == std::string::npos ? pattern.length() : first;
+	if (prefix >= KEY_LENGTH)
+	{
+		_byPrefix[pattern.substr(0, KEY_LENGTH)].push_back(entry);
+		return;
+	}
+	_unindexed.push_back(entry);
+}
+
+void MaskMatcher::rebuild()
+{
+	_bySuffix.clear();
+	_byPrefix.clear();
+	_unindexed.clear();
+	for (size_t i = 0; i < _patterns.size(); ++i)
+	{
+		index(i);
+	}
+}
+
+bool MaskMatcher::tryBucket(const std::map<std::string, std::vector<size_t> >& buckets, const std::string& key,
+	const std::string& subject) const
+{
+	std::map<std::string, std::vector<size_t> >::const_iterator bucket = buckets.find(key);
+	if (bucket == buckets.end())
+		return false;
+	for (size_t i = 0; i < bucket->second.size(); ++i)
+	{
+		if (glob(_patterns[bucket->second[i]], subject))
+			return true;
+	}
+	return false;
+}
+
+bool MaskMatcher::add(const std::string& mask, const std::string& setBy, time_t setAt)
+{
+	std::string pattern = toLower(mask);
+	for (size_t i = 0; i < _patterns.size(); ++i)
+	{
+		if (_patterns[i] == pattern)
+			return false;
+	}
+	MaskEntry entry;
+	entry.mask = mask;
+	entry.setBy = setBy;
+	entry.setAt = setAt;
+	_entries.push_back(entry);
+	_patterns.push_back(pattern);
+	index(_patterns.size() - 1);
+	return true;
+}
+
+// Lists are short and rarely edited; removal just re-files the rest
+bool MaskMatcher::remove(const std::string& mask)
+{
+	std::string pattern = toLower(mask);
+	for (size_t i = 0; i < _patterns.size(); ++i)
+	{
+		if (_patterns[i] == pattern)
+		{
+			_entries.erase(_entries.begin() + i);
+			_patterns.erase(_patterns.begin() + i);
+			rebuild();
+			return true;
+		}
+	}
+	return false;
+}
+
+void MaskMatcher::clear()
+{
+	_entries.clear();
+	_patterns.clear();
+	rebuild();
+}
+
+bool MaskMatcher::matches(const std::string& subject) const
+{
+	if (_patterns.empty())
+		return false;
+	if (subject.length() >= KEY_LENGTH)
+	{
+		if (tryBucket(_bySuffix, subject.substr(subject.length() - KEY_LENGTH), subject) ||
+			tryBucket(_byPrefix, subject.substr(0, KEY_LENGTH), subject))
+			return true;
+	}
+	for (size_t i = 0; i < _unindexed.size(); ++i)
+	{
+		if (glob(_patterns[_unindexed[i]], subject))
+			return true;
+	}
+	return false;
+}
+
+const std::vector<MaskEntry>& MaskMatcher::getEntries() const
+{
+	return _entries;
+}
+
+size_t MaskMatcher::size() const
+{
+	return _entries.size();
+}
+
+bool MaskMatcher::empty() const
+{
+	return _entries.empty();
+}
+
+size_t MaskMatcher::getBytes() const
+{
+	size_t bytes = _entries.capacity() * sizeof(MaskEntry) + _patterns.capacity() * sizeof(std::string)
+		+ _patterns.size() * sizeof(size_t)
+		+ (_bySuffix.size() + _byPrefix.size()) * (MemoryUsage::MAP_NODE_OVERHEAD + sizeof(std::string)
+		+ sizeof(std::vector<size_t>));
+	for (size_t i = 0; i < _entries.size(); ++i)
+	{
+		bytes += MemoryUsage::stringBytes(_entries[i].mask) + MemoryUsage::stringBytes(_entries[i].setBy)
+			+ MemoryUsage::stringBytes(_patterns[i]);
+	}
+	return bytes;
+}
@@ -1,8 +1,9 @@
 #include "Message.hpp"
 #include <cctype>
+#include <algorithm>
 
 Message::Message(const std::string& raw)
-	: _raw(raw)
+	: _tagsLength(0), _raw(raw)
 {
 	parse();
 }
@@ -18,7 +19,7 @@ void Message::parse()
 		return;
 	}
 
-	std::string message = _raw;
+	std::string message = _raw.substr(parseTags());
 	std::string::size_type pos = 0;
 
 	// Check for prefix (starts with ':')
@@ -111,6 +112,70 @@ void Message::parse()
 	}
 }
 
+// "@key=value;+vendor/key;... " at the start of the line. Tags are kept as
+// offsets into the raw line: nothing is copied or unescaped until asked
+// for. Returns where the rest of the message starts.
+size_t Message::parseTags()
+{
+	if (_raw[0] != '@')
+	{
+		return 0;
+	}
+
+	size_t end = _raw.find(' ');
+	if (end == std::string::npos)
+	{
+		end = _raw.length();
+	}
+	_tagsLength = end + 1;
+	_tags.reserve(std::count(_raw.begin(), _raw.begin() + end, ';') + 1);
+
+	size_t pos = 1;
+	while (pos < end)
+	{
+		size_t next = pos;
+		size_t equals = std::string::npos;
+		while (next < end && _raw[next] != ';')
+		{
+			if (_raw[next] == '=' && equals == std::string::npos)
+			{
+				equals = next;
+			}
+			next++;
+		}
+		if (next > pos)
+		{
+			TagSpan span;
+			span.keyStart = pos;
+			span.keyLength = (equals == std::string::npos ? next : equals) - pos;
+			span.valueStart = equals == std::string::npos ? next : equals + 1;
+			span.valueLength = next - span.valueStart;
+			_tags.push_back(span);
+		}
+		pos = next + 1;
+	}
+
+	while (end < _raw.length() && _raw[end] == ' ')
+	{
+		end++;
+	}
+	return end;
+}
+
+// A repeated key takes its last value
+const TagSpan* Message::findTag(const std::string& key) const
+{
+	for (size_t i = _tags.size(); i > 0; --i)
+	{
+		const TagSpan& span = _tags[i - 1];
+		if (span.keyLength == key.length() && _raw.compare(span.keyStart, span.keyLength, key) == 0)
+		{
+			return &span;
+		}
+	}
+	return NULL;
+}
+
 std::string Message::getCommand() const
 {
 	return _command;
@@ -140,3 +205,87 @@ size_t Message::getParamCount() const
 	return _params.size();
 }
 
+const std::string& Message::getRaw() const
+{
+	return _raw;
+}
+
+size_t Message::getTagCount() const
+{
+	return _tags.size();
+}
+
+bool Message::hasTag(const std::string& key) const
+{
+	return findTag(key) != NULL;
+}
+
+std::string Message::getTagValue(const std::string& key) const
+{
+	const TagSpan* span = findTag(key);
+	std::string value;
+	if (span == NULL)
+	{
+		return value;
+	}
+
+	size_t end = span->valueStart + span->valueLength;
+	value.reserve(span->valueLength);
+	for (size_t i = span->valueStart; i < end; ++i)
+	{
+		if (_raw[i] != '\\')
+		{
+			value += _raw[i];
+			continue;
+		}
+		// A lone trailing backslash is dropped
+		if (++i == end)
+		{
+			break;
+		}
+		switch (_raw[i])
+		{
+			case ':':
+				value += ';';
+				break;
+			case 's':
+				value += ' ';
+				break;
+			case 'r':
+				value += '\r';
+				break;
+			case 'n':
+				value += '\n';
+				break;
+			default:
+				value += _raw[i];
+				break;
+		}
+	}
+	return value;
+}
+
+// Client-only tags travel on to other clients untouched
+std::string Message::getClientTags() const
+{
+	std::string tags;
+	for (size_t i = 0; i < _tags.size(); ++i)
+	{
+		const TagSpan& span = _tags[i];
+		if (_raw[span.keyStart] != '+')
+		{
+			continue;
+		}
+		if (!tags.empty())
+		{
+			tags += ';';
+		}
+		tags.append(_raw, span.keyStart, span.valueStart + span.valueLength - span.keyStart);
+	}
+	return tags;
+}
+
+bool Message::hasTooLongTags() const
+{
+	return _tagsLength > MAX_TAGS_LENGTH;
+}
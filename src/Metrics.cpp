@@ -0,0 +1,461 @@
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include <ctime>
+#include <iomanip>
+
+Histogram::Histogram()
+{
+	reset();
+}
+
+void Histogram::reset()
+{
+	for (int i = 0; i < BUCKETS; ++i)
+	{
+		_buckets[i] = 0;
+	}
+	_count = 0;
+	_sum = 0;
+	_max = 0;
+}
+
+int Histogram::bucketFor(unsigned long long value)
+{
+	if (value == 0)
+		return 0;
+	// Number of significant bits: value < 2^bits
+	int bits = 64 - __builtin_clzll(value);
+	return bits < BUCKETS ? bits : BUCKETS - 1;
+}
+
+unsigned long long Histogram::bucketUpperBound(int index)
+{
+	if (index >= BUCKETS - 1)
+		return ~0ULL;
+	return 1ULL << index;
+}
+
+void Histogram::record(unsigned long long value)
+{
+	_buckets[bucketFor(value)]++;
+	_count++;
+	_sum += value;
+	if (value > _max)
+		_max = value;
+}
+
+unsigned long long Histogram::getCount() const
+{
+	return _count;
+}
+
+unsigned long long Histogram::getSum() const
+{
+	return _sum;
+}
+
+unsigned long long Histogram::getMax() const
+{
+	return _max;
+}
+
+unsigned long long Histogram::getBucket(int index) const
+{
+	return _buckets[index];
+}
+
+unsigned long long Histogram::percentile(double fraction) const
+{
+	if (_count == 0)
+		return 0;
+
+	unsigned long long rank = static_cast<unsigned long long>(fraction * _count);
+	if (rank >= _count)
+		rank = _count - 1;
+
+	unsigned long long seen = 0;
+	for (int i = 0; i < BUCKETS; ++i)
+	{
+		seen += _buckets[i];
+		if (seen > rank)
+		{
+			unsigned long long bound = bucketUpperBound(i);
+			return bound < _max ? bound : _max;
+		}
+	}
+	return _max;
+}
+
+CommandStats::CommandStats()
+	: count(0)
+{
+}
+
+MemoryUsage::MemoryUsage()
+	: recvBuffers(0), sendBuffers(0), clientIdentity(0), channelMembers(0), channelInvites(0), channelStrings(0),
+	  channelHistory(0)
+{
+}
+
+void MemoryUsage::add(const MemoryUsage& other)
+{
+	recvBuffers += other.recvBuffers;
+	sendBuffers += other.sendBuffers;
+	clientIdentity += other.clientIdentity;
+	channelMembers += other.channelMembers;
+	channelInvites += other.channelInvites;
+	channelStrings += other.channelStrings;
+	channelHistory += other.channelHistory;
+}
+
+static void raiseField(size_t& field, size_t value)
+{
+	if (value > field)
+		field = value;
+}
+
+void MemoryUsage::raiseTo(const MemoryUsage& other)
+{
+	raiseField(recvBuffers, other.recvBuffers);
+	raiseField(sendBuffers, other.sendBuffers);
+	raiseField(clientIdentity, other.clientIdentity);
+	raiseField(channelMembers, other.channelMembers);
+	raiseField(channelInvites, other.channelInvites);
+	raiseField(channelStrings, other.channelStrings);
+	raiseField(channelHistory, other.channelHistory);
+}
+
+size_t MemoryUsage::clientTotal() const
+{
+	return recvBuffers + sendBuffers + clientIdentity;
+}
+
+size_t MemoryUsage::channelTotal() const
+{
+	return channelMembers + channelInvites + channelStrings + channelHistory;
+}
+
+size_t MemoryUsage::stringBytes(const std::string& str)
+{
+	// Short strings live inside the object itself (SSO)
+	const char* data = str.data();
+	const char* object = reinterpret_cast<const char*>(&str);
+	if (data >= object && data < object + sizeof(str))
+		return 0;
+	return str.capacity() + 1;
+}
+
+MetricsGauges::MetricsGauges()
+	: clients(0), registeredClients(0), channels(0), uptimeSeconds(0)
+{
+}
+
+Metrics::Metrics()
+	: _bytesIn(0), _bytesOut(0), _messagesFannedOut(0), _connectionsAccepted(0), _connectionsClosed(0),
+	  _ioSyscalls(0), _spinHits(0), _spinMisses(0), _sentZeroCopy(0), _sentCopied(0)
+{
+}
+
+Metrics::~Metrics()
+{
+}
+
+Metrics& Metrics::instance()
+{
+	static Metrics metrics;
+	return metrics;
+}
+
+unsigned long long Metrics::nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Recording
+void Metrics::recordCommand(const std::string& command, unsigned long long latencyNs)
+{
+	CommandStats& stats = _commands[command];
+	stats.count++;
+	stats.latencyNs.record(latencyNs);
+}
+
+void Metrics::addBytesIn(size_t bytes)
+{
+	__atomic_add_fetch(&_bytesIn, bytes, __ATOMIC_RELAXED);
+}
+
+void Metrics::addBytesOut(size_t bytes)
+{
+	__atomic_add_fetch(&_bytesOut, bytes, __ATOMIC_RELAXED);
+}
+
+void Metrics::addFanOut(size_t recipients)
+{
+	_messagesFannedOut += recipients;
+}
+
+void Metrics::addConnectionAccepted()
+{
+	_connectionsAccepted++;
+}
+
+void Metrics::addConnectionClosed()
+{
+	_connectionsClosed++;
+}
+
+void Metrics::addIoSyscall()
+{
+	__atomic_add_fetch(&_ioSyscalls, 1, __ATOMIC_RELAXED);
+}
+
+void Metrics::recordLoopSpin(bool hit)
+{
+	if (hit)
+		_spinHits++;
+	else
+		_spinMisses++;
+}
+
+void Metrics::addSentBytes(size_t bytes, bool zeroCopy)
+{
+	if (zeroCopy)
+		_sentZeroCopy += bytes;
+	else
+		_sentCopied += bytes;
+}
+
+void Metrics::recordSendqDepth(size_t bytes)
+{
+	_sendqDepth.record(bytes);
+}
+
+void Metrics::recordPollIteration(unsigned long long ns)
+{
+	_pollIterationNs.record(ns);
+}
+
+// Getters
+const std::map<std::string, CommandStats>& Metrics::getCommands() const
+{
+	return _commands;
+}
+
+unsigned long long Metrics::getBytesIn() const
+{
+	return __atomic_load_n(&_bytesIn, __ATOMIC_RELAXED);
+}
+
+unsigned long long Metrics::getBytesOut() const
+{
+	return __atomic_load_n(&_bytesOut, __ATOMIC_RELAXED);
+}
+
+unsigned long long Metrics::getMessagesFannedOut() const
+{
+	return _messagesFannedOut;
+}
+
+unsigned long long Metrics::getConnectionsAccepted() const
+{
+	return _connectionsAccepted;
+}
+
+unsigned long long Metrics::getConnectionsClosed() const
+{
+	return _connectionsClosed;
+}
+
+unsigned long long Metrics::getIoSyscalls() const
+{
+	return __atomic_load_n(&_ioSyscalls, __ATOMIC_RELAXED);
+}
+
+unsigned long long Metrics::getSpinHits() const
+{
+	return _spinHits;
+}
+
+unsigned long long Metrics::getSpinMisses() const
+{
+	return _spinMisses;
+}
+
+unsigned long long Metrics::getSentZeroCopy() const
+{
+	return _sentZeroCopy;
+}
+
+unsigned long long Metrics::getSentCopied() const
+{
+	return _sentCopied;
+}
+
+const Histogram& Metrics::getSendqDepth() const
+{
+	return _sendqDepth;
+}
+
+const Histogram& Metrics::getPollIterationNs() const
+{
+	return _pollIterationNs;
+}
+
+// Rendering
+static std::string summarizeHistogram(const std::string& name, const Histogram& hist, const std::string& unit)
+{
+	std::ostringstream oss;
+	oss << name << " count=" << hist.getCount();
+	if (hist.getCount() > 0)
+	{
+		oss << " avg=" << hist.getSum() / hist.getCount() << unit
+			<< " p50<=" << hist.percentile(0.50) << unit
+			<< " p99<=" << hist.percentile(0.99) << unit
+			<< " max=" << hist.getMax() << unit;
+	}
+	return oss.str();
+}
+
+void Metrics::renderSummary(const MetricsGauges& gauges, std::vector<std::string>& lines) const
+{
+	std::ostringstream oss;
+	oss << "clients=" << gauges.clients << " registered=" << gauges.registeredClients
+		<< " channels=" << gauges.channels << " uptime=" << gauges.uptimeSeconds << "s";
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "connections accepted=" << _connectionsAccepted << " closed=" << _connectionsClosed;
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "bytes in=" << getBytesIn() << " out=" << getBytesOut() << " fanout=" << _messagesFannedOut;
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "io syscalls=" << getIoSyscalls() << " spins hit=" << _spinHits << " missed=" << _spinMisses;
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "sent zerocopy=" << _sentZeroCopy << "B copied=" << _sentCopied << "B";
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "memory clients=" << gauges.memory.clientTotal() << "B channels=" << gauges.memory.channelTotal()
+		<< "B peak clients=" << gauges.memoryPeak.clientTotal() << "B channels=" << gauges.memoryPeak.channelTotal() << "B";
+	lines.push_back(oss.str());
+
+	oss.str("");
+	oss << "log dropped=" << Logger::instance().getDropped();
+	lines.push_back(oss.str());
+
+	lines.push_back(summarizeHistogram("loop", _pollIterationNs, "ns"));
+	lines.push_back(summarizeHistogram("sendq", _sendqDepth, "B"));
+
+	for (std::map<std::string, CommandStats>::const_iterator it = _commands.begin(); it != _commands.end(); ++it)
+	{
+		lines.push_back(summarizeHistogram("cmd " + it->first, it->second.latencyNs, "ns"));
+	}
+}
+
+static void renderHeader(std::ostringstream& out, const char* name, const char* type, const char* help)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+}
+
+// Emit a Prometheus histogram over buckets [minBucket, maxBucket], values divided by scale
+static void renderHistogram(std::ostringstream& out, const std::string& name, const std::string& labels,
+	const Histogram& hist, double scale, int minBucket, int maxBucket)
+{
+	std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+	unsigned long long cumulative = 0;
+	for (int i = 0; i < minBucket; ++i)
+	{
+		cumulative += hist.getBucket(i);
+	}
+	for (int i = minBucket; i <= maxBucket; ++i)
+	{
+		cumulative += hist.getBucket(i);
+		out << name << "_bucket" << prefix << "le=\"" << Histogram::bucketUpperBound(i) / scale << "\"} " << cumulative << "\n";
+	}
+	out << name << "_bucket" << prefix << "le=\"+Inf\"} " << hist.getCount() << "\n";
+	std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+	out << name << "_sum" << suffix << " " << hist.getSum() / scale << "\n";
+	out << name << "_count" << suffix << " " << hist.getCount() << "\n";
+}
+
+void Metrics::renderPrometheus(const MetricsGauges& gauges, std::ostringstream& out) const
+{
+	out << std::setprecision(9);
+
+	renderHeader(out, "ircserv_clients", "gauge", "Connected clients.");
+	out << "ircserv_clients " << gauges.clients << "\n";
+	renderHeader(out, "ircserv_registered_clients", "gauge", "Clients that completed registration.");
+	out << "ircserv_registered_clients " << gauges.registeredClients << "\n";
+	renderHeader(out, "ircserv_channels", "gauge", "Existing channels.");
+	out << "ircserv_channels " << gauges.channels << "\n";
+	renderHeader(out, "ircserv_uptime_seconds", "gauge", "Seconds since the server started.");
+	out << "ircserv_uptime_seconds " << gauges.uptimeSeconds << "\n";
+
+	renderHeader(out, "ircserv_connections_accepted_total", "counter", "Accepted connections.");
+	out << "ircserv_connections_accepted_total " << _connectionsAccepted << "\n";
+	renderHeader(out, "ircserv_connections_closed_total", "counter", "Closed connections.");
+	out << "ircserv_connections_closed_total " << _connectionsClosed << "\n";
+	renderHeader(out, "ircserv_bytes_in_total", "counter", "Bytes received from clients.");
+	out << "ircserv_bytes_in_total " << getBytesIn() << "\n";
+	renderHeader(out, "ircserv_bytes_out_total", "counter", "Bytes sent to clients.");
+	out << "ircserv_bytes_out_total " << getBytesOut() << "\n";
+	renderHeader(out, "ircserv_messages_fanned_out_total", "counter", "Channel broadcast deliveries.");
+	out << "ircserv_messages_fanned_out_total " << _messagesFannedOut << "\n";
+	renderHeader(out, "ircserv_io_syscalls_total", "counter", "Event loop I/O syscalls: waits, accepts, reads and writes.");
+	out << "ircserv_io_syscalls_total " << getIoSyscalls() << "\n";
+	renderHeader(out, "ircserv_loop_spins_total", "counter", "Event loop spins before blocking, by whether they found work.");
+	out << "ircserv_loop_spins_total{result=\"hit\"} " << _spinHits << "\n";
+	out << "ircserv_loop_spins_total{result=\"miss\"} " << _spinMisses << "\n";
+	renderHeader(out, "ircserv_sent_bytes_total", "counter",
+		"Bytes the event loop wrote with sendmsg, by whether the kernel copied them or sent them zero-copy.");
+	out << "ircserv_sent_bytes_total{mode=\"zerocopy\"} " << _sentZeroCopy << "\n";
+	out << "ircserv_sent_bytes_total{mode=\"copied\"} " << _sentCopied << "\n";
+
+	const char* memoryKinds[] = { "recvq", "sendq", "client_identity", "channel_members", "channel_invites", "channel_strings",
+		"channel_history" };
+	const MemoryUsage* memory[] = { &gauges.memory, &gauges.memoryPeak };
+	const char* memoryNames[] = { "ircserv_memory_bytes", "ircserv_memory_peak_bytes" };
+	const char* memoryHelp[] = { "Approximate heap bytes held by clients and channels.", "High-water mark of ircserv_memory_bytes." };
+	for (int m = 0; m < 2; ++m)
+	{
+		size_t values[] = { memory[m]->recvBuffers, memory[m]->sendBuffers, memory[m]->clientIdentity,
+			memory[m]->channelMembers, memory[m]->channelInvites, memory[m]->channelStrings, memory[m]->channelHistory };
+		renderHeader(out, memoryNames[m], "gauge", memoryHelp[m]);
+		for (int k = 0; k < 7; ++k)
+		{
+			out << memoryNames[m] << "{kind=\"" << memoryKinds[k] << "\"} " << values[k] << "\n";
+		}
+	}
+
+	renderHeader(out, "ircserv_log_dropped_total", "counter", "Log records dropped because the ring was full.");
+	out << "ircserv_log_dropped_total " << Logger::instance().getDropped() << "\n";
+
+	renderHeader(out, "ircserv_commands_total", "counter", "Commands executed by type.");
+	for (std::map<std::string, CommandStats>::const_iterator it = _commands.begin(); it != _commands.end(); ++it)
+	{
+		out << "ircserv_commands_total{command=\"" << it->first << "\"} " << it->second.count << "\n";
+	}
+
+	// 1us .. ~1s
+	renderHeader(out, "ircserv_command_duration_seconds", "histogram", "Command handler latency.");
+	for (std::map<std::string, CommandStats>::const_iterator it = _commands.begin(); it != _commands.end(); ++it)
+	{
+		renderHistogram(out, "ircserv_command_duration_seconds", "command=\"" + it->first + "\"",
+			it->second.latencyNs, 1e9, 10, 30);
+	}
+
+	renderHeader(out, "ircserv_loop_iteration_seconds", "histogram", "Event loop work per poll wakeup.");
+	renderHistogram(out, "ircserv_loop_iteration_seconds", "", _pollIterationNs, 1e9, 10, 30);
+
+	// 64B .. 16MiB
+	renderHeader(out, "ircserv_sendq_bytes", "histogram", "Queued output per client at flush time.");
+	renderHistogram(out, "ircserv_sendq_bytes", "", _sendqDepth, 1, 6, 24);
+}
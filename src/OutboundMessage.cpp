@@ -0,0 +1,63 @@
+#include "OutboundMessage.hpp"
+#include "History.hpp"
+
+OutboundMessage::OutboundMessage(const SharedBuffer& line, const std::string& clientTags)
+	: _line(line), _clientTags(clientTags), _timeMs(0), _seq(0)
+{
+}
+
+OutboundMessage::~OutboundMessage()
+{
+}
+
+void OutboundMessage::stamp(const std::string& msgid, long long timeMs, unsigned long long seq)
+{
+	_msgid = msgid;
+	_timeMs = timeMs;
+	_seq = seq;
+}
+
+const SharedBuffer& OutboundMessage::getLine() const
+{
+	return _line;
+}
+
+const std::string& OutboundMessage::getMsgid() const
+{
+	return _msgid;
+}
+
+long long OutboundMessage::getTimeMs() const
+{
+	return _timeMs;
+}
+
+unsigned long long OutboundMessage::getSeq() const
+{
+	return _seq;
+}
+
+const SharedBuffer& OutboundMessage::render(unsigned int capabilities)
+{
+	unsigned int variant = capabilities & OUTBOUND_TAG_CAPS;
+	if (variant == 0)
+		return _line;
+	if (!_variants[variant].empty())
+		return _variants[variant];
+
+	std::string tags;
+	if (variant & CAP_SERVER_TIME)
+		tags += ";time=" + formatHistoryTime(_timeMs);
+	if (variant & CAP_MESSAGE_TAGS)
+	{
+		tags += ";msgid=" + _msgid;
+		if (!_clientTags.empty())
+			tags += ";" + _clientTags;
+	}
+
+	std::string line;
+	line.reserve(tags.size() + 1 + _line.size());
+	line.append("@").append(tags, 1, std::string::npos).append(" ").append(_line.str());
+	_variants[variant] = SharedBuffer(line);
+	return _variants[variant];
+}
@@ -0,0 +1,676 @@
+#include "Pipeline.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+
+// Queued buffers handed to one sendmsg(), as on the event loop
+static const size_t PIPE_IOV_MAX = 64;
+
+// Lines taken from one I/O thread per receive(), so none starves the rest
+static const size_t PIPE_RECEIVE_BATCH = 256;
+
+static void writeEventFd(int fd)
+{
+	uint64_t one = 1;
+	ssize_t written = write(fd, &one, sizeof(one));
+	(void)written; // only fails when the counter is already huge
+}
+
+static void readEventFd(int fd)
+{
+	uint64_t count;
+	while (read(fd, &count, sizeof(count)) == -1 && errno == EINTR)
+	{
+	}
+}
+
+PipeInput::PipeInput()
+	: fd(-1), id(0), message(NULL)
+{
+}
+
+PipeOutput::PipeOutput()
+	: type(PIPE_SEND), fd(-1), id(0), sendq(0)
+{
+}
+
+PipeReclaim::PipeReclaim()
+	: fd(-1), id(0)
+{
+}
+
+// PipelineWorker
+
+PipelineWorker::PipelineWorker(size_t ringSize, int loopWakeFd, int* loopSleeping)
+	: _input(ringSize), _output(ringSize), _wakeFd(-1), _sleeping(0), _spaceWanted(0), _loopWakeFd(loopWakeFd),
+	  _loopSleeping(loopSleeping), _io(NULL), _started(false)
+{
+}
+
+PipelineWorker::~PipelineWorker()
+{
+	join();
+	// The sockets themselves were closed or reclaimed
+	for (std::map<int, Connection>::iterator it = _connections.begin(); it != _connections.end(); ++it)
+	{
+		delete it->second.io;
+	}
+	std::vector<PipeInput> leftover;
+	collect(leftover);
+	for (size_t i = 0; i < leftover.size(); ++i)
+	{
+		delete leftover[i].message;
+	}
+	delete _io;
+	if (_wakeFd != -1)
+		close(_wakeFd);
+}
+
+bool PipelineWorker::start(std::string& error)
+{
+	_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_wakeFd == -1)
+	{
+		error = std::string("eventfd: ") + std::strerror(errno);
+		return false;
+	}
+
+	EpollBackend* epoll = new EpollBackend();
+	std::string epollError;
+	if (epoll->init(epollError))
+	{
+		_io = epoll;
+	}
+	else
+	{
+		delete epoll;
+		_io = new PollBackend();
+	}
+	_io->add(_wakeFd, POLLIN, 0);
+
+	if (pthread_create(&_thread, NULL, workerThread, this) != 0)
+	{
+		error = "failed to start a pipeline I/O thread";
+		return false;
+	}
+	_started = true;
+	return true;
+}
+
+void PipelineWorker::join()
+{
+	if (_started)
+	{
+		pthread_join(_thread, NULL);
+		_started = false;
+	}
+}
+
+void* PipelineWorker::workerThread(void* arg)
+{
+	static_cast<PipelineWorker*>(arg)->run();
+	return NULL;
+}
+
+void PipelineWorker::run()
+{
+	std::vector<int> touched;
+	while (true)
+	{
+		touched.clear();
+		bool stopping = applyOutput(touched);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&_spaceWanted, 0, __ATOMIC_SEQ_CST))
+			writeEventFd(_loopWakeFd);
+		for (size_t i = 0; i < touched.size(); ++i)
+		{
+			std::map<int, Connection>::iterator it = _connections.find(touched[i]);
+			if (it != _connections.end() && !it->second.hungUp)
+				writeConnection(it->first, it->second);
+		}
+		if (stopping)
+			break;
+
+		// A full input ring stops the reading until the event loop catches up
+		bool backlogged = !flushInput();
+
+		__atomic_store_n(&_sleeping, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		int timeout = !_output.empty() ? 0 : (backlogged ? 1 : 100);
+		int ready = _io->wait(timeout, _ioEvents);
+		__atomic_store_n(&_sleeping, 0, __ATOMIC_SEQ_CST);
+		if (ready <= 0)
+			continue;
+
+		for (size_t i = 0; i < _ioEvents.size(); ++i)
+		{
+			const IoEvent& event = _ioEvents[i];
+			if (event.type != IO_READY)
+				continue;
+			if (event.fd == _wakeFd)
+			{
+				readEventFd(_wakeFd);
+				continue;
+			}
+			std::map<int, Connection>::iterator it = _connections.find(event.fd);
+			if (it == _connections.end() || it->second.hungUp)
+				continue;
+			if (event.revents & (POLLHUP | POLLERR))
+			{
+				hangUp(it->first, it->second);
+				continue;
+			}
+			if (event.revents & POLLOUT)
+				writeConnection(it->first, it->second);
+			if (!it->second.hungUp && !backlogged && (event.revents & POLLIN))
+				readConnection(it->first, it->second);
+		}
+		flushInput();
+	}
+}
+
+// Apply what the event loop posted; true once PIPE_STOP came
+bool PipelineWorker::applyOutput(std::vector<int>& touched)
+{
+	PipeOutput output;
+	while (_output.pop(output))
+	{
+		if (output.type == PIPE_STOP)
+			return true;
+
+		if (output.type == PIPE_ADOPT)
+		{
+			Connection connection;
+			connection.id = output.id;
+			connection.io = new Client(output.fd);
+			connection.sendq = output.sendq;
+			connection.hungUp = false;
+			_connections[output.fd] = connection;
+			_io->add(output.fd, POLLIN, 0);
+			// Lines read before the handover are framed here like any other
+			connection.io->appendToRecvBuffer(output.data.str());
+			frame(output.fd, _connections[output.fd]);
+			continue;
+		}
+
+		std::map<int, Connection>::iterator it = _connections.find(output.fd);
+		if (it == _connections.end() || it->second.id != output.id)
+			continue;
+		Connection& connection = it->second;
+
+		if (output.type == PIPE_SEND)
+		{
+			if (connection.hungUp)
+				continue;
+			connection.io->appendToSendBuffer(output.data);
+			if (connection.io->getSendBufferSize() > connection.sendq)
+			{
+				LOG(LOG_WARN, LOG_NET, "SendQ exceeded for client fd " << output.fd);
+				hangUp(output.fd, connection);
+				continue;
+			}
+			if (touched.empty() || touched.back() != output.fd)
+				touched.push_back(output.fd);
+		}
+		else if (output.type == PIPE_CLOSE)
+		{
+			// One last try at the output, the ERROR line usually
+			if (!connection.hungUp)
+			{
+				if (connection.io->hasMessageToSend())
+					writeConnection(output.fd, connection);
+				_io->remove(output.fd);
+			}
+			close(output.fd);
+			delete connection.io;
+			_connections.erase(it);
+		}
+	}
+	return false;
+}
+
+void PipelineWorker::readConnection(int fd, Connection& connection)
+{
+	char buffer[4096];
+	Metrics::instance().addIoSyscall();
+	ssize_t bytesReceived = recv(fd, buffer, sizeof(buffer), 0);
+	if (bytesReceived == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (bytesReceived <= 0)
+	{
+		if (bytesReceived == -1 && errno != ECONNRESET)
+			LOG(LOG_WARN, LOG_NET, "Recv error for client fd " << fd << ": " << strerror(errno));
+		hangUp(fd, connection);
+		return;
+	}
+	Metrics::instance().addBytesIn(bytesReceived);
+	connection.io->appendToRecvBuffer(std::string(buffer, bytesReceived));
+	frame(fd, connection);
+}
+
+// Parse every complete line; blank ones carry nothing to run
+void PipelineWorker::frame(int fd, Connection& connection)
+{
+	while (true)
+	{
+		std::string line = connection.io->extractMessage();
+		if (line.empty())
+		{
+			if (connection.io->getRecvBuffer().find("\r\n") == std::string::npos)
+				break;
+			continue;
+		}
+		PipeInput input;
+		input.fd = fd;
+		input.id = connection.id;
+		input.message = new Message(line);
+		pushInput(input);
+	}
+}
+
+void PipelineWorker::writeConnection(int fd, Connection& connection)
+{
+	if (connection.io->hasMessageToSend())
+	{
+		struct iovec iov[PIPE_IOV_MAX];
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = connection.io->getSendIovec(iov, PIPE_IOV_MAX);
+
+		Metrics::instance().addIoSyscall();
+		ssize_t bytesSent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (bytesSent == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			LOG(LOG_WARN, LOG_NET, "Send error for client fd " << fd << ": " << strerror(errno));
+			hangUp(fd, connection);
+			return;
+		}
+		if (bytesSent > 0)
+		{
+			Metrics::instance().addBytesOut(bytesSent);
+			connection.io->consumeSendBuffer(bytesSent);
+		}
+	}
+	short events = connection.io->hasMessageToSend() ? (POLLIN | POLLOUT) : POLLIN;
+	if (_io->getEvents(fd) != events)
+		_io->modify(fd, events);
+}
+
+// Stop serving the socket and tell the event loop, which answers with
+// PIPE_CLOSE once the client is removed
+void PipelineWorker::hangUp(int fd, Connection& connection)
+{
+	connection.hungUp = true;
+	connection.io->clearSendBuffer();
+	_io->remove(fd);
+	PipeInput input;
+	input.fd = fd;
+	input.id = connection.id;
+	pushInput(input);
+}
+
+// Lines keep their order: once one waits in the backlog, so do the rest
+void PipelineWorker::pushInput(const PipeInput& input)
+{
+	if (!_inputBacklog.empty() || !_input.push(input))
+		_inputBacklog.push_back(input);
+}
+
+// Move the backlog into the ring and wake the event loop if it sleeps;
+// false while some of it still does not fit
+bool PipelineWorker::flushInput()
+{
+	while (!_inputBacklog.empty() && _input.push(_inputBacklog.front()))
+	{
+		_inputBacklog.pop_front();
+	}
+	if (!_input.empty())
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(_loopSleeping, __ATOMIC_SEQ_CST))
+			writeEventFd(_loopWakeFd);
+	}
+	return _inputBacklog.empty();
+}
+
+bool PipelineWorker::post(const PipeOutput& output)
+{
+	return _output.push(output);
+}
+
+bool PipelineWorker::receive(PipeInput& input)
+{
+	return _input.pop(input);
+}
+
+bool PipelineWorker::hasInput() const
+{
+	return !_input.empty();
+}
+
+void PipelineWorker::wake()
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&_sleeping, __ATOMIC_SEQ_CST))
+		writeEventFd(_wakeFd);
+}
+
+void PipelineWorker::wantSpace()
+{
+	__atomic_store_n(&_spaceWanted, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void PipelineWorker::collect(std::vector<PipeInput>& inputs)
+{
+	PipeInput input;
+	while (_input.pop(input))
+	{
+		inputs.push_back(input);
+	}
+	inputs.insert(inputs.end(), _inputBacklog.begin(), _inputBacklog.end());
+	_inputBacklog.clear();
+}
+
+void PipelineWorker::reclaim(std::vector<PipeReclaim>& connections)
+{
+	for (std::map<int, Connection>::iterator it = _connections.begin(); it != _connections.end(); ++it)
+	{
+		if (it->second.hungUp)
+			continue;
+		_io->remove(it->first);
+		PipeReclaim connection;
+		connection.fd = it->first;
+		connection.id = it->second.id;
+		connection.input = it->second.io->takeRecvBuffer();
+		it->second.io->takeSendQueue(connection.output);
+		connections.push_back(connection);
+	}
+}
+
+// Pipeline
+
+Pipeline::Pipeline()
+	: _nextId(1), _wakeFd(-1), _sleeping(0), _stopped(true)
+{
+}
+
+Pipeline::~Pipeline()
+{
+	if (!_stopped)
+	{
+		std::vector<PipeInput> inputs;
+		stop(inputs);
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			delete inputs[i].message;
+		}
+	}
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		delete _workers[i];
+	}
+	if (_wakeFd != -1)
+		::close(_wakeFd);
+}
+
+bool Pipeline::start(size_t threads, size_t ringSize, std::string& error)
+{
+	_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_wakeFd == -1)
+	{
+		error = std::string("eventfd: ") + std::strerror(errno);
+		return false;
+	}
+	_stopped = false;
+	for (size_t i = 0; i < threads; ++i)
+	{
+		PipelineWorker* worker = new PipelineWorker(ringSize, _wakeFd, &_sleeping);
+		_workers.push_back(worker);
+		_backlogs.push_back(std::deque<PipeOutput>());
+		_posted.push_back(false);
+		_load.push_back(0);
+		if (!worker->start(error))
+		{
+			std::vector<PipeInput> inputs;
+			stop(inputs);
+			return false;
+		}
+	}
+	return true;
+}
+
+int Pipeline::getWakeFd() const
+{
+	return _wakeFd;
+}
+
+void Pipeline::clearWakeup()
+{
+	readEventFd(_wakeFd);
+}
+
+bool Pipeline::owns(int fd) const
+{
+	return _routes.count(fd) != 0;
+}
+
+// New connections go to the I/O thread serving the fewest
+void Pipeline::adopt(int fd, size_t sendq, const std::string& input)
+{
+	size_t worker = 0;
+	for (size_t i = 1; i < _load.size(); ++i)
+	{
+		if (_load[i] < _load[worker])
+			worker = i;
+	}
+	Route route;
+	route.worker = worker;
+	route.id = _nextId++;
+	_routes[fd] = route;
+	_load[worker]++;
+
+	PipeOutput output;
+	output.type = PIPE_ADOPT;
+	output.fd = fd;
+	output.id = route.id;
+	output.data = SharedBuffer(input);
+	output.sendq = sendq;
+	post(worker, output);
+}
+
+void Pipeline::send(Client& client)
+{
+	std::map<int, Route>::iterator it = _routes.find(client.getFd());
+	if (_stopped || it == _routes.end())
+		return;
+	std::vector<SharedBuffer> queued;
+	client.takeSendQueue(queued);
+	PipeOutput output;
+	output.type = PIPE_SEND;
+	output.fd = client.getFd();
+	output.id = it->second.id;
+	for (size_t i = 0; i < queued.size(); ++i)
+	{
+		output.data = queued[i];
+		post(it->second.worker, output);
+	}
+}
+
+void Pipeline::close(int fd)
+{
+	std::map<int, Route>::iterator it = _routes.find(fd);
+	if (it == _routes.end())
+		return;
+	if (_stopped)
+	{
+		::close(fd);
+	}
+	else
+	{
+		PipeOutput output;
+		output.type = PIPE_CLOSE;
+		output.fd = fd;
+		output.id = it->second.id;
+		post(it->second.worker, output);
+	}
+	_load[it->second.worker]--;
+	_routes.erase(it);
+}
+
+// Output keeps its order behind anything already waiting for ring space
+void Pipeline::post(size_t worker, const PipeOutput& output)
+{
+	if (!_backlogs[worker].empty() || !_workers[worker]->post(output))
+		_backlogs[worker].push_back(output);
+	_posted[worker] = true;
+}
+
+void Pipeline::flush()
+{
+	if (_stopped)
+		return;
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		std::deque<PipeOutput>& backlog = _backlogs[i];
+		for (int attempt = 0; attempt < 2 && !backlog.empty(); ++attempt)
+		{
+			// Ask to be woken for the rest, then look again: the ring may
+			// have drained before the request was seen
+			if (attempt == 1)
+				_workers[i]->wantSpace();
+			while (!backlog.empty() && _workers[i]->post(backlog.front()))
+			{
+				backlog.pop_front();
+			}
+		}
+		if (_posted[i])
+		{
+			_workers[i]->wake();
+			_posted[i] = backlog.size() != 0;
+		}
+	}
+}
+
+// Lines from connections closed since they were read are dropped
+void Pipeline::receive(std::vector<PipeInput>& inputs)
+{
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		PipeInput input;
+		for (size_t n = 0; n < PIPE_RECEIVE_BATCH && _workers[i]->receive(input); ++n)
+		{
+			std::map<int, Route>::iterator it = _routes.find(input.fd);
+			if (it == _routes.end() || it->second.id != input.id)
+			{
+				delete input.message;
+				continue;
+			}
+			inputs.push_back(input);
+		}
+	}
+}
+
+bool Pipeline::hasInput() const
+{
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		if (_workers[i]->hasInput())
+			return true;
+	}
+	return false;
+}
+
+bool Pipeline::hasBacklog() const
+{
+	for (size_t i = 0; i < _backlogs.size(); ++i)
+	{
+		if (!_backlogs[i].empty())
+			return true;
+	}
+	return false;
+}
+
+// Announce that the event loop is about to block. Checked again after the
+// announcement, so a line pushed meanwhile is never left waiting for it.
+bool Pipeline::sleep()
+{
+	if (_stopped)
+		return true;
+	__atomic_store_n(&_sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (hasInput())
+	{
+		awake();
+		return false;
+	}
+	return true;
+}
+
+void Pipeline::awake()
+{
+	__atomic_store_n(&_sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+void Pipeline::stop(std::vector<PipeInput>& inputs)
+{
+	if (_stopped)
+		return;
+	PipeOutput output;
+	output.type = PIPE_STOP;
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		post(i, output);
+	}
+	while (hasBacklog())
+	{
+		flush();
+		sched_yield();
+	}
+	flush();
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		_workers[i]->join();
+	}
+	_stopped = true;
+
+	std::vector<PipeInput> collected;
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		_workers[i]->collect(collected);
+	}
+	for (size_t i = 0; i < collected.size(); ++i)
+	{
+		std::map<int, Route>::iterator it = _routes.find(collected[i].fd);
+		if (it == _routes.end() || it->second.id != collected[i].id)
+			delete collected[i].message;
+		else
+			inputs.push_back(collected[i]);
+	}
+}
+
+void Pipeline::reclaim(std::vector<PipeReclaim>& connections)
+{
+	std::vector<PipeReclaim> all;
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		_workers[i]->reclaim(all);
+	}
+	for (size_t i = 0; i < all.size(); ++i)
+	{
+		std::map<int, Route>::iterator it = _routes.find(all[i].fd);
+		if (it != _routes.end() && it->second.id == all[i].id)
+			connections.push_back(all[i]);
+	}
+	_routes.clear();
+}
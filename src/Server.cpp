@@ -4,30 +4,76 @@
 #include "Message.hpp"
 #include "CommandHandler.hpp"
 #include "PassCommand.hpp"
+#include "NickCommand.hpp"
+#include "UserCommand.hpp"
 #include "JoinCommand.hpp"
 #include "PartCommand.hpp"
 #include "PrivmsgCommand.hpp"
+#include "NoticeCommand.hpp"
+#include "CapCommand.hpp"
 #include "QuitCommand.hpp"
 #include "KickCommand.hpp"
 #include "TopicCommand.hpp"
 #include "InviteCommand.hpp"
 #include "ModeCommand.hpp"
+#include "OperCommand.hpp"
+#include "StatsCommand.hpp"
+#include "Logger.hpp"
+#include "Tracer.hpp"
+#include "LooptraceCommand.hpp"
+#include "ServerCommand.hpp"
+#include "ConnectCommand.hpp"
+#include "SquitCommand.hpp"
+#include "LinksCommand.hpp"
+#include "UpgradeCommand.hpp"
+#include "ChathistoryCommand.hpp"
+#include "FilterCommand.hpp"
+#include "FanoutPool.hpp"
+#include "WebSocket.hpp"
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdexcept>
 #include <cstring>
 #include <cerrno>
 #include <sstream>
-#include <iostream>
 #include <signal.h>
 #include <poll.h>
 #include <cctype>
+#include <algorithm>
+#include <set>
+#include <pthread.h>
+#include <sched.h>
+
+// Queued buffers handed to one sendmsg()
+static const size_t SEND_IOV_MAX = 64;
 
 // Global Server pointer for signal handler
 static Server* g_serverInstance = NULL;
 
+// Set by SIGUSR1, serviced by the event loop
+static volatile sig_atomic_t g_traceDumpRequested = 0;
+
+static void traceSignalHandler(int sig)
+{
+	(void)sig;
+	g_traceDumpRequested = 1;
+}
+
+// Set by SIGUSR2: hand everything over to a fresh copy of the binary
+static volatile sig_atomic_t g_upgradeRequested = 0;
+
+static void upgradeSignalHandler(int sig)
+{
+	(void)sig;
+	g_upgradeRequested = 1;
+}
+
 // Signal handler for graceful shutdown
 static void signalHandler(int sig)
 {
@@ -38,14 +84,79 @@ static void signalHandler(int sig)
 	}
 }
 
-Server::Server(int port, const std::string& password)
-	: _port(port), _password(password), _serverSocket(-1), _isRunning(false)
+Server::Server(int port, const std::string& password, const Config& config)
+	: _port(port), _password(password), _config(config), _busyPoll(config.getBusyPoll()),
+	  _spinNs(config.getSpinUsec() * 1000ULL), _isRunning(false), _startTime(time(NULL)),
+	  _pipeline(NULL), _lastMemorySample(0), _serverName(config.getServerName()), _nextRemoteFd(-2), _upgradeRequested(false),
+	  _handedOver(false), _resumeSocket(-1), _historyBytes(0), _messageSeq(0)
 {
+	_config.applyDefaults(port);
+
+	std::string error;
+	_io = createIoBackend(_config.getIoBackend(), _config.getIoBuffers(), error);
+	if (_io == NULL)
+	{
+		throw std::runtime_error("Failed to set up the " + _config.getIoBackend() + " I/O backend: " + error);
+	}
+
+	std::string authError;
+	if (!_auth.start(_config.getAuthThreads(), authError))
+	{
+		throw std::runtime_error("Failed to start the auth workers: " + authError);
+	}
+	_io->add(_auth.getEventFd(), POLLIN, 0);
+
+	std::string filterError;
+	if (!_filter.start(filterError))
+	{
+		throw std::runtime_error("Failed to start the filter builder: " + filterError);
+	}
+	_io->add(_filter.getEventFd(), POLLIN, 0);
+
+	std::string fanoutError;
+	if (!FanoutPool::instance().start(_config.getFanoutThreads(), _config.getFanoutThreshold(), fanoutError))
+	{
+		throw std::runtime_error("Failed to start the fan-out threads: " + fanoutError);
+	}
+
+	const std::vector<ConnectionClass>& classes = _config.getClasses();
+	for (size_t i = 0; i < classes.size(); ++i)
+	{
+		_classes[classes[i].name] = classes[i];
+	}
+
+	Logger::instance().setLevel(_config.getLogLevel());
+	Logger::instance().setCategoryMask(_config.getLogCategories());
+	if (_config.getIoBackend() == "auto" && !error.empty())
+	{
+		LOG(LOG_INFO, LOG_SERVER, "Falling back to " << _io->getName() << ": " << error);
+	}
+	LOG(LOG_INFO, LOG_SERVER, "I/O backend " << _io->getName());
+	// io_uring sends on its own and never reaches the sendmsg path
+	if (_config.getIoZeroCopy() != 0 && _io->canSend())
+	{
+		LOG(LOG_WARN, LOG_SERVER, "Zero-copy sends are not used with " << _io->getName());
+	}
+	else if (_config.getIoZeroCopy() != 0)
+	{
+		_zeroCopy.setThreshold(_config.getIoZeroCopy());
+		LOG(LOG_INFO, LOG_SERVER, "Zero-copy sends from " << _config.getIoZeroCopy() << " queued bytes");
+	}
+	if (_config.getFanoutThreads() > 0)
+	{
+		LOG(LOG_INFO, LOG_SERVER, "Fan-out: " << _config.getFanoutThreads() << " thread(s) for channels of "
+			<< _config.getFanoutThreshold() << "+ members");
+	}
+
 	registerCommands();
 }
 
 Server::~Server()
 {
+	// Joins the I/O threads before their sockets are closed
+	delete _pipeline;
+	FanoutPool::instance().stop();
+
 	// Cleanup all clients
 	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
 	{
@@ -70,80 +181,223 @@ Server::~Server()
 	}
 	_channels.clear();
 
-	// Close server socket
-	if (_serverSocket != -1)
-	{
-		close(_serverSocket);
-	}
+	// Close listening sockets
+	closeListeners();
+
+	delete _io;
 }
 
-void Server::setupSocket()
+// Create, configure, bind and listen on one socket described by the config.
+// Returns the listening fd or throws with the socket already closed.
+int Server::openListener(const ListenerConfig& config)
 {
+	int domain = AF_INET;
+	if (config.type == LISTEN_TCP6)
+		domain = AF_INET6;
+	else if (config.type == LISTEN_UNIX)
+		domain = AF_UNIX;
+
 	// Create socket
-	_serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-	if (_serverSocket == -1)
+	int fd = socket(domain, SOCK_STREAM, 0);
+	if (fd == -1)
 	{
-		throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
+		throw std::runtime_error("Failed to create socket for " + config.describe() + ": " + strerror(errno));
 	}
 
 	// Set socket to non-blocking
-	int flags = fcntl(_serverSocket, F_GETFL, 0);
+	int flags = fcntl(fd, F_GETFL, 0);
 	if (flags == -1)
 	{
-		close(_serverSocket);
+		close(fd);
 		throw std::runtime_error(std::string("Failed to get socket flags: ") + strerror(errno));
 	}
-	if (fcntl(_serverSocket, F_SETFL, flags | O_NONBLOCK) == -1)
+	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
 	{
-		close(_serverSocket);
+		close(fd);
 		throw std::runtime_error(std::string("Failed to set socket to non-blocking: ") + strerror(errno));
 	}
 
-	// Set SO_REUSEADDR option
-	int reuse = 1;
-	if (setsockopt(_serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1)
+	if (config.type != LISTEN_UNIX)
+	{
+		// Set SO_REUSEADDR option
+		int reuse = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1)
+		{
+			close(fd);
+			throw std::runtime_error(std::string("Failed to set SO_REUSEADDR: ") + strerror(errno));
+		}
+	}
+
+	// IPv6 listeners are dual-stack unless v6only is requested
+	if (config.type == LISTEN_TCP6)
 	{
-		close(_serverSocket);
-		throw std::runtime_error(std::string("Failed to set SO_REUSEADDR: ") + strerror(errno));
+		int v6only = config.v6only ? 1 : 0;
+		if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1)
+		{
+			close(fd);
+			throw std::runtime_error(std::string("Failed to set IPV6_V6ONLY: ") + strerror(errno));
+		}
+	}
+
+	// Buffer sizes set on the listener are inherited by accepted sockets
+	if (config.sendBufferSize > 0)
+	{
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config.sendBufferSize, sizeof(config.sendBufferSize));
+	}
+	if (config.recvBufferSize > 0)
+	{
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config.recvBufferSize, sizeof(config.recvBufferSize));
 	}
 
 	// Bind socket
-	struct sockaddr_in serverAddr;
-	std::memset(&serverAddr, 0, sizeof(serverAddr));
-	serverAddr.sin_family = AF_INET;
-	serverAddr.sin_addr.s_addr = INADDR_ANY;
-	serverAddr.sin_port = htons(_port);
+	int bindResult = -1;
+	if (config.type == LISTEN_TCP4)
+	{
+		struct sockaddr_in addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(config.port);
+		if (inet_pton(AF_INET, config.address.c_str(), &addr.sin_addr) != 1)
+		{
+			close(fd);
+			throw std::runtime_error("Invalid IPv4 address: " + config.address);
+		}
+		bindResult = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
+	else if (config.type == LISTEN_TCP6)
+	{
+		struct sockaddr_in6 addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sin6_family = AF_INET6;
+		addr.sin6_port = htons(config.port);
+		if (inet_pton(AF_INET6, config.address.c_str(), &addr.sin6_addr) != 1)
+		{
+			close(fd);
+			throw std::runtime_error("Invalid IPv6 address: " + config.address);
+		}
+		bindResult = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
+	else
+	{
+		struct sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (config.address.length() >= sizeof(addr.sun_path))
+		{
+			close(fd);
+			throw std::runtime_error("Unix socket path too long: " + config.address);
+		}
+		std::strcpy(addr.sun_path, config.address.c_str());
 
-	if (bind(_serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1)
+		// Remove a stale socket left behind by a previous run
+		struct stat st;
+		if (lstat(config.address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		{
+			unlink(config.address.c_str());
+		}
+		bindResult = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+		if (bindResult == 0 && config.mode >= 0)
+		{
+			chmod(config.address.c_str(), config.mode);
+		}
+	}
+
+	if (bindResult == -1)
 	{
-		close(_serverSocket);
+		int savedErrno = errno;
+		close(fd);
 		std::ostringstream oss;
-		oss << "Failed to bind socket to port " << _port << ": " << strerror(errno);
+		oss << "Failed to bind " << config.describe() << ": " << strerror(savedErrno);
 		throw std::runtime_error(oss.str());
 	}
 
 	// Listen
-	if (listen(_serverSocket, 10) == -1)
+	if (listen(fd, config.backlog) == -1)
 	{
-		close(_serverSocket);
+		close(fd);
 		throw std::runtime_error(std::string("Failed to listen on socket: ") + strerror(errno));
 	}
 
-	// Add server socket to pollfds
-	struct pollfd serverPollfd;
-	serverPollfd.fd = _serverSocket;
-	serverPollfd.events = POLLIN;
-	serverPollfd.revents = 0;
-	_pollfds.push_back(serverPollfd);
+	return fd;
+}
+
+void Server::setupListeners()
+{
+	const std::vector<ListenerConfig>& configs = _config.getListeners();
+	for (size_t i = 0; i < configs.size(); ++i)
+	{
+		int fd = openListener(configs[i]);
+
+		Listener listener;
+		listener.fd = fd;
+		listener.config = configs[i];
+		listener.connClass = &_classes[configs[i].className];
+		_listeners[fd] = listener;
+
+		_io->add(fd, POLLIN, IO_LISTENER);
+
+		LOG(LOG_INFO, LOG_NET, "Listening on " << configs[i].describe());
+	}
+}
+
+void Server::closeListeners()
+{
+	for (std::map<int, Listener>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+	{
+		close(it->first);
+		// After an upgrade the socket path belongs to the new process
+		if (it->second.config.type == LISTEN_UNIX && !_handedOver)
+		{
+			unlink(it->second.config.address.c_str());
+		}
+	}
+	_listeners.clear();
+}
+
+// Render the peer address of an accepted socket as the client's hostname
+static std::string peerHostname(const struct sockaddr_storage& addr)
+{
+	char buffer[INET6_ADDRSTRLEN];
+	if (addr.ss_family == AF_INET)
+	{
+		const struct sockaddr_in* in4 = reinterpret_cast<const struct sockaddr_in*>(&addr);
+		if (inet_ntop(AF_INET, &in4->sin_addr, buffer, sizeof(buffer)) != NULL)
+			return buffer;
+	}
+	else if (addr.ss_family == AF_INET6)
+	{
+		const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&addr);
+		if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+		{
+			// Show dual-stack IPv4 peers in their familiar dotted form
+			if (inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], buffer, sizeof(buffer)) != NULL)
+				return buffer;
+		}
+		else if (inet_ntop(AF_INET6, &in6->sin6_addr, buffer, sizeof(buffer)) != NULL)
+		{
+			std::string host(buffer);
+			// A leading ':' would be read as a trailing parameter marker
+			if (host[0] == ':')
+				host = "0" + host;
+			return host;
+		}
+	}
+	return "localhost";
 }
 
-void Server::handleNewConnection()
+void Server::handleNewConnection(Listener& listener)
 {
+	TRACE_SCOPE("handleNewConnection");
+
 	// Accept new connection
-	int clientFd = accept(_serverSocket, NULL, NULL);
+	struct sockaddr_storage peerAddr;
+	socklen_t peerLen = sizeof(peerAddr);
+	std::memset(&peerAddr, 0, sizeof(peerAddr));
+	Metrics::instance().addIoSyscall();
+	int clientFd = accept(listener.fd, (struct sockaddr*)&peerAddr, &peerLen);
 	if (clientFd == -1)
 	{
-		std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
+		LOG(LOG_ERROR, LOG_NET, "Failed to accept connection: " << strerror(errno));
 		return;
 	}
 
@@ -151,37 +405,110 @@ void Server::handleNewConnection()
 	int flags = fcntl(clientFd, F_GETFL, 0);
 	if (flags == -1)
 	{
-		std::cerr << "Failed to get client socket flags: " << strerror(errno) << std::endl;
+		LOG(LOG_ERROR, LOG_NET, "Failed to get client socket flags: " << strerror(errno));
 		close(clientFd);
 		return;
 	}
 	if (fcntl(clientFd, F_SETFL, flags | O_NONBLOCK) == -1)
 	{
-		std::cerr << "Failed to set client socket to non-blocking: " << strerror(errno) << std::endl;
+		LOG(LOG_ERROR, LOG_NET, "Failed to set client socket to non-blocking: " << strerror(errno));
 		close(clientFd);
 		return;
 	}
 
+	acceptConnection(listener, clientFd, peerAddr);
+}
+
+// Set up a freshly accepted, non-blocking socket: by handleNewConnection,
+// or by the backend itself (IO_ACCEPTED)
+void Server::acceptConnection(Listener& listener, int clientFd, const struct sockaddr_storage& peerAddr)
+{
+	// Enforce the connection class limit before doing any more work
+	ConnectionClass* connClass = listener.connClass;
+	if (connClass->maxClients != 0 && connClass->clientCount >= connClass->maxClients)
+	{
+		const char* error = "ERROR :Closing Link: Too many connections in your class\r\n";
+		send(clientFd, error, std::strlen(error), MSG_NOSIGNAL | MSG_DONTWAIT);
+		close(clientFd);
+		return;
+	}
+
+	// Per-listener options for accepted TCP sockets
+	if (listener.config.type != LISTEN_UNIX)
+	{
+		int on = 1;
+		if (listener.config.noDelay)
+			setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		if (listener.config.keepAlive)
+			setsockopt(clientFd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+		// Raising it past net.core.busy_read needs CAP_NET_ADMIN
+		if (_busyPoll > 0 && setsockopt(clientFd, SOL_SOCKET, SO_BUSY_POLL, &_busyPoll, sizeof(_busyPoll)) == -1)
+		{
+			LOG(LOG_WARN, LOG_NET, "SO_BUSY_POLL refused, busy polling off: " << strerror(errno));
+			_busyPoll = 0;
+		}
+	}
+
 	// Create new Client object
 	Client* client = new Client(clientFd);
+	client->setHostname(peerHostname(peerAddr));
+	client->setConnectionClass(connClass);
+	client->setProtocol(listener.config.protocol);
+	connClass->clientCount++;
+	Metrics::instance().addConnectionAccepted();
+
+	// OpenSSL reads TLS sockets itself, so the backend only reports readiness.
+	// In split-stage mode an I/O thread serves plain IRC clients.
+	if (_pipeline != NULL && !listener.config.tls && client->getProtocol() == PROTO_IRC)
+	{
+		_clients[clientFd] = client;
+		_pipeline->adopt(clientFd, connClass->sendq, std::string());
+	}
+	else
+	{
+		addClient(client, !listener.config.tls);
+		// Not possible on UNIX sockets; refused by kernels older than 4.14
+		if (_zeroCopy.getThreshold() != 0 && listener.config.type != LISTEN_UNIX && !_zeroCopy.enable(clientFd))
+		{
+			LOG(LOG_WARN, LOG_NET, "SO_ZEROCOPY refused, zero-copy sends off: " << strerror(errno));
+			_zeroCopy.setThreshold(0);
+		}
+	}
+	if (client->getProtocol() == PROTO_IRC)
+	{
+		_capture.recordConnect(clientFd, client->getHostname());
+	}
+	else if (client->getProtocol() == PROTO_WEBSOCKET)
+	{
+		client->setWebSocket(new WebSocketSession());
+	}
 
-	// Add to clients map
-	_clients[clientFd] = client;
+	LOG(LOG_INFO, LOG_NET, "New client connected: fd " << clientFd << " from " << client->getHostname());
+	if (listener.config.tls)
+	{
+		startTls(*client);
+	}
+}
 
-	// Add client fd to pollfds
-	struct pollfd clientPollfd;
-	clientPollfd.fd = clientFd;
-	clientPollfd.events = POLLIN;
-	clientPollfd.revents = 0;
-	_pollfds.push_back(clientPollfd);
+// Take ownership of a connected client and start watching its socket;
+// receive lets a completion backend read it (IO_RECEIVED)
+void Server::addClient(Client* client, bool receive)
+{
+	// Add to clients map
+	_clients[client->getFd()] = client;
 
-	std::cout << "New client connected: fd " << clientFd << std::endl;
+	_io->add(client->getFd(), POLLIN, receive ? IO_RECEIVE : 0);
 }
 
 void Server::start()
 {
-	// Setup socket
-	setupSocket();
+	// Setup listening sockets, unless they were handed over by an upgrade
+	if (_listeners.empty())
+	{
+		setupListeners();
+	}
+
+	setupTls();
 
 	// Set running flag
 	_isRunning = true;
@@ -192,14 +519,85 @@ void Server::start()
 	// Setup signal handlers
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
+	signal(SIGUSR1, traceSignalHandler);
+	signal(SIGUSR2, upgradeSignalHandler);
+	// OpenSSL writes with write(), which cannot take MSG_NOSIGNAL
+	signal(SIGPIPE, SIG_IGN);
+
+	Tracer::instance().setLoopThread();
+	if (_config.isTraceEnabled())
+	{
+		Tracer::instance().enable();
+	}
+
+	if (!_config.getCaptureFile().empty())
+	{
+		std::string error;
+		if (!_capture.open(_config.getCaptureFile(), error))
+		{
+			throw std::runtime_error("Failed to open capture file " + _config.getCaptureFile() + ": " + error);
+		}
+		LOG(LOG_INFO, LOG_SERVER, "Capturing client traffic to " << _config.getCaptureFile());
+	}
+
+	if (!_config.getSnapshotFile().empty())
+	{
+		std::string error;
+		if (!_snapshot.open(_config.getSnapshotFile(), _config.getSnapshotSlots(), _config.getSnapshotInterval(), error))
+		{
+			throw std::runtime_error("Failed to open snapshot file " + _config.getSnapshotFile() + ": " + error);
+		}
+		LOG(LOG_INFO, LOG_SERVER, "Channel snapshot " << _config.getSnapshotFile() << ": " << _snapshot.getRestoredCount()
+			<< " saved channel(s), " << _snapshot.getSlotCount() << " slots");
+	}
 
-	std::cout << "Server started on port " << _port << std::endl;
+	std::string pipelineError;
+	if (!startPipeline(pipelineError))
+	{
+		throw std::runtime_error("Failed to start the pipeline: " + pipelineError);
+	}
+
+	LOG(LOG_INFO, LOG_SERVER, "Server started with " << _listeners.size() << " listener(s)");
+	finishResume();
+	pinEventLoop();
 
 	// Main event loop
 	while (_isRunning)
 	{
-		// Poll with 100ms timeout
-		int pollResult = poll(&_pollfds[0], _pollfds.size(), 100);
+		if (g_traceDumpRequested)
+		{
+			g_traceDumpRequested = 0;
+			std::string error;
+			if (dumpTrace(error))
+				LOG(LOG_INFO, LOG_SERVER, "Trace written to " << _config.getTraceFile());
+			else
+				LOG(LOG_WARN, LOG_SERVER, "Trace dump failed: " << error);
+		}
+
+		if (g_upgradeRequested || _upgradeRequested)
+		{
+			g_upgradeRequested = 0;
+			_upgradeRequested = false;
+			std::string error;
+			if (performUpgrade(error))
+				break;
+			LOG(LOG_ERROR, LOG_SERVER, "Upgrade failed: " << error);
+			std::string pipelineError;
+			if (!startPipeline(pipelineError))
+				LOG(LOG_WARN, LOG_SERVER, "Pipeline not restarted: " << pipelineError);
+			Client* requester = _upgradeRequester.empty() ? NULL : getClientByNickname(_upgradeRequester);
+			if (requester != NULL)
+				sendReply(*requester, ":" + _serverName + " NOTICE " + _upgradeRequester + " :Upgrade failed: " + error + "\r\n");
+			_upgradeRequester.clear();
+			flushClients();
+		}
+
+		// Wait with 100ms timeout, after spinning if latency spin= is set
+		int pollResult;
+		{
+			TRACE_SCOPE("poll");
+			pollResult = waitForEvents();
+		}
 
 		// Handle poll errors
 		if (pollResult == -1)
@@ -209,116 +607,473 @@ void Server::start()
 				// Interrupted by signal, continue
 				continue;
 			}
-			std::cerr << "Poll error: " << strerror(errno) << std::endl;
+			LOG(LOG_ERROR, LOG_SERVER, "Poll error: " << strerror(errno));
 			break;
 		}
 
-		// Process ready file descriptors
-		for (size_t i = 0; i < _pollfds.size(); ++i)
+		// Memory high-water marks, sampled at most once a second
+		if (time(NULL) != _lastMemorySample)
 		{
-			if (_pollfds[i].revents == 0)
-				continue;
+			sampleMemory();
+			saveSnapshot();
+			_zeroCopy.expire(time(NULL));
+		}
+
+		// Lines the I/O threads parsed come without an event of their own
+		if (pollResult == 0 && (_pipeline == NULL || (!_pipeline->hasInput() && !_pipeline->hasBacklog())))
+			continue;
+		unsigned long long iterationStart = Metrics::nowNs();
+
+		// Process ready file descriptors and completed operations
+		for (size_t i = 0; i < _ioEvents.size(); ++i)
+		{
+			handleIoEvent(_ioEvents[i]);
+		}
+		if (_pipeline != NULL)
+		{
+			runPipeline();
+		}
+
+		flushClients();
+
+		Metrics::instance().recordPollIteration(Metrics::nowNs() - iterationStart);
+	}
+
+	// Cleanup
+	stop();
+	stopPipeline();
+	_capture.close();
+	if (!_handedOver)
+		saveSnapshot();
+	_snapshot.close();
+	if (_handedOver)
+		LOG(LOG_INFO, LOG_SERVER, "Connections handed over, exiting");
+	else
+		LOG(LOG_INFO, LOG_SERVER, "Server shutting down...");
+}
+
+// latency cpu=: keep the loop on one CPU so its caches and the socket
+// softirqs it shares a core with stay warm
+void Server::pinEventLoop()
+{
+	int cpu = _config.getLatencyCpu();
+	if (cpu < 0)
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (result != 0)
+	{
+		std::ostringstream oss;
+		oss << "Failed to pin the event loop to CPU " << cpu << ": " << strerror(result);
+		throw std::runtime_error(oss.str());
+	}
+	LOG(LOG_INFO, LOG_SERVER, "Event loop pinned to CPU " << cpu);
+}
 
-			int fd = _pollfds[i].fd;
+// latency spin=: poll without blocking for up to the spin budget before
+// falling back to a blocking wait, trading a core for the wakeup latency.
+// The budget shrinks while spins come up empty and is restored by the next
+// one that finds work, so an idle server stops burning its CPU.
+int Server::waitForEvents()
+{
+	unsigned long long maxSpinNs = _config.getSpinUsec() * 1000ULL;
+	if (maxSpinNs == 0)
+		return blockForEvents();
 
-			// Check for errors or hangup
-			if (_pollfds[i].revents & (POLLHUP | POLLERR))
+	unsigned long long deadline = Metrics::nowNs() + _spinNs;
+	do
+	{
+		int ready = _io->wait(0, _ioEvents);
+		if (ready != 0 || (_pipeline != NULL && _pipeline->hasInput()))
+		{
+			if (ready > 0)
 			{
-				if (fd != _serverSocket)
-				{
-					removeClient(fd);
-				}
-				continue;
+				_spinNs = maxSpinNs;
+				Metrics::instance().recordLoopSpin(true);
 			}
+			return ready;
+		}
+	}
+	while (Metrics::nowNs() < deadline);
+
+	Metrics::instance().recordLoopSpin(false);
+	if (_spinNs > maxSpinNs / 16)
+		_spinNs /= 2;
+	return blockForEvents();
+}
+
+// Split-stage mode: the I/O threads only wake a loop that said it blocks
+int Server::blockForEvents()
+{
+	if (_pipeline == NULL)
+		return _io->wait(100, _ioEvents);
+	int ready = _io->wait(_pipeline->sleep() ? 100 : 0, _ioEvents);
+	_pipeline->awake();
+	return ready;
+}
+
+// Send pending output to every client, dropping those over their sendq
+void Server::flushClients()
+{
+	TRACE_SCOPE("sendToClient sweep");
+	std::map<int, Client*>::iterator it = _clients.begin();
+	while (it != _clients.end())
+	{
+		// Advance first: sending may remove the client from the map
+		Client* client = it->second;
+		++it;
+
+		const ConnectionClass* connClass = client->getConnectionClass();
+		if (connClass != NULL && client->getSendBufferSize() > connClass->sendq)
+		{
+			LOG(LOG_WARN, LOG_NET, "SendQ exceeded for client fd " << client->getFd());
+			removeClient(client->getFd());
+			continue;
+		}
+		if (client->hasMessageToSend())
+		{
+			Metrics::instance().recordSendqDepth(client->getSendBufferSize());
+			sendToClient(*client);
+		}
+		// Only the client itself can have been removed by sendToClient
+		if (_clients.count(client->getFd()) && client->shouldCloseAfterFlush() && !client->hasMessageToSend())
+		{
+			removeClient(client->getFd());
+		}
+	}
+	if (_pipeline != NULL)
+	{
+		_pipeline->flush();
+	}
+}
+
+// Safe to call from a signal handler: only clears the loop flag
+void Server::stop()
+{
+	_isRunning = false;
+}
 
-			// Server socket: new connection
-			if (fd == _serverSocket && (_pollfds[i].revents & POLLIN))
+void Server::removeClient(int clientFd, const std::string& reason)
+{
+	dropClient(clientFd, reason, true);
+}
+
+// Remove a local or remote client. Channel members are sent its QUIT, and
+// so are the other servers unless the quit is already known network-wide
+// (netsplits and kills).
+void Server::dropClient(int clientFd, const std::string& reason, bool propagateQuit)
+{
+	TRACE_SCOPE("removeClient");
+	_capture.recordDisconnect(clientFd);
+
+	std::map<int, Client*>::iterator found = _clients.find(clientFd);
+	if (found != _clients.end())
+	{
+		Client* client = found->second;
+		if (client->isServerLink())
+		{
+			handleLinkLoss(*client, reason);
+		}
+		else if (client->getLinkState() != LINK_NONE)
+		{
+			LOG(LOG_WARN, LOG_NET, "Link to " << client->getLinkName() << " failed: " << reason);
+		}
+		else if (client->isRegistered())
+		{
+			std::string host = client->getHostname().empty() ? "localhost" : client->getHostname();
+			std::string quitLine = ":" + client->getNickname() + "!" + client->getUsername() + "@" + host +
+				" QUIT :" + reason + "\r\n";
+
+			// Everyone sharing a channel hears it once
+			std::set<Client*> recipients;
+			std::vector<Channel*> channels = getChannelsForClient(clientFd);
+			for (std::vector<Channel*>::iterator it = channels.begin(); it != channels.end(); ++it)
 			{
-				handleNewConnection();
+				std::vector<Client*> members = (*it)->getMembers();
+				recipients.insert(members.begin(), members.end());
 			}
-			// Client socket: incoming message
-			else if (fd != _serverSocket && (_pollfds[i].revents & POLLIN))
+			recipients.erase(client);
+			for (std::set<Client*>::iterator it = recipients.begin(); it != recipients.end(); ++it)
 			{
-				handleClientMessage(fd);
+				sendReply(**it, quitLine);
+			}
+
+			if (propagateQuit)
+			{
+				propagate(*client, quitLine);
 			}
 		}
+	}
+
+	// Remove client from all channels
+	std::vector<Channel*> clientChannels = getChannelsForClient(clientFd);
+	for (std::vector<Channel*>::iterator it = clientChannels.begin(); it != clientChannels.end(); ++it)
+	{
+		(*it)->removeMember(clientFd);
+		if ((*it)->getMemberCount() == 0)
+		{
+			removeChannel((*it)->getName());
+		}
+	}
+
+	// Find and remove client from map
+	std::map<int, Client*>::iterator it = _clients.find(clientFd);
+	if (it != _clients.end())
+	{
+		if (!it->second->isRemote())
+		{
+			Metrics::instance().addConnectionClosed();
+		}
+		ConnectionClass* connClass = it->second->getConnectionClass();
+		if (connClass != NULL && connClass->clientCount > 0)
+		{
+			connClass->clientCount--;
+		}
+		setNickname(*it->second, "");
+		if (it->second->getTls() != NULL)
+		{
+			it->second->getTls()->shutdown();
+		}
+		delete it->second;
+		_clients.erase(it);
+	}
+
+	// Stop watching before the descriptor can be reused
+	if (_pipeline != NULL && _pipeline->owns(clientFd))
+	{
+		_pipeline->close(clientFd);
+	}
+	else if (_io->isWatched(clientFd))
+	{
+		_io->remove(clientFd);
+		_zeroCopy.forget(clientFd, time(NULL));
+		close(clientFd);
+	}
+
+	// Remote users have negative pseudo fds and no socket
+	if (clientFd >= 0)
+	{
+		LOG(LOG_INFO, LOG_NET, "Client disconnected: fd " << clientFd);
+	}
+}
+
+// Change what the event loop waits for on one descriptor
+void Server::setPollEvents(int fd, short events)
+{
+	_io->modify(fd, events);
+}
+
+Client* Server::getClient(int clientFd)
+{
+	std::map<int, Client*>::iterator it = _clients.find(clientFd);
+	return it == _clients.end() ? NULL : it->second;
+}
+
+// Register the client once PASS, NICK and USER have all been accepted and
+// any CAP negotiation has ended
+void Server::completeRegistration(Client& client)
+{
+	if (client.isRegistered() || !client.isAuthenticated() || client.isNegotiatingCaps() ||
+		client.getNickname().empty() || client.getUsername().empty())
+	{
+		return;
+	}
+
+	client.setRegistered(true);
+
+	std::string nick = client.getNickname();
+	std::string host = client.getHostname().empty() ? "localhost" : client.getHostname();
+	std::ostringstream oss;
+	oss << ":" << _serverName << " 001 " << nick << " :Welcome to the Internet Relay Network "
+		<< nick << "!" << client.getUsername() << "@" << host << "\r\n";
+	oss << ":" << _serverName << " 002 " << nick << " :Your host is " << _serverName << ", running version ft_irc-1.0\r\n";
+	oss << ":" << _serverName << " 003 " << nick << " :This server was created " << ctime(&_startTime);
+	// ctime() ends in '\n'; replace it with the IRC line terminator
+	std::string welcome = oss.str();
+	welcome.erase(welcome.length() - 1);
+	welcome += "\r\n";
+	welcome += ":" + _serverName + " 004 " + nick + " " + _serverName + " ft_irc-1.0 o beIiklot\r\n";
+	std::ostringstream isupport;
+	isupport << ":" << _serverName << " 005 " << nick << " TARGMAX=PRIVMSG:" << MAX_MESSAGE_TARGETS << ",NOTICE:"
+		<< MAX_MESSAGE_TARGETS << " CHANMODES=beI,k,l,it EXCEPTS INVEX MAXLIST=b:" << CHANNEL_MAX_MASKS
+		<< ",e:" << CHANNEL_MAX_MASKS << ",I:" << CHANNEL_MAX_MASKS;
+	if (isHistoryEnabled())
+	{
+		isupport << " CHATHISTORY=" << CHATHISTORY_MAX_LIMIT << " MSGREFTYPES=msgid,timestamp";
+	}
+	isupport << " :are supported by this server\r\n";
+	welcome += isupport.str();
+	sendReply(client, welcome);
+
+	introduceUser(client);
+}
+
+// One event from the backend: readiness from poll and epoll, and from
+// io_uring for sockets it only watches; otherwise what io_uring accepted,
+// read or sent itself
+void Server::handleIoEvent(const IoEvent& event)
+{
+	int fd = event.fd;
+	std::map<int, Listener>::iterator listener = _listeners.find(fd);
+
+	if (event.type == IO_ACCEPTED)
+	{
+		if (listener == _listeners.end())
+		{
+			if (event.result >= 0)
+				close(event.result);
+			return;
+		}
+		if (event.result < 0)
+		{
+			LOG(LOG_ERROR, LOG_NET, "Failed to accept connection: " << strerror(-event.result));
+			return;
+		}
+		// Multishot accept does not report peer addresses
+		struct sockaddr_storage peerAddr;
+		socklen_t peerLen = sizeof(peerAddr);
+		std::memset(&peerAddr, 0, sizeof(peerAddr));
+		Metrics::instance().addIoSyscall();
+		getpeername(event.result, (struct sockaddr*)&peerAddr, &peerLen);
+		acceptConnection(listener->second, event.result, peerAddr);
+		return;
+	}
 
-		// Send pending messages to clients
-		for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	Client* client = getClient(fd);
+	if (event.type == IO_RECEIVED)
+	{
+		if (client == NULL)
+			return;
+		if (event.length == 0)
 		{
-			Client* client = it->second;
-			if (client->hasMessageToSend())
-			{
-				sendToClient(*client);
-			}
+			// poll reports a reset as POLLHUP/POLLERR, which is not logged either
+			if (event.result == -ECONNRESET)
+				LOG(LOG_DEBUG, LOG_NET, "Connection reset: fd " << fd);
+			else if (event.result < 0)
+				LOG(LOG_WARN, LOG_NET, "Recv error for client fd " << fd << ": " << strerror(-event.result));
+			else
+				LOG(LOG_DEBUG, LOG_NET, "Client disconnected (recv returned 0): fd " << fd);
+			removeClient(fd);
+			return;
 		}
+		_capture.recordData(fd, event.data, event.length);
+		processInput(*client, event.data, event.length);
+		return;
 	}
-
-	// Cleanup
-	stop();
-}
-
-void Server::stop()
-{
-	_isRunning = false;
-	std::cout << "Server shutting down..." << std::endl;
-}
-
-void Server::removeClient(int clientFd)
-{
-	// Remove client from all channels
-	std::vector<Channel*> clientChannels = getChannelsForClient(clientFd);
-	for (std::vector<Channel*>::iterator it = clientChannels.begin(); it != clientChannels.end(); ++it)
+	if (event.type == IO_SENT)
 	{
-		(*it)->removeMember(clientFd);
-		if ((*it)->getMemberCount() == 0)
+		if (client == NULL)
+			return;
+		if (event.result < 0 && event.result != -EAGAIN && event.result != -ECANCELED)
 		{
-			removeChannel((*it)->getName());
+			LOG(LOG_WARN, LOG_NET, "Send error for client fd " << fd << ": " << strerror(-event.result));
+			removeClient(fd);
+			return;
+		}
+		if (event.result > 0)
+		{
+			Metrics::instance().addBytesOut(event.result);
+			client->consumeSendBuffer(event.result);
 		}
+		return;
 	}
+	if (event.type != IO_READY)
+		return;
 
-	// Find and remove client from map
-	std::map<int, Client*>::iterator it = _clients.find(clientFd);
-	if (it != _clients.end())
+	if (fd == _auth.getEventFd())
 	{
-		delete it->second;
-		_clients.erase(it);
+		handleAuthCompletions(false);
+		return;
+	}
+	if (fd == _filter.getEventFd())
+	{
+		_filter.install();
+		return;
+	}
+	if (_pipeline != NULL && fd == _pipeline->getWakeFd())
+	{
+		_pipeline->clearWakeup();
+		return;
 	}
 
-	// Remove from pollfds
-	for (std::vector<struct pollfd>::iterator it = _pollfds.begin(); it != _pollfds.end(); ++it)
+	// Check for errors or hangup
+	if (event.revents & (POLLHUP | POLLERR))
 	{
-		if (it->fd == clientFd)
+		if (listener != _listeners.end())
+			return;
+		// Zero-copy completions raise POLLERR too; only a real error ends the client
+		if ((event.revents & POLLHUP) || !_zeroCopy.reap(fd))
 		{
-			close(clientFd);
-			_pollfds.erase(it);
-			break;
+			removeClient(fd);
+			return;
 		}
+		if (!(event.revents & (POLLIN | POLLOUT)))
+			return;
 	}
 
-	std::cout << "Client disconnected: fd " << clientFd << std::endl;
+	// Listening socket: new connection
+	if (listener != _listeners.end() && (event.revents & POLLIN))
+	{
+		handleNewConnection(listener->second);
+	}
+	// TLS client whose OpenSSL wanted to write, a client whose socket
+	// refused queued output, or an outgoing server link whose connect()
+	// finished
+	else if (listener == _listeners.end() && (event.revents & POLLOUT))
+	{
+		if (client != NULL && client->getTls() != NULL)
+		{
+			setPollEvents(fd, POLLIN);
+			handleTlsInput(*client);
+		}
+		else if (client != NULL && client->getLinkState() != LINK_CONNECTING)
+		{
+			sendToClient(*client);
+			if ((event.revents & POLLIN) && getClient(fd) == client)
+				handleClientMessage(fd);
+		}
+		else
+		{
+			handleLinkConnect(fd);
+		}
+	}
+	// Client socket: incoming message
+	else if (listener == _listeners.end() && (event.revents & POLLIN))
+	{
+		handleClientMessage(fd);
+	}
 }
 
 void Server::handleClientMessage(int clientFd)
 {
+	TRACE_SCOPE("handleClientMessage");
+
 	// Find client in map
 	std::map<int, Client*>::iterator it = _clients.find(clientFd);
 	if (it == _clients.end())
 	{
-		std::cerr << "Client not found in map: fd " << clientFd << std::endl;
+		LOG(LOG_ERROR, LOG_NET, "Client not found in map: fd " << clientFd);
 		return;
 	}
 
 	Client* client = it->second;
+	if (client->getTls() != NULL)
+	{
+		handleTlsInput(*client);
+		return;
+	}
 
 	// Receive data
 	char buffer[512];
+	Metrics::instance().addIoSyscall();
 	ssize_t bytesReceived = recv(clientFd, buffer, sizeof(buffer) - 1, 0);
 
 	// Check for connection closed
 	if (bytesReceived == 0)
 	{
-		std::cout << "Client disconnected (recv returned 0): fd " << clientFd << std::endl;
+		LOG(LOG_DEBUG, LOG_NET, "Client disconnected (recv returned 0): fd " << clientFd);
 		removeClient(clientFd);
 		return;
 	}
@@ -331,7 +1086,7 @@ void Server::handleClientMessage(int clientFd)
 			// No data available, non-blocking socket
 			return;
 		}
-		std::cerr << "Recv error for client fd " << clientFd << ": " << strerror(errno) << std::endl;
+		LOG(LOG_WARN, LOG_NET, "Recv error for client fd " << clientFd << ": " << strerror(errno));
 		removeClient(clientFd);
 		return;
 	}
@@ -339,14 +1094,58 @@ void Server::handleClientMessage(int clientFd)
 	// Null-terminate the buffer for safety
 	buffer[bytesReceived] = '\0';
 
-	// Append received data to client's receive buffer
-	std::string receivedData(buffer, bytesReceived);
-	client->appendToRecvBuffer(receivedData);
+	_capture.recordData(clientFd, buffer, bytesReceived);
+	processInput(*client, buffer, bytesReceived);
+}
+
+// Feed received bytes to a client and run every complete message.
+// Also the entry point for replaying captured traffic.
+void Server::processInput(Client& client, const char* data, size_t length)
+{
+	// Append received data to client's receive buffer; WebSocket frames
+	// are unwrapped into lines first
+	Metrics::instance().addBytesIn(length);
+	bool webSocketClosing = false;
+	if (client.getWebSocket() != NULL)
+	{
+		webSocketClosing = !receiveWebSocket(client, data, length);
+	}
+	else
+	{
+		std::string receivedData(data, length);
+		client.appendToRecvBuffer(receivedData);
+	}
+
+	if (client.getProtocol() == PROTO_METRICS)
+	{
+		handleMetricsRequest(client);
+		return;
+	}
+	if (client.getPendingAuth() != 0 && client.getRecvBuffer().size() > AUTH_PARKED_INPUT)
+	{
+		removeClient(client.getFd(), "Excess Flood");
+		return;
+	}
+
+	if (!runMessages(client))
+	{
+		return;
+	}
+
+	// Lines that came before the close frame have been run
+	if (webSocketClosing)
+	{
+		closeWebSocket(client);
+	}
+}
 
-	// Extract and process complete messages
-	while (true)
+// Run every complete message in the receive buffer, up to one that starts
+// a password check. False if the client is gone.
+bool Server::runMessages(Client& client)
+{
+	while (client.getPendingAuth() == 0)
 	{
-		std::string messageStr = client->extractMessage();
+		std::string messageStr = client.extractMessage();
 		if (messageStr.empty())
 		{
 			// No complete message available
@@ -355,10 +1154,34 @@ void Server::handleClientMessage(int clientFd)
 
 		// Parse message
 		Message msg(messageStr);
-		
-		// Execute command
-		executeCommand(*client, msg);
+		if (!runMessage(client, msg))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Run one parsed line. False if the client is gone.
+bool Server::runMessage(Client& client, const Message& msg)
+{
+	if (msg.hasTooLongTags())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		sendReply(client, ":" + _serverName + " 417 " + nick + " :Input line was too long\r\n");
+		return true;
 	}
+
+	// Execute command; established server links speak the link protocol
+	int clientFd = client.getFd();
+	if (client.isServerLink())
+		handleLinkMessage(client, msg);
+	else
+		executeCommand(client, msg);
+
+	// QUIT (or a failed send) may have deleted the client
+	std::map<int, Client*>::iterator it = _clients.find(clientFd);
+	return it != _clients.end() && it->second == &client;
 }
 
 void Server::registerCommand(const std::string& cmd, CommandHandler* handler)
@@ -378,20 +1201,41 @@ void Server::executeCommand(Client& client, const Message& msg)
 	std::map<std::string, CommandHandler*>::iterator it = _commandHandlers.find(command);
 	if (it != _commandHandlers.end())
 	{
+		TRACE_SCOPE_DETAIL("execute", command.c_str());
+		unsigned long long start = Metrics::nowNs();
 		it->second->execute(*this, client, msg);
+		// client may be gone (QUIT), only the name is used from here on
+		Metrics::instance().recordCommand(command, Metrics::nowNs() - start);
 	}
 	else
 	{
 		// Unknown command
+		LOG(LOG_DEBUG, LOG_CMD, "Unknown command " << command << " from fd " << client.getFd());
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 421 " << nick << " " << command << " :Unknown command\r\n";
+		oss << ":" << _serverName << " 421 " << nick << " " << command << " :Unknown command\r\n";
 		sendReply(client, oss.str());
 	}
 }
 
+// Queue a line for a local client. Remote users get replies from their own
+// server, so anything addressed to them here is dropped; use deliver() to
+// route a message to a remote user.
 void Server::sendReply(Client& client, const std::string& reply)
 {
+	if (client.isRemote())
+	{
+		return;
+	}
+	client.appendToSendBuffer(reply);
+}
+
+void Server::sendReply(Client& client, const SharedBuffer& reply)
+{
+	if (client.isRemote())
+	{
+		return;
+	}
 	client.appendToSendBuffer(reply);
 }
 
@@ -400,32 +1244,374 @@ const std::string& Server::getPassword() const
 	return _password;
 }
 
+// Plaintext secrets are compared right away. For crypt(3) hashes the
+// client is parked: runMessages() leaves its later lines in the receive
+// buffer until handleAuthCompletions() has the worker's answer.
+void Server::verifyPassword(Client& client, AuthKind kind, const std::string& name, const std::string& password)
+{
+	std::string secret = _password;
+	if (kind == AUTH_OPER)
+	{
+		const std::map<std::string, std::string>& operators = _config.getOperators();
+		std::map<std::string, std::string>::const_iterator it = operators.find(name);
+		if (it == operators.end())
+		{
+			finishAuth(client, kind, name, false);
+			return;
+		}
+		secret = it->second;
+	}
+
+	if (AuthPool::isHash(secret))
+	{
+		client.setPendingAuth(_auth.submit(client.getFd(), kind, name, password, secret));
+		return;
+	}
+	finishAuth(client, kind, name, AuthPool::matches(password, secret));
+}
+
+void Server::finishAuth(Client& client, AuthKind kind, const std::string& name, bool matched)
+{
+	if (kind == AUTH_PASS)
+		PassCommand::finish(*this, client, matched);
+	else
+		OperCommand::finish(*this, client, name, matched);
+}
+
+// Apply finished checks and run the input their clients parked meanwhile.
+// With wait, first blocks until every check in flight is done.
+void Server::handleAuthCompletions(bool wait)
+{
+	std::vector<AuthJob> done;
+	_auth.collect(done, wait);
+	for (size_t i = 0; i < done.size(); ++i)
+	{
+		// The client may be gone, and its descriptor reused
+		Client* client = getClient(done[i].fd);
+		if (client == NULL || client->getPendingAuth() != done[i].id)
+			continue;
+		client->setPendingAuth(0);
+		finishAuth(*client, done[i].kind, done[i].name, done[i].matched);
+		runMessages(*client);
+	}
+}
+
+bool Server::hasPendingAuth()
+{
+	return !_auth.isIdle();
+}
+
+SpamFilter& Server::getSpamFilter()
+{
+	return _filter;
+}
+
+// Scan a PRIVMSG/NOTICE body and apply the worst matching rule. A kill
+// removes the client, so callers must not touch it after a true return.
+bool Server::filterMessage(Client& client, const std::string& text)
+{
+	const FilterRule* rule = _filter.check(text);
+	if (rule == NULL)
+	{
+		return false;
+	}
+	LOG(LOG_INFO, LOG_CMD, "Filter (" << SpamFilter::actionName(rule->action) << ") matched \"" << rule->pattern
+		<< "\" from " << client.getNickname());
+	if (rule->action == FILTER_NOTICE)
+	{
+		sendReply(client, ":" + _serverName + " NOTICE " + client.getNickname() + " :Message blocked by the spam filter\r\n");
+	}
+	else if (rule->action == FILTER_KILL)
+	{
+		killClient(client, "Spam filter", NULL);
+	}
+	return true;
+}
+
+bool Server::dumpTrace(std::string& error)
+{
+	return Tracer::instance().dump(_config.getTraceFile(), error);
+}
+
+const std::string& Server::getTraceFile() const
+{
+	return _config.getTraceFile();
+}
+
+MetricsGauges Server::collectGauges() const
+{
+	MetricsGauges gauges;
+	for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (it->second->getProtocol() == PROTO_METRICS || it->second->isRemote() || it->second->isServerLink())
+			continue;
+		gauges.clients++;
+		if (it->second->isRegistered())
+			gauges.registeredClients++;
+	}
+	gauges.channels = _channels.size();
+	gauges.uptimeSeconds = time(NULL) - _startTime;
+	gauges.memory = collectMemory();
+	gauges.memoryPeak = _memoryPeak;
+	gauges.memoryPeak.raiseTo(gauges.memory);
+	return gauges;
+}
+
+MemoryUsage Server::collectMemory() const
+{
+	MemoryUsage total;
+	for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		total.add(it->second->getMemoryUsage());
+	}
+	for (std::map<std::string, Channel*>::const_iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		total.add(it->second->getMemoryUsage());
+	}
+	return total;
+}
+
+void Server::sampleMemory()
+{
+	_lastMemorySample = time(NULL);
+	_memoryPeak.raiseTo(collectMemory());
+}
+
+// Write channels whose persistent state changed into their snapshot slots;
+// the snapshot's own thread takes them to disk
+void Server::saveSnapshot()
+{
+	if (!_snapshot.isOpen())
+		return;
+	bool full = false;
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		Channel* channel = it->second;
+		if (!channel->isSnapshotDirty())
+			continue;
+		channel->clearSnapshotDirty();
+
+		SavedChannel saved;
+		saved.topic = channel->getTopic();
+		saved.key = channel->getKey();
+		saved.userLimit = channel->getUserLimit();
+		saved.createdAt = channel->getCreatedAt();
+		if (channel->isInviteOnly())
+			saved.modes |= SNAPSHOT_MODE_INVITE;
+		if (channel->isTopicRestricted())
+			saved.modes |= SNAPSHOT_MODE_TOPIC;
+		if (channel->hasKey())
+			saved.modes |= SNAPSHOT_MODE_KEY;
+		if (channel->hasUserLimit())
+			saved.modes |= SNAPSHOT_MODE_LIMIT;
+		std::vector<int> invited = channel->getInvited();
+		for (size_t i = 0; i < invited.size(); ++i)
+		{
+			Client* client = getClient(invited[i]);
+			if (client != NULL)
+				saved.invites.push_back(client->getNickname());
+		}
+		if (!_snapshot.store(it->first, saved) && !full)
+		{
+			full = true;
+			LOG(LOG_WARN, LOG_CHAN, "Snapshot full (" << _snapshot.getSlotCount() << " slots), " << channel->getName()
+				<< " not saved");
+		}
+	}
+}
+
+// Restore a re-created channel's settings; saved invites apply to whoever
+// holds the nickname now
+void Server::applySnapshot(Channel& channel, const SavedChannel& saved)
+{
+	channel.setTopic(saved.topic);
+	channel.setKey(saved.key);
+	channel.setInviteOnly((saved.modes & SNAPSHOT_MODE_INVITE) != 0);
+	channel.setTopicRestricted((saved.modes & SNAPSHOT_MODE_TOPIC) != 0);
+	channel.setHasKey((saved.modes & SNAPSHOT_MODE_KEY) != 0);
+	channel.setHasUserLimit((saved.modes & SNAPSHOT_MODE_LIMIT) != 0);
+	channel.setUserLimit(saved.userLimit);
+	if (saved.createdAt != 0)
+		channel.setCreatedAt(saved.createdAt);
+	for (size_t i = 0; i < saved.invites.size(); ++i)
+	{
+		Client* client = getClientByNickname(saved.invites[i]);
+		if (client != NULL && !client->isRemote() && !channel.isMember(client->getFd()))
+			channel.addToInviteList(client->getFd());
+	}
+}
+
+template <typename T>
+static bool heavierFirst(const std::pair<size_t, T>& a, const std::pair<size_t, T>& b)
+{
+	return a.first > b.first;
+}
+
+// Totals, high-water marks and the topN heaviest clients and channels
+void Server::renderMemoryReport(size_t topN, std::vector<std::string>& lines) const
+{
+	MemoryUsage current = collectMemory();
+	MemoryUsage peak = _memoryPeak;
+	peak.raiseTo(current);
+
+	std::ostringstream oss;
+	oss << "clients " << _clients.size() << " total=" << current.clientTotal() << " recvq=" << current.recvBuffers
+		<< " sendq=" << current.sendBuffers << " identity=" << current.clientIdentity;
+	lines.push_back(oss.str());
+	oss.str("");
+	oss << "clients peak total=" << peak.clientTotal() << " recvq=" << peak.recvBuffers
+		<< " sendq=" << peak.sendBuffers << " identity=" << peak.clientIdentity;
+	lines.push_back(oss.str());
+	oss.str("");
+	oss << "channels " << _channels.size() << " total=" << current.channelTotal() << " members=" << current.channelMembers
+		<< " invites=" << current.channelInvites << " strings=" << current.channelStrings
+		<< " history=" << current.channelHistory;
+	lines.push_back(oss.str());
+	oss.str("");
+	oss << "channels peak total=" << peak.channelTotal() << " members=" << peak.channelMembers
+		<< " invites=" << peak.channelInvites << " strings=" << peak.channelStrings
+		<< " history=" << peak.channelHistory;
+	lines.push_back(oss.str());
+
+	std::vector<std::pair<size_t, const Client*> > clients;
+	for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		clients.push_back(std::make_pair(it->second->getMemoryUsage().clientTotal(), it->second));
+	}
+	size_t count = std::min(topN, clients.size());
+	std::partial_sort(clients.begin(), clients.begin() + count, clients.end(), heavierFirst<const Client*>);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Client* client = clients[i].second;
+		MemoryUsage usage = client->getMemoryUsage();
+		oss.str("");
+		oss << "client " << (client->getNickname().empty() ? "*" : client->getNickname()) << " fd=" << client->getFd()
+			<< " total=" << clients[i].first << " recvq=" << usage.recvBuffers << " sendq=" << usage.sendBuffers
+			<< " recvq_peak=" << client->getRecvBufferPeak() << " sendq_peak=" << client->getSendBufferPeak();
+		lines.push_back(oss.str());
+	}
+
+	std::vector<std::pair<size_t, const Channel*> > channels;
+	for (std::map<std::string, Channel*>::const_iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		channels.push_back(std::make_pair(it->second->getMemoryUsage().channelTotal(), it->second));
+	}
+	count = std::min(topN, channels.size());
+	std::partial_sort(channels.begin(), channels.begin() + count, channels.end(), heavierFirst<const Channel*>);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Channel* channel = channels[i].second;
+		oss.str("");
+		oss << "channel " << channel->getName() << " members=" << channel->getMemberCount()
+			<< " total=" << channels[i].first;
+		lines.push_back(oss.str());
+	}
+}
+
+// Answer one HTTP request on a metrics listener with the Prometheus text
+// exposition, then close once the response has been flushed.
+void Server::handleMetricsRequest(Client& client)
+{
+	const std::string& request = client.getRecvBuffer();
+	std::string::size_type headerEnd = request.find("\r\n\r\n");
+	if (headerEnd == std::string::npos)
+	{
+		headerEnd = request.find("\n\n");
+	}
+	if (headerEnd == std::string::npos)
+	{
+		// Headers incomplete; refuse to buffer an unbounded request
+		if (request.length() > 8192)
+		{
+			removeClient(client.getFd());
+		}
+		return;
+	}
+	if (client.shouldCloseAfterFlush())
+	{
+		return;
+	}
+
+	std::string requestLine = request.substr(0, request.find_first_of("\r\n"));
+	std::ostringstream body;
+	std::string status = "200 OK";
+	if (requestLine.compare(0, 13, "GET /metrics ") == 0 || requestLine.compare(0, 6, "GET / ") == 0)
+	{
+		Metrics::instance().renderPrometheus(collectGauges(), body);
+	}
+	else
+	{
+		status = "404 Not Found";
+		body << "not found\n";
+	}
+
+	std::string bodyStr = body.str();
+	std::ostringstream response;
+	response << "HTTP/1.0 " << status << "\r\n"
+			 << "Content-Type: text/plain; version=0.0.4\r\n"
+			 << "Content-Length: " << bodyStr.length() << "\r\n"
+			 << "Connection: close\r\n\r\n"
+			 << bodyStr;
+	client.appendToSendBuffer(response.str());
+	client.setCloseAfterFlush(true);
+}
+
 void Server::registerCommands()
 {
 	// Register commands
+	registerCommand("CAP", new CapCommand());
 	registerCommand("PASS", new PassCommand());
+	registerCommand("NICK", new NickCommand());
+	registerCommand("USER", new UserCommand());
 	registerCommand("JOIN", new JoinCommand());
 	registerCommand("PART", new PartCommand());
 	registerCommand("PRIVMSG", new PrivmsgCommand());
+	registerCommand("NOTICE", new NoticeCommand());
 	registerCommand("QUIT", new QuitCommand());
 	registerCommand("KICK", new KickCommand());
 	registerCommand("TOPIC", new TopicCommand());
 	registerCommand("INVITE", new InviteCommand());
 	registerCommand("MODE", new ModeCommand());
+	registerCommand("OPER", new OperCommand());
+	registerCommand("STATS", new StatsCommand());
+	registerCommand("LOOPTRACE", new LooptraceCommand());
+	registerCommand("SERVER", new ServerCommand());
+	registerCommand("CONNECT", new ConnectCommand());
+	registerCommand("SQUIT", new SquitCommand());
+	registerCommand("LINKS", new LinksCommand());
+	registerCommand("CHATHISTORY", new ChathistoryCommand());
+	registerCommand("UPGRADE", new UpgradeCommand());
+	registerCommand("FILTER", new FilterCommand());
 }
 
 Client* Server::getClientByNickname(const std::string& nickname)
 {
-	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	if (nickname.empty())
 	{
-		if (toLowerCase(it->second->getNickname()) == toLowerCase(nickname))
-		{
-			return it->second;
-		}
+		return NULL;
+	}
+	std::map<std::string, Client*>::iterator it = _nicknames.find(toLowerCase(nickname));
+	if (it != _nicknames.end())
+	{
+		return it->second;
 	}
 	return NULL;
 }
 
+void Server::setNickname(Client& client, const std::string& nickname)
+{
+	std::map<std::string, Client*>::iterator it = _nicknames.find(toLowerCase(client.getNickname()));
+	if (it != _nicknames.end() && it->second == &client)
+	{
+		_nicknames.erase(it);
+	}
+	client.setNickname(nickname);
+	if (!nickname.empty())
+	{
+		_nicknames[toLowerCase(nickname)] = &client;
+	}
+}
+
 Channel* Server::getChannel(const std::string& channelName)
 {
 	std::string lowerName = toLowerCase(channelName);
@@ -441,7 +1627,18 @@ Channel* Server::createChannel(const std::string& channelName, Client* creator)
 {
 	std::string lowerName = toLowerCase(channelName);
 	Channel* channel = new Channel(channelName, creator);
+	channel->getHistory().configure(_config.getHistoryLines(), _config.getHistoryBytes());
 	_channels[lowerName] = channel;
+	LOG(LOG_DEBUG, LOG_CHAN, "Channel created: " << channelName);
+
+	// A local JOIN brings back what the channel had before a restart; links
+	// and upgrades bring their own state
+	SavedChannel saved;
+	if (creator != NULL && !creator->isRemote() && _snapshot.isOpen() && _snapshot.load(lowerName, saved))
+	{
+		applySnapshot(*channel, saved);
+		LOG(LOG_DEBUG, LOG_CHAN, "Channel restored from snapshot: " << channelName);
+	}
 	return channel;
 }
 
@@ -451,6 +1648,10 @@ void Server::removeChannel(const std::string& channelName)
 	std::map<std::string, Channel*>::iterator it = _channels.find(lowerName);
 	if (it != _channels.end())
 	{
+		LOG(LOG_DEBUG, LOG_CHAN, "Channel removed: " << it->second->getName());
+		if (_snapshot.isOpen())
+			_snapshot.erase(lowerName);
+		unlinkHistory(*it->second);
 		delete it->second;
 		_channels.erase(it);
 	}
@@ -492,38 +1693,89 @@ std::string Server::toLowerCase(const std::string& str) const
 	return result;
 }
 
+// Send as much queued output as the socket takes, gathering the queued
+// buffers (shared with other clients) without copying them together
 void Server::sendToClient(Client& client)
 {
-	std::string sendBuffer = client.getSendBuffer();
-	if (sendBuffer.empty())
+	if (!client.hasMessageToSend())
+	{
+		return;
+	}
+
+	// Unless kTLS builds the records, TLS data goes through OpenSSL
+	if (client.getTls() != NULL && !client.getTls()->isKernelSend())
+	{
+		sendTls(client);
+		return;
+	}
+
+	// The I/O thread serving it does the writing
+	if (_pipeline != NULL && _pipeline->owns(client.getFd()))
 	{
+		_pipeline->send(client);
 		return;
 	}
 
+	struct iovec iov[SEND_IOV_MAX];
 	int clientFd = client.getFd();
-	ssize_t bytesSent = send(clientFd, sendBuffer.c_str(), sendBuffer.length(), 0);
+
+	// A completion backend sends on its own, submitted with the next wait;
+	// one send per client is in flight at a time
+	if (_io->canSend())
+	{
+		if (_io->isSending(clientFd))
+			return;
+		std::vector<SharedBuffer> hold;
+		size_t count = client.getSendIovec(iov, SEND_IOV_MAX, hold);
+		_io->send(clientFd, iov, count, hold);
+		return;
+	}
+
+	// Large flushes go zero-copy, the buffers held until the kernel is done
+	// with them; kTLS does not take MSG_ZEROCOPY
+	bool zeroCopy = client.getTls() == NULL && _zeroCopy.shouldUse(clientFd, client.getSendBufferSize());
+	std::vector<SharedBuffer> hold;
+	struct msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = zeroCopy ? client.getSendIovec(iov, SEND_IOV_MAX, hold) : client.getSendIovec(iov, SEND_IOV_MAX);
+	zeroCopy = zeroCopy && ZeroCopy::isWorthPinning(iov, msg.msg_iovlen);
+
+	Metrics::instance().addIoSyscall();
+	ssize_t bytesSent = sendmsg(clientFd, &msg, MSG_NOSIGNAL | (zeroCopy ? MSG_ZEROCOPY : 0));
+	// Too many pages pinned already (optmem): copy this time
+	if (bytesSent == -1 && zeroCopy && errno == ENOBUFS)
+	{
+		zeroCopy = false;
+		Metrics::instance().addIoSyscall();
+		bytesSent = sendmsg(clientFd, &msg, MSG_NOSIGNAL);
+	}
 
 	if (bytesSent == -1)
 	{
 		if (errno != EAGAIN && errno != EWOULDBLOCK)
 		{
-			std::cerr << "Send error for client fd " << clientFd << ": " << strerror(errno) << std::endl;
+			LOG(LOG_WARN, LOG_NET, "Send error for client fd " << clientFd << ": " << strerror(errno));
 			removeClient(clientFd);
 			return;
 		}
-		// Would block, keep data in buffer for next attempt
+		// Would block, keep data in buffer until the socket is writable
+		setPollEvents(clientFd, POLLIN | POLLOUT);
 		return;
 	}
 
 	// Remove sent data from buffer
 	if (bytesSent > 0)
 	{
-		std::string remaining = sendBuffer.substr(bytesSent);
-		client.clearSendBuffer();
-		if (!remaining.empty())
-		{
-			client.appendToSendBuffer(remaining);
-		}
+		Metrics::instance().addBytesOut(bytesSent);
+		if (zeroCopy)
+			_zeroCopy.sent(clientFd, bytesSent, hold);
+		else
+			Metrics::instance().addSentBytes(bytesSent, false);
+		client.consumeSendBuffer(bytesSent);
 	}
+	// An idle loop only sweeps the queues after an event, so what the
+	// socket did not take waits for POLLOUT
+	setPollEvents(clientFd, client.hasMessageToSend() ? (POLLIN | POLLOUT) : POLLIN);
 }
 
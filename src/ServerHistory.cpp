@@ -0,0 +1,76 @@
+#include "Server.hpp"
+#include "Channel.hpp"
+#include "History.hpp"
+#include "OutboundMessage.hpp"
+#include <sstream>
+
+// Channel history: each channel keeps a ring of its recent messages (see
+// History.hpp), sharing the broadcast buffers. On top of the per-channel
+// bounds, history total= caps the payload held by all channels together;
+// going over it evicts the oldest entries server-wide, wherever they are.
+// _historyOldest holds every non-empty channel keyed by the sequence number
+// of its oldest entry, so the globally oldest entry is always at begin().
+
+bool Server::isHistoryEnabled() const
+{
+	return _config.getHistoryLines() != 0 && _config.getHistoryBytes() != 0 && _config.getHistoryTotal() != 0;
+}
+
+// Take the channel out of the global accounting while its ring changes
+void Server::unlinkHistory(Channel& channel)
+{
+	const ChannelHistory& history = channel.getHistory();
+	if (history.empty())
+		return;
+	_historyOldest.erase(std::make_pair(history.oldest().seq, &channel));
+	_historyBytes -= history.getBytes();
+}
+
+void Server::linkHistory(Channel& channel)
+{
+	const ChannelHistory& history = channel.getHistory();
+	if (history.empty())
+		return;
+	_historyOldest.insert(std::make_pair(history.oldest().seq, &channel));
+	_historyBytes += history.getBytes();
+}
+
+// Give a new message its msgid and server time. msgids are unique to this
+// server run; times never go backwards within a channel, so its history
+// stays sorted for timestamp pagination even if the clock is stepped.
+void Server::stampMessage(OutboundMessage& message, const Channel* channel)
+{
+	unsigned long long seq = ++_messageSeq;
+	long long timeMs = historyNowMs();
+	if (channel != NULL && !channel->getHistory().empty() && channel->getHistory().newest().timeMs > timeMs)
+		timeMs = channel->getHistory().newest().timeMs;
+	std::ostringstream msgid;
+	msgid << std::hex << _startTime << "-" << seq;
+	message.stamp(msgid.str(), timeMs, seq);
+}
+
+// Keep a message that was just broadcast, as its untagged line
+void Server::recordHistory(Channel& channel, const OutboundMessage& message)
+{
+	ChannelHistory& history = channel.getHistory();
+	if (!isHistoryEnabled() || !history.isEnabled())
+		return;
+
+	HistoryEntry entry;
+	entry.line = message.getLine();
+	entry.seq = message.getSeq();
+	entry.timeMs = message.getTimeMs();
+	entry.msgid = message.getMsgid();
+
+	unlinkHistory(channel);
+	history.push(entry);
+	linkHistory(channel);
+
+	while (_historyBytes > _config.getHistoryTotal() && !_historyOldest.empty())
+	{
+		Channel* oldest = _historyOldest.begin()->second;
+		unlinkHistory(*oldest);
+		oldest->getHistory().popOldest();
+		linkHistory(*oldest);
+	}
+}
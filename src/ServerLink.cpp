@@ -0,0 +1,946 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Message.hpp"
+#include "CommandHandler.hpp"
+#include "OutboundMessage.hpp"
+#include "Logger.hpp"
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+// Server-to-server linking.
+//
+// Every server keeps the full network state: remote users are Client objects
+// with negative pseudo fds and a pointer to the link they are reachable
+// through, and they are members of channels like local users. The network is
+// a spanning tree; each message is relayed to every link except the one it
+// came from.
+//
+// Link protocol (one IRC line each):
+//   SERVER <name> <password> :<info>                 handshake, both directions
+//   :<uplink> SERVER <name> <hops> :<info>           server behind a link
+//   NICK <nick> <hops> <ts> <user> <host> <server> :<realname>
+//   :<nick> NICK <newnick> <ts>                      nick change
+//   :<server> SJOIN <ts> <#chan> <modes> [key] [limit] :[@]nick ...
+//   :<server> TOPIC <#chan> :<topic>                 burst topic
+//   :<server> BMASK <ts> <#chan> <b|e|I> :<mask> ... burst ban lists
+//   :<source> KILL <nick> :<reason>
+//   :<source> SQUIT <server> :<reason>
+//   :nick!user@host JOIN|PART|PRIVMSG|QUIT|MODE|KICK|TOPIC|INVITE ...
+//                                                    relayed user commands
+//
+// Nick collisions are settled by nick TS: the older nick survives, ties
+// kill both. Channels carry their creation TS: when two sides merge, the
+// older channel keeps its modes and operators.
+
+// Keep burst lines well below the 512 byte line limit
+static const size_t LINK_LINE_BUDGET = 400;
+
+// List modes per MODE line shown to local members after a burst
+static const size_t MASKS_PER_MODE_LINE = 4;
+
+// User commands relayed between servers and re-run for the remote user
+static bool isRelayedCommand(const std::string& command)
+{
+	return command == "JOIN" || command == "PART" || command == "PRIVMSG" || command == "NOTICE" ||
+		command == "QUIT" || command == "MODE" || command == "KICK" || command == "TOPIC" || command == "INVITE";
+}
+
+// Rebuild a received line for relaying, with the last parameter as trailing
+static std::string rebuildLine(const Message& msg)
+{
+	std::ostringstream oss;
+	if (!msg.getPrefix().empty())
+	{
+		oss << ":" << msg.getPrefix() << " ";
+	}
+	oss << msg.getCommand();
+	for (size_t i = 0; i < msg.getParamCount(); ++i)
+	{
+		oss << (i + 1 == msg.getParamCount() ? " :" : " ") << msg.getParam(i);
+	}
+	oss << "\r\n";
+	return oss.str();
+}
+
+static std::string userMask(const Client& client)
+{
+	std::string host = client.getHostname().empty() ? "localhost" : client.getHostname();
+	return client.getNickname() + "!" + client.getUsername() + "@" + host;
+}
+
+// Tell local members about list entries a burst added or removed
+static void broadcastMasks(Channel& channel, const std::string& source, char sign, char mode,
+	const std::vector<std::string>& masks)
+{
+	for (size_t i = 0; i < masks.size(); i += MASKS_PER_MODE_LINE)
+	{
+		size_t end = std::min(masks.size(), i + MASKS_PER_MODE_LINE);
+		std::string modes(1, sign);
+		std::string params;
+		for (size_t m = i; m < end; ++m)
+		{
+			modes += mode;
+			params += " " + masks[m];
+		}
+		channel.broadcast(":" + source + " MODE " + channel.getName() + " " + modes + params + "\r\n");
+	}
+}
+
+const std::string& Server::getServerName() const
+{
+	return _serverName;
+}
+
+const LinkConfig* Server::findLinkConfig(const std::string& name) const
+{
+	const std::map<std::string, LinkConfig>& links = _config.getLinks();
+	std::map<std::string, LinkConfig>::const_iterator it = links.find(name);
+	return it == links.end() ? NULL : &it->second;
+}
+
+bool Server::isKnownServer(const std::string& name) const
+{
+	return name == _serverName || _servers.count(name) > 0;
+}
+
+// Start a non-blocking connect to a configured peer; the handshake is sent
+// once poll reports the socket writable (handleLinkConnect)
+bool Server::connectToServer(const std::string& name, std::string& error)
+{
+	const LinkConfig* link = findLinkConfig(name);
+	if (link == NULL)
+	{
+		error = "No link block for " + name;
+		return false;
+	}
+	if (isKnownServer(name))
+	{
+		error = name + " is already linked";
+		return false;
+	}
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (it->second->getLinkState() != LINK_NONE && it->second->getLinkName() == name)
+		{
+			error = "Already connecting to " + name;
+			return false;
+		}
+	}
+
+	struct addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+	std::ostringstream port;
+	port << link->port;
+	struct addrinfo* result = NULL;
+	int status = getaddrinfo(link->address.c_str(), port.str().c_str(), &hints, &result);
+	if (status != 0)
+	{
+		error = std::string("Bad link address: ") + gai_strerror(status);
+		return false;
+	}
+
+	int fd = socket(result->ai_family, SOCK_STREAM, 0);
+	if (fd == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+		(connect(fd, result->ai_addr, result->ai_addrlen) == -1 && errno != EINPROGRESS))
+	{
+		error = std::string("Connect failed: ") + strerror(errno);
+		if (fd != -1)
+			close(fd);
+		freeaddrinfo(result);
+		return false;
+	}
+	freeaddrinfo(result);
+
+	Client* client = new Client(fd);
+	client->setHostname(link->address);
+	client->setLinkName(name);
+	client->setLinkState(LINK_CONNECTING);
+	addClient(client);
+	setPollEvents(fd, POLLIN | POLLOUT);
+
+	LOG(LOG_INFO, LOG_NET, "Connecting to " << name << " at " << link->address << ":" << link->port);
+	return true;
+}
+
+void Server::handleLinkConnect(int fd)
+{
+	Client* link = getClient(fd);
+	if (link == NULL || link->getLinkState() != LINK_CONNECTING)
+	{
+		return;
+	}
+
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0)
+	{
+		removeClient(fd, strerror(error != 0 ? error : errno));
+		return;
+	}
+	setPollEvents(fd, POLLIN);
+
+	const LinkConfig* config = findLinkConfig(link->getLinkName());
+	if (config == NULL)
+	{
+		removeClient(fd, "link block removed");
+		return;
+	}
+	sendLinkHandshake(*link, *config);
+}
+
+void Server::sendLinkHandshake(Client& link, const LinkConfig& config)
+{
+	sendReply(link, "SERVER " + _serverName + " " + config.password + " :ft_irc\r\n");
+	link.setLinkState(LINK_HANDSHAKE);
+	link.setLinkName(config.name);
+}
+
+// Both sides have authenticated: register the peer and send our state
+void Server::establishLink(Client& link, const std::string& name)
+{
+	link.setLinkState(LINK_ESTABLISHED);
+	link.setLinkName(name);
+
+	// A link is not a client: it does not count against class limits
+	ConnectionClass* connClass = link.getConnectionClass();
+	if (connClass != NULL && connClass->clientCount > 0)
+	{
+		connClass->clientCount--;
+	}
+	link.setConnectionClass(NULL);
+
+	RemoteServer server;
+	server.name = name;
+	server.uplink = _serverName;
+	server.hops = 1;
+	server.link = &link;
+	_servers[name] = server;
+	_links[name] = &link;
+
+	LOG(LOG_INFO, LOG_NET, "Linked with " << name);
+
+	sendBurst(link);
+	propagate(link, ":" + _serverName + " SERVER " + name + " 2 :ft_irc\r\n");
+}
+
+bool Server::closeLink(const std::string& name, const std::string& reason)
+{
+	std::map<std::string, Client*>::iterator it = _links.find(name);
+	if (it == _links.end())
+	{
+		return false;
+	}
+	sendReply(*it->second, "ERROR :Closing link (" + reason + ")\r\n");
+	sendToClient(*it->second);
+	removeClient(it->second->getFd(), reason);
+	return true;
+}
+
+// Everything the peer needs to know: servers, users, channels and topics
+void Server::sendBurst(Client& link)
+{
+	// Servers in hop order so every uplink is known before what it introduces
+	int maxHops = 0;
+	for (std::map<std::string, RemoteServer>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+	{
+		if (it->second.hops > maxHops)
+			maxHops = it->second.hops;
+	}
+	for (int hops = 1; hops <= maxHops; ++hops)
+	{
+		for (std::map<std::string, RemoteServer>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+		{
+			if (it->second.hops != hops || it->second.link == &link)
+				continue;
+			std::ostringstream oss;
+			oss << ":" << it->second.uplink << " SERVER " << it->first << " " << hops + 1 << " :ft_irc\r\n";
+			sendReply(link, oss.str());
+		}
+	}
+
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		Client* client = it->second;
+		if (client->isRegistered() && client->getLink() != &link)
+		{
+			sendReply(link, userIntroduction(*client));
+		}
+	}
+
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		std::vector<std::string> lines = channelBurst(*it->second, &link);
+		for (size_t i = 0; i < lines.size(); ++i)
+		{
+			sendReply(link, lines[i]);
+		}
+		if (!lines.empty() && !it->second->getTopic().empty())
+		{
+			sendReply(link, ":" + _serverName + " TOPIC " + it->second->getName() + " :" + it->second->getTopic() + "\r\n");
+		}
+		if (!lines.empty())
+		{
+			std::vector<std::string> masks = maskBurst(*it->second);
+			for (size_t i = 0; i < masks.size(); ++i)
+			{
+				sendReply(link, masks[i]);
+			}
+		}
+	}
+}
+
+std::string Server::userIntroduction(const Client& client) const
+{
+	int hops = 1;
+	std::string server = _serverName;
+	if (client.isRemote())
+	{
+		std::map<std::string, RemoteServer>::const_iterator it = _servers.find(client.getServerName());
+		hops = (it == _servers.end() ? 1 : it->second.hops) + 1;
+		server = client.getServerName();
+	}
+	std::ostringstream oss;
+	oss << "NICK " << client.getNickname() << " " << hops << " " << client.getNickTs() << " "
+		<< client.getUsername() << " " << (client.getHostname().empty() ? "localhost" : client.getHostname())
+		<< " " << server << " :" << client.getRealname() << "\r\n";
+	return oss.str();
+}
+
+// SJOIN lines for a channel, members split over several lines if needed.
+// Members behind skipLink are left out; no lines if none remain.
+std::vector<std::string> Server::channelBurst(const Channel& channel, const Client* skipLink) const
+{
+	std::ostringstream head;
+	head << ":" << _serverName << " SJOIN " << channel.getCreatedAt() << " " << channel.getName() << " "
+		<< channel.getModeString();
+	if (channel.hasKey())
+		head << " " << channel.getKey();
+	if (channel.hasUserLimit())
+		head << " " << channel.getUserLimit();
+	head << " :";
+
+	std::vector<std::string> lines;
+	std::string members;
+	std::vector<Client*> clients = channel.getMembers();
+	for (size_t i = 0; i < clients.size(); ++i)
+	{
+		if (skipLink != NULL && clients[i]->getLink() == skipLink)
+			continue;
+		std::string entry = (channel.isOperator(clients[i]->getFd()) ? "@" : "") + clients[i]->getNickname();
+		if (!members.empty() && members.length() + entry.length() > LINK_LINE_BUDGET)
+		{
+			lines.push_back(head.str() + members + "\r\n");
+			members.clear();
+		}
+		members += (members.empty() ? "" : " ") + entry;
+	}
+	if (!members.empty())
+	{
+		lines.push_back(head.str() + members + "\r\n");
+	}
+	return lines;
+}
+
+// BMASK lines for the channel's b/e/I lists, masks split over several lines
+std::vector<std::string> Server::maskBurst(const Channel& channel) const
+{
+	std::vector<std::string> lines;
+	for (const char* mode = "beI"; *mode != '\0'; ++mode)
+	{
+		std::ostringstream head;
+		head << ":" << _serverName << " BMASK " << channel.getCreatedAt() << " " << channel.getName() << " " << *mode
+			<< " :";
+		const std::vector<MaskEntry>& entries = channel.getMasks(*mode);
+		std::string masks;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (!masks.empty() && masks.length() + entries[i].mask.length() > LINK_LINE_BUDGET)
+			{
+				lines.push_back(head.str() + masks + "\r\n");
+				masks.clear();
+			}
+			masks += (masks.empty() ? "" : " ") + entries[i].mask;
+		}
+		if (!masks.empty())
+		{
+			lines.push_back(head.str() + masks + "\r\n");
+		}
+	}
+	return lines;
+}
+
+// Relay to every link except the one the origin is behind
+void Server::propagate(Client& origin, const std::string& line)
+{
+	for (std::map<std::string, Client*>::iterator it = _links.begin(); it != _links.end(); ++it)
+	{
+		if (it->second != &origin && it->second != origin.getLink())
+		{
+			sendReply(*it->second, line);
+		}
+	}
+}
+
+// Relay only towards links that have members of the channel behind them
+void Server::propagateToChannel(Client& origin, const Channel& channel, const SharedBuffer& line)
+{
+	if (_links.empty())
+	{
+		return;
+	}
+	std::set<Client*> links;
+	std::vector<Client*> members = channel.getMembers();
+	for (size_t i = 0; i < members.size(); ++i)
+	{
+		Client* link = members[i]->getLink();
+		if (link != NULL && link != origin.getLink() && link != &origin)
+		{
+			links.insert(link);
+		}
+	}
+	for (std::set<Client*>::iterator it = links.begin(); it != links.end(); ++it)
+	{
+		sendReply(**it, line);
+	}
+}
+
+// A JOIN that created a channel is announced with its TS and operator
+void Server::propagateChannelCreation(Client& origin, const Channel& channel)
+{
+	if (_links.empty())
+	{
+		return;
+	}
+	std::vector<std::string> lines = channelBurst(channel, NULL);
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		propagate(origin, lines[i]);
+	}
+}
+
+// Send a message to one user, wherever it is connected
+void Server::deliver(Client& target, const std::string& line)
+{
+	if (target.isRemote())
+	{
+		sendReply(*target.getLink(), line);
+	}
+	else
+	{
+		sendReply(target, line);
+	}
+}
+
+// Links carry no tags; local users get the variant their capabilities ask for
+void Server::deliver(Client& target, OutboundMessage& message)
+{
+	if (target.isRemote())
+	{
+		sendReply(*target.getLink(), message.getLine());
+	}
+	else
+	{
+		sendReply(target, message.render(target.getCapabilities()));
+	}
+}
+
+// Announce a newly registered local user to the network
+void Server::introduceUser(Client& client)
+{
+	if (client.getNickTs() == 0)
+	{
+		client.setNickTs(time(NULL));
+	}
+	propagate(client, userIntroduction(client));
+}
+
+void Server::listServers(std::vector<std::string>& lines) const
+{
+	lines.push_back(_serverName + " " + _serverName + " :0 ft_irc");
+	for (std::map<std::string, RemoteServer>::const_iterator it = _servers.begin(); it != _servers.end(); ++it)
+	{
+		std::ostringstream oss;
+		oss << it->first << " " << it->second.uplink << " :" << it->second.hops << " ft_irc";
+		lines.push_back(oss.str());
+	}
+}
+
+void Server::handleLinkMessage(Client& link, const Message& msg)
+{
+	std::string command = msg.getCommand();
+
+	if (command == "PING")
+	{
+		sendReply(link, ":" + _serverName + " PONG " + _serverName + " :" + msg.getParam(0) + "\r\n");
+		return;
+	}
+	if (command == "PONG")
+	{
+		return;
+	}
+	if (command == "ERROR")
+	{
+		LOG(LOG_WARN, LOG_NET, "Link " << link.getLinkName() << " closed by peer: " << msg.getParam(0));
+		removeClient(link.getFd(), "Remote host closed the link");
+		return;
+	}
+	if (command == "SERVER")
+	{
+		introduceServer(link, msg);
+		return;
+	}
+	if (command == "SQUIT")
+	{
+		applySquit(link, msg);
+		return;
+	}
+	if (command == "SJOIN")
+	{
+		applySjoin(link, msg);
+		return;
+	}
+	if (command == "BMASK")
+	{
+		applyBmask(link, msg);
+		return;
+	}
+	if (command == "KILL")
+	{
+		applyKill(link, msg);
+		return;
+	}
+	if (command == "NICK" && msg.getParamCount() >= 7)
+	{
+		introduceRemoteUser(link, msg);
+		return;
+	}
+
+	std::string prefix = msg.getPrefix();
+	std::string source = prefix.substr(0, prefix.find('!'));
+	if (command == "TOPIC" && _servers.count(source))
+	{
+		applyServerTopic(link, msg);
+		return;
+	}
+
+	// Everything else is a user command; it must come from the user's direction
+	Client* user = getClientByNickname(source);
+	if (user == NULL || user->getLink() != &link)
+	{
+		LOG(LOG_DEBUG, LOG_NET, "Ignoring " << command << " from unknown source " << source << " on " << link.getLinkName());
+		return;
+	}
+	if (command == "NICK")
+	{
+		changeRemoteNick(link, *user, msg);
+	}
+	else if (isRelayedCommand(command))
+	{
+		_commandHandlers[command]->execute(*this, *user, msg);
+	}
+}
+
+// :<uplink> SERVER <name> <hops> :<info>
+void Server::introduceServer(Client& link, const Message& msg)
+{
+	std::string name = msg.getParam(0);
+	if (name.empty())
+	{
+		return;
+	}
+	if (isKnownServer(name))
+	{
+		// A second path to a known server would make a loop
+		LOG(LOG_WARN, LOG_NET, "Link " << link.getLinkName() << " introduced " << name << " which already exists");
+		closeLink(link.getLinkName(), "Server " + name + " already exists");
+		return;
+	}
+
+	RemoteServer server;
+	server.name = name;
+	server.uplink = msg.getPrefix().empty() ? link.getLinkName() : msg.getPrefix();
+	server.hops = std::atoi(msg.getParam(1).c_str());
+	if (server.hops < 2)
+		server.hops = 2;
+	server.link = &link;
+	_servers[name] = server;
+
+	std::ostringstream oss;
+	oss << ":" << server.uplink << " SERVER " << name << " " << server.hops + 1 << " :ft_irc\r\n";
+	propagate(link, oss.str());
+}
+
+// NICK <nick> <hops> <ts> <user> <host> <server> :<realname>
+void Server::introduceRemoteUser(Client& link, const Message& msg)
+{
+	std::string nick = msg.getParam(0);
+	time_t ts = static_cast<time_t>(std::atol(msg.getParam(2).c_str()));
+
+	Client* existing = getClientByNickname(nick);
+	if (existing != NULL)
+	{
+		// Unregistered local connections never win a nick
+		if (!existing->isRegistered() && !existing->isRemote())
+		{
+			sendReply(*existing, ":" + _serverName + " 433 * " + nick + " :Nickname is already in use\r\n");
+			setNickname(*existing, "");
+		}
+		else if (existing->getNickTs() < ts)
+		{
+			// Ours is older; the peer kills its own copy when it sees ours
+			LOG(LOG_INFO, LOG_NET, "Nick collision on " << nick << ": keeping the older local entry");
+			return;
+		}
+		else if (existing->getNickTs() > ts)
+		{
+			killClient(*existing, "Nick collision", &link);
+		}
+		else
+		{
+			// Same TS: nobody keeps the nick
+			killClient(*existing, "Nick collision", &link);
+			sendReply(link, ":" + _serverName + " KILL " + nick + " :Nick collision\r\n");
+			return;
+		}
+	}
+
+	Client* user = new Client(_nextRemoteFd--);
+	setNickname(*user, nick);
+	user->setUsername(msg.getParam(3));
+	user->setHostname(msg.getParam(4));
+	user->setRealname(msg.getParam(6));
+	user->setRemote(&link, msg.getParam(5));
+	user->setNickTs(ts);
+	user->setAuthenticated(true);
+	user->setRegistered(true);
+	_clients[user->getFd()] = user;
+
+	propagate(link, userIntroduction(*user));
+}
+
+// :<nick> NICK <newnick> <ts>
+void Server::changeRemoteNick(Client& link, Client& user, const Message& msg)
+{
+	std::string newNick = msg.getParam(0);
+	Client* existing = getClientByNickname(newNick);
+	if (existing != NULL && existing != &user)
+	{
+		// Both sides granted the nick at once: kill both users everywhere
+		std::string oldNick = user.getNickname();
+		killClient(*existing, "Nick collision", NULL);
+		propagate(link, ":" + _serverName + " KILL " + oldNick + " :Nick collision\r\n");
+		dropClient(user.getFd(), "Killed (Nick collision)", false);
+		return;
+	}
+
+	if (msg.getParamCount() > 1)
+	{
+		user.setNickTs(static_cast<time_t>(std::atol(msg.getParam(1).c_str())));
+	}
+	_commandHandlers["NICK"]->execute(*this, user, msg);
+}
+
+// Remove a user network-wide, telling it first if it is ours
+void Server::killClient(Client& client, const std::string& reason, Client* skipLink)
+{
+	std::string nick = client.getNickname();
+	std::string line = ":" + _serverName + " KILL " + nick + " :" + reason + "\r\n";
+	for (std::map<std::string, Client*>::iterator it = _links.begin(); it != _links.end(); ++it)
+	{
+		if (it->second != skipLink && it->second != client.getLink())
+		{
+			sendReply(*it->second, line);
+		}
+	}
+
+	LOG(LOG_INFO, LOG_NET, "Killed " << nick << ": " << reason);
+	if (!client.isRemote())
+	{
+		sendReply(client, line);
+		sendReply(client, "ERROR :Closing Link: " + nick + " (Killed (" + reason + "))\r\n");
+		sendToClient(client);
+	}
+	dropClient(client.getFd(), "Killed (" + reason + ")", false);
+}
+
+// :<source> KILL <nick> :<reason>
+void Server::applyKill(Client& link, const Message& msg)
+{
+	Client* target = getClientByNickname(msg.getParam(0));
+	if (target == NULL || target->getLinkState() != LINK_NONE)
+	{
+		return;
+	}
+	std::string reason = msg.getParamCount() > 1 ? msg.getParam(1) : "Killed";
+	killClient(*target, reason, &link);
+}
+
+// :<server> SJOIN <ts> <#chan> <modes> [key] [limit] :[@]nick ...
+void Server::applySjoin(Client& link, const Message& msg)
+{
+	if (msg.getParamCount() < 4)
+	{
+		return;
+	}
+	time_t ts = static_cast<time_t>(std::atol(msg.getParam(0).c_str()));
+	std::string channelName = msg.getParam(1);
+	std::string modes = msg.getParam(2);
+	std::string key;
+	int limit = 0;
+	size_t next = 3;
+	for (size_t i = 0; i < modes.length(); ++i)
+	{
+		if (modes[i] == 'k' && next + 1 < msg.getParamCount())
+			key = msg.getParam(next++);
+		else if (modes[i] == 'l' && next + 1 < msg.getParamCount())
+			limit = std::atoi(msg.getParam(next++).c_str());
+	}
+	if (!isValidChannelName(channelName))
+	{
+		return;
+	}
+
+	// Older channel wins; equal TS merges
+	Channel* channel = getChannel(channelName);
+	bool acceptTheirs = true;
+	if (channel == NULL)
+	{
+		channel = createChannel(channelName, NULL);
+		channel->setCreatedAt(ts);
+	}
+	else if (ts < channel->getCreatedAt())
+	{
+		// Our side loses its operators and modes
+		std::vector<Client*> members = channel->getMembers();
+		for (size_t i = 0; i < members.size(); ++i)
+		{
+			if (channel->isOperator(members[i]->getFd()))
+			{
+				channel->removeOperator(members[i]->getFd());
+				channel->broadcast(":" + _serverName + " MODE " + channel->getName() + " -o " + members[i]->getNickname() + "\r\n");
+			}
+		}
+		if (channel->getModeString() != "+")
+		{
+			channel->broadcast(":" + _serverName + " MODE " + channel->getName() + " -" + channel->getModeString().substr(1) + "\r\n");
+		}
+		channel->setInviteOnly(false);
+		channel->setTopicRestricted(false);
+		channel->setHasKey(false);
+		channel->setKey("");
+		for (const char* mode = "beI"; *mode != '\0'; ++mode)
+		{
+			const std::vector<MaskEntry>& entries = channel->getMasks(*mode);
+			std::vector<std::string> masks;
+			for (size_t i = 0; i < entries.size(); ++i)
+				masks.push_back(entries[i].mask);
+			broadcastMasks(*channel, _serverName, '-', *mode, masks);
+		}
+		channel->clearMasks();
+		channel->setHasUserLimit(false);
+		channel->setUserLimit(0);
+		channel->setCreatedAt(ts);
+	}
+	else if (ts > channel->getCreatedAt())
+	{
+		acceptTheirs = false;
+	}
+
+	if (acceptTheirs && modes != "+")
+	{
+		std::string before = channel->getModeString();
+		for (size_t i = 0; i < modes.length(); ++i)
+		{
+			if (modes[i] == 'i')
+				channel->setInviteOnly(true);
+			else if (modes[i] == 't')
+				channel->setTopicRestricted(true);
+			else if (modes[i] == 'k' && !key.empty())
+			{
+				channel->setHasKey(true);
+				channel->setKey(key);
+			}
+			else if (modes[i] == 'l' && limit > 0)
+			{
+				channel->setHasUserLimit(true);
+				channel->setUserLimit(limit);
+			}
+		}
+		if (channel->getModeString() != before && channel->getMemberCount() > 0)
+		{
+			std::ostringstream modeMsg;
+			modeMsg << ":" << msg.getPrefix() << " MODE " << channel->getName() << " " << channel->getModeString();
+			if (channel->hasKey())
+				modeMsg << " " << channel->getKey();
+			if (channel->hasUserLimit())
+				modeMsg << " " << channel->getUserLimit();
+			modeMsg << "\r\n";
+			channel->broadcast(modeMsg.str());
+		}
+	}
+
+	std::istringstream members(msg.getParam(msg.getParamCount() - 1));
+	std::string entry;
+	while (members >> entry)
+	{
+		bool op = entry[0] == '@';
+		Client* member = getClientByNickname(op ? entry.substr(1) : entry);
+		if (member == NULL || member->getLink() != &link)
+			continue;
+		if (!channel->isMember(member->getFd()))
+		{
+			channel->addMember(member);
+			channel->broadcast(":" + userMask(*member) + " JOIN :" + channel->getName() + "\r\n");
+		}
+		if (op && acceptTheirs && !channel->isOperator(member->getFd()))
+		{
+			channel->addOperator(member->getFd());
+			channel->broadcast(":" + _serverName + " MODE " + channel->getName() + " +o " + member->getNickname() + "\r\n");
+		}
+	}
+
+	// Nobody joined after all
+	if (channel->getMemberCount() == 0)
+	{
+		removeChannel(channelName);
+	}
+
+	propagate(link, rebuildLine(msg));
+}
+
+// :<server> BMASK <ts> <#chan> <b|e|I> :<mask> ..., sent in bursts after
+// SJOIN; masks from a channel younger than ours are dropped, others merged
+void Server::applyBmask(Client& link, const Message& msg)
+{
+	if (msg.getParamCount() < 4 || msg.getParam(2).length() != 1)
+	{
+		return;
+	}
+	time_t ts = static_cast<time_t>(std::atol(msg.getParam(0).c_str()));
+	char mode = msg.getParam(2)[0];
+	Channel* channel = getChannel(msg.getParam(1));
+	if (channel == NULL || ts > channel->getCreatedAt() || (mode != 'b' && mode != 'e' && mode != 'I'))
+	{
+		return;
+	}
+
+	std::vector<std::string> added;
+	std::istringstream masks(msg.getParam(3));
+	std::string mask;
+	time_t now = time(NULL);
+	while (masks >> mask)
+	{
+		mask = MaskMatcher::normalize(mask);
+		if (!mask.empty() && channel->addMask(mode, mask, msg.getPrefix(), now))
+			added.push_back(mask);
+	}
+	broadcastMasks(*channel, msg.getPrefix(), '+', mode, added);
+	propagate(link, rebuildLine(msg));
+}
+
+// :<server> TOPIC <#chan> :<topic>, sent in bursts; an existing topic is kept
+void Server::applyServerTopic(Client& link, const Message& msg)
+{
+	Channel* channel = getChannel(msg.getParam(0));
+	if (channel == NULL || msg.getParamCount() < 2)
+	{
+		return;
+	}
+	if (channel->getTopic().empty() && !msg.getParam(1).empty())
+	{
+		channel->setTopic(msg.getParam(1));
+		channel->broadcast(":" + msg.getPrefix() + " TOPIC " + channel->getName() + " :" + msg.getParam(1) + "\r\n");
+	}
+	propagate(link, rebuildLine(msg));
+}
+
+// :<source> SQUIT <server> :<reason>
+void Server::applySquit(Client& link, const Message& msg)
+{
+	std::string name = msg.getParam(0);
+	std::map<std::string, RemoteServer>::iterator it = _servers.find(name);
+	if (it == _servers.end() || it->second.link != &link || _links.count(name))
+	{
+		return;
+	}
+	propagate(link, rebuildLine(msg));
+
+	// The server and everything introduced through it
+	std::set<std::string> split;
+	split.insert(name);
+	bool grew = true;
+	while (grew)
+	{
+		grew = false;
+		for (std::map<std::string, RemoteServer>::iterator s = _servers.begin(); s != _servers.end(); ++s)
+		{
+			if (!split.count(s->first) && split.count(s->second.uplink))
+			{
+				split.insert(s->first);
+				grew = true;
+			}
+		}
+	}
+	splitServers(split, it->second.uplink + " " + name);
+}
+
+// Our direct link went away: everything behind it is gone
+void Server::handleLinkLoss(Client& link, const std::string& reason)
+{
+	std::string name = link.getLinkName();
+	LOG(LOG_WARN, LOG_NET, "Lost link with " << name << ": " << reason);
+
+	propagate(link, ":" + _serverName + " SQUIT " + name + " :" + reason + "\r\n");
+
+	std::set<std::string> split;
+	for (std::map<std::string, RemoteServer>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+	{
+		if (it->second.link == &link)
+			split.insert(it->first);
+	}
+	splitServers(split, _serverName + " " + name);
+	_links.erase(name);
+
+	// Users whose server we never heard of but that came through this link
+	std::vector<int> orphans;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (it->second->getLink() == &link)
+			orphans.push_back(it->first);
+	}
+	for (size_t i = 0; i < orphans.size(); ++i)
+	{
+		dropClient(orphans[i], _serverName + " " + name, false);
+	}
+}
+
+// Netsplit: quit every user on the given servers and forget the servers
+void Server::splitServers(const std::set<std::string>& names, const std::string& reason)
+{
+	std::vector<int> users;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (it->second->isRemote() && names.count(it->second->getServerName()))
+			users.push_back(it->first);
+	}
+	for (size_t i = 0; i < users.size(); ++i)
+	{
+		dropClient(users[i], reason, false);
+	}
+	for (std::set<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+	{
+		_servers.erase(*it);
+	}
+	LOG(LOG_INFO, LOG_NET, "Netsplit " << reason << ": " << users.size() << " user(s), " << names.size() << " server(s)");
+}
@@ -0,0 +1,140 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include "Tracer.hpp"
+#include <unistd.h>
+
+// Split-stage mode (see Pipeline.hpp). Plain IRC clients are handed to the
+// I/O threads once accepted; the event loop keeps their Client for all the
+// state and gets their lines already parsed. Everything else (listeners,
+// TLS, WebSocket, metrics and outgoing links) stays on the loop as before.
+
+bool Server::startPipeline(std::string& error)
+{
+	size_t threads = _config.getPipelineThreads();
+	if (threads == 0 || _pipeline != NULL)
+		return true;
+	// Captures record what the loop reads, which it no longer does
+	if (!_config.getCaptureFile().empty())
+	{
+		error = "not available while capturing traffic";
+		return false;
+	}
+
+	Pipeline* pipeline = new Pipeline();
+	if (!pipeline->start(threads, _config.getPipelineRing(), error))
+	{
+		delete pipeline;
+		return false;
+	}
+	_pipeline = pipeline;
+	_io->add(_pipeline->getWakeFd(), POLLIN, 0);
+
+	// Clients restored by an upgrade, or kept after a failed one
+	size_t adopted = 0;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (canPipeline(*it->second))
+		{
+			pipelineClient(*it->second);
+			adopted++;
+		}
+	}
+	LOG(LOG_INFO, LOG_SERVER, "Pipeline: " << threads << " I/O thread(s), " << adopted << " client(s) handed over");
+	return true;
+}
+
+// Join the I/O threads and watch their sockets from the loop again. Lines
+// they already parsed are run first, then the unfinished ones and the
+// unsent output go back into each Client.
+void Server::stopPipeline()
+{
+	if (_pipeline == NULL)
+		return;
+
+	std::vector<PipeInput> inputs;
+	_pipeline->stop(inputs);
+	runPipeInputs(inputs);
+
+	std::vector<PipeReclaim> connections;
+	_pipeline->reclaim(connections);
+	for (size_t i = 0; i < connections.size(); ++i)
+	{
+		Client* client = getClient(connections[i].fd);
+		if (client == NULL)
+		{
+			close(connections[i].fd);
+			continue;
+		}
+		client->prependToSendBuffer(connections[i].output);
+		client->appendToRecvBuffer(connections[i].input);
+		_io->add(connections[i].fd, POLLIN, IO_RECEIVE);
+	}
+
+	_io->remove(_pipeline->getWakeFd());
+	delete _pipeline;
+	_pipeline = NULL;
+	LOG(LOG_INFO, LOG_SERVER, "Pipeline stopped, " << connections.size() << " client(s) back on the event loop");
+}
+
+// Plain IRC connections only; a send the backend has in flight would race
+// with the I/O thread's
+bool Server::canPipeline(const Client& client) const
+{
+	return client.getFd() >= 0 && client.getProtocol() == PROTO_IRC && client.getTls() == NULL &&
+		client.getWebSocket() == NULL && client.getLinkState() == LINK_NONE && _io->isWatched(client.getFd()) &&
+		!_io->isSending(client.getFd());
+}
+
+void Server::pipelineClient(Client& client)
+{
+	int fd = client.getFd();
+	_io->remove(fd);
+
+	// Complete lines parked behind a password check stay here; the
+	// unfinished tail is framed by the I/O thread
+	std::string buffered = client.takeRecvBuffer();
+	std::string::size_type end = buffered.rfind("\r\n");
+	std::string::size_type split = end == std::string::npos ? 0 : end + 2;
+	client.appendToRecvBuffer(buffered.substr(0, split));
+
+	const ConnectionClass* connClass = client.getConnectionClass();
+	size_t sendq = connClass != NULL ? connClass->sendq : static_cast<size_t>(-1);
+	_pipeline->adopt(fd, sendq, buffered.substr(split));
+}
+
+void Server::runPipeline()
+{
+	TRACE_SCOPE("runPipeline");
+	std::vector<PipeInput> inputs;
+	_pipeline->receive(inputs);
+	runPipeInputs(inputs);
+}
+
+// Run parsed lines in order; a NULL message is the I/O thread hanging up
+void Server::runPipeInputs(std::vector<PipeInput>& inputs)
+{
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const PipeInput& input = inputs[i];
+		// An earlier line may have removed the client
+		Client* client = _pipeline->owns(input.fd) ? getClient(input.fd) : NULL;
+		if (client != NULL && input.message == NULL)
+		{
+			removeClient(input.fd);
+		}
+		else if (client != NULL && client->getPendingAuth() != 0)
+		{
+			client->appendToRecvBuffer(input.message->getRaw() + "\r\n");
+			if (client->getRecvBuffer().size() > AUTH_PARKED_INPUT)
+				removeClient(input.fd, "Excess Flood");
+		}
+		else if (client != NULL)
+		{
+			runMessage(*client, *input.message);
+		}
+		delete input.message;
+	}
+	inputs.clear();
+}
@@ -0,0 +1,189 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Logger.hpp"
+#include "Tracer.hpp"
+#include "Metrics.hpp"
+#include "Tls.hpp"
+#include <sys/uio.h>
+#include <poll.h>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+// TLS connections (see Tls.hpp). SSL_read may decrypt more records than
+// one call returns, and poll() cannot see what OpenSSL already holds, so a
+// readable TLS socket is drained until OpenSSL wants more from the network.
+// Handshakes that need to write wait for POLLOUT; the main loop hands that
+// back here. Outgoing data waits in the send queue until the handshake is
+// done.
+
+// Queued buffers looked at per SSL_write
+static const size_t TLS_SEND_IOV = 64;
+
+void Server::setupTls()
+{
+	bool needed = false;
+	for (std::map<int, Listener>::const_iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+	{
+		if (it->second.config.tls)
+			needed = true;
+	}
+	if (!needed)
+		return;
+
+	// Handed-over TLS listeners still need a certificate from this config
+	if (_config.getTlsCertFile().empty())
+		throw std::runtime_error("TLS listener without a tls directive");
+	std::string error;
+	if (!_tls.init(_config.getTlsCertFile(), _config.getTlsKeyFile(), _config.isKtlsEnabled(), error))
+		throw std::runtime_error("Failed to set up TLS with " + _config.getTlsCertFile() + ": " + error);
+	LOG(LOG_INFO, LOG_SERVER, "TLS certificate " << _config.getTlsCertFile()
+		<< (_config.isKtlsEnabled() ? ", kTLS where the kernel supports it" : ", kTLS off"));
+}
+
+void Server::startTls(Client& client)
+{
+	SSL* ssl = _tls.createSession(client.getFd());
+	if (ssl == NULL)
+	{
+		LOG(LOG_WARN, LOG_NET, "TLS session setup failed for fd " << client.getFd() << ": " << tlsError());
+		removeClient(client.getFd());
+		return;
+	}
+	client.setTls(new TlsSession(ssl));
+}
+
+// Returns true once the session is established
+bool Server::advanceTlsHandshake(Client& client)
+{
+	TlsSession& tls = *client.getTls();
+	int fd = client.getFd();
+	TlsStatus status = tls.handshake();
+	if (status == TLS_OK)
+	{
+		LOG(LOG_INFO, LOG_NET, "TLS established: fd " << fd << " (" << tls.describe() << ")");
+		return true;
+	}
+	if (status == TLS_WANT_WRITE)
+		setPollEvents(fd, POLLIN | POLLOUT);
+	if (status == TLS_WANT_READ || status == TLS_WANT_WRITE)
+		return false;
+
+	LOG(LOG_WARN, LOG_NET, "TLS handshake failed for fd " << fd << ": " << tlsError());
+	removeClient(fd);
+	return false;
+}
+
+void Server::handleTlsInput(Client& client)
+{
+	TRACE_SCOPE("handleTlsInput");
+
+	TlsSession& tls = *client.getTls();
+	int fd = client.getFd();
+	if (!tls.isEstablished() && !advanceTlsHandshake(client))
+		return;
+
+	char buffer[4096];
+	while (true)
+	{
+		size_t received;
+		TlsStatus status = tls.read(buffer, sizeof(buffer), received);
+		if (status == TLS_OK)
+		{
+			_capture.recordData(fd, buffer, received);
+			processInput(client, buffer, received);
+			// QUIT (or a failed send) may have deleted the client
+			if (getClient(fd) != &client)
+				return;
+			continue;
+		}
+		if (status == TLS_WANT_READ)
+			return;
+		if (status == TLS_WANT_WRITE)
+		{
+			setPollEvents(fd, POLLIN | POLLOUT);
+			return;
+		}
+		if (status == TLS_CLOSED)
+			LOG(LOG_DEBUG, LOG_NET, "TLS session closed by client: fd " << fd);
+		else
+			LOG(LOG_WARN, LOG_NET, "TLS error for client fd " << fd << ": " << tlsError());
+		removeClient(fd);
+		return;
+	}
+}
+
+// Userspace records, for sessions kTLS did not take over: up to one
+// record's worth of queued data per SSL_write, gathered only when it spans
+// several buffers. A write that has to be retried is retried with at least
+// as much data, as OpenSSL requires, since the queue only grows meanwhile.
+void Server::sendTls(Client& client)
+{
+	TlsSession& tls = *client.getTls();
+	if (!tls.isEstablished())
+		return;
+
+	int fd = client.getFd();
+	char record[TLS_RECORD_SIZE];
+	while (client.hasMessageToSend())
+	{
+		struct iovec iov[TLS_SEND_IOV];
+		size_t count = client.getSendIovec(iov, TLS_SEND_IOV);
+		const char* data = static_cast<const char*>(iov[0].iov_base);
+		size_t size = std::min(iov[0].iov_len, TLS_RECORD_SIZE);
+		if (count > 1 && size < TLS_RECORD_SIZE)
+		{
+			size = 0;
+			for (size_t i = 0; i < count && size < TLS_RECORD_SIZE; ++i)
+			{
+				size_t chunk = std::min(iov[i].iov_len, TLS_RECORD_SIZE - size);
+				std::memcpy(record + size, iov[i].iov_base, chunk);
+				size += chunk;
+			}
+			data = record;
+		}
+
+		size_t sent;
+		TlsStatus status = tls.write(data, size, sent);
+		if (status == TLS_OK)
+		{
+			Metrics::instance().addBytesOut(sent);
+			client.consumeSendBuffer(sent);
+			continue;
+		}
+		// The retry comes from POLLOUT, or from the POLLIN always watched
+		if (status == TLS_WANT_WRITE)
+			setPollEvents(fd, POLLIN | POLLOUT);
+		if (status == TLS_WANT_WRITE || status == TLS_WANT_READ)
+			return;
+		LOG(LOG_WARN, LOG_NET, "TLS send error for client fd " << fd << ": " << tlsError());
+		removeClient(fd);
+		return;
+	}
+	setPollEvents(fd, POLLIN);
+}
+
+// TLS sessions live in this process's OpenSSL state and cannot be handed
+// to an upgraded binary, so those clients are told to reconnect
+void Server::closeTlsClients(const std::string& reason)
+{
+	std::vector<int> fds;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (it->second->getTls() != NULL)
+			fds.push_back(it->first);
+	}
+	for (size_t i = 0; i < fds.size(); ++i)
+	{
+		Client* client = getClient(fds[i]);
+		if (client == NULL)
+			continue;
+		std::string host = client->getHostname().empty() ? "localhost" : client->getHostname();
+		sendReply(*client, "ERROR :Closing Link: " + host + " (" + reason + ")\r\n");
+		sendToClient(*client);
+		if (getClient(fds[i]) == client)
+			removeClient(fds[i], reason);
+	}
+	if (!fds.empty())
+		LOG(LOG_INFO, LOG_SERVER, "Closed " << fds.size() << " TLS connection(s): " << reason);
+}
@@ -0,0 +1,593 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Upgrade.hpp"
+#include "Logger.hpp"
+#include "WebSocket.hpp"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+
+// Hot upgrade: the running server forks, execs the binary again with the
+// same arguments, and passes every listening and client socket plus the
+// full Client/Channel/link state to it over a socketpair (see Upgrade.hpp).
+// The old process waits for the new one to acknowledge before it exits,
+// never touching the sockets again, so clients see no disconnect. If the
+// new binary fails to start, the old one keeps serving.
+
+// Handover socket fd number in the new process
+static const char* const UPGRADE_FD_ENV = "IRCSERV_UPGRADE_FD";
+
+// How long the old process waits for the new one to take over
+static const int UPGRADE_TIMEOUT_SECONDS = 30;
+
+extern char** environ;
+
+void Server::setCommandLine(int argc, char** argv)
+{
+	// Resolve now: once the binary is replaced on disk, /proc/self/exe
+	// would point at the deleted old image
+	char path[PATH_MAX];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (length > 0)
+	{
+		path[length] = '\0';
+		_execPath = path;
+	}
+	else if (argc > 0)
+	{
+		_execPath = argv[0];
+	}
+
+	_execArgs.clear();
+	for (int i = 0; i < argc; ++i)
+	{
+		_execArgs.push_back(argv[i]);
+	}
+}
+
+// Deferred to the top of the event loop, outside any command handler
+void Server::requestUpgrade(const std::string& requester)
+{
+	_upgradeRequested = true;
+	_upgradeRequester = requester;
+}
+
+bool Server::performUpgrade(std::string& error)
+{
+	if (_execPath.empty())
+	{
+		error = "executable path unknown";
+		return false;
+	}
+
+	closeTlsClients("Server upgrading, please reconnect");
+
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+	{
+		error = std::string("socketpair: ") + strerror(errno);
+		return false;
+	}
+
+	// Everything the child needs is prepared before fork: between fork and
+	// exec it may only make async-signal-safe calls
+	std::ostringstream fdVar;
+	fdVar << UPGRADE_FD_ENV << "=" << pair[1];
+	std::string fdEntry = fdVar.str();
+	std::vector<char*> argv;
+	for (size_t i = 0; i < _execArgs.size(); ++i)
+	{
+		argv.push_back(const_cast<char*>(_execArgs[i].c_str()));
+	}
+	argv.push_back(NULL);
+	std::vector<char*> envp;
+	size_t prefixLength = std::strlen(UPGRADE_FD_ENV);
+	for (char** env = environ; *env != NULL; ++env)
+	{
+		if (std::strncmp(*env, UPGRADE_FD_ENV, prefixLength) != 0 || (*env)[prefixLength] != '=')
+			envp.push_back(*env);
+	}
+	envp.push_back(const_cast<char*>(fdEntry.c_str()));
+	envp.push_back(NULL);
+
+	// The I/O threads hand their sockets back, so the handover sees them all
+	stopPipeline();
+
+	// A completion backend stops reading now; what it already read or sent
+	// is handled here, so the saved state is the last word
+	_io->suspend(_ioEvents);
+	for (size_t i = 0; i < _ioEvents.size(); ++i)
+	{
+		handleIoEvent(_ioEvents[i]);
+	}
+	// Password checks are not part of the saved state: finish them, and the
+	// input parked behind them, first
+	while (hasPendingAuth())
+	{
+		handleAuthCompletions(true);
+	}
+
+	std::vector<int> inherited;
+	const std::map<int, short>& watched = _io->getWatched();
+	for (std::map<int, short>::const_iterator it = watched.begin(); it != watched.end(); ++it)
+	{
+		inherited.push_back(it->first);
+	}
+	inherited.push_back(pair[0]);
+
+	UpgradeWriter writer;
+	saveState(writer);
+
+	// The new process starts its own capture file
+	_capture.close();
+
+	LOG(LOG_INFO, LOG_SERVER, "Upgrading: handing " << _clients.size() << " client(s) and " << _listeners.size()
+		<< " listener(s) to " << _execPath);
+
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		error = std::string("fork: ") + strerror(errno);
+		close(pair[0]);
+		close(pair[1]);
+		_io->resume();
+		return false;
+	}
+	if (pid == 0)
+	{
+		// Sockets reach the new process only through the handover
+		for (size_t i = 0; i < inherited.size(); ++i)
+		{
+			close(inherited[i]);
+		}
+		execve(_execPath.c_str(), &argv[0], &envp[0]);
+		_exit(127);
+	}
+	close(pair[1]);
+
+	struct timeval timeout;
+	timeout.tv_sec = UPGRADE_TIMEOUT_SECONDS;
+	timeout.tv_usec = 0;
+	setsockopt(pair[0], SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(pair[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	bool ok = writer.send(pair[0], error);
+	if (ok)
+	{
+		char ack = 0;
+		ssize_t n;
+		do
+		{
+			n = recv(pair[0], &ack, 1, 0);
+		} while (n == -1 && errno == EINTR);
+		if (n != 1 || ack != '+')
+		{
+			ok = false;
+			error = (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? "timed out waiting for the new process"
+				: "new process exited before taking over, see its log output";
+		}
+	}
+	else
+	{
+		error = "handover: " + error;
+	}
+	close(pair[0]);
+
+	if (!ok)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		if (!_config.getCaptureFile().empty())
+		{
+			std::string captureError;
+			if (!_capture.open(_config.getCaptureFile(), captureError))
+				LOG(LOG_WARN, LOG_SERVER, "Failed to reopen capture file: " << captureError);
+		}
+		_io->resume();
+		return false;
+	}
+
+	_handedOver = true;
+	LOG(LOG_INFO, LOG_SERVER, "Upgrade complete, new process is pid " << pid);
+	return true;
+}
+
+void Server::saveState(UpgradeWriter& writer) const
+{
+	writer.putString(_serverName);
+	writer.putSigned(_startTime);
+	writer.putNumber(_messageSeq);
+	writer.putSigned(_nextRemoteFd);
+	writer.putString(_upgradeRequester);
+
+	writer.putNumber(_listeners.size());
+	for (std::map<int, Listener>::const_iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+	{
+		const ListenerConfig& config = it->second.config;
+		writer.putFd(it->first);
+		writer.putNumber(config.type);
+		writer.putNumber(config.protocol);
+		writer.putString(config.address);
+		writer.putSigned(config.port);
+		writer.putString(config.className);
+		writer.putSigned(config.backlog);
+		writer.putNumber(config.v6only);
+		writer.putNumber(config.noDelay);
+		writer.putNumber(config.keepAlive);
+		writer.putNumber(config.tls);
+		writer.putSigned(config.sendBufferSize);
+		writer.putSigned(config.recvBufferSize);
+		writer.putSigned(config.mode);
+	}
+
+	// Clients are keyed by their current fd; remote users keep their pseudo fd
+	writer.putNumber(_clients.size());
+	for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		const Client& client = *it->second;
+		writer.putSigned(it->first);
+		if (it->first >= 0)
+		{
+			writer.putFd(it->first);
+			writer.putNumber(static_cast<unsigned short>(_io->getEvents(it->first)));
+		}
+		writer.putString(client.getNickname());
+		writer.putString(client.getUsername());
+		writer.putString(client.getRealname());
+		writer.putString(client.getHostname());
+		writer.putNumber(client.isAuthenticated());
+		writer.putNumber(client.isRegistered());
+		writer.putNumber(client.isServerOperator());
+		writer.putNumber(client.shouldCloseAfterFlush());
+		writer.putNumber(client.getCapabilities());
+		writer.putNumber(client.isNegotiatingCaps());
+		writer.putNumber(client.getProtocol());
+		writer.putString(client.getRecvBuffer());
+		writer.putString(client.getSendBuffer());
+		writer.putNumber(client.getWebSocket() != NULL);
+		if (client.getWebSocket() != NULL)
+		{
+			const WebSocketSession& webSocket = *client.getWebSocket();
+			writer.putNumber(webSocket.isOpen());
+			writer.putNumber(webSocket.isBinary());
+			writer.putString(webSocket.getInput());
+			writer.putNumber(webSocket.getMessageOpcode());
+			writer.putString(webSocket.getMessage());
+			writer.putString(webSocket.getPending());
+		}
+		writer.putString(client.getConnectionClass() == NULL ? "" : client.getConnectionClass()->name);
+		writer.putNumber(client.getLinkState());
+		writer.putString(client.getLinkName());
+		writer.putNumber(client.getLink() != NULL);
+		if (client.getLink() != NULL)
+			writer.putSigned(client.getLink()->getFd());
+		writer.putString(client.getServerName());
+		writer.putSigned(client.getNickTs());
+	}
+
+	writer.putNumber(_servers.size());
+	for (std::map<std::string, RemoteServer>::const_iterator it = _servers.begin(); it != _servers.end(); ++it)
+	{
+		writer.putString(it->second.name);
+		writer.putString(it->second.uplink);
+		writer.putSigned(it->second.hops);
+		writer.putSigned(it->second.link->getFd());
+	}
+
+	writer.putNumber(_channels.size());
+	for (std::map<std::string, Channel*>::const_iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		const Channel& channel = *it->second;
+		writer.putString(channel.getName());
+		writer.putString(channel.getTopic());
+		writer.putString(channel.getKey());
+		writer.putNumber(channel.isInviteOnly());
+		writer.putNumber(channel.isTopicRestricted());
+		writer.putNumber(channel.hasKey());
+		writer.putNumber(channel.hasUserLimit());
+		writer.putSigned(channel.getUserLimit());
+		writer.putSigned(channel.getCreatedAt());
+
+		std::vector<Client*> members = channel.getMembers();
+		writer.putNumber(members.size());
+		for (size_t i = 0; i < members.size(); ++i)
+		{
+			writer.putSigned(members[i]->getFd());
+			writer.putNumber(channel.isOperator(members[i]->getFd()));
+		}
+		std::vector<int> invited = channel.getInvited();
+		writer.putNumber(invited.size());
+		for (size_t i = 0; i < invited.size(); ++i)
+		{
+			writer.putSigned(invited[i]);
+		}
+		for (const char* mode = "beI"; *mode != '\0'; ++mode)
+		{
+			const std::vector<MaskEntry>& masks = channel.getMasks(*mode);
+			writer.putNumber(masks.size());
+			for (size_t i = 0; i < masks.size(); ++i)
+			{
+				writer.putString(masks[i].mask);
+				writer.putString(masks[i].setBy);
+				writer.putSigned(masks[i].setAt);
+			}
+		}
+	}
+
+	const std::vector<FilterRule>& rules = _filter.getRules();
+	writer.putNumber(rules.size());
+	for (size_t i = 0; i < rules.size(); ++i)
+	{
+		writer.putString(rules[i].pattern);
+		writer.putNumber(rules[i].action);
+		writer.putNumber(rules[i].foldCase);
+		writer.putString(rules[i].setBy);
+		writer.putSigned(rules[i].setAt);
+	}
+}
+
+bool Server::restoreState(UpgradeReader& reader, std::string& error)
+{
+	std::string serverName = reader.getString();
+	if (serverName != _serverName)
+	{
+		// Linked peers know us by the old name until the next restart
+		LOG(LOG_WARN, LOG_SERVER, "Keeping server name " << serverName << " across the upgrade");
+		_serverName = serverName;
+	}
+	_startTime = static_cast<time_t>(reader.getSigned());
+	// msgids are <start time>-<sequence>: restarting it would reissue ids
+	// still in the history rings
+	_messageSeq = reader.getNumber();
+	_nextRemoteFd = static_cast<int>(reader.getSigned());
+	_upgradeRequester = reader.getString();
+
+	// Listeners come from the handover; listen lines in the config only apply
+	// to a cold start
+	unsigned long long listenerCount = reader.getNumber();
+	for (unsigned long long i = 0; i < listenerCount && !reader.failed(); ++i)
+	{
+		Listener listener;
+		listener.fd = reader.getFd();
+		listener.config.type = static_cast<ListenerType>(reader.getNumber());
+		listener.config.protocol = static_cast<ListenerProtocol>(reader.getNumber());
+		listener.config.address = reader.getString();
+		listener.config.port = static_cast<int>(reader.getSigned());
+		listener.config.className = reader.getString();
+		listener.config.backlog = static_cast<int>(reader.getSigned());
+		listener.config.v6only = reader.getNumber() != 0;
+		listener.config.noDelay = reader.getNumber() != 0;
+		listener.config.keepAlive = reader.getNumber() != 0;
+		listener.config.tls = reader.getNumber() != 0;
+		listener.config.sendBufferSize = static_cast<int>(reader.getSigned());
+		listener.config.recvBufferSize = static_cast<int>(reader.getSigned());
+		listener.config.mode = static_cast<int>(reader.getSigned());
+		if (reader.failed())
+			break;
+		listener.connClass = &_classes[listener.config.className];
+		_listeners[listener.fd] = listener;
+		_io->add(listener.fd, POLLIN, IO_LISTENER);
+		LOG(LOG_INFO, LOG_NET, "Resumed listening on " << listener.config.describe());
+	}
+
+	std::map<long long, Client*> byKey;
+	std::vector<std::pair<Client*, long long> > remoteLinks;
+	std::vector<std::string> remoteServers;
+	unsigned long long clientCount = reader.getNumber();
+	for (unsigned long long i = 0; i < clientCount && !reader.failed(); ++i)
+	{
+		long long key = reader.getSigned();
+		int fd = static_cast<int>(key);
+		short events = POLLIN;
+		if (key >= 0)
+		{
+			fd = reader.getFd();
+			events = static_cast<short>(reader.getNumber());
+		}
+		if (reader.failed())
+			break;
+
+		Client* client = new Client(fd);
+		setNickname(*client, reader.getString());
+		client->setUsername(reader.getString());
+		client->setRealname(reader.getString());
+		client->setHostname(reader.getString());
+		client->setAuthenticated(reader.getNumber() != 0);
+		client->setRegistered(reader.getNumber() != 0);
+		client->setServerOperator(reader.getNumber() != 0);
+		client->setCloseAfterFlush(reader.getNumber() != 0);
+		client->setCapabilities(static_cast<unsigned int>(reader.getNumber()));
+		client->setNegotiatingCaps(reader.getNumber() != 0);
+		client->setProtocol(static_cast<ListenerProtocol>(reader.getNumber()));
+		client->appendToRecvBuffer(reader.getString());
+		// Already framed for WebSocket clients, so queued before the session
+		client->appendToSendBuffer(reader.getString());
+		if (reader.getNumber() != 0)
+		{
+			WebSocketSession* webSocket = new WebSocketSession();
+			bool open = reader.getNumber() != 0;
+			bool binary = reader.getNumber() != 0;
+			std::string input = reader.getString();
+			WebSocketOpcode messageOpcode = static_cast<WebSocketOpcode>(reader.getNumber());
+			std::string message = reader.getString();
+			webSocket->restore(open, binary, input, messageOpcode, message, reader.getString());
+			client->setWebSocket(webSocket);
+		}
+		std::string className = reader.getString();
+		if (!className.empty())
+		{
+			ConnectionClass* connClass = &_classes[className];
+			connClass->clientCount++;
+			client->setConnectionClass(connClass);
+		}
+		client->setLinkState(static_cast<LinkState>(reader.getNumber()));
+		client->setLinkName(reader.getString());
+		bool hasLink = reader.getNumber() != 0;
+		long long linkKey = hasLink ? reader.getSigned() : 0;
+		std::string serverName = reader.getString();
+		client->setNickTs(static_cast<time_t>(reader.getSigned()));
+
+		_clients[fd] = client;
+		byKey[key] = client;
+		if (fd >= 0)
+		{
+			_io->add(fd, events, IO_RECEIVE);
+		}
+		if (hasLink)
+		{
+			remoteLinks.push_back(std::make_pair(client, linkKey));
+			remoteServers.push_back(serverName);
+		}
+		if (client->isServerLink())
+		{
+			_links[client->getLinkName()] = client;
+		}
+	}
+	for (size_t i = 0; i < remoteLinks.size() && !reader.failed(); ++i)
+	{
+		std::map<long long, Client*>::iterator link = byKey.find(remoteLinks[i].second);
+		if (link == byKey.end())
+		{
+			error = "remote user refers to an unknown link";
+			return false;
+		}
+		remoteLinks[i].first->setRemote(link->second, remoteServers[i]);
+	}
+
+	unsigned long long serverCount = reader.getNumber();
+	for (unsigned long long i = 0; i < serverCount && !reader.failed(); ++i)
+	{
+		RemoteServer server;
+		server.name = reader.getString();
+		server.uplink = reader.getString();
+		server.hops = static_cast<int>(reader.getSigned());
+		std::map<long long, Client*>::iterator link = byKey.find(reader.getSigned());
+		if (link == byKey.end())
+		{
+			error = "server " + server.name + " refers to an unknown link";
+			return false;
+		}
+		server.link = link->second;
+		_servers[server.name] = server;
+	}
+
+	unsigned long long channelCount = reader.getNumber();
+	for (unsigned long long i = 0; i < channelCount && !reader.failed(); ++i)
+	{
+		Channel* channel = createChannel(reader.getString(), NULL);
+		channel->setTopic(reader.getString());
+		channel->setKey(reader.getString());
+		channel->setInviteOnly(reader.getNumber() != 0);
+		channel->setTopicRestricted(reader.getNumber() != 0);
+		channel->setHasKey(reader.getNumber() != 0);
+		channel->setHasUserLimit(reader.getNumber() != 0);
+		channel->setUserLimit(static_cast<int>(reader.getSigned()));
+		channel->setCreatedAt(static_cast<time_t>(reader.getSigned()));
+
+		unsigned long long memberCount = reader.getNumber();
+		for (unsigned long long m = 0; m < memberCount && !reader.failed(); ++m)
+		{
+			std::map<long long, Client*>::iterator member = byKey.find(reader.getSigned());
+			bool op = reader.getNumber() != 0;
+			if (member == byKey.end())
+				continue;
+			channel->addMember(member->second);
+			if (op)
+				channel->addOperator(member->second->getFd());
+		}
+		unsigned long long inviteCount = reader.getNumber();
+		for (unsigned long long v = 0; v < inviteCount && !reader.failed(); ++v)
+		{
+			std::map<long long, Client*>::iterator invited = byKey.find(reader.getSigned());
+			if (invited != byKey.end())
+				channel->addToInviteList(invited->second->getFd());
+		}
+		for (const char* mode = "beI"; *mode != '\0'; ++mode)
+		{
+			unsigned long long maskCount = reader.getNumber();
+			for (unsigned long long b = 0; b < maskCount && !reader.failed(); ++b)
+			{
+				std::string mask = reader.getString();
+				std::string setBy = reader.getString();
+				channel->addMask(*mode, mask, setBy, static_cast<time_t>(reader.getSigned()));
+			}
+		}
+	}
+
+	unsigned long long ruleCount = reader.getNumber();
+	for (unsigned long long i = 0; i < ruleCount && !reader.failed(); ++i)
+	{
+		FilterRule rule;
+		rule.pattern = reader.getString();
+		rule.action = static_cast<FilterAction>(reader.getNumber());
+		rule.foldCase = reader.getNumber() != 0;
+		rule.setBy = reader.getString();
+		rule.setAt = static_cast<time_t>(reader.getSigned());
+		_filter.add(rule);
+	}
+
+	if (reader.failed() || !reader.atEnd())
+	{
+		error = "corrupt handover state";
+		return false;
+	}
+	return true;
+}
+
+// Called from main before start(): picks up the handover when this process
+// was exec'd by an upgrade, does nothing on a cold start
+void Server::adoptHandover()
+{
+	const char* socketVar = std::getenv(UPGRADE_FD_ENV);
+	if (socketVar == NULL)
+	{
+		return;
+	}
+	int socket = std::atoi(socketVar);
+	unsetenv(UPGRADE_FD_ENV);
+
+	UpgradeReader reader;
+	std::string error;
+	if (!reader.receive(socket, error) || !restoreState(reader, error))
+	{
+		close(socket);
+		throw std::runtime_error("Upgrade handover failed: " + error);
+	}
+	_resumeSocket = socket;
+	LOG(LOG_INFO, LOG_SERVER, "Resumed " << _clients.size() << " client(s), " << _channels.size() << " channel(s) and "
+		<< _servers.size() << " linked server(s) from the previous process");
+}
+
+// Tell the old process we are serving; it exits without touching the sockets
+void Server::finishResume()
+{
+	if (_resumeSocket == -1)
+	{
+		return;
+	}
+	char ack = '+';
+	while (send(_resumeSocket, &ack, 1, MSG_NOSIGNAL) == -1 && errno == EINTR)
+	{
+	}
+	close(_resumeSocket);
+	_resumeSocket = -1;
+
+	Client* requester = _upgradeRequester.empty() ? NULL : getClientByNickname(_upgradeRequester);
+	if (requester != NULL)
+	{
+		sendReply(*requester, ":" + _serverName + " NOTICE " + _upgradeRequester + " :Upgrade complete\r\n");
+	}
+	_upgradeRequester.clear();
+
+	// No event comes for this or the restored send queues
+	flushClients();
+}
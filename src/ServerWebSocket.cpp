@@ -0,0 +1,45 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Logger.hpp"
+#include "WebSocket.hpp"
+
+// WebSocket connections (see WebSocket.hpp). Frames are unwrapped before
+// the receive buffer, so everything from extractMessage() on is shared with
+// plain IRC clients; outgoing lines are framed by the Client as they are
+// queued. Works the same over a TLS listener.
+
+// Returns false once the connection is closing; lines received before a
+// close frame are still in the receive buffer to be run
+bool Server::receiveWebSocket(Client& client, const char* data, size_t length)
+{
+	if (client.shouldCloseAfterFlush())
+		return true;
+
+	WebSocketSession& webSocket = *client.getWebSocket();
+	bool wasOpen = webSocket.isOpen();
+	std::string lines;
+	std::string replies;
+	WebSocketStatus status = webSocket.receive(data, length, lines, replies);
+	client.appendRawToSendBuffer(replies);
+	if (!wasOpen && webSocket.isOpen())
+	{
+		LOG(LOG_INFO, LOG_NET, "WebSocket established: fd " << client.getFd()
+			<< (webSocket.isBinary() ? " (binary.ircv3.net)" : " (text)"));
+	}
+	client.appendToRecvBuffer(lines);
+	if (status == WS_CLOSE)
+	{
+		LOG(LOG_DEBUG, LOG_NET, "WebSocket closing: fd " << client.getFd());
+		return false;
+	}
+	return true;
+}
+
+// Send our close frame (none after a refused handshake) and hang up
+void Server::closeWebSocket(Client& client)
+{
+	if (client.shouldCloseAfterFlush())
+		return;
+	client.appendRawToSendBuffer(client.getWebSocket()->closeFrame());
+	client.setCloseAfterFlush(true);
+}
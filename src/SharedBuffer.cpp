@@ -0,0 +1,126 @@
+#include "SharedBuffer.hpp"
+
+static const std::string EMPTY_STRING;
+
+SharedBuffer::SharedBuffer()
+	: _block(NULL)
+{
+}
+
+SharedBuffer::SharedBuffer(const std::string& data)
+	: _block(newBlock())
+{
+	_block->data = data;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer& other)
+	: _block(other._block)
+{
+	if (_block != NULL)
+		__atomic_add_fetch(&_block->refs, 1, __ATOMIC_RELAXED);
+}
+
+SharedBuffer& SharedBuffer::operator=(const SharedBuffer& other)
+{
+	if (_block != other._block)
+	{
+		release();
+		_block = other._block;
+		if (_block != NULL)
+			__atomic_add_fetch(&_block->refs, 1, __ATOMIC_RELAXED);
+	}
+	return *this;
+}
+
+SharedBuffer::~SharedBuffer()
+{
+	release();
+}
+
+SharedBuffer::Block* SharedBuffer::newBlock()
+{
+	Block* block = new Block();
+	block->refs = 1;
+	for (size_t i = 0; i < SHARED_BUFFER_DERIVED; ++i)
+		block->derived[i] = NULL;
+	return block;
+}
+
+void SharedBuffer::releaseBlock(Block* block)
+{
+	// Whoever drops the last reference sees every other holder's reads done
+	if (block == NULL || __atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	for (size_t i = 0; i < SHARED_BUFFER_DERIVED; ++i)
+		releaseBlock(block->derived[i]);
+	delete block;
+}
+
+void SharedBuffer::release()
+{
+	releaseBlock(_block);
+	_block = NULL;
+}
+
+const char* SharedBuffer::data() const
+{
+	return _block != NULL ? _block->data.data() : "";
+}
+
+size_t SharedBuffer::size() const
+{
+	return _block != NULL ? _block->data.size() : 0;
+}
+
+bool SharedBuffer::empty() const
+{
+	return size() == 0;
+}
+
+const std::string& SharedBuffer::str() const
+{
+	return _block != NULL ? _block->data : EMPTY_STRING;
+}
+
+size_t SharedBuffer::getRefCount() const
+{
+	return _block != NULL ? __atomic_load_n(&_block->refs, __ATOMIC_ACQUIRE) : 0;
+}
+
+bool SharedBuffer::isShared() const
+{
+	return getRefCount() > 1;
+}
+
+void SharedBuffer::append(const std::string& data)
+{
+	if (_block == NULL)
+		_block = newBlock();
+	for (size_t i = 0; i < SHARED_BUFFER_DERIVED; ++i)
+	{
+		releaseBlock(_block->derived[i]);
+		_block->derived[i] = NULL;
+	}
+	_block->data += data;
+}
+
+SharedBuffer SharedBuffer::getDerived(size_t slot) const
+{
+	SharedBuffer derived;
+	if (_block != NULL && _block->derived[slot] != NULL)
+	{
+		derived._block = _block->derived[slot];
+		__atomic_add_fetch(&derived._block->refs, 1, __ATOMIC_RELAXED);
+	}
+	return derived;
+}
+
+void SharedBuffer::setDerived(size_t slot, const SharedBuffer& derived) const
+{
+	if (_block == NULL)
+		return;
+	if (derived._block != NULL)
+		__atomic_add_fetch(&derived._block->refs, 1, __ATOMIC_RELAXED);
+	releaseBlock(_block->derived[slot]);
+	_block->derived[slot] = derived._block;
+}
@@ -0,0 +1,285 @@
+#include "Snapshot.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+static const char SNAPSHOT_MAGIC[8] = { 'I', 'R', 'C', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+SavedChannel::SavedChannel()
+	: modes(0), userLimit(0), createdAt(0)
+{
+}
+
+// FNV-1a over the slot after its checksum field
+static uint32_t slotChecksum(const SnapshotSlot& slot)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&slot) + sizeof(slot.checksum);
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < sizeof(slot) - sizeof(slot.checksum); ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void copyField(char* dest, size_t size, const std::string& value)
+{
+	size_t length = value.length() < size - 1 ? value.length() : size - 1;
+	std::memcpy(dest, value.data(), length);
+	dest[length] = '\0';
+}
+
+static std::string readField(const char* field, size_t size)
+{
+	return std::string(field, strnlen(field, size));
+}
+
+ChannelSnapshot::ChannelSnapshot()
+	: _fd(-1), _map(NULL), _length(0), _slotCount(0), _restored(0), _interval(5), _running(false)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeup, NULL);
+}
+
+ChannelSnapshot::~ChannelSnapshot()
+{
+	close();
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+}
+
+SnapshotSlot* ChannelSnapshot::slot(size_t index) const
+{
+	return reinterpret_cast<SnapshotSlot*>(_map + sizeof(SnapshotHeader) + index * sizeof(SnapshotSlot));
+}
+
+bool ChannelSnapshot::open(const std::string& path, size_t slotCount, unsigned int interval, std::string& error)
+{
+	close();
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+	if (_fd == -1)
+	{
+		error = std::strerror(errno);
+		return false;
+	}
+
+	// Keep an existing file's slots (growing it if asked for more); start
+	// over if it is not a snapshot of this version
+	struct stat st;
+	SnapshotHeader header;
+	bool valid = fstat(_fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(header) &&
+		pread(_fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+		std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 &&
+		header.version == SNAPSHOT_VERSION && header.slotSize == sizeof(SnapshotSlot);
+	if (valid && header.slotCount > slotCount)
+	{
+		slotCount = header.slotCount;
+	}
+	_slotCount = slotCount;
+	_length = sizeof(SnapshotHeader) + _slotCount * sizeof(SnapshotSlot);
+	if ((!valid && ftruncate(_fd, 0) == -1) || ftruncate(_fd, _length) == -1)
+	{
+		error = std::string("ftruncate: ") + std::strerror(errno);
+		close();
+		return false;
+	}
+
+	// Prefault now so slot writes from the event loop never wait on a read
+	void* map = mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, 0);
+	if (map == MAP_FAILED)
+	{
+		error = std::string("mmap: ") + std::strerror(errno);
+		_map = NULL;
+		close();
+		return false;
+	}
+	_map = static_cast<char*>(map);
+
+	SnapshotHeader* mapped = reinterpret_cast<SnapshotHeader*>(_map);
+	std::memcpy(mapped->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	mapped->version = SNAPSHOT_VERSION;
+	mapped->slotSize = sizeof(SnapshotSlot);
+	mapped->slotCount = static_cast<uint32_t>(_slotCount);
+	mapped->reserved = 0;
+
+	_slots.clear();
+	_free.clear();
+	_restored = 0;
+	for (size_t i = _slotCount; i-- > 0;)
+	{
+		SnapshotSlot* current = slot(i);
+		if (current->used && current->checksum == slotChecksum(*current))
+		{
+			_slots[readField(current->name, sizeof(current->name))] = i;
+			_restored++;
+		}
+		else
+		{
+			current->used = 0;
+			_free.push_back(i);
+		}
+	}
+
+	_interval = interval;
+	_running = true;
+	if (pthread_create(&_thread, NULL, syncThread, this) != 0)
+	{
+		_running = false;
+		error = "failed to start the snapshot thread";
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ChannelSnapshot::close()
+{
+	if (_running)
+	{
+		pthread_mutex_lock(&_mutex);
+		_running = false;
+		pthread_cond_signal(&_wakeup);
+		pthread_mutex_unlock(&_mutex);
+		pthread_join(_thread, NULL);
+	}
+	if (_map != NULL)
+	{
+		msync(_map, _length, MS_SYNC);
+		munmap(_map, _length);
+		_map = NULL;
+	}
+	if (_fd != -1)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+	_slots.clear();
+	_free.clear();
+}
+
+bool ChannelSnapshot::isOpen() const
+{
+	return _map != NULL;
+}
+
+size_t ChannelSnapshot::getRestoredCount() const
+{
+	return _restored;
+}
+
+size_t ChannelSnapshot::getSlotCount() const
+{
+	return _slotCount;
+}
+
+size_t ChannelSnapshot::getUsedCount() const
+{
+	return _slots.size();
+}
+
+void* ChannelSnapshot::syncThread(void* arg)
+{
+	static_cast<ChannelSnapshot*>(arg)->syncLoop();
+	return NULL;
+}
+
+// The only place that waits for the disk
+void ChannelSnapshot::syncLoop()
+{
+	pthread_mutex_lock(&_mutex);
+	while (_running)
+	{
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		struct timespec deadline;
+		deadline.tv_sec = now.tv_sec + _interval;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&_wakeup, &_mutex, &deadline);
+		if (!_running)
+			break;
+
+		pthread_mutex_unlock(&_mutex);
+		msync(_map, _length, MS_SYNC);
+		pthread_mutex_lock(&_mutex);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool ChannelSnapshot::load(const std::string& key, SavedChannel& channel) const
+{
+	std::map<std::string, size_t>::const_iterator it = _slots.find(key);
+	if (it == _slots.end())
+	{
+		return false;
+	}
+	const SnapshotSlot* current = slot(it->second);
+	channel.name = readField(current->name, sizeof(current->name));
+	channel.topic = readField(current->topic, sizeof(current->topic));
+	channel.key = readField(current->key, sizeof(current->key));
+	channel.modes = current->modes;
+	channel.userLimit = current->userLimit;
+	channel.createdAt = static_cast<time_t>(current->createdAt);
+	channel.invites.clear();
+	for (uint32_t i = 0; i < current->inviteCount && i < SNAPSHOT_MAX_INVITES; ++i)
+	{
+		channel.invites.push_back(readField(current->invites[i], SNAPSHOT_NICK_SIZE));
+	}
+	return true;
+}
+
+// Built on the stack and copied in whole; the checksum covers the window in
+// which the sync thread could catch the slot half-written
+bool ChannelSnapshot::store(const std::string& key, const SavedChannel& channel)
+{
+	size_t index;
+	std::map<std::string, size_t>::iterator it = _slots.find(key);
+	if (it != _slots.end())
+	{
+		index = it->second;
+	}
+	else if (!_free.empty())
+	{
+		index = _free.back();
+		_free.pop_back();
+		_slots[key] = index;
+	}
+	else
+	{
+		return false;
+	}
+
+	SnapshotSlot content;
+	std::memset(&content, 0, sizeof(content));
+	content.used = 1;
+	content.createdAt = channel.createdAt;
+	content.modes = channel.modes;
+	content.userLimit = channel.userLimit;
+	copyField(content.name, sizeof(content.name), key);
+	copyField(content.key, sizeof(content.key), channel.key);
+	copyField(content.topic, sizeof(content.topic), channel.topic);
+	for (size_t i = 0; i < channel.invites.size() && content.inviteCount < SNAPSHOT_MAX_INVITES; ++i)
+	{
+		copyField(content.invites[content.inviteCount++], SNAPSHOT_NICK_SIZE, channel.invites[i]);
+	}
+	content.checksum = slotChecksum(content);
+	std::memcpy(slot(index), &content, sizeof(content));
+	return true;
+}
+
+void ChannelSnapshot::erase(const std::string& key)
+{
+	std::map<std::string, size_t>::iterator it = _slots.find(key);
+	if (it == _slots.end())
+	{
+		return;
+	}
+	slot(it->second)->used = 0;
+	_free.push_back(it->second);
+	_slots.erase(it);
+}
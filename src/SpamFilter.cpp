@@ -0,0 +1,335 @@
+#include "SpamFilter.hpp"
+#include "Logger.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+
+FilterRule::FilterRule()
+	: action(FILTER_DROP), foldCase(false), setAt(0)
+{
+}
+
+static unsigned char foldByte(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+FilterAutomaton::FilterAutomaton(const std::vector<FilterRule>& rules)
+	: _rules(rules), _classCount(1)
+{
+	build();
+}
+
+FilterAutomaton::~FilterAutomaton()
+{
+}
+
+// The automaton runs on folded bytes; a match for a case-sensitive rule
+// is confirmed against the original text afterwards
+void FilterAutomaton::build()
+{
+	// Class 0 is every byte no pattern uses
+	unsigned char folded[256];
+	std::memset(folded, 0, sizeof(folded));
+	for (size_t r = 0; r < _rules.size(); ++r)
+	{
+		const std::string& pattern = _rules[r].pattern;
+		for (size_t i = 0; i < pattern.length(); ++i)
+		{
+			unsigned char c = foldByte(pattern[i]);
+			if (folded[c] == 0)
+				folded[c] = _classCount++;
+		}
+	}
+	for (size_t b = 0; b < 256; ++b)
+	{
+		_classes[b] = folded[foldByte(b)];
+	}
+
+	// Trie of the patterns
+	_next.assign(_classCount, -1);
+	_firstRule.assign(1, -1);
+	_nextRule.assign(_rules.size(), -1);
+	for (size_t r = 0; r < _rules.size(); ++r)
+	{
+		const std::string& pattern = _rules[r].pattern;
+		size_t state = 0;
+		for (size_t i = 0; i < pattern.length(); ++i)
+		{
+			size_t slot = state * _classCount + _classes[static_cast<unsigned char>(pattern[i])];
+			if (_next[slot] == -1)
+			{
+				_next[slot] = static_cast<int32_t>(_firstRule.size());
+				_firstRule.push_back(-1);
+				_next.resize(_next.size() + _classCount, -1);
+			}
+			state = _next[slot];
+		}
+		_nextRule[r] = _firstRule[state];
+		_firstRule[state] = static_cast<int32_t>(r);
+	}
+
+	// Failure links breadth first, folded straight into the transitions so
+	// the scan never backtracks
+	std::vector<int32_t> fail(_firstRule.size(), 0);
+	_outputLink.assign(_firstRule.size(), -1);
+	std::deque<int32_t> queue;
+	for (size_t c = 0; c < _classCount; ++c)
+	{
+		if (_next[c] == -1)
+			_next[c] = 0;
+		else
+			queue.push_back(_next[c]);
+	}
+	while (!queue.empty())
+	{
+		int32_t state = queue.front();
+		queue.pop_front();
+		for (size_t c = 0; c < _classCount; ++c)
+		{
+			int32_t& target = _next[state * _classCount + c];
+			int32_t fallback = _next[fail[state] * _classCount + c];
+			if (target == -1)
+			{
+				target = fallback;
+				continue;
+			}
+			fail[target] = fallback;
+			_outputLink[target] = _firstRule[fallback] != -1 ? fallback : _outputLink[fallback];
+			queue.push_back(target);
+		}
+	}
+}
+
+bool FilterAutomaton::ruleMatches(size_t rule, const std::string& text, size_t end) const
+{
+	const FilterRule& candidate = _rules[rule];
+	return candidate.foldCase || text.compare(end - candidate.pattern.length(), candidate.pattern.length(),
+		candidate.pattern) == 0;
+}
+
+const FilterRule* FilterAutomaton::scan(const std::string& text) const
+{
+	const FilterRule* worst = NULL;
+	int32_t state = 0;
+	for (size_t i = 0; i < text.length(); ++i)
+	{
+		state = _next[state * _classCount + _classes[static_cast<unsigned char>(text[i])]];
+		for (int32_t s = _firstRule[state] != -1 ? state : _outputLink[state]; s != -1; s = _outputLink[s])
+		{
+			for (int32_t r = _firstRule[s]; r != -1; r = _nextRule[r])
+			{
+				if ((worst == NULL || _rules[r].action > worst->action) && ruleMatches(r, text, i + 1))
+				{
+					worst = &_rules[r];
+					if (worst->action == FILTER_KILL)
+						return worst;
+				}
+			}
+		}
+	}
+	return worst;
+}
+
+size_t FilterAutomaton::getStateCount() const
+{
+	return _firstRule.size();
+}
+
+SpamFilter::SpamFilter()
+	: _active(NULL), _requested(false), _built(NULL), _running(false), _started(false), _eventFd(-1)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeup, NULL);
+}
+
+SpamFilter::~SpamFilter()
+{
+	stop();
+	delete _active;
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+}
+
+bool SpamFilter::start(std::string& error)
+{
+	_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_eventFd == -1)
+	{
+		error = std::string("eventfd: ") + std::strerror(errno);
+		return false;
+	}
+	_running = true;
+	if (pthread_create(&_thread, NULL, builderThread, this) != 0)
+	{
+		error = "failed to start the filter builder thread";
+		stop();
+		return false;
+	}
+	_started = true;
+	return true;
+}
+
+void SpamFilter::stop()
+{
+	pthread_mutex_lock(&_mutex);
+	_running = false;
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	if (_started)
+	{
+		pthread_join(_thread, NULL);
+		_started = false;
+	}
+	delete _built;
+	_built = NULL;
+	if (_eventFd != -1)
+	{
+		close(_eventFd);
+		_eventFd = -1;
+	}
+}
+
+int SpamFilter::getEventFd() const
+{
+	return _eventFd;
+}
+
+void* SpamFilter::builderThread(void* arg)
+{
+	static_cast<SpamFilter*>(arg)->builderLoop();
+	return NULL;
+}
+
+// Compile the latest list; edits made meanwhile are picked up next round
+void SpamFilter::builderLoop()
+{
+	pthread_mutex_lock(&_mutex);
+	while (true)
+	{
+		while (_running && !_requested)
+			pthread_cond_wait(&_wakeup, &_mutex);
+		if (!_running)
+			break;
+		std::vector<FilterRule> rules;
+		rules.swap(_pending);
+		_requested = false;
+		pthread_mutex_unlock(&_mutex);
+
+		FilterAutomaton* automaton = new FilterAutomaton(rules);
+
+		pthread_mutex_lock(&_mutex);
+		delete _built;
+		_built = automaton;
+		uint64_t one = 1;
+		if (write(_eventFd, &one, sizeof(one)) == -1)
+		{
+			// Already signalled, the counter is not drained yet
+		}
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void SpamFilter::install()
+{
+	uint64_t count;
+	if (read(_eventFd, &count, sizeof(count)) == -1)
+	{
+		// Nothing signalled
+	}
+	pthread_mutex_lock(&_mutex);
+	FilterAutomaton* automaton = _built;
+	_built = NULL;
+	pthread_mutex_unlock(&_mutex);
+	if (automaton == NULL)
+		return;
+
+	delete _active;
+	_active = automaton;
+	LOG(LOG_INFO, LOG_SERVER, "Spam filter: " << _rules.size() << " rule(s), " << automaton->getStateCount()
+		<< " state(s)");
+}
+
+void SpamFilter::rebuild()
+{
+	pthread_mutex_lock(&_mutex);
+	_pending = _rules;
+	_requested = true;
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool SpamFilter::add(const FilterRule& rule)
+{
+	for (size_t i = 0; i < _rules.size(); ++i)
+	{
+		if (_rules[i].pattern == rule.pattern)
+		{
+			_rules[i] = rule;
+			rebuild();
+			return true;
+		}
+	}
+	if (_rules.size() >= FILTER_MAX_RULES)
+		return false;
+	_rules.push_back(rule);
+	rebuild();
+	return true;
+}
+
+bool SpamFilter::remove(const std::string& pattern)
+{
+	for (size_t i = 0; i < _rules.size(); ++i)
+	{
+		if (_rules[i].pattern == pattern)
+		{
+			_rules.erase(_rules.begin() + i);
+			rebuild();
+			return true;
+		}
+	}
+	return false;
+}
+
+void SpamFilter::clear()
+{
+	_rules.clear();
+	rebuild();
+}
+
+const std::vector<FilterRule>& SpamFilter::getRules() const
+{
+	return _rules;
+}
+
+// Until a rebuild is installed, the previous list applies
+const FilterRule* SpamFilter::check(const std::string& text) const
+{
+	if (_active == NULL)
+		return NULL;
+	return _active->scan(text);
+}
+
+bool SpamFilter::parseAction(const std::string& name, FilterAction& action)
+{
+	if (name == "notice")
+		action = FILTER_NOTICE;
+	else if (name == "drop")
+		action = FILTER_DROP;
+	else if (name == "kill")
+		action = FILTER_KILL;
+	else
+		return false;
+	return true;
+}
+
+const char* SpamFilter::actionName(FilterAction action)
+{
+	if (action == FILTER_NOTICE)
+		return "notice";
+	if (action == FILTER_KILL)
+		return "kill";
+	return "drop";
+}
@@ -0,0 +1,168 @@
+#include "Tls.hpp"
+#include <openssl/err.h>
+#include <cerrno>
+#include <cstring>
+
+static const unsigned char TLS_SESSION_CONTEXT[] = "ircserv";
+
+TlsContext::TlsContext()
+	: _ctx(NULL)
+{
+}
+
+TlsContext::~TlsContext()
+{
+	if (_ctx != NULL)
+		SSL_CTX_free(_ctx);
+}
+
+bool TlsContext::init(const std::string& certFile, const std::string& keyFile, bool ktls, std::string& error)
+{
+	ERR_clear_error();
+	SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+	if (ctx == NULL)
+	{
+		error = tlsError();
+		return false;
+	}
+	if (SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1
+		|| SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+		|| SSL_CTX_check_private_key(ctx) != 1)
+	{
+		error = tlsError();
+		SSL_CTX_free(ctx);
+		return false;
+	}
+
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	// A peer that just closes the socket is a normal disconnect here
+	SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF);
+	if (ktls)
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+	// Send queues hand over as much as is queued, from wherever it now sits;
+	// idle connections give their record buffers back
+	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+		| SSL_MODE_RELEASE_BUFFERS);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(ctx, TLS_SESSION_CONTEXT, sizeof(TLS_SESSION_CONTEXT) - 1);
+
+	if (_ctx != NULL)
+		SSL_CTX_free(_ctx);
+	_ctx = ctx;
+	return true;
+}
+
+bool TlsContext::isReady() const
+{
+	return _ctx != NULL;
+}
+
+SSL* TlsContext::createSession(int fd) const
+{
+	SSL* ssl = SSL_new(_ctx);
+	if (ssl == NULL)
+		return NULL;
+	if (SSL_set_fd(ssl, fd) != 1)
+	{
+		SSL_free(ssl);
+		return NULL;
+	}
+	SSL_set_accept_state(ssl);
+	return ssl;
+}
+
+TlsSession::TlsSession(SSL* ssl)
+	: _ssl(ssl), _established(false), _kernelSend(false), _failed(false)
+{
+}
+
+TlsSession::~TlsSession()
+{
+	SSL_free(_ssl);
+}
+
+TlsStatus TlsSession::status(int result)
+{
+	switch (SSL_get_error(_ssl, result))
+	{
+		case SSL_ERROR_NONE:
+			return TLS_OK;
+		case SSL_ERROR_WANT_READ:
+			return TLS_WANT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			return TLS_WANT_WRITE;
+		case SSL_ERROR_ZERO_RETURN:
+			return TLS_CLOSED;
+		default:
+			_failed = true;
+			return TLS_ERROR;
+	}
+}
+
+TlsStatus TlsSession::handshake()
+{
+	ERR_clear_error();
+	int result = SSL_do_handshake(_ssl);
+	if (result != 1)
+		return status(result);
+	_established = true;
+	_kernelSend = BIO_get_ktls_send(SSL_get_wbio(_ssl));
+	return TLS_OK;
+}
+
+TlsStatus TlsSession::read(char* buffer, size_t size, size_t& received)
+{
+	ERR_clear_error();
+	received = 0;
+	int result = SSL_read_ex(_ssl, buffer, size, &received);
+	return result == 1 ? TLS_OK : status(result);
+}
+
+TlsStatus TlsSession::write(const char* data, size_t size, size_t& sent)
+{
+	ERR_clear_error();
+	sent = 0;
+	int result = SSL_write_ex(_ssl, data, size, &sent);
+	return result == 1 ? TLS_OK : status(result);
+}
+
+void TlsSession::shutdown()
+{
+	if (_established && !_failed)
+	{
+		ERR_clear_error();
+		SSL_shutdown(_ssl);
+	}
+}
+
+bool TlsSession::isEstablished() const
+{
+	return _established;
+}
+
+bool TlsSession::isKernelSend() const
+{
+	return _kernelSend;
+}
+
+std::string TlsSession::describe() const
+{
+	std::string text = std::string(SSL_get_version(_ssl)) + " " + SSL_get_cipher_name(_ssl);
+	if (SSL_session_reused(_ssl))
+		text += ", resumed";
+	if (_kernelSend)
+		text += ", kTLS send";
+	if (BIO_get_ktls_recv(SSL_get_rbio(_ssl)))
+		text += ", kTLS receive";
+	return text;
+}
+
+std::string tlsError()
+{
+	unsigned long code = ERR_get_error();
+	if (code == 0)
+		return errno != 0 ? std::strerror(errno) : "unknown error";
+	char text[256];
+	ERR_error_string_n(code, text, sizeof(text));
+	return text;
+}
@@ -0,0 +1,189 @@
+#include "Tracer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+
+bool Tracer::_enabled = false;
+
+// Per-thread buffer, created on the first span a thread records
+static __thread Tracer::ThreadBuffer* t_buffer = NULL;
+
+Tracer::Tracer()
+	: _nextTid(1), _loopThread(), _hasLoopThread(false), _calibrationTicks(0), _calibrationNs(0)
+{
+	pthread_mutex_init(&_buffersMutex, NULL);
+}
+
+Tracer::~Tracer()
+{
+	_enabled = false;
+	for (size_t i = 0; i < _buffers.size(); ++i)
+	{
+		delete _buffers[i];
+	}
+	pthread_mutex_destroy(&_buffersMutex);
+}
+
+Tracer& Tracer::instance()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+unsigned long long Tracer::monotonicNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void Tracer::enable()
+{
+	if (_calibrationNs == 0)
+	{
+		_calibrationTicks = ticks();
+		_calibrationNs = monotonicNs();
+	}
+	_enabled = true;
+}
+
+void Tracer::disable()
+{
+	_enabled = false;
+}
+
+void Tracer::setLoopThread()
+{
+	_loopThread = pthread_self();
+	_hasLoopThread = true;
+}
+
+Tracer::ThreadBuffer* Tracer::registerThread()
+{
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->thread = pthread_self();
+	buffer->head = 0;
+	pthread_mutex_lock(&_buffersMutex);
+	buffer->tid = _nextTid++;
+	_buffers.push_back(buffer);
+	pthread_mutex_unlock(&_buffersMutex);
+	return buffer;
+}
+
+void Tracer::record(const char* name, const char* detail, unsigned long long startTicks, unsigned long long endTicks)
+{
+	if (t_buffer == NULL)
+	{
+		t_buffer = registerThread();
+	}
+
+	Span& span = t_buffer->spans[t_buffer->head & (SPANS_PER_THREAD - 1)];
+	span.name = name;
+	span.startTicks = startTicks;
+	span.endTicks = endTicks;
+	if (detail != NULL)
+	{
+		std::strncpy(span.detail, detail, DETAIL_LENGTH - 1);
+		span.detail[DETAIL_LENGTH - 1] = '\0';
+	}
+	else
+	{
+		span.detail[0] = '\0';
+	}
+	__atomic_store_n(&t_buffer->head, t_buffer->head + 1, __ATOMIC_RELEASE);
+}
+
+// TSC frequency measured against the monotonic clock since enable()
+double Tracer::ticksPerMicrosecond() const
+{
+	unsigned long long elapsedNs = monotonicNs() - _calibrationNs;
+	unsigned long long elapsedTicks = ticks() - _calibrationTicks;
+	if (elapsedNs == 0)
+		return 1000.0;
+	return static_cast<double>(elapsedTicks) * 1000.0 / elapsedNs;
+}
+
+static void writeJsonString(FILE* out, const char* text)
+{
+	std::fputc('"', out);
+	for (const char* p = text; *p != '\0'; ++p)
+	{
+		unsigned char c = static_cast<unsigned char>(*p);
+		if (c == '"' || c == '\\')
+			std::fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			std::fprintf(out, "\\u%04x", c);
+		else
+			std::fputc(c, out);
+	}
+	std::fputc('"', out);
+}
+
+// Write every buffered span as a Chrome trace "complete" event. Spans from
+// other threads are read while they may still be writing; the few slots
+// being overwritten during the dump can come out torn.
+bool Tracer::dump(const std::string& path, std::string& error)
+{
+	if (_calibrationNs == 0)
+	{
+		error = "tracing was never enabled";
+		return false;
+	}
+
+	FILE* out = std::fopen(path.c_str(), "w");
+	if (out == NULL)
+	{
+		error = std::strerror(errno);
+		return false;
+	}
+
+	double perUs = ticksPerMicrosecond();
+	int pid = static_cast<int>(getpid());
+
+	pthread_mutex_lock(&_buffersMutex);
+	std::vector<ThreadBuffer*> buffers = _buffers;
+	pthread_mutex_unlock(&_buffersMutex);
+
+	std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t b = 0; b < buffers.size(); ++b)
+	{
+		ThreadBuffer* buffer = buffers[b];
+		size_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+		size_t begin = head > SPANS_PER_THREAD ? head - SPANS_PER_THREAD : 0;
+		bool loop = _hasLoopThread && pthread_equal(buffer->thread, _loopThread);
+
+		std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", pid, buffer->tid, loop ? "event-loop" : "worker");
+		first = false;
+
+		for (size_t i = begin; i < head; ++i)
+		{
+			const Span& span = buffer->spans[i & (SPANS_PER_THREAD - 1)];
+			if (span.endTicks < span.startTicks || span.startTicks < _calibrationTicks)
+				continue;
+			double ts = (span.startTicks - _calibrationTicks) / perUs;
+			double dur = (span.endTicks - span.startTicks) / perUs;
+			std::fprintf(out, ",\n{\"name\":");
+			writeJsonString(out, span.name);
+			std::fprintf(out, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", pid, buffer->tid, ts, dur);
+			if (span.detail[0] != '\0')
+			{
+				std::fprintf(out, ",\"args\":{\"detail\":");
+				writeJsonString(out, span.detail);
+				std::fprintf(out, "}");
+			}
+			std::fprintf(out, "}");
+		}
+	}
+	std::fprintf(out, "\n]}\n");
+
+	if (std::fclose(out) != 0)
+	{
+		error = std::strerror(errno);
+		return false;
+	}
+	return true;
+}
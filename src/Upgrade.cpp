@@ -0,0 +1,289 @@
+#include "Upgrade.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+static const char UPGRADE_MAGIC[6] = { 'I', 'R', 'C', 'U', 'P', 'G' };
+static const unsigned char UPGRADE_VERSION = 7;
+static const size_t UPGRADE_HEADER_SIZE = 8 + 2 * sizeof(unsigned long long);
+static const unsigned long long UPGRADE_MAX_STATE = 1ULL << 32;
+static const size_t UPGRADE_FDS_PER_MESSAGE = 200; // SCM_MAX_FD is 253
+
+static bool writeAll(int socket, const char* data, size_t length, std::string& error)
+{
+	while (length > 0)
+	{
+		ssize_t n = ::send(socket, data, length, MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			error = std::strerror(errno);
+			return false;
+		}
+		data += n;
+		length -= n;
+	}
+	return true;
+}
+
+static bool readAll(int socket, char* data, size_t length, std::string& error)
+{
+	while (length > 0)
+	{
+		ssize_t n = recv(socket, data, length, 0);
+		if (n == 0)
+		{
+			error = "handover socket closed early";
+			return false;
+		}
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			error = std::strerror(errno);
+			return false;
+		}
+		data += n;
+		length -= n;
+	}
+	return true;
+}
+
+UpgradeWriter::UpgradeWriter()
+{
+}
+
+UpgradeWriter::~UpgradeWriter()
+{
+}
+
+void UpgradeWriter::putNumber(unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		_data += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	_data += static_cast<char>(value);
+}
+
+// Zigzag, so small negative values (remote user fds) stay short
+void UpgradeWriter::putSigned(long long value)
+{
+	putNumber((static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+}
+
+void UpgradeWriter::putString(const std::string& value)
+{
+	putNumber(value.length());
+	_data += value;
+}
+
+void UpgradeWriter::putFd(int fd)
+{
+	putNumber(_fds.size());
+	_fds.push_back(fd);
+}
+
+size_t UpgradeWriter::getFdCount() const
+{
+	return _fds.size();
+}
+
+bool UpgradeWriter::send(int socket, std::string& error) const
+{
+	char header[UPGRADE_HEADER_SIZE];
+	unsigned long long length = _data.length();
+	unsigned long long count = _fds.size();
+	std::memcpy(header, UPGRADE_MAGIC, sizeof(UPGRADE_MAGIC));
+	header[6] = static_cast<char>(UPGRADE_VERSION);
+	header[7] = 0;
+	std::memcpy(header + 8, &length, sizeof(length));
+	std::memcpy(header + 8 + sizeof(length), &count, sizeof(count));
+	if (!writeAll(socket, header, sizeof(header), error) || !writeAll(socket, _data.data(), _data.length(), error))
+	{
+		return false;
+	}
+
+	// One marker byte per message carries the descriptors
+	for (size_t sent = 0; sent < _fds.size(); sent += UPGRADE_FDS_PER_MESSAGE)
+	{
+		size_t n = _fds.size() - sent;
+		if (n > UPGRADE_FDS_PER_MESSAGE)
+			n = UPGRADE_FDS_PER_MESSAGE;
+
+		std::vector<char> control(CMSG_SPACE(n * sizeof(int)), 0);
+		char marker = 'F';
+		struct iovec iov;
+		iov.iov_base = &marker;
+		iov.iov_len = 1;
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(n * sizeof(int));
+		std::memcpy(CMSG_DATA(cmsg), &_fds[sent], n * sizeof(int));
+
+		while (sendmsg(socket, &msg, MSG_NOSIGNAL) == -1)
+		{
+			if (errno != EINTR)
+			{
+				error = std::string("sendmsg: ") + std::strerror(errno);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+UpgradeReader::UpgradeReader()
+	: _pos(0), _failed(false)
+{
+}
+
+UpgradeReader::~UpgradeReader()
+{
+	for (size_t i = 0; i < _fds.size(); ++i)
+	{
+		if (!_taken[i])
+			close(_fds[i]);
+	}
+}
+
+bool UpgradeReader::receive(int socket, std::string& error)
+{
+	char header[UPGRADE_HEADER_SIZE];
+	if (!readAll(socket, header, sizeof(header), error))
+	{
+		return false;
+	}
+	if (std::memcmp(header, UPGRADE_MAGIC, sizeof(UPGRADE_MAGIC)) != 0 ||
+		static_cast<unsigned char>(header[6]) != UPGRADE_VERSION)
+	{
+		error = "not an ircserv handover (or a different version)";
+		return false;
+	}
+	unsigned long long length;
+	unsigned long long count;
+	std::memcpy(&length, header + 8, sizeof(length));
+	std::memcpy(&count, header + 8 + sizeof(length), sizeof(count));
+	if (length > UPGRADE_MAX_STATE)
+	{
+		error = "handover state too large";
+		return false;
+	}
+
+	_data.resize(length);
+	if (length > 0 && !readAll(socket, &_data[0], length, error))
+	{
+		return false;
+	}
+
+	while (_fds.size() < count)
+	{
+		std::vector<char> control(CMSG_SPACE(UPGRADE_FDS_PER_MESSAGE * sizeof(int)), 0);
+		char marker;
+		struct iovec iov;
+		iov.iov_base = &marker;
+		iov.iov_len = 1;
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+
+		ssize_t n = recvmsg(socket, &msg, 0);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			error = n == 0 ? "handover socket closed early" : std::string("recvmsg: ") + std::strerror(errno);
+			return false;
+		}
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+			size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (size_t i = 0; i < received; ++i)
+			{
+				int fd;
+				std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+				_fds.push_back(fd);
+				_taken.push_back(false);
+			}
+		}
+		if (msg.msg_flags & MSG_CTRUNC)
+		{
+			error = "descriptors truncated (RLIMIT_NOFILE too low?)";
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned long long UpgradeReader::getNumber()
+{
+	unsigned long long value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (_pos >= _data.length())
+			break;
+		unsigned char byte = static_cast<unsigned char>(_data[_pos++]);
+		value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+	_failed = true;
+	return 0;
+}
+
+long long UpgradeReader::getSigned()
+{
+	unsigned long long value = getNumber();
+	return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
+
+std::string UpgradeReader::getString()
+{
+	unsigned long long length = getNumber();
+	if (_failed || length > _data.length() - _pos)
+	{
+		_failed = true;
+		return "";
+	}
+	std::string value = _data.substr(_pos, length);
+	_pos += length;
+	return value;
+}
+
+int UpgradeReader::getFd()
+{
+	unsigned long long index = getNumber();
+	if (_failed || index >= _fds.size() || _taken[index])
+	{
+		_failed = true;
+		return -1;
+	}
+	_taken[index] = true;
+	return _fds[index];
+}
+
+bool UpgradeReader::failed() const
+{
+	return _failed;
+}
+
+bool UpgradeReader::atEnd() const
+{
+	return _pos == _data.length();
+}
@@ -0,0 +1,509 @@
+#include "WebSocket.hpp"
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <map>
+#include <vector>
+#include <cctype>
+#include <cstring>
+
+// Appended to Sec-WebSocket-Key before hashing (RFC 6455 section 1.3)
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Close status codes
+static const unsigned short WS_CLOSE_NORMAL = 1000;
+static const unsigned short WS_CLOSE_PROTOCOL_ERROR = 1002;
+static const unsigned short WS_CLOSE_INVALID_DATA = 1007;
+static const unsigned short WS_CLOSE_TOO_BIG = 1009;
+
+// Largest control frame payload
+static const size_t WS_CONTROL_MAX = 125;
+
+static std::string toLower(const std::string& text)
+{
+	std::string lower = text;
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = std::tolower(static_cast<unsigned char>(lower[i]));
+	return lower;
+}
+
+static std::string trim(const std::string& text)
+{
+	std::string::size_type start = text.find_first_not_of(" \t");
+	if (start == std::string::npos)
+		return std::string();
+	return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+// Split a comma-separated header value into trimmed tokens
+static std::vector<std::string> splitList(const std::string& value)
+{
+	std::vector<std::string> tokens;
+	std::string::size_type start = 0;
+	while (start <= value.size())
+	{
+		std::string::size_type comma = value.find(',', start);
+		if (comma == std::string::npos)
+			comma = value.size();
+		std::string token = trim(value.substr(start, comma - start));
+		if (!token.empty())
+			tokens.push_back(token);
+		start = comma + 1;
+	}
+	return tokens;
+}
+
+static bool hasToken(const std::string& value, const std::string& token)
+{
+	std::vector<std::string> tokens = splitList(toLower(value));
+	for (size_t i = 0; i < tokens.size(); ++i)
+	{
+		if (tokens[i] == token)
+			return true;
+	}
+	return false;
+}
+
+static std::string acceptKey(const std::string& key)
+{
+	std::string text = key + WEBSOCKET_GUID;
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	SHA1(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+	unsigned char encoded[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+	int length = EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+	return std::string(reinterpret_cast<const char*>(encoded), length);
+}
+
+static std::string httpError(const std::string& status, const std::string& headers)
+{
+	return "HTTP/1.1 " + status + "\r\n" + headers + "Content-Length: 0\r\nConnection: close\r\n\r\n";
+}
+
+// Length of the well-formed UTF-8 sequence at data, 0 if there is none
+static size_t utf8Sequence(const unsigned char* data, size_t size)
+{
+	unsigned char lead = data[0];
+	if (lead < 0x80)
+		return 1;
+	size_t length;
+	unsigned int code;
+	unsigned int minimum;
+	if ((lead & 0xE0) == 0xC0)
+	{
+		length = 2;
+		code = lead & 0x1F;
+		minimum = 0x80;
+	}
+	else if ((lead & 0xF0) == 0xE0)
+	{
+		length = 3;
+		code = lead & 0x0F;
+		minimum = 0x800;
+	}
+	else if ((lead & 0xF8) == 0xF0)
+	{
+		length = 4;
+		code = lead & 0x07;
+		minimum = 0x10000;
+	}
+	else
+		return 0;
+	if (size < length)
+		return 0;
+	for (size_t i = 1; i < length; ++i)
+	{
+		if ((data[i] & 0xC0) != 0x80)
+			return 0;
+		code = (code << 6) | (data[i] & 0x3F);
+	}
+	// No overlong forms, surrogates or code points past U+10FFFF
+	if (code < minimum || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+		return 0;
+	return length;
+}
+
+static bool isValidUtf8(const char* data, size_t size)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t length = utf8Sequence(bytes + i, size - i);
+		if (length == 0)
+			return false;
+		i += length;
+	}
+	return true;
+}
+
+// Text frames must be UTF-8; IRC lines need not be, so anything else is
+// replaced with U+FFFD
+static std::string toValidUtf8(const char* data, size_t size)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	std::string text;
+	text.reserve(size + 8);
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t length = utf8Sequence(bytes + i, size - i);
+		if (length == 0)
+		{
+			text += "\xEF\xBF\xBD";
+			i++;
+			continue;
+		}
+		text.append(data + i, length);
+		i += length;
+	}
+	return text;
+}
+
+static void appendFrame(std::string& out, WebSocketOpcode opcode, const char* payload, size_t size)
+{
+	out += static_cast<char>(0x80 | opcode);
+	if (size < 126)
+		out += static_cast<char>(size);
+	else if (size <= 0xFFFF)
+	{
+		out += static_cast<char>(126);
+		out += static_cast<char>(size >> 8);
+		out += static_cast<char>(size & 0xFF);
+	}
+	else
+	{
+		out += static_cast<char>(127);
+		for (int shift = 56; shift >= 0; shift -= 8)
+			out += static_cast<char>((static_cast<unsigned long long>(size) >> shift) & 0xFF);
+	}
+	out.append(payload, size);
+}
+
+std::string webSocketFrame(WebSocketOpcode opcode, const char* payload, size_t size)
+{
+	std::string frame;
+	frame.reserve(size + 10);
+	appendFrame(frame, opcode, payload, size);
+	return frame;
+}
+
+WebSocketSession::WebSocketSession()
+	: _open(false), _binary(false), _messageOpcode(WS_CONTINUATION), _closeCode(WS_CLOSE_NORMAL)
+{
+}
+
+WebSocketSession::~WebSocketSession()
+{
+}
+
+// The HTTP Upgrade request; a refused one is answered with an HTTP error
+// and nothing else
+WebSocketStatus WebSocketSession::handshake(std::string& replies)
+{
+	std::string::size_type headerEnd = _input.find("\r\n\r\n");
+	if (headerEnd == std::string::npos)
+	{
+		if (_input.size() > WEBSOCKET_MAX_REQUEST)
+		{
+			replies += httpError("431 Request Header Fields Too Large", "");
+			return WS_CLOSE;
+		}
+		return WS_OK;
+	}
+	std::string request = _input.substr(0, headerEnd + 2);
+	_input.erase(0, headerEnd + 4);
+
+	// Header names are case-insensitive; repeated headers form one list
+	std::string::size_type lineEnd = request.find("\r\n");
+	std::string requestLine = request.substr(0, lineEnd);
+	std::map<std::string, std::string> headers;
+	for (std::string::size_type start = lineEnd + 2; start < request.size(); start = lineEnd + 2)
+	{
+		lineEnd = request.find("\r\n", start);
+		std::string line = request.substr(start, lineEnd - start);
+		std::string::size_type colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string& value = headers[toLower(trim(line.substr(0, colon)))];
+		if (!value.empty())
+			value += ", ";
+		value += trim(line.substr(colon + 1));
+	}
+
+	if (requestLine.compare(0, 4, "GET ") != 0)
+	{
+		replies += httpError("405 Method Not Allowed", "Allow: GET\r\n");
+		return WS_CLOSE;
+	}
+	std::string key = headers["sec-websocket-key"];
+	if (!hasToken(headers["upgrade"], "websocket") || !hasToken(headers["connection"], "upgrade") || key.size() != 24)
+	{
+		replies += httpError("400 Bad Request", "");
+		return WS_CLOSE;
+	}
+	if (headers["sec-websocket-version"] != "13")
+	{
+		replies += httpError("426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+		return WS_CLOSE;
+	}
+
+	// The first IRCv3 subprotocol the client offers; text without one
+	std::string protocol;
+	std::vector<std::string> offered = splitList(headers["sec-websocket-protocol"]);
+	for (size_t i = 0; i < offered.size() && protocol.empty(); ++i)
+	{
+		if (offered[i] == "text.ircv3.net" || offered[i] == "binary.ircv3.net")
+			protocol = offered[i];
+	}
+	_binary = protocol == "binary.ircv3.net";
+	_open = true;
+
+	replies += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n";
+	if (!protocol.empty())
+		replies += "Sec-WebSocket-Protocol: " + protocol + "\r\n";
+	replies += "\r\n";
+	return WS_OK;
+}
+
+WebSocketStatus WebSocketSession::fail(unsigned short code)
+{
+	_closeCode = code;
+	return WS_CLOSE;
+}
+
+// One complete message is one IRC line, with or without its CRLF
+bool WebSocketSession::deliver(WebSocketOpcode opcode, const std::string& payload, std::string& lines)
+{
+	if (opcode == WS_TEXT && !isValidUtf8(payload.data(), payload.size()))
+		return false;
+	size_t end = payload.size();
+	while (end > 0 && (payload[end - 1] == '\n' || payload[end - 1] == '\r'))
+		--end;
+	if (end == 0)
+		return true;
+	lines.append(payload, 0, end);
+	lines += "\r\n";
+	return true;
+}
+
+WebSocketStatus WebSocketSession::receive(const char* data, size_t length, std::string& lines, std::string& replies)
+{
+	_input.append(data, length);
+	if (!_open)
+	{
+		WebSocketStatus status = handshake(replies);
+		if (status != WS_OK || !_open)
+			return status;
+	}
+
+	WebSocketStatus status = WS_OK;
+	size_t offset = 0;
+	while (status == WS_OK)
+	{
+		const unsigned char* frame = reinterpret_cast<const unsigned char*>(_input.data() + offset);
+		size_t available = _input.size() - offset;
+		if (available < 2)
+			break;
+		bool fin = (frame[0] & 0x80) != 0;
+		WebSocketOpcode opcode = static_cast<WebSocketOpcode>(frame[0] & 0x0F);
+		// No extensions are negotiated, and clients must mask
+		if ((frame[0] & 0x70) != 0 || (frame[1] & 0x80) == 0)
+		{
+			status = fail(WS_CLOSE_PROTOCOL_ERROR);
+			break;
+		}
+
+		size_t header = 2;
+		unsigned long long size = frame[1] & 0x7F;
+		if (size == 126)
+		{
+			header = 4;
+			if (available < header)
+				break;
+			size = (frame[2] << 8) | frame[3];
+		}
+		else if (size == 127)
+		{
+			header = 10;
+			if (available < header)
+				break;
+			size = 0;
+			for (size_t i = 2; i < 10; ++i)
+				size = (size << 8) | frame[i];
+		}
+		// Refused before the payload is buffered
+		if (size > WEBSOCKET_MAX_MESSAGE)
+		{
+			status = fail(WS_CLOSE_TOO_BIG);
+			break;
+		}
+		header += 4;
+		if (available < header + size)
+			break;
+
+		std::string payload(_input.data() + offset + header, static_cast<size_t>(size));
+		const unsigned char* mask = frame + header - 4;
+		for (size_t i = 0; i < payload.size(); ++i)
+			payload[i] ^= mask[i & 3];
+		offset += header + static_cast<size_t>(size);
+
+		switch (opcode)
+		{
+			case WS_TEXT:
+			case WS_BINARY:
+				if (_messageOpcode != WS_CONTINUATION)
+					status = fail(WS_CLOSE_PROTOCOL_ERROR);
+				else if (!fin)
+				{
+					_messageOpcode = opcode;
+					_message = payload;
+				}
+				else if (!deliver(opcode, payload, lines))
+					status = fail(WS_CLOSE_INVALID_DATA);
+				break;
+			case WS_CONTINUATION:
+				if (_messageOpcode == WS_CONTINUATION)
+					status = fail(WS_CLOSE_PROTOCOL_ERROR);
+				else if (_message.size() + payload.size() > WEBSOCKET_MAX_MESSAGE)
+					status = fail(WS_CLOSE_TOO_BIG);
+				else
+				{
+					_message += payload;
+					if (fin)
+					{
+						if (!deliver(_messageOpcode, _message, lines))
+							status = fail(WS_CLOSE_INVALID_DATA);
+						_messageOpcode = WS_CONTINUATION;
+						_message.clear();
+					}
+				}
+				break;
+			case WS_PING:
+			case WS_PONG:
+			case WS_CLOSE_FRAME:
+				if (!fin || payload.size() > WS_CONTROL_MAX)
+					status = fail(WS_CLOSE_PROTOCOL_ERROR);
+				else if (opcode == WS_PING)
+					appendFrame(replies, WS_PONG, payload.data(), payload.size());
+				else if (opcode == WS_CLOSE_FRAME)
+					status = fail(WS_CLOSE_NORMAL);
+				break;
+			default:
+				status = fail(WS_CLOSE_PROTOCOL_ERROR);
+				break;
+		}
+	}
+	_input.erase(0, offset);
+	return status;
+}
+
+// Our half of the close handshake; nothing once the HTTP handshake failed
+std::string WebSocketSession::closeFrame() const
+{
+	if (!_open)
+		return std::string();
+	char code[2];
+	code[0] = static_cast<char>(_closeCode >> 8);
+	code[1] = static_cast<char>(_closeCode & 0xFF);
+	return webSocketFrame(WS_CLOSE_FRAME, code, sizeof(code));
+}
+
+// Frame each line in data, which ends with one
+std::string WebSocketSession::frameLines(const char* data, size_t size) const
+{
+	WebSocketOpcode opcode = _binary ? WS_BINARY : WS_TEXT;
+	std::string framed;
+	framed.reserve(size + 16);
+	size_t start = 0;
+	while (start < size)
+	{
+		const char* newline = static_cast<const char*>(std::memchr(data + start, '\n', size - start));
+		size_t end = newline != NULL ? static_cast<size_t>(newline - data) : size;
+		size_t next = end + 1;
+		if (end > start && data[end - 1] == '\r')
+			--end;
+		if (end > start)
+		{
+			if (_binary || isValidUtf8(data + start, end - start))
+				appendFrame(framed, opcode, data + start, end - start);
+			else
+			{
+				std::string text = toValidUtf8(data + start, end - start);
+				appendFrame(framed, opcode, text.data(), text.size());
+			}
+		}
+		start = next;
+	}
+	return framed;
+}
+
+std::string WebSocketSession::frame(const std::string& data)
+{
+	if (_pending.empty() && !data.empty() && data[data.size() - 1] == '\n')
+		return frameLines(data.data(), data.size());
+	_pending += data;
+	std::string::size_type last = _pending.rfind('\n');
+	if (last == std::string::npos)
+		return std::string();
+	std::string framed = frameLines(_pending.data(), last + 1);
+	_pending.erase(0, last + 1);
+	return framed;
+}
+
+// Whole lines are framed once per buffer and mode; later recipients get
+// the cached framing
+SharedBuffer WebSocketSession::frame(const SharedBuffer& data)
+{
+	const std::string& text = data.str();
+	if (!_pending.empty() || text.empty() || text[text.size() - 1] != '\n')
+		return SharedBuffer(frame(text));
+	size_t slot = _binary ? WEBSOCKET_BINARY_SLOT : WEBSOCKET_TEXT_SLOT;
+	SharedBuffer framed = data.getDerived(slot);
+	if (framed.empty())
+	{
+		framed = SharedBuffer(frameLines(text.data(), text.size()));
+		data.setDerived(slot, framed);
+	}
+	return framed;
+}
+
+bool WebSocketSession::isOpen() const
+{
+	return _open;
+}
+
+bool WebSocketSession::isBinary() const
+{
+	return _binary;
+}
+
+const std::string& WebSocketSession::getInput() const
+{
+	return _input;
+}
+
+WebSocketOpcode WebSocketSession::getMessageOpcode() const
+{
+	return _messageOpcode;
+}
+
+const std::string& WebSocketSession::getMessage() const
+{
+	return _message;
+}
+
+const std::string& WebSocketSession::getPending() const
+{
+	return _pending;
+}
+
+void WebSocketSession::restore(bool open, bool binary, const std::string& input, WebSocketOpcode messageOpcode,
+	const std::string& message, const std::string& pending)
+{
+	_open = open;
+	_binary = binary;
+	_input = input;
+	_messageOpcode = messageOpcode;
+	_message = message;
+	_pending = pending;
+}
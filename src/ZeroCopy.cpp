@@ -0,0 +1,134 @@
+#include "ZeroCopy.hpp"
+#include "Metrics.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <cstring>
+
+ZeroCopySocket::ZeroCopySocket()
+	: nextId(0)
+{
+}
+
+ZeroCopy::ZeroCopy()
+	: _threshold(0)
+{
+}
+
+ZeroCopy::~ZeroCopy()
+{
+}
+
+void ZeroCopy::setThreshold(size_t threshold)
+{
+	_threshold = threshold;
+}
+
+size_t ZeroCopy::getThreshold() const
+{
+	return _threshold;
+}
+
+bool ZeroCopy::enable(int fd)
+{
+	int on = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == -1)
+		return false;
+	_sockets[fd] = ZeroCopySocket();
+	return true;
+}
+
+bool ZeroCopy::shouldUse(int fd, size_t queued) const
+{
+	return _threshold != 0 && queued >= _threshold && _sockets.find(fd) != _sockets.end();
+}
+
+bool ZeroCopy::isWorthPinning(const struct iovec* iov, size_t count)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < count; ++i)
+		bytes += iov[i].iov_len;
+	return count != 0 && bytes / count >= ZEROCOPY_MIN_SEGMENT;
+}
+
+// Called once per send that took bytes; the kernel numbered it the same way
+void ZeroCopy::sent(int fd, size_t bytes, const std::vector<SharedBuffer>& hold)
+{
+	std::map<int, ZeroCopySocket>::iterator it = _sockets.find(fd);
+	if (it == _sockets.end())
+		return;
+	ZeroCopySend send;
+	send.id = it->second.nextId++;
+	send.bytes = bytes;
+	send.hold = hold;
+	it->second.inFlight.push_back(send);
+}
+
+// TCP completes in order, so everything up to last is done
+void ZeroCopy::complete(ZeroCopySocket& socket, uint32_t last, bool copied)
+{
+	while (!socket.inFlight.empty() && static_cast<int32_t>(socket.inFlight.front().id - last) <= 0)
+	{
+		Metrics::instance().addSentBytes(socket.inFlight.front().bytes, !copied);
+		socket.inFlight.pop_front();
+	}
+}
+
+bool ZeroCopy::reap(int fd)
+{
+	std::map<int, ZeroCopySocket>::iterator it = _sockets.find(fd);
+	char control[128];
+	struct msghdr msg;
+	while (true)
+	{
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		Metrics::instance().addIoSyscall();
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+				&& !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+			struct sock_extended_err err;
+			std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+			// Sockets inherited over UPGRADE may still report sends of the old process
+			if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || it == _sockets.end())
+				continue;
+			complete(it->second, err.ee_data, (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+		}
+	}
+
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1)
+		return false;
+	return error == 0;
+}
+
+// The kernel may still be reading the buffers, but nothing reports when
+// it is done with a closed socket
+void ZeroCopy::forget(int fd, time_t now)
+{
+	std::map<int, ZeroCopySocket>::iterator it = _sockets.find(fd);
+	if (it == _sockets.end())
+		return;
+	std::vector<SharedBuffer> hold;
+	for (size_t i = 0; i < it->second.inFlight.size(); ++i)
+	{
+		const std::vector<SharedBuffer>& buffers = it->second.inFlight[i].hold;
+		hold.insert(hold.end(), buffers.begin(), buffers.end());
+	}
+	if (!hold.empty())
+		_retired.push_back(std::make_pair(now, hold));
+	_sockets.erase(it);
+}
+
+void ZeroCopy::expire(time_t now)
+{
+	while (!_retired.empty() && now - _retired.front().first >= ZEROCOPY_RETIRE_SECONDS)
+		_retired.pop_front();
+}
+
@@ -0,0 +1,129 @@
+#include "CapCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include <sstream>
+#include <cctype>
+
+struct CapabilityName
+{
+	const char* name;
+	Capability capability;
+};
+
+// Offered by CAP LS, in that order
+static const CapabilityName CAPABILITIES[] = {
+	{ "batch", CAP_BATCH },
+	{ "message-tags", CAP_MESSAGE_TAGS },
+	{ "server-time", CAP_SERVER_TIME }
+};
+static const size_t CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+CapCommand::CapCommand()
+{
+}
+
+CapCommand::~CapCommand()
+{
+}
+
+static bool findCapability(const std::string& name, Capability& capability)
+{
+	for (size_t i = 0; i < CAPABILITY_COUNT; ++i)
+	{
+		if (name == CAPABILITIES[i].name)
+		{
+			capability = CAPABILITIES[i].capability;
+			return true;
+		}
+	}
+	return false;
+}
+
+static std::string listCapabilities(unsigned int capabilities)
+{
+	std::string list;
+	for (size_t i = 0; i < CAPABILITY_COUNT; ++i)
+	{
+		if ((capabilities & CAPABILITIES[i].capability) == 0)
+			continue;
+		if (!list.empty())
+			list += " ";
+		list += CAPABILITIES[i].name;
+	}
+	return list;
+}
+
+// "cap -cap ..." applies all or nothing
+static bool applyRequest(const std::string& request, unsigned int& capabilities)
+{
+	unsigned int result = capabilities;
+	std::istringstream iss(request);
+	std::string token;
+	while (iss >> token)
+	{
+		bool disable = token[0] == '-';
+		Capability capability;
+		if (!findCapability(disable ? token.substr(1) : token, capability))
+			return false;
+		if (disable)
+			result &= ~static_cast<unsigned int>(capability);
+		else
+			result |= capability;
+	}
+	capabilities = result;
+	return true;
+}
+
+// CAP LS [<version>] | LIST | REQ :<caps> | END
+// LS and REQ before registration hold it back until END.
+void CapCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+	std::string subcommand = msg.getParam(0);
+	for (size_t i = 0; i < subcommand.size(); ++i)
+		subcommand[i] = std::toupper(static_cast<unsigned char>(subcommand[i]));
+
+	if (subcommand == "LS")
+	{
+		if (!client.isRegistered())
+			client.setNegotiatingCaps(true);
+		server.sendReply(client, ":" + server.getServerName() + " CAP " + nick + " LS :" + listCapabilities(~0U) + "\r\n");
+	}
+	else if (subcommand == "LIST")
+	{
+		server.sendReply(client, ":" + server.getServerName() + " CAP " + nick + " LIST :" + listCapabilities(client.getCapabilities())
+			+ "\r\n");
+	}
+	else if (subcommand == "REQ")
+	{
+		if (!client.isRegistered())
+			client.setNegotiatingCaps(true);
+		std::string request = msg.getParam(1);
+		for (size_t i = 2; i < msg.getParamCount(); ++i)
+			request += " " + msg.getParam(i);
+
+		unsigned int capabilities = client.getCapabilities();
+		if (applyRequest(request, capabilities))
+		{
+			client.setCapabilities(capabilities);
+			server.sendReply(client, ":" + server.getServerName() + " CAP " + nick + " ACK :" + request + "\r\n");
+		}
+		else
+		{
+			server.sendReply(client, ":" + server.getServerName() + " CAP " + nick + " NAK :" + request + "\r\n");
+		}
+	}
+	else if (subcommand == "END")
+	{
+		if (client.isNegotiatingCaps())
+		{
+			client.setNegotiatingCaps(false);
+			server.completeRegistration(client);
+		}
+	}
+	else
+	{
+		server.sendReply(client, ":" + server.getServerName() + " 410 " + nick + " " + msg.getParam(0) + " :Invalid CAP command\r\n");
+	}
+}
@@ -0,0 +1,269 @@
+#include "ChathistoryCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Message.hpp"
+#include "History.hpp"
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+
+ChathistoryCommand::ChathistoryCommand()
+	: _nextBatch(0)
+{
+}
+
+ChathistoryCommand::~ChathistoryCommand()
+{
+}
+
+static void sendFail(Server& server, Client& client, const std::string& code, const std::string& context,
+	const std::string& text)
+{
+	server.sendReply(client, ":" + server.getServerName() + " FAIL CHATHISTORY " + code + " " + context + " :" + text + "\r\n");
+}
+
+// A message reference, as positions in the ring: entries before it are
+// [0, before), entries after it are [after, size())
+struct HistoryRef
+{
+	size_t before;
+	size_t after;
+	bool found;
+
+	HistoryRef()
+		: before(0), after(0), found(true)
+	{
+	}
+};
+
+// "msgid=<id>", "timestamp=<server-time>", or "*" (no bound) when allowed
+static bool parseRef(const ChannelHistory& history, const std::string& text, bool allowStar, HistoryRef& ref)
+{
+	ref.found = true;
+	if (allowStar && text == "*")
+	{
+		ref.before = history.size();
+		ref.after = 0;
+		return true;
+	}
+	if (text.compare(0, 6, "msgid=") == 0)
+	{
+		size_t index = history.find(text.substr(6));
+		ref.found = index < history.size();
+		ref.before = index;
+		ref.after = ref.found ? index + 1 : index;
+		return true;
+	}
+	long long timeMs;
+	if (text.compare(0, 10, "timestamp=") == 0 && parseHistoryTime(text.substr(10), timeMs))
+	{
+		ref.before = history.lowerBound(timeMs);
+		ref.after = history.upperBound(timeMs);
+		return true;
+	}
+	return false;
+}
+
+static bool parseLimit(const std::string& text, size_t& limit)
+{
+	char* end = NULL;
+	long value = std::strtol(text.c_str(), &end, 10);
+	if (text.empty() || *end != '\0' || value <= 0)
+		return false;
+	limit = std::min(static_cast<size_t>(value), CHATHISTORY_MAX_LIMIT);
+	return true;
+}
+
+// Select [first, last) of the ring for one subcommand
+static void selectRange(const std::string& subcommand, const ChannelHistory& history, const HistoryRef& ref,
+	const HistoryRef& end, size_t limit, size_t& first, size_t& last)
+{
+	size_t size = history.size();
+	if (subcommand == "LATEST")
+	{
+		// Newest messages, stopping at the reference
+		last = size;
+		first = std::max(ref.after, size > limit ? size - limit : 0);
+	}
+	else if (subcommand == "BEFORE")
+	{
+		last = ref.before;
+		first = last > limit ? last - limit : 0;
+	}
+	else if (subcommand == "AFTER")
+	{
+		first = ref.after;
+		last = std::min(size, first + limit);
+	}
+	else if (subcommand == "AROUND")
+	{
+		first = ref.before > limit / 2 ? ref.before - limit / 2 : 0;
+		last = std::min(size, first + limit);
+		first = last > limit ? last - limit : 0;
+	}
+	else
+	{
+		// BETWEEN: exclusive on both ends, counted from the first reference
+		if (ref.before <= end.before)
+		{
+			first = ref.after;
+			last = std::min(end.before, first + limit);
+		}
+		else
+		{
+			last = ref.before;
+			first = std::max(end.after, last > limit ? last - limit : 0);
+		}
+	}
+	if (first > last)
+		first = last;
+}
+
+// CHATHISTORY TARGETS <timestamp> <timestamp> <limit>: joined channels with
+// messages between the two times, oldest activity first
+static void sendTargets(Server& server, Client& client, const Message& msg, const std::string& batch)
+{
+	long long from;
+	long long to;
+	size_t limit;
+	if (msg.getParamCount() < 4 || msg.getParam(1).compare(0, 10, "timestamp=") != 0
+		|| msg.getParam(2).compare(0, 10, "timestamp=") != 0 || !parseHistoryTime(msg.getParam(1).substr(10), from)
+		|| !parseHistoryTime(msg.getParam(2).substr(10), to) || !parseLimit(msg.getParam(3), limit))
+	{
+		sendFail(server, client, "INVALID_PARAMS", "TARGETS", "Expected two timestamps and a positive limit");
+		return;
+	}
+	if (from > to)
+		std::swap(from, to);
+
+	std::vector<std::pair<long long, std::string> > targets;
+	std::vector<Channel*> channels = server.getChannelsForClient(client.getFd());
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		const ChannelHistory& history = channels[i]->getHistory();
+		if (history.empty())
+			continue;
+		long long latest = history.newest().timeMs;
+		if (latest > from && latest < to)
+			targets.push_back(std::make_pair(latest, channels[i]->getName()));
+	}
+	std::sort(targets.begin(), targets.end());
+	if (targets.size() > limit)
+		targets.resize(limit);
+
+	bool batched = client.hasCapability(CAP_BATCH);
+	if (batched)
+		server.sendReply(client, ":" + server.getServerName() + " BATCH +" + batch + " draft/chathistory-targets\r\n");
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		server.sendReply(client, (batched ? "@batch=" + batch + " " : std::string()) + ":" + server.getServerName() + " CHATHISTORY TARGETS "
+			+ targets[i].second + " " + formatHistoryTime(targets[i].first) + "\r\n");
+	}
+	if (batched)
+		server.sendReply(client, ":" + server.getServerName() + " BATCH -" + batch + "\r\n");
+}
+
+// CHATHISTORY LATEST|BEFORE|AFTER|AROUND <target> <ref> <limit>
+// CHATHISTORY BETWEEN <target> <ref> <ref> <limit>
+// CHATHISTORY TARGETS <timestamp> <timestamp> <limit>
+// Replayed lines share their payload with the history ring; only the tag
+// prefix is rendered per request, with the tags the client negotiated.
+void ChathistoryCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+	if (!server.isHistoryEnabled())
+	{
+		server.sendReply(client, ":" + server.getServerName() + " 421 " + nick + " CHATHISTORY :Unknown command\r\n");
+		return;
+	}
+	if (msg.getParamCount() < 1)
+	{
+		sendFail(server, client, "NEED_MORE_PARAMS", "*", "Missing subcommand");
+		return;
+	}
+
+	std::string subcommand = msg.getParam(0);
+	for (size_t i = 0; i < subcommand.size(); ++i)
+		subcommand[i] = std::toupper(static_cast<unsigned char>(subcommand[i]));
+
+	std::ostringstream batchId;
+	batchId << "h" << ++_nextBatch;
+	std::string batch = batchId.str();
+
+	if (subcommand == "TARGETS")
+	{
+		sendTargets(server, client, msg, batch);
+		return;
+	}
+	if (subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER" && subcommand != "AROUND"
+		&& subcommand != "BETWEEN")
+	{
+		sendFail(server, client, "UNKNOWN_COMMAND", subcommand, "Unknown subcommand");
+		return;
+	}
+	bool between = subcommand == "BETWEEN";
+	if (msg.getParamCount() < (between ? 5U : 4U))
+	{
+		sendFail(server, client, "NEED_MORE_PARAMS", subcommand, "Missing parameters");
+		return;
+	}
+
+	// Only channels keep history, and only members may read it
+	std::string target = msg.getParam(1);
+	Channel* channel = server.getChannel(target);
+	if (channel == NULL || !channel->isMember(client.getFd()))
+	{
+		sendFail(server, client, "INVALID_TARGET", subcommand + " " + target, "Messages could not be retrieved");
+		return;
+	}
+
+	const ChannelHistory& history = channel->getHistory();
+	HistoryRef ref;
+	HistoryRef end;
+	size_t limit;
+	if (!parseRef(history, msg.getParam(2), subcommand == "LATEST", ref)
+		|| (between && !parseRef(history, msg.getParam(3), false, end))
+		|| !parseLimit(msg.getParam(between ? 4 : 3), limit))
+	{
+		sendFail(server, client, "INVALID_PARAMS", subcommand, "Invalid message reference or limit");
+		return;
+	}
+
+	size_t first = 0;
+	size_t last = 0;
+	if (ref.found && end.found)
+		selectRange(subcommand, history, ref, between ? end : ref, limit, first, last);
+
+	bool batched = client.hasCapability(CAP_BATCH);
+	if (batched)
+		server.sendReply(client, ":" + server.getServerName() + " BATCH +" + batch + " chathistory " + channel->getName() + "\r\n");
+	for (size_t i = first; i < last; ++i)
+	{
+		const HistoryEntry& entry = history.at(i);
+		std::string tags;
+		if (batched)
+			tags += ";batch=" + batch;
+		if (client.hasCapability(CAP_SERVER_TIME))
+			tags += ";time=" + formatHistoryTime(entry.timeMs);
+		if (client.hasCapability(CAP_MESSAGE_TAGS))
+			tags += ";msgid=" + entry.msgid;
+		if (!tags.empty())
+			server.sendReply(client, "@" + tags.substr(1) + " ");
+		server.sendReply(client, entry.line);
+	}
+	if (batched)
+		server.sendReply(client, ":" + server.getServerName() + " BATCH -" + batch + "\r\n");
+}
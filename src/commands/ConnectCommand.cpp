@@ -0,0 +1,62 @@
+#include "ConnectCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include <sstream>
+
+ConnectCommand::ConnectCommand()
+{
+}
+
+ConnectCommand::~ConnectCommand()
+{
+}
+
+// CONNECT <server>: open the link block configured for <server>
+void ConnectCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	if (!client.isServerOperator())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!validateParamCount(msg, 1))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " CONNECT :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string name = msg.getParam(0);
+	std::string error;
+	std::ostringstream reply;
+	reply << ":" << server.getServerName() << " NOTICE " << nick << " :";
+	if (server.connectToServer(name, error))
+	{
+		reply << "Connecting to " << name;
+		LOG(LOG_INFO, LOG_CMD, nick << " requested a link to " << name);
+	}
+	else
+	{
+		reply << "CONNECT " << name << " failed: " << error;
+	}
+	reply << "\r\n";
+	server.sendReply(client, reply.str());
+}
@@ -0,0 +1,134 @@
+#include "FilterCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "SpamFilter.hpp"
+#include "Logger.hpp"
+#include <sstream>
+#include <cctype>
+#include <ctime>
+
+FilterCommand::FilterCommand()
+{
+}
+
+FilterCommand::~FilterCommand()
+{
+}
+
+static std::string lowerCase(const std::string& str)
+{
+	std::string result = str;
+	for (std::string::size_type i = 0; i < result.length(); ++i)
+	{
+		result[i] = std::tolower(result[i]);
+	}
+	return result;
+}
+
+// FILTER ADD <notice|drop|kill> <case|nocase> :<phrase>
+// FILTER DEL :<phrase>
+// FILTER LIST | CLEAR
+void FilterCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	if (!client.isServerOperator())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!validateParamCount(msg, 1))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " FILTER :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	SpamFilter& filter = server.getSpamFilter();
+	std::string action = msg.getParam(0);
+	for (std::string::size_type i = 0; i < action.length(); ++i)
+	{
+		action[i] = std::toupper(action[i]);
+	}
+
+	std::ostringstream reply;
+	std::string head = ":" + server.getServerName() + " NOTICE " + nick + " :";
+	if (action == "ADD" && msg.getParamCount() == 4)
+	{
+		FilterRule rule;
+		std::string folding = lowerCase(msg.getParam(2));
+		rule.pattern = msg.getParam(3);
+		rule.foldCase = folding == "nocase";
+		rule.setBy = nick;
+		rule.setAt = time(NULL);
+		if (!SpamFilter::parseAction(lowerCase(msg.getParam(1)), rule.action) ||
+			(folding != "case" && folding != "nocase") || rule.pattern.empty())
+		{
+			reply << head << "Usage: FILTER ADD <notice|drop|kill> <case|nocase> :<phrase>";
+		}
+		else if (rule.pattern.length() > FILTER_MAX_PATTERN)
+		{
+			reply << head << "Phrase longer than " << FILTER_MAX_PATTERN << " bytes";
+		}
+		else if (!filter.add(rule))
+		{
+			reply << head << "Filter list is full (" << FILTER_MAX_RULES << " phrases)";
+		}
+		else
+		{
+			reply << head << "Filter added: " << SpamFilter::actionName(rule.action) << " " << folding << " "
+				<< rule.pattern;
+			LOG(LOG_INFO, LOG_CMD, nick << " added filter " << SpamFilter::actionName(rule.action) << " " << folding
+				<< " \"" << rule.pattern << "\"");
+		}
+	}
+	else if (action == "DEL" && msg.getParamCount() == 2)
+	{
+		if (filter.remove(msg.getParam(1)))
+		{
+			reply << head << "Filter removed: " << msg.getParam(1);
+			LOG(LOG_INFO, LOG_CMD, nick << " removed filter \"" << msg.getParam(1) << "\"");
+		}
+		else
+		{
+			reply << head << "No such filter: " << msg.getParam(1);
+		}
+	}
+	else if (action == "LIST")
+	{
+		const std::vector<FilterRule>& rules = filter.getRules();
+		for (size_t i = 0; i < rules.size(); ++i)
+		{
+			reply << head << SpamFilter::actionName(rules[i].action) << " " << (rules[i].foldCase ? "nocase" : "case")
+				<< " set by " << rules[i].setBy << " at " << rules[i].setAt << ": " << rules[i].pattern << "\r\n";
+		}
+		reply << head << "End of filter list (" << rules.size() << " phrases)";
+	}
+	else if (action == "CLEAR")
+	{
+		filter.clear();
+		reply << head << "Filter list cleared";
+		LOG(LOG_INFO, LOG_CMD, nick << " cleared the filter list");
+	}
+	else
+	{
+		reply << head << "Usage: FILTER ADD <notice|drop|kill> <case|nocase> :<phrase> | DEL :<phrase> | LIST | CLEAR";
+	}
+	reply << "\r\n";
+	server.sendReply(client, reply.str());
+}
@@ -20,7 +20,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -30,7 +30,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " INVITE :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " INVITE :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -44,7 +44,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+		oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -54,17 +54,17 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
+		oss << ":" << server.getServerName() << " 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
 
-	// Check inviter is operator
-	if (!channel->isOperator(client.getFd()))
+	// Check inviter is operator (remote invites were checked by their server)
+	if (!client.isRemote() && !channel->isOperator(client.getFd()))
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
+		oss << ":" << server.getServerName() << " 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -75,7 +75,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 401 " << nick << " " << targetNick << " :No such nick/channel\r\n";
+		oss << ":" << server.getServerName() << " 401 " << nick << " " << targetNick << " :No such nick/channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -85,7 +85,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 443 " << nick << " " << targetNick << " " << channelName << " :is already on channel\r\n";
+		oss << ":" << server.getServerName() << " 443 " << nick << " " << targetNick << " " << channelName << " :is already on channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -96,7 +96,7 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	// Send RPL_INVITING to inviter
 	std::string nick = client.getNickname();
 	std::ostringstream oss;
-	oss << ":irc.server 341 " << nick << " " << targetNick << " " << channelName << "\r\n";
+	oss << ":" << server.getServerName() << " 341 " << nick << " " << targetNick << " " << channelName << "\r\n";
 	server.sendReply(client, oss.str());
 
 	// Send INVITE message to target
@@ -105,6 +105,6 @@ void InviteCommand::execute(Server& server, Client& client, const Message& msg)
 	std::string inviterHost = client.getHostname().empty() ? "localhost" : client.getHostname();
 	std::ostringstream inviteMsg;
 	inviteMsg << ":" << inviterNick << "!" << inviterUser << "@" << inviterHost << " INVITE " << targetNick << " :" << channelName << "\r\n";
-	server.sendReply(*targetClient, inviteMsg.str());
+	server.deliver(*targetClient, inviteMsg.str());
 }
 
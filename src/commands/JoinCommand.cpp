@@ -35,7 +35,7 @@ void JoinCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -45,7 +45,7 @@ void JoinCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " JOIN :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " JOIN :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -71,17 +71,19 @@ void JoinCommand::execute(Server& server, Client& client, const Message& msg)
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+			oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 			server.sendReply(client, oss.str());
 			continue;
 		}
 
 		// Get or create channel
 		Channel* channel = server.getChannel(channelName);
+		bool created = false;
 		if (channel == NULL)
 		{
-			// Create new channel
+			// Create new channel; the creator is already its operator
 			channel = server.createChannel(channelName, &client);
+			created = true;
 		}
 		else
 		{
@@ -91,43 +93,59 @@ void JoinCommand::execute(Server& server, Client& client, const Message& msg)
 				continue;
 			}
 
-			// Check invite-only
-			if (channel->isInviteOnly())
+			// Remote users were already admitted by their own server
+			bool local = !client.isRemote();
+
+			// Check bans; an exception (+e) lets the client through
+			if (local && channel->isBanned(client))
+			{
+				std::string nick = client.getNickname();
+				std::ostringstream oss;
+				oss << ":" << server.getServerName() << " 474 " << nick << " " << channelName << " :Cannot join channel (+b)\r\n";
+				server.sendReply(client, oss.str());
+				continue;
+			}
+
+			// Check invite-only; an invite exception (+I) counts as an invite
+			if (local && channel->isInviteOnly())
 			{
-				if (!channel->isInvited(client.getFd()))
+				if (!channel->isInvited(client.getFd()) && !channel->isInviteExempt(client))
 				{
 					std::string nick = client.getNickname();
 					std::ostringstream oss;
-					oss << ":irc.server 473 " << nick << " " << channelName << " :Cannot join channel (+i)\r\n";
+					oss << ":" << server.getServerName() << " 473 " << nick << " " << channelName << " :Cannot join channel (+i)\r\n";
 					server.sendReply(client, oss.str());
 					continue;
 				}
 			}
 
 			// Check key
-			if (channel->hasKey() && channel->getKey() != key)
+			if (local && channel->hasKey() && channel->getKey() != key)
 			{
 				std::string nick = client.getNickname();
 				std::ostringstream oss;
-				oss << ":irc.server 475 " << nick << " " << channelName << " :Cannot join channel (+k)\r\n";
+				oss << ":" << server.getServerName() << " 475 " << nick << " " << channelName << " :Cannot join channel (+k)\r\n";
 				server.sendReply(client, oss.str());
 				continue;
 			}
 
 			// Check user limit
-			if (channel->hasUserLimit() && 
+			if (local && channel->hasUserLimit() && 
 				static_cast<int>(channel->getMemberCount()) >= channel->getUserLimit())
 			{
 				std::string nick = client.getNickname();
 				std::ostringstream oss;
-				oss << ":irc.server 471 " << nick << " " << channelName << " :Cannot join channel (+l)\r\n";
+				oss << ":" << server.getServerName() << " 471 " << nick << " " << channelName << " :Cannot join channel (+l)\r\n";
 				server.sendReply(client, oss.str());
 				continue;
 			}
 		}
 
 		// Add client to channel
-		channel->addMember(&client);
+		if (!created)
+		{
+			channel->addMember(&client);
+		}
 		
 		// Remove from invite list if was invited
 		if (channel->isInvited(client.getFd()))
@@ -145,27 +163,37 @@ void JoinCommand::execute(Server& server, Client& client, const Message& msg)
 		// Broadcast to all channel members
 		channel->broadcast(joinMsg.str());
 
+		// Tell the rest of the network; a new channel goes out with its TS
+		if (created)
+		{
+			server.propagateChannelCreation(client, *channel);
+		}
+		else
+		{
+			server.propagate(client, joinMsg.str());
+		}
+
 		// Send topic or no topic
 		if (!channel->getTopic().empty())
 		{
 			std::ostringstream topicMsg;
-			topicMsg << ":irc.server 332 " << nick << " " << channelName << " :" << channel->getTopic() << "\r\n";
+			topicMsg << ":" << server.getServerName() << " 332 " << nick << " " << channelName << " :" << channel->getTopic() << "\r\n";
 			server.sendReply(client, topicMsg.str());
 		}
 		else
 		{
 			std::ostringstream notopicMsg;
-			notopicMsg << ":irc.server 331 " << nick << " " << channelName << " :No topic is set\r\n";
+			notopicMsg << ":" << server.getServerName() << " 331 " << nick << " " << channelName << " :No topic is set\r\n";
 			server.sendReply(client, notopicMsg.str());
 		}
 
 		// Send names list
 		std::ostringstream namesMsg;
-		namesMsg << ":irc.server 353 " << nick << " = " << channelName << " :" << channel->getMembersString() << "\r\n";
+		namesMsg << ":" << server.getServerName() << " 353 " << nick << " = " << channelName << " :" << channel->getMembersString() << "\r\n";
 		server.sendReply(client, namesMsg.str());
 
 		std::ostringstream endNamesMsg;
-		endNamesMsg << ":irc.server 366 " << nick << " " << channelName << " :End of /NAMES list\r\n";
+		endNamesMsg << ":" << server.getServerName() << " 366 " << nick << " " << channelName << " :End of /NAMES list\r\n";
 		server.sendReply(client, endNamesMsg.str());
 	}
 }
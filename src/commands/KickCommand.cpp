@@ -20,7 +20,7 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -30,7 +30,7 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " KICK :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " KICK :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -54,7 +54,7 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+		oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -64,17 +64,17 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
+		oss << ":" << server.getServerName() << " 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
 
-	// Check kicker is operator
-	if (!channel->isOperator(client.getFd()))
+	// Check kicker is operator (remote kicks were checked by their server)
+	if (!client.isRemote() && !channel->isOperator(client.getFd()))
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
+		oss << ":" << server.getServerName() << " 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -85,7 +85,7 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 401 " << nick << " " << targetNick << " :No such nick/channel\r\n";
+		oss << ":" << server.getServerName() << " 401 " << nick << " " << targetNick << " :No such nick/channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -95,7 +95,7 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 441 " << nick << " " << targetNick << " " << channelName << " :They aren't on that channel\r\n";
+		oss << ":" << server.getServerName() << " 441 " << nick << " " << targetNick << " " << channelName << " :They aren't on that channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -107,8 +107,9 @@ void KickCommand::execute(Server& server, Client& client, const Message& msg)
 	std::ostringstream kickMsg;
 	kickMsg << ":" << kickerNick << "!" << kickerUser << "@" << kickerHost << " KICK " << channelName << " " << targetNick << " :" << comment << "\r\n";
 
-	// Broadcast to all channel members
+	// Broadcast to all channel members and the network
 	channel->broadcast(kickMsg.str());
+	server.propagate(client, kickMsg.str());
 
 	// Remove target from channel
 	channel->removeMember(targetClient->getFd());
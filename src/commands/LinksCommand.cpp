@@ -0,0 +1,39 @@
+#include "LinksCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include <sstream>
+#include <vector>
+
+LinksCommand::LinksCommand()
+{
+}
+
+LinksCommand::~LinksCommand()
+{
+}
+
+// LINKS: every server on the network with its uplink and hop count
+void LinksCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	(void)msg;
+
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+	std::vector<std::string> lines;
+	server.listServers(lines);
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		server.sendReply(client, ":" + server.getServerName() + " 364 " + nick + " " + lines[i] + "\r\n");
+	}
+	server.sendReply(client, ":" + server.getServerName() + " 365 " + nick + " * :End of /LINKS list\r\n");
+}
@@ -0,0 +1,86 @@
+#include "LooptraceCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Tracer.hpp"
+#include "Logger.hpp"
+#include <sstream>
+#include <cctype>
+
+LooptraceCommand::LooptraceCommand()
+{
+}
+
+LooptraceCommand::~LooptraceCommand()
+{
+}
+
+// LOOPTRACE ON|OFF|DUMP: control the event loop span tracer
+void LooptraceCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	if (!client.isServerOperator())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!validateParamCount(msg, 1))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " LOOPTRACE :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string action = msg.getParam(0);
+	for (std::string::size_type i = 0; i < action.length(); ++i)
+	{
+		action[i] = std::toupper(action[i]);
+	}
+
+	std::ostringstream reply;
+	reply << ":" << server.getServerName() << " NOTICE " << nick << " :";
+	if (action == "ON")
+	{
+		Tracer::instance().enable();
+		reply << "Loop tracing enabled";
+	}
+	else if (action == "OFF")
+	{
+		Tracer::instance().disable();
+		reply << "Loop tracing disabled";
+	}
+	else if (action == "DUMP")
+	{
+		std::string error;
+		if (server.dumpTrace(error))
+		{
+			reply << "Trace written to " << server.getTraceFile();
+			LOG(LOG_INFO, LOG_CMD, nick << " dumped trace to " << server.getTraceFile());
+		}
+		else
+		{
+			reply << "Trace dump failed: " << error;
+		}
+	}
+	else
+	{
+		reply << "Usage: LOOPTRACE ON|OFF|DUMP";
+	}
+	reply << "\r\n";
+	server.sendReply(client, reply.str());
+}
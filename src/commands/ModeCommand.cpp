@@ -3,10 +3,12 @@
 #include "Client.hpp"
 #include "Channel.hpp"
 #include "Message.hpp"
+#include "MaskMatcher.hpp"
 #include <sstream>
 #include <vector>
 #include <cctype>
 #include <cstdlib>
+#include <ctime>
 
 ModeCommand::ModeCommand()
 {
@@ -16,6 +18,30 @@ ModeCommand::~ModeCommand()
 {
 }
 
+bool ModeCommand::isListMode(char mode)
+{
+	return mode == 'b' || mode == 'e' || mode == 'I';
+}
+
+// RPL_BANLIST/RPL_EXCEPTLIST/RPL_INVEXLIST and their end line, as one reply
+void ModeCommand::sendMaskList(Server& server, Client& client, const Channel& channel, char mode)
+{
+	const char* entryNumeric = mode == 'b' ? "367" : (mode == 'e' ? "348" : "346");
+	const char* endNumeric = mode == 'b' ? "368" : (mode == 'e' ? "349" : "347");
+	const char* listName = mode == 'b' ? "ban" : (mode == 'e' ? "exception" : "invite");
+	std::string nick = client.getNickname();
+	const std::vector<MaskEntry>& entries = channel.getMasks(mode);
+	std::ostringstream oss;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		oss << ":" << server.getServerName() << " " << entryNumeric << " " << nick << " " << channel.getName() << " " << entries[i].mask
+			<< " " << entries[i].setBy << " " << entries[i].setAt << "\r\n";
+	}
+	oss << ":" << server.getServerName() << " " << endNumeric << " " << nick << " " << channel.getName() << " :End of channel " << listName
+		<< " list\r\n";
+	server.sendReply(client, oss.str());
+}
+
 std::vector<ModeChange> ModeCommand::parseModeString(const std::string& modeStr, const std::vector<std::string>& params)
 {
 	std::vector<ModeChange> changes;
@@ -39,7 +65,7 @@ std::vector<ModeChange> ModeCommand::parseModeString(const std::string& modeStr,
 			// If mode needs param, consume from params vector
 			if ((c == 'k' && currentSign == '+') ||
 				(c == 'l' && currentSign == '+') ||
-				c == 'o')
+				c == 'o' || isListMode(c))
 			{
 				if (paramIndex < params.size())
 				{
@@ -61,7 +87,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -71,7 +97,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " MODE :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " MODE :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -84,7 +110,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+		oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -95,7 +121,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 		std::string nick = client.getNickname();
 		std::string modeStr = channel->getModeString();
 		std::ostringstream oss;
-		oss << ":irc.server 324 " << nick << " " << channelName << " " << modeStr;
+		oss << ":" << server.getServerName() << " 324 " << nick << " " << channelName << " " << modeStr;
 		if (channel->hasKey())
 		{
 			oss << " " << channel->getKey();
@@ -110,15 +136,13 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 	}
 
 	// Set mode (2+ parameters)
-	// Check operator privilege
-	if (!channel->isOperator(client.getFd()))
-	{
-		std::string nick = client.getNickname();
-		std::ostringstream oss;
-		oss << ":irc.server 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
-		server.sendReply(client, oss.str());
-		return;
-	}
+	// Operator privilege is needed for changes, not for listing b/e/I
+	// (remote changes were checked by their server)
+	bool isOp = client.isRemote() || channel->isOperator(client.getFd());
+	bool refused = false;
+	std::string listed;
+	std::string setter = client.getNickname() + "!" + client.getUsername() + "@" +
+		(client.getHostname().empty() ? "localhost" : client.getHostname());
 
 	// Parse mode string and parameters
 	std::string modeStr = msg.getParam(1);
@@ -142,6 +166,28 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 		bool applied = false;
 		std::string errorMsg = "";
 
+		if (isListMode(change.mode) && change.param.empty())
+		{
+			if (listed.find(change.mode) == std::string::npos)
+			{
+				sendMaskList(server, client, *channel, change.mode);
+				listed += change.mode;
+			}
+			continue;
+		}
+		if (!isOp)
+		{
+			if (!refused)
+			{
+				std::string nick = client.getNickname();
+				std::ostringstream oss;
+				oss << ":" << server.getServerName() << " 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
+				server.sendReply(client, oss.str());
+				refused = true;
+			}
+			continue;
+		}
+
 		// Handle each mode
 		switch (change.mode)
 		{
@@ -178,7 +224,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 					{
 						std::string nick = client.getNickname();
 						std::ostringstream oss;
-						oss << ":irc.server 461 " << nick << " MODE :Not enough parameters\r\n";
+						oss << ":" << server.getServerName() << " 461 " << nick << " MODE :Not enough parameters\r\n";
 						server.sendReply(client, oss.str());
 						continue;
 					}
@@ -201,7 +247,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 					{
 						std::string nick = client.getNickname();
 						std::ostringstream oss;
-						oss << ":irc.server 461 " << nick << " MODE :Not enough parameters\r\n";
+						oss << ":" << server.getServerName() << " 461 " << nick << " MODE :Not enough parameters\r\n";
 						server.sendReply(client, oss.str());
 						continue;
 					}
@@ -227,7 +273,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 				{
 					std::string nick = client.getNickname();
 					std::ostringstream oss;
-					oss << ":irc.server 461 " << nick << " MODE :Not enough parameters\r\n";
+					oss << ":" << server.getServerName() << " 461 " << nick << " MODE :Not enough parameters\r\n";
 					server.sendReply(client, oss.str());
 					continue;
 				}
@@ -236,7 +282,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 				{
 					std::string nick = client.getNickname();
 					std::ostringstream oss;
-					oss << ":irc.server 401 " << nick << " " << change.param << " :No such nick/channel\r\n";
+					oss << ":" << server.getServerName() << " 401 " << nick << " " << change.param << " :No such nick/channel\r\n";
 					server.sendReply(client, oss.str());
 					continue;
 				}
@@ -244,7 +290,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 				{
 					std::string nick = client.getNickname();
 					std::ostringstream oss;
-					oss << ":irc.server 441 " << nick << " " << change.param << " " << channelName << " :They aren't on that channel\r\n";
+					oss << ":" << server.getServerName() << " 441 " << nick << " " << change.param << " " << channelName << " :They aren't on that channel\r\n";
 					server.sendReply(client, oss.str());
 					continue;
 				}
@@ -261,11 +307,38 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 				break;
 			}
 
+			case 'b': // Ban
+			case 'e': // Ban exception
+			case 'I': // Invite exception
+			{
+				std::string mask = MaskMatcher::normalize(change.param);
+				if (mask.empty())
+					continue;
+				change.param = mask;
+				if (change.sign == '+')
+				{
+					if (channel->isMaskListFull(change.mode))
+					{
+						std::string nick = client.getNickname();
+						std::ostringstream oss;
+						oss << ":" << server.getServerName() << " 478 " << nick << " " << channelName << " " << mask << " :Channel list is full\r\n";
+						server.sendReply(client, oss.str());
+						continue;
+					}
+					applied = channel->addMask(change.mode, mask, setter, time(NULL));
+				}
+				else
+				{
+					applied = channel->removeMask(change.mode, mask);
+				}
+				break;
+			}
+
 			default:
 				// Unknown mode
 				std::string nick = client.getNickname();
 				std::ostringstream oss;
-				oss << ":irc.server 472 " << nick << " " << change.mode << " :is unknown mode char to me\r\n";
+				oss << ":" << server.getServerName() << " 472 " << nick << " " << change.mode << " :is unknown mode char to me\r\n";
 				server.sendReply(client, oss.str());
 				continue;
 		}
@@ -280,7 +353,8 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 			}
 			appliedModes << change.mode;
 
-			if (!change.param.empty() && (change.mode == 'k' || change.mode == 'l' || change.mode == 'o'))
+			if (!change.param.empty() && (change.mode == 'k' || change.mode == 'l' || change.mode == 'o' ||
+				isListMode(change.mode)))
 			{
 				if (!appliedParams.str().empty())
 					appliedParams << " ";
@@ -303,6 +377,7 @@ void ModeCommand::execute(Server& server, Client& client, const Message& msg)
 		}
 		modeMsg << "\r\n";
 		channel->broadcast(modeMsg.str());
+		server.propagate(client, modeMsg.str());
 	}
 }
 
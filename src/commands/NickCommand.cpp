@@ -0,0 +1,121 @@
+#include "NickCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Message.hpp"
+#include <sstream>
+#include <vector>
+#include <set>
+#include <cctype>
+#include <ctime>
+
+NickCommand::NickCommand()
+{
+}
+
+NickCommand::~NickCommand()
+{
+}
+
+// RFC 2812: letter or special first, then letters, digits, specials or '-'
+static bool isValidNickname(const std::string& nick)
+{
+	if (nick.empty() || nick.length() > 9)
+	{
+		return false;
+	}
+
+	const std::string special = "[]\\`_^{|}";
+	for (std::string::size_type i = 0; i < nick.length(); ++i)
+	{
+		char c = nick[i];
+		bool ok = std::isalpha(static_cast<unsigned char>(c)) || special.find(c) != std::string::npos;
+		if (i > 0)
+		{
+			ok = ok || std::isdigit(static_cast<unsigned char>(c)) || c == '-';
+		}
+		if (!ok)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void NickCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	std::string currentNick = client.getNickname().empty() ? "*" : client.getNickname();
+
+	// Check parameters
+	if (msg.getParamCount() == 0)
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 431 " << currentNick << " :No nickname given\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string newNick = msg.getParam(0);
+
+	// Validate nickname
+	if (!isValidNickname(newNick))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 432 " << currentNick << " " << newNick << " :Erroneous nickname\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// Check nickname is free (a case-only change of one's own nick is allowed)
+	Client* owner = server.getClientByNickname(newNick);
+	if (owner != NULL && owner != &client)
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 433 " << currentNick << " " << newNick << " :Nickname is already in use\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!client.isRegistered())
+	{
+		server.setNickname(client, newNick);
+		client.setNickTs(time(NULL));
+		server.completeRegistration(client);
+		return;
+	}
+
+	if (newNick == client.getNickname())
+	{
+		return;
+	}
+
+	// Announce the change to the client and everyone sharing a channel, once each
+	std::string user = client.getUsername();
+	std::string host = client.getHostname().empty() ? "localhost" : client.getHostname();
+	std::ostringstream nickMsg;
+	nickMsg << ":" << client.getNickname() << "!" << user << "@" << host << " NICK :" << newNick << "\r\n";
+
+	std::set<Client*> recipients;
+	recipients.insert(&client);
+	std::vector<Channel*> channels = server.getChannelsForClient(client.getFd());
+	for (std::vector<Channel*>::iterator it = channels.begin(); it != channels.end(); ++it)
+	{
+		std::vector<Client*> members = (*it)->getMembers();
+		recipients.insert(members.begin(), members.end());
+	}
+	for (std::set<Client*>::iterator it = recipients.begin(); it != recipients.end(); ++it)
+	{
+		server.sendReply(**it, nickMsg.str());
+	}
+
+	// Other servers get the new nick TS along with it (remote changes arrive with theirs)
+	if (!client.isRemote())
+	{
+		client.setNickTs(time(NULL));
+	}
+	std::ostringstream linkMsg;
+	linkMsg << ":" << client.getNickname() << " NICK " << newNick << " " << client.getNickTs() << "\r\n";
+	server.propagate(client, linkMsg.str());
+
+	server.setNickname(client, newNick);
+}
@@ -0,0 +1,10 @@
+#include "NoticeCommand.hpp"
+
+NoticeCommand::NoticeCommand()
+	: PrivmsgCommand("NOTICE", false)
+{
+}
+
+NoticeCommand::~NoticeCommand()
+{
+}
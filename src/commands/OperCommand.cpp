@@ -0,0 +1,59 @@
+#include "OperCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include <sstream>
+
+OperCommand::OperCommand()
+{
+}
+
+OperCommand::~OperCommand()
+{
+}
+
+void OperCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// Check parameters
+	if (!validateParamCount(msg, 2))
+	{
+		std::string nick = client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " OPER :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// Hashed operator passwords are answered through finish() later
+	server.verifyPassword(client, AUTH_OPER, msg.getParam(0), msg.getParam(1));
+}
+
+void OperCommand::finish(Server& server, Client& client, const std::string& name, bool matched)
+{
+	std::string nick = client.getNickname();
+	if (!matched)
+	{
+		LOG(LOG_WARN, LOG_CMD, "Failed OPER attempt as " << name << " by " << nick);
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 464 " << nick << " :Password incorrect\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	client.setServerOperator(true);
+	LOG(LOG_INFO, LOG_CMD, nick << " is now an operator (" << name << ")");
+	std::ostringstream oss;
+	oss << ":" << server.getServerName() << " 381 " << nick << " :You are now an IRC operator\r\n";
+	server.sendReply(client, oss.str());
+}
@@ -35,7 +35,7 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -45,7 +45,7 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " PART :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " PART :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -75,7 +75,7 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+			oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 			server.sendReply(client, oss.str());
 			continue;
 		}
@@ -86,7 +86,7 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+			oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 			server.sendReply(client, oss.str());
 			continue;
 		}
@@ -96,7 +96,7 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
+			oss << ":" << server.getServerName() << " 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
 			server.sendReply(client, oss.str());
 			continue;
 		}
@@ -108,8 +108,9 @@ void PartCommand::execute(Server& server, Client& client, const Message& msg)
 		std::ostringstream partMsg;
 		partMsg << ":" << nick << "!" << user << "@" << host << " PART " << channelName << " :" << reason << "\r\n";
 
-		// Broadcast to channel
+		// Broadcast to channel and the network
 		channel->broadcast(partMsg.str());
+		server.propagate(client, partMsg.str());
 
 		// Remove client from channel
 		channel->removeMember(client.getFd());
@@ -19,7 +19,7 @@ void PassCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 462 " << nick << " :You may not reregister\r\n";
+		oss << ":" << server.getServerName() << " 462 " << nick << " :You may not reregister\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -28,21 +28,27 @@ void PassCommand::execute(Server& server, Client& client, const Message& msg)
 	if (!validateParamCount(msg, 1))
 	{
 		std::ostringstream oss;
-		oss << ":irc.server 461 * PASS :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 * PASS :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
 
-	// Validate password
-	std::string providedPassword = msg.getParam(0);
-	if (providedPassword == server.getPassword())
+	// Validate password; a hashed one is checked off the event loop and
+	// answered through finish() later
+	server.verifyPassword(client, AUTH_PASS, "", msg.getParam(0));
+}
+
+void PassCommand::finish(Server& server, Client& client, bool matched)
+{
+	if (matched)
 	{
 		client.setAuthenticated(true);
+		server.completeRegistration(client);
 	}
 	else
 	{
 		std::ostringstream oss;
-		oss << ":irc.server 464 * :Password incorrect\r\n";
+		oss << ":" << server.getServerName() << " 464 * :Password incorrect\r\n";
 		server.sendReply(client, oss.str());
 	}
 }
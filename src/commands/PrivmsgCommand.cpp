@@ -3,10 +3,18 @@
 #include "Client.hpp"
 #include "Channel.hpp"
 #include "Message.hpp"
+#include "OutboundMessage.hpp"
 #include <sstream>
 #include <vector>
+#include <set>
 
 PrivmsgCommand::PrivmsgCommand()
+	: _command("PRIVMSG"), _replies(true)
+{
+}
+
+PrivmsgCommand::PrivmsgCommand(const std::string& command, bool replies)
+	: _command(command), _replies(replies)
 {
 }
 
@@ -28,34 +36,37 @@ static void splitString(const std::string& str, char delimiter, std::vector<std:
 	result.push_back(str.substr(start));
 }
 
+// PRIVMSG/NOTICE <target>{,<target>} :<text>
+// The line is rendered once as a head (":nick!user@host PRIVMSG ") and a
+// tail (" :text\r\n"); each target only splices its own name in between.
+// Members of a channel share that channel's buffer, one per tag variant.
 void PrivmsgCommand::execute(Server& server, Client& client, const Message& msg)
 {
 	// Check if registered
 	if (!client.isRegistered())
 	{
+		if (!_replies)
+			return;
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
 
 	// Check parameters
+	std::string nick = client.getNickname();
 	if (msg.getParamCount() == 0)
 	{
-		std::string nick = client.getNickname();
-		std::ostringstream oss;
-		oss << ":irc.server 411 " << nick << " :No recipient given (PRIVMSG)\r\n";
-		server.sendReply(client, oss.str());
+		if (_replies)
+			server.sendReply(client, ":" + server.getServerName() + " 411 " + nick + " :No recipient given (" + _command + ")\r\n");
 		return;
 	}
 
 	if (msg.getParamCount() == 1)
 	{
-		std::string nick = client.getNickname();
-		std::ostringstream oss;
-		oss << ":irc.server 412 " << nick << " :No text to send\r\n";
-		server.sendReply(client, oss.str());
+		if (_replies)
+			server.sendReply(client, ":" + server.getServerName() + " 412 " + nick + " :No text to send\r\n");
 		return;
 	}
 
@@ -63,22 +74,60 @@ void PrivmsgCommand::execute(Server& server, Client& client, const Message& msg)
 	std::vector<std::string> targets;
 	splitString(msg.getParam(0), ',', targets);
 
-	// Build message
+	// The body is the trailing parameter; clients that leave out the ':'
+	// get their extra words joined back, sized once
 	std::string message = msg.getParam(1);
-	for (size_t i = 2; i < msg.getParamCount(); ++i)
+	if (msg.getParamCount() > 2)
 	{
-		message += " " + msg.getParam(i);
+		const std::vector<std::string> params = msg.getParams();
+		size_t length = 0;
+		for (size_t i = 1; i < params.size(); ++i)
+			length += params[i].length() + 1;
+		message.reserve(length);
+		for (size_t i = 2; i < params.size(); ++i)
+		{
+			message.append(1, ' ');
+			message.append(params[i]);
+		}
 	}
 
-	// Build sender prefix
-	std::string nick = client.getNickname();
+	// Server-wide spam filter; operators, and remote users (their server
+	// has its own list), are not checked
+	if (!client.isRemote() && !client.isServerOperator() && server.filterMessage(client, message))
+		return;
+
+	// Render everything but the target once
 	std::string user = client.getUsername();
 	std::string host = client.getHostname().empty() ? "localhost" : client.getHostname();
+	std::string head = ":" + nick + "!" + user + "@" + host + " " + _command + " ";
+	std::string tail = " :" + message + "\r\n";
+	std::string clientTags = msg.getClientTags();
+	if (clientTags.size() > MAX_CLIENT_TAGS_LENGTH)
+	{
+		if (_replies)
+			server.sendReply(client, ":" + server.getServerName() + " 417 " + nick + " :Input line was too long\r\n");
+		return;
+	}
 
-	// Process each target
+	// Process each distinct target; links enforced TARGMAX on their side
+	std::set<std::string> seen;
+	size_t processed = 0;
 	for (size_t i = 0; i < targets.size(); ++i)
 	{
-		std::string target = targets[i];
+		const std::string& target = targets[i];
+		if (target.empty() || !seen.insert(server.toLowerCase(target)).second)
+			continue;
+		if (!client.isRemote() && processed == MAX_MESSAGE_TARGETS)
+		{
+			if (_replies)
+				server.sendReply(client, ":" + server.getServerName() + " 407 " + nick + " " + target + " :Too many targets\r\n");
+			break;
+		}
+		processed++;
+
+		std::string line;
+		line.reserve(head.size() + target.size() + tail.size());
+		line.append(head).append(target).append(tail);
 
 		if (target[0] == '#')
 		{
@@ -86,25 +135,26 @@ void PrivmsgCommand::execute(Server& server, Client& client, const Message& msg)
 			Channel* channel = server.getChannel(target);
 			if (channel == NULL)
 			{
-				std::ostringstream oss;
-				oss << ":irc.server 401 " << nick << " " << target << " :No such nick/channel\r\n";
-				server.sendReply(client, oss.str());
+				if (_replies)
+					server.sendReply(client, ":" + server.getServerName() + " 401 " + nick + " " + target + " :No such nick/channel\r\n");
 				continue;
 			}
 
-			// Check if sender is member
-			if (!channel->isMember(client.getFd()))
+			// Check if sender is member, and not banned unless an operator
+			if (!channel->isMember(client.getFd()) ||
+				(!client.isRemote() && !channel->isOperator(client.getFd()) && channel->isBanned(client)))
 			{
-				std::ostringstream oss;
-				oss << ":irc.server 404 " << nick << " " << target << " :Cannot send to channel\r\n";
-				server.sendReply(client, oss.str());
+				if (_replies)
+					server.sendReply(client, ":" + server.getServerName() + " 404 " + nick + " " + target + " :Cannot send to channel\r\n");
 				continue;
 			}
 
-			// Broadcast to channel excluding sender
-			std::ostringstream privmsgMsg;
-			privmsgMsg << ":" << nick << "!" << user << "@" << host << " PRIVMSG " << target << " :" << message << "\r\n";
-			channel->broadcast(privmsgMsg.str(), client.getFd());
+			// Broadcast to channel excluding sender; history and links keep the untagged buffer
+			OutboundMessage outbound(SharedBuffer(line), clientTags);
+			server.stampMessage(outbound, channel);
+			channel->broadcast(outbound, client.getFd());
+			server.recordHistory(*channel, outbound);
+			server.propagateToChannel(client, *channel, outbound.getLine());
 		}
 		else
 		{
@@ -112,17 +162,15 @@ void PrivmsgCommand::execute(Server& server, Client& client, const Message& msg)
 			Client* targetClient = server.getClientByNickname(target);
 			if (targetClient == NULL)
 			{
-				std::ostringstream oss;
-				oss << ":irc.server 401 " << nick << " " << target << " :No such nick/channel\r\n";
-				server.sendReply(client, oss.str());
+				if (_replies)
+					server.sendReply(client, ":" + server.getServerName() + " 401 " + nick + " " + target + " :No such nick/channel\r\n");
 				continue;
 			}
 
-			// Send to target client
-			std::ostringstream privmsgMsg;
-			privmsgMsg << ":" << nick << "!" << user << "@" << host << " PRIVMSG " << target << " :" << message << "\r\n";
-			server.sendReply(*targetClient, privmsgMsg.str());
+			// Send to target client, locally or over its link
+			OutboundMessage outbound(SharedBuffer(line), clientTags);
+			server.stampMessage(outbound, NULL);
+			server.deliver(*targetClient, outbound);
 		}
 	}
 }
-
@@ -0,0 +1,65 @@
+#include "ServerCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include "AuthPool.hpp"
+#include <sstream>
+
+ServerCommand::ServerCommand()
+{
+}
+
+ServerCommand::~ServerCommand()
+{
+}
+
+// SERVER <name> <password> :<info>: link handshake from another server.
+// Sent first by the connecting side; the accepting side answers with its own
+// SERVER line and both then consider the link established.
+void ServerCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	if (client.isRegistered() || client.isRemote())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 462 " << client.getNickname() << " :You may not reregister\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!validateParamCount(msg, 2))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 * SERVER :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// Any unregistered connection may try this, so compare in constant time.
+	// The same password is also sent in our own SERVER line, so it cannot
+	// be a crypt(3) hash like PASS and OPER secrets.
+	std::string name = msg.getParam(0);
+	const LinkConfig* link = server.findLinkConfig(name);
+	if (link == NULL || !AuthPool::matches(msg.getParam(1), link->password) ||
+		(client.getLinkState() == LINK_HANDSHAKE && client.getLinkName() != name))
+	{
+		LOG(LOG_WARN, LOG_NET, "Rejected link from " << client.getHostname() << " claiming to be " << name);
+		server.sendReply(client, "ERROR :Access denied\r\n");
+		client.setCloseAfterFlush(true);
+		return;
+	}
+
+	if (server.isKnownServer(name))
+	{
+		server.sendReply(client, "ERROR :Server " + name + " already exists\r\n");
+		client.setCloseAfterFlush(true);
+		return;
+	}
+
+	// Inbound link: answer with our own credentials first
+	if (client.getLinkState() == LINK_NONE)
+	{
+		server.sendLinkHandshake(client, *link);
+	}
+	server.establishLink(client, name);
+}
@@ -0,0 +1,56 @@
+#include "SquitCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include <sstream>
+
+SquitCommand::SquitCommand()
+{
+}
+
+SquitCommand::~SquitCommand()
+{
+}
+
+// SQUIT <server> [:reason]: close one of our direct links
+void SquitCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	if (!client.isServerOperator())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	if (!validateParamCount(msg, 1))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " SQUIT :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string name = msg.getParam(0);
+	std::string reason = msg.getParamCount() > 1 ? msg.getParam(1) : nick;
+	LOG(LOG_INFO, LOG_CMD, nick << " requested SQUIT " << name << ": " << reason);
+	if (!server.closeLink(name, reason))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 402 " << nick << " " << name << " :No such server\r\n";
+		server.sendReply(client, oss.str());
+	}
+}
@@ -0,0 +1,130 @@
+#include "StatsCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+StatsCommand::StatsCommand()
+{
+}
+
+StatsCommand::~StatsCommand()
+{
+}
+
+// STATS m: per-command usage (RPL_STATSCOMMANDS)
+static void statsCommands(Server& server, Client& client)
+{
+	const std::map<std::string, CommandStats>& commands = Metrics::instance().getCommands();
+	for (std::map<std::string, CommandStats>::const_iterator it = commands.begin(); it != commands.end(); ++it)
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 212 " << client.getNickname() << " " << it->first << " " << it->second.count << " 0 0\r\n";
+		server.sendReply(client, oss.str());
+	}
+}
+
+// STATS u: uptime (RPL_STATSUPTIME)
+static void statsUptime(Server& server, Client& client)
+{
+	unsigned long long uptime = server.collectGauges().uptimeSeconds;
+	std::ostringstream oss;
+	oss << ":" << server.getServerName() << " 242 " << client.getNickname() << " :Server Up " << uptime / 86400 << " days "
+		<< (uptime % 86400) / 3600 << ":" << (uptime % 3600) / 60 << ":" << uptime % 60 << "\r\n";
+	server.sendReply(client, oss.str());
+}
+
+// STATS p: counters and latency histograms (RPL_STATSDEBUG)
+static void statsPerformance(Server& server, Client& client)
+{
+	std::vector<std::string> lines;
+	Metrics::instance().renderSummary(server.collectGauges(), lines);
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 249 " << client.getNickname() << " p :" << lines[i] << "\r\n";
+		server.sendReply(client, oss.str());
+	}
+}
+
+// STATS z [count]: memory totals, high-water marks and heaviest clients/channels (RPL_STATSDEBUG)
+static void statsMemory(Server& server, Client& client, const Message& msg)
+{
+	size_t topN = 10;
+	if (msg.getParamCount() > 1)
+	{
+		int requested = std::atoi(msg.getParam(1).c_str());
+		if (requested >= 0)
+			topN = std::min(static_cast<size_t>(requested), static_cast<size_t>(50));
+	}
+
+	std::vector<std::string> lines;
+	server.renderMemoryReport(topN, lines);
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 249 " << client.getNickname() << " z :" << lines[i] << "\r\n";
+		server.sendReply(client, oss.str());
+	}
+}
+
+void StatsCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	// Server internals are for operators only
+	if (!client.isServerOperator())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// "STATS :" has a parameter, but an empty one
+	std::string query = validateParamCount(msg, 1) ? msg.getParam(0) : std::string();
+	if (query.empty())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " STATS :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	char letter = query[0];
+	switch (letter)
+	{
+		case 'm':
+			statsCommands(server, client);
+			break;
+		case 'u':
+			statsUptime(server, client);
+			break;
+		case 'p':
+			statsPerformance(server, client);
+			break;
+		case 'z':
+			statsMemory(server, client, msg);
+			break;
+		default:
+			break;
+	}
+
+	std::ostringstream oss;
+	oss << ":" << server.getServerName() << " 219 " << nick << " " << letter << " :End of STATS report\r\n";
+	server.sendReply(client, oss.str());
+}
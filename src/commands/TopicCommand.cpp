@@ -20,7 +20,7 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 451 " << nick << " :You have not registered\r\n";
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -30,7 +30,7 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 461 " << nick << " TOPIC :Not enough parameters\r\n";
+		oss << ":" << server.getServerName() << " 461 " << nick << " TOPIC :Not enough parameters\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -43,7 +43,7 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 403 " << nick << " " << channelName << " :No such channel\r\n";
+		oss << ":" << server.getServerName() << " 403 " << nick << " " << channelName << " :No such channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -53,7 +53,7 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
+		oss << ":" << server.getServerName() << " 442 " << nick << " " << channelName << " :You're not on that channel\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -65,14 +65,14 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 332 " << nick << " " << channelName << " :" << channel->getTopic() << "\r\n";
+			oss << ":" << server.getServerName() << " 332 " << nick << " " << channelName << " :" << channel->getTopic() << "\r\n";
 			server.sendReply(client, oss.str());
 		}
 		else
 		{
 			std::string nick = client.getNickname();
 			std::ostringstream oss;
-			oss << ":irc.server 331 " << nick << " " << channelName << " :No topic is set\r\n";
+			oss << ":" << server.getServerName() << " 331 " << nick << " " << channelName << " :No topic is set\r\n";
 			server.sendReply(client, oss.str());
 		}
 		return;
@@ -86,12 +86,12 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 		newTopic += " " + msg.getParam(i);
 	}
 
-	// Check if topic restricted and client not operator
-	if (channel->isTopicRestricted() && !channel->isOperator(client.getFd()))
+	// Check if topic restricted and client not operator (remote changes were checked by their server)
+	if (channel->isTopicRestricted() && !client.isRemote() && !channel->isOperator(client.getFd()))
 	{
 		std::string nick = client.getNickname();
 		std::ostringstream oss;
-		oss << ":irc.server 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
+		oss << ":" << server.getServerName() << " 482 " << nick << " " << channelName << " :You're not channel operator\r\n";
 		server.sendReply(client, oss.str());
 		return;
 	}
@@ -106,5 +106,6 @@ void TopicCommand::execute(Server& server, Client& client, const Message& msg)
 	std::ostringstream topicMsg;
 	topicMsg << ":" << nick << "!" << user << "@" << host << " TOPIC " << channelName << " :" << newTopic << "\r\n";
 	channel->broadcast(topicMsg.str());
+	server.propagate(client, topicMsg.str());
 }
 
@@ -0,0 +1,44 @@
+#include "UpgradeCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Logger.hpp"
+#include <sstream>
+
+UpgradeCommand::UpgradeCommand()
+{
+}
+
+UpgradeCommand::~UpgradeCommand()
+{
+}
+
+// UPGRADE: re-exec the server binary, keeping every connection open
+void UpgradeCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	(void)msg;
+
+	// Check if registered
+	if (!client.isRegistered())
+	{
+		std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 451 " << nick << " :You have not registered\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string nick = client.getNickname();
+
+	if (!client.isServerOperator() || client.isRemote())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 481 " << nick << " :Permission Denied- You're not an IRC operator\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	LOG(LOG_INFO, LOG_CMD, nick << " requested an upgrade");
+	server.requestUpgrade(nick);
+	server.sendReply(client, ":" + server.getServerName() + " NOTICE " + nick + " :Upgrading\r\n");
+}
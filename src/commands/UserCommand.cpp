@@ -0,0 +1,46 @@
+#include "UserCommand.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include <sstream>
+
+UserCommand::UserCommand()
+{
+}
+
+UserCommand::~UserCommand()
+{
+}
+
+void UserCommand::execute(Server& server, Client& client, const Message& msg)
+{
+	std::string nick = client.getNickname().empty() ? "*" : client.getNickname();
+
+	// Check if client is already registered
+	if (client.isRegistered())
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 462 " << nick << " :You may not reregister\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	// USER <username> <mode> <unused> :<realname>
+	if (!validateParamCount(msg, 4))
+	{
+		std::ostringstream oss;
+		oss << ":" << server.getServerName() << " 461 " << nick << " USER :Not enough parameters\r\n";
+		server.sendReply(client, oss.str());
+		return;
+	}
+
+	std::string realname = msg.getParam(3);
+	for (size_t i = 4; i < msg.getParamCount(); ++i)
+	{
+		realname += " " + msg.getParam(i);
+	}
+
+	client.setUsername(msg.getParam(0));
+	client.setRealname(realname);
+	server.completeRegistration(client);
+}
@@ -3,6 +3,7 @@
 #include <cctype>
 #include <string>
 #include "Server.hpp"
+#include "Logger.hpp"
 
 bool isValidPort(const std::string& portStr) {
 	if (portStr.empty())
@@ -18,11 +19,11 @@ bool isValidPort(const std::string& portStr) {
 }
 
 void printUsage(const char* programName) {
-	std::cout << "Usage: " << programName << " <port> <password>" << std::endl;
+	std::cout << "Usage: " << programName << " <port> <password> [config]" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
-	if (argc != 3) {
+	if (argc != 3 && argc != 4) {
 		printUsage(argv[0]);
 		return 1;
 	}
@@ -40,14 +41,25 @@ int main(int argc, char* argv[]) {
 	
 	try
 	{
-		Server server(port, password);
+		Config config;
+		if (argc == 4)
+			config.loadFile(argv[3]);
+
+		Logger::instance().start();
+		Server server(port, password, config);
+		server.setCommandLine(argc, argv);
+		server.adoptHandover();
 		server.start();
 	}
 	catch (const std::exception& e)
 	{
+		Logger::instance().stop();
 		std::cerr << "Error: " << e.what() << std::endl;
 		return 1;
 	}
+
+	// Drain buffered log records before exiting
+	Logger::instance().stop();
 	
 	return 0;
 }
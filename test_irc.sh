@@ -2,15 +2,19 @@
 
 PORT=6667
 PASS="test123"
+CONF="/tmp/test_irc.conf"
 
 # Colors
 GREEN='\033[0;32m'
 RED='\033[0;31m'
 NC='\033[0m'
 
+# Operator for the FILTER tests
+echo "oper admin adminpass" > $CONF
+
 # Start server
 echo "Starting server..."
-./ircserv $PORT $PASS > server.log 2>&1 &
+./ircserv $PORT $PASS $CONF > server.log 2>&1 &
 SERVER_PID=$!
 sleep 1
 
@@ -58,9 +62,104 @@ fi
 echo -e "\n[TEST 5] KICK command"
 echo -e "${GREEN}✓ KICK test requires manual verification${NC}"
 
+# Test 6: Ban, exception and invite exception lists
+echo -e "\n[TEST 6] Channel +b/+e/+I"
+# The op keeps the channels alive while the others try to join
+(echo -e "PASS $PASS\r\nNICK banop\r\nUSER banop 0 * :Op\r\nJOIN #bans,#wild,#inv\r\nMODE #bans +b bob!*@*\r\nMODE #wild +be *!*@* *!erin@*\r\nMODE #inv +iI *!frank@*\r\n"; sleep 10; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_op.log 2>&1 &
+OP_PID=$!
+sleep 1
+(echo -e "PASS $PASS\r\nNICK bob\r\nUSER bob 0 * :Bob\r\nJOIN #bans\r\n"; sleep 1; echo -e "NICK bobby\r\nJOIN #bans\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_bob.log 2>&1
+(echo -e "PASS $PASS\r\nNICK carol\r\nUSER carol 0 * :Carol\r\nJOIN #wild\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_carol.log 2>&1
+(echo -e "PASS $PASS\r\nNICK erin\r\nUSER erin 0 * :Erin\r\nJOIN #wild\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_erin.log 2>&1
+(echo -e "PASS $PASS\r\nNICK frank\r\nUSER frank 0 * :Frank\r\nJOIN #inv\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_frank.log 2>&1
+(echo -e "PASS $PASS\r\nNICK greg\r\nUSER greg 0 * :Greg\r\nJOIN #inv\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test6_greg.log 2>&1
+wait $OP_PID
+if grep -q " 474 bob #bans" /tmp/test6_bob.log && grep -q ":bobby!.* JOIN :#bans" /tmp/test6_bob.log; then
+    echo -e "${GREEN}✓ +b refuses JOIN, and a NICK change clears the cached ban${NC}"
+else
+    echo -e "${RED}✗ +b / NICK change failed${NC}"
+    cat /tmp/test6_bob.log
+fi
+if grep -q " 474 carol #wild" /tmp/test6_carol.log && grep -q ":erin!.* JOIN :#wild" /tmp/test6_erin.log; then
+    echo -e "${GREEN}✓ *!*@* ban (unindexed mask) and +e exception passed${NC}"
+else
+    echo -e "${RED}✗ *!*@* ban / +e exception failed${NC}"
+    cat /tmp/test6_carol.log /tmp/test6_erin.log
+fi
+if grep -q ":frank!.* JOIN :#inv" /tmp/test6_frank.log && grep -q " 473 greg #inv" /tmp/test6_greg.log; then
+    echo -e "${GREEN}✓ +I bypasses +i passed${NC}"
+else
+    echo -e "${RED}✗ +I / +i failed${NC}"
+    cat /tmp/test6_frank.log /tmp/test6_greg.log
+fi
+
+# Test 7: Spam filter
+echo -e "\n[TEST 7] FILTER"
+# Overlapping phrases (spam/spammer), a case-sensitive phrase sharing its
+# node with a nocase one (BADword/badword), and kill > drop > notice
+(echo -e "PASS $PASS\r\nNICK fop\r\nUSER fop 0 * :Fop\r\nOPER admin adminpass\r\nFILTER ADD notice nocase :spam\r\nFILTER ADD drop nocase :spammer\r\nFILTER ADD kill case :BADword\r\nFILTER ADD notice nocase :badword\r\nJOIN #flt\r\n"; sleep 3; echo -e "PRIVMSG #flt :spam from an oper\r\n"; sleep 4; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test7_op.log 2>&1 &
+OP_PID=$!
+sleep 1
+(echo -e "PASS $PASS\r\nNICK watcher\r\nUSER watcher 0 * :Watcher\r\nJOIN #flt\r\n"; sleep 6; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test7_watch.log 2>&1 &
+WATCH_PID=$!
+sleep 1
+(echo -e "PASS $PASS\r\nNICK sender\r\nUSER sender 0 * :Sender\r\nJOIN #flt\r\n"; sleep 1; echo -e "PRIVMSG #flt :I am a spammer\r\nPRIVMSG #flt :just spam\r\nPRIVMSG #flt :a badword in lower case\r\nPRIVMSG #flt :clean line\r\n"; sleep 1; echo -e "PRIVMSG #flt :spammer says BADword\r\n"; sleep 1) | nc localhost $PORT > /tmp/test7_spam.log 2>&1
+wait $OP_PID $WATCH_PID
+if [ "$(grep -c "blocked by the spam filter" /tmp/test7_spam.log)" = "2" ] && grep -q "ERROR" /tmp/test7_spam.log; then
+    echo -e "${GREEN}✓ Worst action wins (drop over notice, kill over drop)${NC}"
+else
+    echo -e "${RED}✗ Filter actions failed${NC}"
+    cat /tmp/test7_spam.log
+fi
+if grep -q ":clean line" /tmp/test7_watch.log && ! grep -q "spammer\|just spam\|badword\|BADword" /tmp/test7_watch.log; then
+    echo -e "${GREEN}✓ Filtered messages are not delivered${NC}"
+else
+    echo -e "${RED}✗ Filtered messages leaked${NC}"
+    cat /tmp/test7_watch.log
+fi
+if grep -q ":spam from an oper" /tmp/test7_watch.log; then
+    echo -e "${GREEN}✓ Operators are not filtered${NC}"
+else
+    echo -e "${RED}✗ Operator message was filtered${NC}"
+    cat /tmp/test7_watch.log
+fi
+
+# Test 8: CHATHISTORY ranges
+echo -e "\n[TEST 8] CHATHISTORY"
+HIST="PASS $PASS\r\nCAP REQ :batch message-tags\r\nCAP END\r\nUSER hist 0 * :Hist\r\n"
+(echo -e "PASS $PASS\r\nNICK keeper\r\nUSER keeper 0 * :Keeper\r\nJOIN #hist\r\n"; sleep 1; echo -e "PRIVMSG #hist :hist1\r\nPRIVMSG #hist :hist2\r\nPRIVMSG #hist :hist3\r\nPRIVMSG #hist :hist4\r\nPRIVMSG #hist :hist5\r\n"; sleep 8; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test8_keep.log 2>&1 &
+OP_PID=$!
+sleep 2
+# "*" reference, and a limit larger than the ring holds
+(echo -e "${HIST}NICK hist1\r\nJOIN #hist\r\nCHATHISTORY LATEST #hist * 1000\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test8_latest.log 2>&1
+ID2=$(sed -n 's/.*msgid=\([^ ;]*\).*PRIVMSG #hist :hist2.*/\1/p' /tmp/test8_latest.log)
+ID4=$(sed -n 's/.*msgid=\([^ ;]*\).*PRIVMSG #hist :hist4.*/\1/p' /tmp/test8_latest.log)
+# Unknown msgid, then BETWEEN with the newer reference first
+(echo -e "${HIST}NICK hist2\r\nJOIN #hist\r\nCHATHISTORY BEFORE #hist msgid=nosuchid 10\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test8_unknown.log 2>&1
+(echo -e "${HIST}NICK hist3\r\nJOIN #hist\r\nCHATHISTORY BETWEEN #hist msgid=$ID4 msgid=$ID2 10\r\n"; sleep 1; echo -e "QUIT\r\n") | nc localhost $PORT > /tmp/test8_between.log 2>&1
+wait $OP_PID
+if [ "$(grep -c "PRIVMSG #hist :hist" /tmp/test8_latest.log)" = "5" ] && grep -q "BATCH -" /tmp/test8_latest.log; then
+    echo -e "${GREEN}✓ LATEST * with a limit above the ring size passed${NC}"
+else
+    echo -e "${RED}✗ LATEST * failed${NC}"
+    cat /tmp/test8_latest.log
+fi
+if grep -q "BATCH -" /tmp/test8_unknown.log && ! grep -q "PRIVMSG #hist :hist" /tmp/test8_unknown.log; then
+    echo -e "${GREEN}✓ Unknown msgid returns an empty batch${NC}"
+else
+    echo -e "${RED}✗ Unknown msgid failed${NC}"
+    cat /tmp/test8_unknown.log
+fi
+if [ -n "$ID2" ] && [ -n "$ID4" ] && [ "$(grep -c "PRIVMSG #hist :hist" /tmp/test8_between.log)" = "1" ] && grep -q ":hist3" /tmp/test8_between.log; then
+    echo -e "${GREEN}✓ BETWEEN with reversed references passed${NC}"
+else
+    echo -e "${RED}✗ BETWEEN with reversed references failed${NC}"
+    cat /tmp/test8_between.log
+fi
+
 # Cleanup
 kill $SERVER_PID 2>/dev/null
 wait $SERVER_PID 2>/dev/null
-rm -f /tmp/test*.log server.log
+rm -f /tmp/test*.log server.log $CONF
 echo -e "\n${GREEN}Testing complete!${NC}"
 